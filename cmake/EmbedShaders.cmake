@@ -0,0 +1,37 @@
+# Turns the compiled SPIR-V binaries into a header of constexpr uint32_t arrays
+# so the renderer does not have to read shaders from disk at startup.
+#
+# Usage: cmake -DSPIRV_FILES="a.spv|b.spv" -DOUTPUT=vk_embedded_shaders.h -P EmbedShaders.cmake
+
+string(REPLACE "|" ";" SPIRV_FILES "${SPIRV_FILES}")
+
+set(ARRAYS "")
+set(TABLE "")
+
+foreach(SPIRV ${SPIRV_FILES})
+	get_filename_component(FILE_NAME ${SPIRV} NAME)
+	string(MAKE_C_IDENTIFIER ${FILE_NAME} SYMBOL)
+
+	# SPIR-V is a stream of little endian words, swap every 4 bytes of the hex dump into one word
+	file(READ ${SPIRV} HEX_CONTENTS HEX)
+	string(REGEX REPLACE "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])" "0x\\4\\3\\2\\1," WORDS "${HEX_CONTENTS}")
+	# CMake regexes have no {n} repetition, so spell out eight words per line
+	set(WORD "0x[0-9a-f]+,")
+	string(REGEX REPLACE "(${WORD}${WORD}${WORD}${WORD}${WORD}${WORD}${WORD}${WORD})" "\\1\n\t\t" WORDS "${WORDS}")
+	string(STRIP "${WORDS}" WORDS)
+
+	string(APPEND ARRAYS "\tinline constexpr uint32_t ${SYMBOL}[] =\n\t{\n\t\t${WORDS}\n\t};\n\n")
+	string(APPEND TABLE "\t\t{ \"${FILE_NAME}\", ${SYMBOL} },\n")
+endforeach()
+
+set(HEADER "// Generated by cmake/EmbedShaders.cmake from the Shaders target. Do not edit.\n")
+string(APPEND HEADER "#pragma once\n\n#include <cstdint>\n#include <span>\n#include <string_view>\n\n")
+string(APPEND HEADER "namespace EmbeddedShaders\n{\n")
+string(APPEND HEADER "\tstruct ShaderBinary\n\t{\n\t\tstd::string_view name;\n\t\tstd::span<const uint32_t> code;\n\t};\n\n")
+string(APPEND HEADER "${ARRAYS}")
+string(APPEND HEADER "\tinline constexpr ShaderBinary binaries[] =\n\t{\n${TABLE}\t};\n}\n")
+
+# Only touch the header when the contents changed so dependent sources are not rebuilt needlessly
+file(WRITE "${OUTPUT}.tmp" "${HEADER}")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different "${OUTPUT}.tmp" "${OUTPUT}")
+file(REMOVE "${OUTPUT}.tmp")
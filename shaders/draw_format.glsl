@@ -0,0 +1,15 @@
+// Format qualifier of the draw image, which is picked at runtime. Shaders storing to it permute over
+// DRAW_FORMAT_R11F_G11F_B10F|DRAW_FORMAT_RGBA8|DRAW_FORMAT_UNTYPED, the plain variant is rgba16f.
+// UNTYPED leaves the qualifier out, for formats GLSL has none for such as rgb9e5.
+// Declare the image as layout(DRAW_IMAGE_FORMAT set = 0, binding = 0), the macro carries the comma.
+
+#if defined(DRAW_FORMAT_R11F_G11F_B10F)
+#define DRAW_IMAGE_FORMAT r11f_g11f_b10f,
+#elif defined(DRAW_FORMAT_RGBA8)
+#define DRAW_IMAGE_FORMAT rgba8,
+#elif defined(DRAW_FORMAT_UNTYPED)
+#extension GL_EXT_shader_image_load_formatted : require
+#define DRAW_IMAGE_FORMAT
+#else
+#define DRAW_IMAGE_FORMAT rgba16f,
+#endif
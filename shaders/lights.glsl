@@ -0,0 +1,89 @@
+// Lights and clusters of the clustered forward lighting, read through buffer device addresses.
+// Layouts match vk_lights.h. The binning shader defines LIGHT_BINNING to get the cluster buffers
+// writable, everything else only reads them.
+
+#extension GL_EXT_buffer_reference : require
+
+#ifdef LIGHT_BINNING
+#define CLUSTER_ACCESS
+#else
+#define CLUSTER_ACCESS readonly
+#endif
+
+struct Light
+{
+    vec3 position;
+    float range;
+    vec3 color;
+    float spotInnerCos;
+    vec3 direction;
+    // -2 for point lights
+    float spotOuterCos;
+};
+
+layout(buffer_reference, std430) readonly buffer LightBuffer
+{
+    Light lights[];
+};
+
+// first index and count into the light indices, per cluster
+layout(buffer_reference, std430) CLUSTER_ACCESS buffer ClusterBuffer
+{
+    uvec2 clusters[];
+};
+
+// The header is copied back to the host, match GpuLightListHeader
+layout(buffer_reference, std430) CLUSTER_ACCESS buffer LightIndexBuffer
+{
+    // entries the clusters asked for, past maxLightIndices when the list ran out
+    uint count;
+    // lights left out of tiles and clusters that had more than the binning keeps
+    uint droppedTileLights;
+    uint droppedClusterLights;
+    // most lights a single cluster touched
+    uint maxClusterLights;
+    uint indices[];
+};
+
+layout(buffer_reference, std430) readonly buffer ClusterFrame
+{
+    mat4 view;
+    // tan of the half fov in x and y, near, far
+    vec4 projection;
+    // log(depth) * x + y is the slice, zw is the extent in pixels
+    vec4 slicing;
+    // clusters in x, y and z, tile size in pixels
+    uvec4 grid;
+    LightBuffer lightBuffer;
+    ClusterBuffer clusterBuffer;
+    LightIndexBuffer lightIndexBuffer;
+    uint lightCount;
+    uint maxLightIndices;
+};
+
+uint clusterIndex(ClusterFrame frame, uvec3 cluster)
+{
+    return cluster.x + (cluster.y + cluster.z * frame.grid.y) * frame.grid.x;
+}
+
+// Light reaching a surface point, with a smooth falloff to zero at the range
+vec3 evaluateLight(Light light, vec3 position, vec3 normal)
+{
+    vec3 toLight = light.position - position;
+    float distanceSquared = dot(toLight, toLight);
+    float rangeSquared = light.range * light.range;
+    if (distanceSquared >= rangeSquared)
+    {
+        return vec3(0.0);
+    }
+
+    vec3 direction = toLight * inversesqrt(max(distanceSquared, 1e-8));
+    float ratio = distanceSquared / rangeSquared;
+    float window = 1.0 - ratio * ratio;
+    float attenuation = window * window / max(distanceSquared, 0.01);
+    if (light.spotOuterCos > -1.0)
+    {
+        attenuation *= smoothstep(light.spotOuterCos, light.spotInnerCos, dot(-direction, light.direction));
+    }
+    return light.color * (max(dot(normal, direction), 0.0) * attenuation);
+}
@@ -0,0 +1,103 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+// Material color, lit by the shadowed sun and the lights of the fragment's cluster unless built as
+// the unlit pipeline
+
+#include "mesh.glsl"
+
+layout(constant_id = 0) const bool UNLIT = false;
+
+layout(location = 0) in vec3 inNormal;
+layout(location = 1) in vec2 inUV;
+layout(location = 2) in vec3 inPosition;
+
+layout(location = 0) out vec4 outColor;
+
+layout(set = 0, binding = 0) uniform sampler2DArrayShadow shadowMap;
+
+// when there is no shadow frame
+const vec3 LIGHT_DIRECTION = vec3(0.4, 0.8, 0.45);
+const float AMBIENT = 0.15;
+
+// View depth back from the perspectiveRH_ZO depth
+float viewDepth(float nearPlane, float farPlane)
+{
+    return nearPlane * farPlane / (farPlane - gl_FragCoord.z * (farPlane - nearPlane));
+}
+
+vec3 clusteredLights(vec3 normal)
+{
+    if (uvec2(PushConstants.clusterFrame) == uvec2(0))
+    {
+        return vec3(0.0);
+    }
+    ClusterFrame frame = PushConstants.clusterFrame;
+    if (frame.lightCount == 0)
+    {
+        return vec3(0.0);
+    }
+
+    float depth = viewDepth(frame.projection.z, frame.projection.w);
+    uint slice = uint(clamp(log(depth) * frame.slicing.x + frame.slicing.y, 0.0, float(frame.grid.z - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy) / frame.grid.w, frame.grid.xy - 1);
+
+    uvec2 cluster = frame.clusterBuffer.clusters[clusterIndex(frame, uvec3(tile, slice))];
+    vec3 result = vec3(0.0);
+    for (uint i = 0; i < cluster.y; i++)
+    {
+        uint light = frame.lightIndexBuffer.indices[cluster.x + i];
+        result += evaluateLight(frame.lightBuffer.lights[light], inPosition, normal);
+    }
+    return result;
+}
+
+// Share of the sun reaching the fragment, 3x3 hardware filtered taps of the cascade it is in
+float sunShadow(ShadowFrame frame, vec3 normal)
+{
+    float depth = dot(frame.viewDepth, vec4(inPosition, 1.0));
+    uint cascade = 0;
+    while (cascade < 3 && depth > frame.splits[cascade])
+    {
+        cascade++;
+    }
+    if (depth > frame.splits[cascade])
+    {
+        return 1.0;
+    }
+
+    // pushed out along the normal by about a texel, so surfaces don't shadow themselves
+    vec3 position = inPosition + normal * frame.texelSizes[cascade] * 1.5;
+    vec4 coord = frame.cascades[cascade] * vec4(position, 1.0);
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+        {
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), coord.z));
+        }
+    }
+    return lit / 9.0;
+}
+
+void main()
+{
+    vec4 color = PushConstants.materialBuffer.materials[PushConstants.material].color;
+    if (!UNLIT)
+    {
+        vec3 normal = normalize(inNormal);
+        vec3 sunDirection = normalize(LIGHT_DIRECTION);
+        float shadow = 1.0;
+        if (uvec2(PushConstants.shadowFrame) != uvec2(0))
+        {
+            ShadowFrame frame = PushConstants.shadowFrame;
+            sunDirection = frame.sunDirection.xyz;
+            shadow = sunShadow(frame, normal);
+        }
+        float diffuse = max(dot(normal, sunDirection), 0.0) * shadow;
+        color.rgb *= AMBIENT + diffuse + clusteredLights(normal);
+    }
+    outColor = color;
+}
@@ -0,0 +1,76 @@
+// Buffers of the mesh pass, all read through buffer device addresses. Layouts match
+// vk_meshes.h, vk_instances.h, vk_meshpass.h and vk_shadows.h
+
+#extension GL_EXT_buffer_reference : require
+
+#include "lights.glsl"
+
+struct Vertex
+{
+    vec3 position;
+    float uvX;
+    vec3 normal;
+    float uvY;
+};
+
+struct Instance
+{
+    mat4 world;
+    uint renderHandle;
+    uint padding[3];
+};
+
+struct Material
+{
+    vec4 color;
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer
+{
+    Vertex vertices[];
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBuffer
+{
+    Instance instances[];
+};
+
+// instance buffer entry of every instance of the frame's draws, in batch order
+layout(buffer_reference, std430) readonly buffer InstanceIndexBuffer
+{
+    uint indices[];
+};
+
+layout(buffer_reference, std430) readonly buffer MaterialBuffer
+{
+    Material materials[];
+};
+
+// cascaded shadow maps of the sun
+layout(buffer_reference, std430) readonly buffer ShadowFrame
+{
+    // world to shadow map uv and depth
+    mat4 cascades[4];
+    // view depth every cascade ends at
+    vec4 splits;
+    // world size of a texel
+    vec4 texelSizes;
+    // towards the sun
+    vec4 sunDirection;
+    // dot with the world position is the view depth
+    vec4 viewDepth;
+};
+
+layout( push_constant ) uniform constants
+{
+    mat4 viewProjection;
+    VertexBuffer vertexBuffer;
+    InstanceBuffer instanceBuffer;
+    InstanceIndexBuffer instanceIndexBuffer;
+    MaterialBuffer materialBuffer;
+    // null when there are no lights this frame
+    ClusterFrame clusterFrame;
+    // null when the ring ran out this frame
+    ShadowFrame shadowFrame;
+    uint material;
+} PushConstants;
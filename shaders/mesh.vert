@@ -0,0 +1,26 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+// Instanced draws of the mesh pass. Vertices are pulled from the mesh library's buffer, and
+// gl_InstanceIndex (which includes the draw's firstInstance) picks the object from the frame's
+// instance indices.
+
+#include "mesh.glsl"
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out vec2 outUV;
+layout(location = 2) out vec3 outPosition;
+
+void main()
+{
+    Vertex vertex = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+    uint instanceIndex = PushConstants.instanceIndexBuffer.indices[gl_InstanceIndex];
+    mat4 world = PushConstants.instanceBuffer.instances[instanceIndex].world;
+
+    vec4 position = world * vec4(vertex.position, 1.0);
+    gl_Position = PushConstants.viewProjection * position;
+    outPosition = position.xyz;
+    // scales are uniform in this scene, no inverse transpose needed
+    outNormal = mat3(world) * vertex.normal;
+    outUV = vec2(vertex.uvX, vertex.uvY);
+}
@@ -0,0 +1,22 @@
+// Feature switches shared by the shader permutations. Shaders list the defines they care about
+// in "// permute:" lines and CMake builds one SPIR-V variant per combination of them.
+
+#ifdef FP16
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+// color math in half precision, the draw image only stores 16 bit floats anyway
+#define hfloat float16_t
+#define hfloat2 f16vec2
+#define hfloat3 f16vec3
+#define hfloat4 f16vec4
+#else
+#define hfloat float
+#define hfloat2 vec2
+#define hfloat3 vec3
+#define hfloat4 vec4
+#endif
+
+#ifdef SUBGROUP
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_ballot : require
+#extension GL_KHR_shader_subgroup_shuffle_relative : require
+#endif
@@ -0,0 +1,41 @@
+// Per-pixel post processing stages shared by the fused post pass and the bloom prefilter.
+// Bits match PostStageBits on the C++ side.
+
+const uint STAGE_EXPOSURE = 1;
+const uint STAGE_BLOOM = 2;
+const uint STAGE_TONEMAP = 4;
+const uint STAGE_GRADING = 8;
+const uint STAGE_SHARPEN = 16;
+
+float luminance(vec3 color)
+{
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 tonemapACES(vec3 x)
+{
+    const float a = 2.51;
+    const float b = 0.03;
+    const float c = 2.43;
+    const float d = 0.59;
+    const float e = 0.14;
+    return clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.0, 1.0);
+}
+
+// contrastSaturation: x contrast, y saturation, z temperature, w tint
+// lift.rgb added to the shadows, gainGamma.rgb scales the highlights and gainGamma.w is the gamma
+vec3 colorGrade(vec3 color, vec4 contrastSaturation, vec3 lift, vec4 gainGamma)
+{
+    // white balance, warm pushes red and cuts blue, tint trades green against magenta
+    vec3 balance = vec3(1.0 + contrastSaturation.z, 1.0 - contrastSaturation.w, 1.0 - contrastSaturation.z);
+    color *= max(balance, vec3(0.0));
+
+    color = (color - 0.5) * contrastSaturation.x + 0.5;
+    color = mix(vec3(luminance(color)), color, contrastSaturation.y);
+
+    color = color * gainGamma.rgb + lift * (1.0 - color);
+    color = pow(max(color, vec3(0.0)), vec3(1.0 / max(gainGamma.w, 0.01)));
+
+    return color;
+}
@@ -0,0 +1,56 @@
+// Streamed textures of the TextureStreamer, bound as a whole set. Define STREAMING_SET before
+// including to move it off set 1. Sampling through sampleStreamed records the mip level a texel
+// footprint wanted, the streamer reads it back and brings that level in when the budget allows.
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+#ifndef STREAMING_SET
+#define STREAMING_SET 1
+#endif
+
+// match vk_streaming.h
+#define MAX_STREAMED_TEXTURES 256
+
+struct StreamedTextureInfo
+{
+    uvec2 size;
+    // level 0 of the resident image is this level of the full chain
+    uint residentMip;
+    // 0 while nothing is resident, the slot must not be sampled then
+    uint mipLevels;
+};
+
+layout(set = STREAMING_SET, binding = 0) uniform sampler2D streamedTextures[MAX_STREAMED_TEXTURES];
+
+layout(std430, set = STREAMING_SET, binding = 1) readonly buffer StreamedTextureInfos
+{
+    uint streamedTextureCount;
+    uint streamedPadding[3];
+    StreamedTextureInfo streamedInfos[];
+};
+
+// finest level asked for per slot, cleared to ~0 by the streamer
+layout(std430, set = STREAMING_SET, binding = 2) buffer StreamingFeedback
+{
+    uint requestedMips[];
+};
+
+bool isStreamedResident(uint slot)
+{
+    return slot < streamedTextureCount && streamedInfos[slot].mipLevels != 0;
+}
+
+// lod is relative to level 0 of the full chain, e.g. log2 of the texels per pixel
+vec4 sampleStreamed(uint slot, vec2 uv, float lod)
+{
+    StreamedTextureInfo info = streamedInfos[slot];
+
+    // most invocations find their level already recorded, which spares the atomic
+    uint wanted = uint(clamp(lod, 0.0, float(info.mipLevels - 1)));
+    if (requestedMips[slot] > wanted)
+    {
+        atomicMin(requestedMips[slot], wanted);
+    }
+
+    return textureLod(streamedTextures[nonuniformEXT(slot)], uv, max(lod - float(info.residentMip), 0.0));
+}
@@ -1,7 +1,23 @@
 #include "vk_engine.h"
+#include "vk_cooker.h"
+#include "vk_scene.h"
+#include "vk_bvh.h"
+#include "vk_benchmark.h"
 
 int main(int argc, char* argv[])
 {
+#ifdef VULKAN_RENDERER_BENCH
+	// the benchmark target is built from the same sources, only the entry point differs
+	return GpuBenchmark::run(argc, argv);
+#else
+	// asset cooking, its self test and the cpu benchmarks run without a window or device
+	int exitCode = 0;
+	if (TextureCooker::runCommandLine(argc, argv, exitCode) || SceneBenchmark::runCommandLine(argc, argv, exitCode) ||
+		BvhBenchmark::runCommandLine(argc, argv, exitCode))
+	{
+		return exitCode;
+	}
+
 	VulkanEngine engine;
 
 	engine.Init();
@@ -9,4 +25,5 @@ int main(int argc, char* argv[])
 	engine.Cleanup();
 
 	return 0;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include <algorithm>
+
+#include <GLFW/glfw3.h>
+
+#include "vk_activity.h"
+
+// seconds the stats are averaged over
+static const double STATS_WINDOW = 1.0;
+
+bool FrameActivity::needsSceneRender(uint64_t sceneHash, bool temporal)
+{
+	if (sceneHash != m_SceneHash || m_FramesSinceSceneChange == 0)
+	{
+		m_SceneHash = sceneHash;
+		m_FramesSinceSceneChange = 0;
+		markActive();
+	}
+
+	bool render = !cacheScene || m_FramesSinceSceneChange == 0 || (temporal && m_FramesSinceSceneChange < settleFrames);
+	m_FramesSinceSceneChange++;
+	return render;
+}
+
+void FrameActivity::endFrame(bool renderedScene, double gpuMilliseconds, uint32_t gpuSampleFrame)
+{
+	double now = glfwGetTime();
+	if (m_WindowStart < 0.0)
+	{
+		m_WindowStart = now;
+		m_WaitSeconds = 0.0;
+	}
+
+	m_Frames++;
+	m_SceneFrames += renderedScene ? 1 : 0;
+	m_FramesSinceActivity++;
+
+	// the profiler reports frames a few behind, each one is counted once
+	if (gpuMilliseconds >= 0.0 && gpuSampleFrame != m_LastGpuSampleFrame)
+	{
+		m_LastGpuSampleFrame = gpuSampleFrame;
+		m_GpuMilliseconds += gpuMilliseconds;
+		m_GpuSamples++;
+	}
+
+	double elapsed = now - m_WindowStart;
+	if (elapsed < STATS_WINDOW)
+	{
+		return;
+	}
+
+	double busySeconds = std::max(elapsed - m_WaitSeconds, 0.0);
+	double gpuMillisecondsPerFrame = m_GpuSamples > 0 ? m_GpuMilliseconds / m_GpuSamples : 0.0;
+
+	m_Stats.framesPerSecond = float(m_Frames / elapsed);
+	m_Stats.sceneFramesPerSecond = float(m_SceneFrames / elapsed);
+	m_Stats.cpuMilliseconds = float(busySeconds * 1000.0 / m_Frames);
+	m_Stats.cpuBusy = float(busySeconds / elapsed);
+	// the samples stand in for every frame presented in the window
+	m_Stats.gpuBusy = float(std::min(gpuMillisecondsPerFrame * m_Frames / (elapsed * 1000.0), 1.0));
+	m_Stats.gpuMilliseconds = float(gpuMillisecondsPerFrame);
+
+	m_WindowStart = now;
+	m_WaitSeconds = 0.0;
+	m_GpuMilliseconds = 0.0;
+	m_GpuSamples = 0;
+	m_Frames = 0;
+	m_SceneFrames = 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "vk_types.h"
+
+// Keeps the main loop from redoing work nobody asked for. The engine hashes everything the scene
+// depends on every frame and re-presents the cached result while it stays the same. Once neither
+// the scene nor the UI changed for a while the loop sleeps in glfwWaitEventsTimeout instead of
+// spinning at the display rate. Also measures how busy the cpu and gpu are, to compare both modes.
+class FrameActivity
+{
+public:
+
+	struct Stats
+	{
+		float framesPerSecond;
+		// frames that had to render the scene rather than re-present it
+		float sceneFramesPerSecond;
+		// main thread time per frame, leaving out event, fence and present waits
+		float cpuMilliseconds;
+		// fractions of the wall time spent busy
+		float cpuBusy;
+		float gpuBusy;
+		float gpuMilliseconds;
+	};
+
+	// re-present the last scene result while nothing it depends on changed
+	bool cacheScene{ true };
+	// sleep between frames when idle
+	bool throttle{ true };
+	// full rate frames after the last change, lets UI animations and the upscaler history settle
+	uint32_t settleFrames{ 32 };
+	// the loop still wakes up this often when idle or minimized, to keep the stats going
+	double idleTimeout{ 0.5 };
+
+	// Once per frame with the hash of the scene state, returns whether the scene has to be rendered.
+	// Temporal effects keep rendering until settled, their output changes with the jitter.
+	bool needsSceneRender(uint64_t sceneHash, bool temporal);
+	// input or anything else that keeps the UI moving
+	void markActive() { m_FramesSinceActivity = 0; }
+	bool isIdle() const { return throttle && m_FramesSinceActivity >= settleFrames; }
+
+	// wall time the main thread spent blocked, left out of the busy time
+	void addWaitTime(double seconds) { m_WaitSeconds += seconds; }
+	// Once per presented frame. gpuMilliseconds of the frame the profiler results belong to, negative if none
+	void endFrame(bool renderedScene, double gpuMilliseconds, uint32_t gpuSampleFrame);
+
+	const Stats& stats() const { return m_Stats; }
+
+private:
+
+	uint64_t m_SceneHash{ 0 };
+	uint32_t m_FramesSinceSceneChange{ 0 };
+	uint32_t m_FramesSinceActivity{ 0 };
+
+	// accumulated over the current stats window
+	double m_WindowStart{ -1.0 };
+	double m_WaitSeconds{ 0.0 };
+	double m_GpuMilliseconds{ 0.0 };
+	uint32_t m_GpuSamples{ 0 };
+	uint32_t m_Frames{ 0 };
+	uint32_t m_SceneFrames{ 0 };
+	uint32_t m_LastGpuSampleFrame{ UINT32_MAX };
+
+	Stats m_Stats{};
+};
@@ -0,0 +1,124 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "vk_autotune.h"
+
+std::string WorkgroupTuner::cachePath()
+{
+	// LOCALAPPDATA on windows, XDG_CACHE_HOME or ~/.cache elsewhere, the temp directory as a last resort
+	std::filesystem::path directory;
+#ifdef _WIN32
+	if (const char* localAppData = std::getenv("LOCALAPPDATA"))
+	{
+		directory = localAppData;
+	}
+#else
+	if (const char* cacheHome = std::getenv("XDG_CACHE_HOME"); cacheHome && cacheHome[0] != '\0')
+	{
+		directory = cacheHome;
+	}
+	else if (const char* home = std::getenv("HOME"))
+	{
+		directory = std::filesystem::path(home) / ".cache";
+	}
+#endif
+
+	std::error_code error;
+	if (directory.empty())
+	{
+		directory = std::filesystem::temp_directory_path(error);
+	}
+
+	directory /= "VulkanRenderer";
+	std::filesystem::create_directories(directory, error);
+	return (directory / "workgroup_sizes.cache").string();
+}
+
+void WorkgroupTuner::init(const VkPhysicalDeviceProperties& properties)
+{
+	// driver updates can change the best shape, so they invalidate previous results
+	deviceKey = fmt::format("{:04x}:{:04x}:{:x}", properties.vendorID, properties.deviceID, properties.driverVersion);
+}
+
+void WorkgroupTuner::load(const char* filePath)
+{
+	std::ifstream file(filePath);
+	if (!file.is_open())
+	{
+		return;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		std::string device, effect;
+		WorkgroupSize size;
+		if (stream >> device >> effect >> size.x >> size.y)
+		{
+			entries[device + " " + effect] = size;
+		}
+	}
+}
+
+void WorkgroupTuner::save(const char* filePath) const
+{
+	std::ofstream file(filePath, std::ios::trunc);
+	if (!file.is_open())
+	{
+		fmt::print(fmt::fg(fmt::color::yellow), "Could not write workgroup cache {}\n", filePath);
+		return;
+	}
+
+	for (const auto& [key, size] : entries)
+	{
+		file << key << " " << size.x << " " << size.y << "\n";
+	}
+}
+
+bool WorkgroupTuner::find(const char* variantName, WorkgroupSize& outSize) const
+{
+	auto it = entries.find(deviceKey + " " + variantName);
+	if (it == entries.end())
+	{
+		return false;
+	}
+
+	outSize = it->second;
+	return true;
+}
+
+void WorkgroupTuner::store(const char* variantName, WorkgroupSize size)
+{
+	entries[deviceKey + " " + variantName] = size;
+}
+
+std::vector<WorkgroupSize> WorkgroupTuner::candidates(const VkPhysicalDeviceLimits& limits, uint32_t subgroupSize)
+{
+	// square tiles favour texture caches, wide rows favour linear image layouts and software rasterizers
+	static const WorkgroupSize shapes[] =
+	{
+		{ 8, 8 }, { 16, 8 }, { 8, 16 }, { 16, 16 }, { 32, 8 }, { 8, 32 }, { 32, 16 }, { 32, 32 }, { 64, 1 }, { 64, 4 }, { 128, 1 }, { 256, 1 }
+	};
+
+	std::vector<WorkgroupSize> result;
+	for (WorkgroupSize shape : shapes)
+	{
+		if (shape.x <= limits.maxComputeWorkGroupSize[0] &&
+			shape.y <= limits.maxComputeWorkGroupSize[1] &&
+			shape.x * shape.y <= limits.maxComputeWorkGroupInvocations && fitsSubgroupSize(shape, subgroupSize))
+		{
+			result.push_back(shape);
+		}
+	}
+
+	// subgroups wider than every shape, a single row of one still works
+	if (result.empty() && subgroupSize != 0)
+	{
+		result.push_back({ subgroupSize, 1 });
+	}
+
+	return result;
+}
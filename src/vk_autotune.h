@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_pipelines.h"
+
+// Remembers the fastest workgroup size of every compute shader variant, per device.
+// Results are persisted in a small text file so tuning only runs the first time an effect
+// is seen on a given device/driver combination.
+struct WorkgroupTuner
+{
+	// vendor, device and driver version of the GPU the results belong to
+	std::string deviceKey;
+	// "deviceKey shaderVariant" -> workgroup size, entries of other devices are kept untouched
+	std::unordered_map<std::string, WorkgroupSize> entries;
+
+	// workgroup_sizes.cache in the per user cache directory, so results are found whatever the working directory
+	static std::string cachePath();
+
+	void init(const VkPhysicalDeviceProperties& properties);
+	void load(const char* filePath);
+	void save(const char* filePath) const;
+
+	bool find(const char* variantName, WorkgroupSize& outSize) const;
+	void store(const char* variantName, WorkgroupSize size);
+
+	// Shapes worth timing that fit within the device limits. A non-zero subgroupSize only keeps the
+	// widths made of full subgroups, never empty
+	static std::vector<WorkgroupSize> candidates(const VkPhysicalDeviceLimits& limits, uint32_t subgroupSize = 0);
+	// whether a size from the cache still suits a pipeline built with that required subgroup size
+	static bool fitsSubgroupSize(WorkgroupSize size, uint32_t subgroupSize) { return subgroupSize == 0 || size.x % subgroupSize == 0; }
+};
@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <cmath>
+
+#include "vk_batching.h"
+#include "vk_scene.h"
+
+bool DrawBatcher::fitsKey(const RenderItem& item)
+{
+	return item.pipeline < (1u << RenderKey::PIPELINE_BITS) && item.material < (1u << RenderKey::MATERIAL_BITS) &&
+		item.mesh < (1u << RenderKey::MESH_BITS);
+}
+
+void DrawBatcher::build(std::span<const uint32_t> visible, const Scene& scene, std::span<const RenderItem> items, std::span<const uint8_t> lods,
+	const glm::vec3& eye, JobSystem* jobs)
+{
+	m_Queue.clear();
+	m_Batches.clear();
+	m_Instances.clear();
+
+	uint32_t bucketCount = uint32_t(std::clamp(depthBuckets, 1, 1 << RenderKey::DEPTH_BITS));
+	float depthScale = bucketCount / std::log2(1.0f + maxDepth);
+
+	m_Queue.reserve(uint32_t(visible.size()));
+	for (uint32_t object : visible)
+	{
+		uint32_t handle = scene.renderHandle(object);
+		if (handle >= items.size())
+		{
+			continue;
+		}
+
+		Aabb bounds = scene.worldBounds(object);
+		float distance = glm::length((bounds.min + bounds.max) * 0.5f - eye);
+		uint32_t bucket = std::min(uint32_t(std::log2(1.0f + distance) * depthScale), bucketCount - 1);
+
+		const RenderItem& item = items[handle];
+		uint32_t lod = object < lods.size() ? lods[object] : 0;
+		m_Queue.push(RenderKey::make(RENDER_PASS_OPAQUE, item.pipeline, item.material, bucket, item.mesh, lod), object);
+	}
+	m_Queue.sort(jobs);
+
+	std::span<const uint64_t> keys = m_Queue.keys();
+	std::span<const uint32_t> objects = m_Queue.payloads();
+	m_Instances.assign(objects.begin(), objects.end());
+	for (uint32_t i = 0; i < keys.size(); i++)
+	{
+		if (!merge || i == 0 || keys[i] != keys[i - 1])
+		{
+			RenderItem item = { RenderKey::pipeline(keys[i]), RenderKey::material(keys[i]), RenderKey::mesh(keys[i]) };
+			m_Batches.push_back({ item, RenderKey::lod(keys[i]), i, 0 });
+		}
+		m_Batches.back().instanceCount++;
+	}
+}
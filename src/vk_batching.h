@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_renderqueue.h"
+
+class Scene;
+class JobSystem;
+
+// What an object is drawn with, the Scene render handle of an object indexes these
+struct RenderItem
+{
+	uint32_t pipeline;
+	uint32_t material;
+	uint32_t mesh;
+};
+
+// Render handle of objects without an item, past the end of every item list so they are never drawn
+constexpr uint32_t INVALID_RENDER_ITEM = ~0u;
+
+// One instanced draw, its instances are instances()[firstInstance, firstInstance + instanceCount)
+struct DrawBatch
+{
+	RenderItem item;
+	uint32_t lod;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+// Puts the visible objects through a RenderQueue keyed by pipeline, material, distance to the
+// camera, mesh and lod, and merges every run of equal keys into one instanced draw. Pipelines change
+// least often, then materials; within those, nearer buckets come first for early depth rejection.
+class DrawBatcher
+{
+public:
+
+	// off gives one draw per object, in the same order, to compare against
+	bool merge{ true };
+	// distance buckets between the camera and maxDepth, spaced logarithmically. More sort front to
+	// back more finely, but split batches of the same mesh and material
+	int depthBuckets{ 4 };
+	float maxDepth{ 500.0f };
+
+	static bool fitsKey(const RenderItem& item);
+
+	// lods has the lod of every scene object, or is empty to draw everything at full detail
+	void build(std::span<const uint32_t> visible, const Scene& scene, std::span<const RenderItem> items, std::span<const uint8_t> lods,
+		const glm::vec3& eye, JobSystem* jobs = nullptr);
+
+	const std::vector<DrawBatch>& batches() const { return m_Batches; }
+	// visible objects in batch order, which are also their indices into the instance buffer
+	const std::vector<uint32_t>& instances() const { return m_Instances; }
+	const RenderQueue& queue() const { return m_Queue; }
+
+private:
+
+	RenderQueue m_Queue;
+	std::vector<DrawBatch> m_Batches;
+	std::vector<uint32_t> m_Instances;
+};
@@ -0,0 +1,829 @@
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <latch>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BCN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "vk_bcn.h"
+#include "vk_jobs.h"
+
+// how hard each quality preset looks for endpoints
+struct QualitySettings
+{
+	int powerIterations;
+	int refinements;
+	// BC7: try all four p-bit combinations every round instead of rounding each endpoint on its own
+	bool exhaustivePBits;
+};
+
+static QualitySettings qualitySettings(BCQuality quality)
+{
+	switch (quality)
+	{
+	case BCQuality::FAST: return { 2, 0, false };
+	case BCQuality::NORMAL: return { 4, 2, false };
+	default: return { 8, 6, true };
+	}
+}
+
+// weight of the second endpoint for every index
+static const float BC1_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+static const float BC4_WEIGHTS[8] = { 0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f };
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// the texels of a block split by channel, so four texels fill an SSE register
+struct BlockTexels
+{
+	alignas(16) float channels[4][16];
+	int channelCount;
+};
+
+static BlockTexels loadBlock(const uint8_t texels[64], int firstChannel, int channelCount)
+{
+	BlockTexels block;
+	block.channelCount = channelCount;
+	for (int c = 0; c < channelCount; c++)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			block.channels[c][i] = float(texels[i * 4 + firstChannel + c]);
+		}
+	}
+	return block;
+}
+
+// Picks the closest palette entry for every texel, returns the summed squared error
+static float fitIndices(const BlockTexels& block, const float palette[][4], int paletteSize, uint8_t indices[16])
+{
+	float total = 0.0f;
+#ifdef BCN_SSE2
+	for (int group = 0; group < 16; group += 4)
+	{
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (int p = 0; p < paletteSize; p++)
+		{
+			__m128 error = _mm_setzero_ps();
+			for (int c = 0; c < block.channelCount; c++)
+			{
+				__m128 difference = _mm_sub_ps(_mm_load_ps(&block.channels[c][group]), _mm_set1_ps(palette[p][c]));
+				error = _mm_add_ps(error, _mm_mul_ps(difference, difference));
+			}
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, best));
+			best = _mm_min_ps(error, best);
+			bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(p)));
+		}
+
+		alignas(16) int32_t lanes[4];
+		alignas(16) float errors[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), bestIndex);
+		_mm_store_ps(errors, best);
+		for (int i = 0; i < 4; i++)
+		{
+			indices[group + i] = uint8_t(lanes[i]);
+			total += errors[i];
+		}
+	}
+#else
+	for (int i = 0; i < 16; i++)
+	{
+		float best = FLT_MAX;
+		for (int p = 0; p < paletteSize; p++)
+		{
+			float error = 0.0f;
+			for (int c = 0; c < block.channelCount; c++)
+			{
+				float difference = block.channels[c][i] - palette[p][c];
+				error += difference * difference;
+			}
+			if (error < best)
+			{
+				best = error;
+				indices[i] = uint8_t(p);
+			}
+		}
+		total += best;
+	}
+#endif
+	return total;
+}
+
+// Endpoints at the extremes of the texels along their principal axis, slightly inset
+static void principalEndpoints(const BlockTexels& block, int powerIterations, float endpoint0[4], float endpoint1[4])
+{
+	int channels = block.channelCount;
+	float mean[4] = {};
+	float low[4], high[4];
+	for (int c = 0; c < channels; c++)
+	{
+		low[c] = 255.0f;
+		high[c] = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			mean[c] += block.channels[c][i];
+			low[c] = std::min(low[c], block.channels[c][i]);
+			high[c] = std::max(high[c], block.channels[c][i]);
+		}
+		mean[c] /= 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int a = 0; a < channels; a++)
+		{
+			for (int b = a; b < channels; b++)
+			{
+				covariance[a][b] += (block.channels[a][i] - mean[a]) * (block.channels[b][i] - mean[b]);
+			}
+		}
+	}
+	for (int a = 0; a < channels; a++)
+	{
+		for (int b = 0; b < a; b++)
+		{
+			covariance[a][b] = covariance[b][a];
+		}
+	}
+
+	// power iteration, starting along the bounding box diagonal
+	float axis[4];
+	for (int c = 0; c < channels; c++)
+	{
+		axis[c] = high[c] - low[c] + 1e-3f;
+	}
+	for (int iteration = 0; iteration < powerIterations; iteration++)
+	{
+		float next[4] = {};
+		float length = 0.0f;
+		for (int a = 0; a < channels; a++)
+		{
+			for (int b = 0; b < channels; b++)
+			{
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length += next[a] * next[a];
+		}
+		if (length < 1e-8f)
+		{
+			break;
+		}
+		length = 1.0f / std::sqrt(length);
+		for (int c = 0; c < channels; c++)
+		{
+			axis[c] = next[c] * length;
+		}
+	}
+
+	float axisLength = 0.0f;
+	for (int c = 0; c < channels; c++)
+	{
+		axisLength += axis[c] * axis[c];
+	}
+	axisLength = std::max(axisLength, 1e-8f);
+
+	float minProjection = FLT_MAX, maxProjection = -FLT_MAX;
+	for (int i = 0; i < 16; i++)
+	{
+		float projection = 0.0f;
+		for (int c = 0; c < channels; c++)
+		{
+			projection += (block.channels[c][i] - mean[c]) * axis[c];
+		}
+		minProjection = std::min(minProjection, projection);
+		maxProjection = std::max(maxProjection, projection);
+	}
+
+	// the palette is spread evenly between the endpoints, pulling them in a little covers the bulk better
+	float inset = (maxProjection - minProjection) / 16.0f;
+	minProjection += inset;
+	maxProjection -= inset;
+	for (int c = 0; c < channels; c++)
+	{
+		endpoint0[c] = std::clamp(mean[c] + axis[c] * maxProjection / axisLength, 0.0f, 255.0f);
+		endpoint1[c] = std::clamp(mean[c] + axis[c] * minProjection / axisLength, 0.0f, 255.0f);
+	}
+}
+
+// Least squares endpoints for the given indices, false when the indices don't pin both down
+static bool refineEndpoints(const BlockTexels& block, const uint8_t indices[16], const float* weights, float endpoint0[4], float endpoint1[4])
+{
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[4] = {}, bx[4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float b = weights[indices[i]];
+		float a = 1.0f - b;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (int c = 0; c < block.channelCount; c++)
+		{
+			ax[c] += a * block.channels[c][i];
+			bx[c] += b * block.channels[c][i];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+	{
+		return false;
+	}
+
+	for (int c = 0; c < block.channelCount; c++)
+	{
+		endpoint0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+		endpoint1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+	}
+	return true;
+}
+
+// Little endian bit packing, for the BC7 block layout
+struct BitWriter
+{
+	uint8_t* bytes;
+	uint32_t position;
+
+	void write(uint32_t value, uint32_t bits)
+	{
+		for (uint32_t i = 0; i < bits; i++, position++)
+		{
+			bytes[position >> 3] |= uint8_t(((value >> i) & 1) << (position & 7));
+		}
+	}
+};
+
+struct BitReader
+{
+	const uint8_t* bytes;
+	uint32_t position;
+
+	uint32_t read(uint32_t bits)
+	{
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < bits; i++, position++)
+		{
+			value |= uint32_t((bytes[position >> 3] >> (position & 7)) & 1) << i;
+		}
+		return value;
+	}
+};
+
+static uint16_t to565(const float color[4])
+{
+	uint32_t r = uint32_t(std::clamp(color[0] * 31.0f / 255.0f + 0.5f, 0.0f, 31.0f));
+	uint32_t g = uint32_t(std::clamp(color[1] * 63.0f / 255.0f + 0.5f, 0.0f, 63.0f));
+	uint32_t b = uint32_t(std::clamp(color[2] * 31.0f / 255.0f + 0.5f, 0.0f, 31.0f));
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void from565(uint16_t packed, int color[3])
+{
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+static void encodeColorBlock(const uint8_t texels[64], const QualitySettings& settings, uint8_t* block)
+{
+	BlockTexels colors = loadBlock(texels, 0, 3);
+	float endpoint0[4], endpoint1[4];
+	principalEndpoints(colors, settings.powerIterations, endpoint0, endpoint1);
+
+	float bestError = FLT_MAX;
+	uint16_t best0 = 0, best1 = 0;
+	uint8_t bestIndices[16] = {};
+	for (int round = 0; round <= settings.refinements; round++)
+	{
+		uint16_t packed0 = to565(endpoint0);
+		uint16_t packed1 = to565(endpoint1);
+		int color0[3], color1[3];
+		from565(packed0, color0);
+		from565(packed1, color1);
+
+		float palette[4][4];
+		for (int c = 0; c < 3; c++)
+		{
+			palette[0][c] = float(color0[c]);
+			palette[1][c] = float(color1[c]);
+			palette[2][c] = float((2 * color0[c] + color1[c]) / 3);
+			palette[3][c] = float((color0[c] + 2 * color1[c]) / 3);
+		}
+
+		uint8_t indices[16];
+		float error = fitIndices(colors, palette, 4, indices);
+		if (error < bestError)
+		{
+			bestError = error;
+			best0 = packed0;
+			best1 = packed1;
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+
+		if (round == settings.refinements || !refineEndpoints(colors, indices, BC1_WEIGHTS, endpoint0, endpoint1))
+		{
+			break;
+		}
+	}
+
+	// BC1 only interpolates four colors when the first endpoint is the larger one
+	if (best0 < best1)
+	{
+		std::swap(best0, best1);
+		for (uint8_t& index : bestIndices)
+		{
+			index ^= 1;
+		}
+	}
+	else if (best0 == best1)
+	{
+		memset(bestIndices, 0, sizeof(bestIndices));
+	}
+
+	uint32_t packedIndices = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		packedIndices |= uint32_t(bestIndices[i]) << (i * 2);
+	}
+	memcpy(block, &best0, 2);
+	memcpy(block + 2, &best1, 2);
+	memcpy(block + 4, &packedIndices, 4);
+}
+
+// One channel with eight interpolated values, the alpha of BC3 and both halves of BC5
+static void encodeChannelBlock(const uint8_t texels[64], int channel, const QualitySettings& settings, uint8_t* block)
+{
+	BlockTexels values = loadBlock(texels, channel, 1);
+	float endpoint0[4], endpoint1[4];
+	principalEndpoints(values, 0, endpoint0, endpoint1);
+
+	float bestError = FLT_MAX;
+	int best0 = 0, best1 = 0;
+	uint8_t bestIndices[16] = {};
+	for (int round = 0; round <= settings.refinements; round++)
+	{
+		int value0 = int(endpoint0[0] + 0.5f);
+		int value1 = int(endpoint1[0] + 0.5f);
+		// the eight value mode needs the first endpoint to be the larger one
+		if (value0 < value1)
+		{
+			std::swap(value0, value1);
+		}
+
+		float palette[8][4];
+		palette[0][0] = float(value0);
+		palette[1][0] = float(value1);
+		for (int i = 2; i < 8; i++)
+		{
+			palette[i][0] = float(((8 - i) * value0 + (i - 1) * value1) / 7);
+		}
+
+		uint8_t indices[16];
+		float error = fitIndices(values, palette, 8, indices);
+		if (error < bestError)
+		{
+			bestError = error;
+			best0 = value0;
+			best1 = value1;
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+
+		endpoint0[0] = float(value0);
+		endpoint1[0] = float(value1);
+		if (round == settings.refinements || !refineEndpoints(values, indices, BC4_WEIGHTS, endpoint0, endpoint1))
+		{
+			break;
+		}
+	}
+
+	if (best0 == best1)
+	{
+		memset(bestIndices, 0, sizeof(bestIndices));
+	}
+
+	uint64_t packedIndices = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		packedIndices |= uint64_t(bestIndices[i]) << (i * 3);
+	}
+	block[0] = uint8_t(best0);
+	block[1] = uint8_t(best1);
+	for (int i = 0; i < 6; i++)
+	{
+		block[2 + i] = uint8_t(packedIndices >> (i * 8));
+	}
+}
+
+// 7 bit endpoint plus the p-bit shared by its channels
+static void quantizeBC7Endpoint(const float endpoint[4], uint32_t pBit, int quantized[4])
+{
+	for (int c = 0; c < 4; c++)
+	{
+		quantized[c] = std::clamp(int((endpoint[c] - float(pBit)) * 0.5f + 0.5f), 0, 127);
+	}
+}
+
+static float bc7EndpointError(const float endpoint[4], const int quantized[4], uint32_t pBit)
+{
+	float error = 0.0f;
+	for (int c = 0; c < 4; c++)
+	{
+		float difference = endpoint[c] - float((quantized[c] << 1) | pBit);
+		error += difference * difference;
+	}
+	return error;
+}
+
+static void encodeBC7Block(const uint8_t texels[64], const QualitySettings& settings, uint8_t* block)
+{
+	BlockTexels colors = loadBlock(texels, 0, 4);
+	float endpoint0[4], endpoint1[4];
+	principalEndpoints(colors, settings.powerIterations, endpoint0, endpoint1);
+
+	float weights[16];
+	for (int i = 0; i < 16; i++)
+	{
+		weights[i] = float(BC7_WEIGHTS[i]) / 64.0f;
+	}
+
+	float bestError = FLT_MAX;
+	int best0[4] = {}, best1[4] = {};
+	uint32_t bestP0 = 0, bestP1 = 0;
+	uint8_t bestIndices[16] = {};
+	for (int round = 0; round <= settings.refinements; round++)
+	{
+		// either every p-bit combination, or the one rounding each endpoint best
+		uint32_t pCandidates[4][2] = { { 0, 0 }, { 0, 1 }, { 1, 0 }, { 1, 1 } };
+		int candidateCount = 4;
+		if (!settings.exhaustivePBits)
+		{
+			int q0[4], q1[4];
+			quantizeBC7Endpoint(endpoint0, 0, q0);
+			quantizeBC7Endpoint(endpoint0, 1, q1);
+			pCandidates[0][0] = bc7EndpointError(endpoint0, q1, 1) < bc7EndpointError(endpoint0, q0, 0) ? 1 : 0;
+			quantizeBC7Endpoint(endpoint1, 0, q0);
+			quantizeBC7Endpoint(endpoint1, 1, q1);
+			pCandidates[0][1] = bc7EndpointError(endpoint1, q1, 1) < bc7EndpointError(endpoint1, q0, 0) ? 1 : 0;
+			candidateCount = 1;
+		}
+
+		// the next refinement starts from this round's best indices
+		uint8_t indices[16];
+		float roundError = FLT_MAX;
+		for (int candidate = 0; candidate < candidateCount; candidate++)
+		{
+			uint32_t p0 = pCandidates[candidate][0];
+			uint32_t p1 = pCandidates[candidate][1];
+			int quantized0[4], quantized1[4];
+			quantizeBC7Endpoint(endpoint0, p0, quantized0);
+			quantizeBC7Endpoint(endpoint1, p1, quantized1);
+
+			float palette[16][4];
+			for (int i = 0; i < 16; i++)
+			{
+				for (int c = 0; c < 4; c++)
+				{
+					int value0 = (quantized0[c] << 1) | int(p0);
+					int value1 = (quantized1[c] << 1) | int(p1);
+					palette[i][c] = float(((64 - BC7_WEIGHTS[i]) * value0 + BC7_WEIGHTS[i] * value1 + 32) >> 6);
+				}
+			}
+
+			uint8_t candidateIndices[16];
+			float error = fitIndices(colors, palette, 16, candidateIndices);
+			if (error < bestError)
+			{
+				bestError = error;
+				memcpy(best0, quantized0, sizeof(best0));
+				memcpy(best1, quantized1, sizeof(best1));
+				bestP0 = p0;
+				bestP1 = p1;
+				memcpy(bestIndices, candidateIndices, sizeof(candidateIndices));
+			}
+			if (error < roundError)
+			{
+				roundError = error;
+				memcpy(indices, candidateIndices, sizeof(indices));
+			}
+		}
+
+		if (round == settings.refinements || !refineEndpoints(colors, indices, weights, endpoint0, endpoint1))
+		{
+			break;
+		}
+	}
+
+	// the first index is stored without its top bit, flip the endpoints when it's set
+	if (bestIndices[0] & 8)
+	{
+		std::swap(best0, best1);
+		std::swap(bestP0, bestP1);
+		for (uint8_t& index : bestIndices)
+		{
+			index = 15 - index;
+		}
+	}
+
+	memset(block, 0, 16);
+	BitWriter writer{ block, 0 };
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		writer.write(uint32_t(best0[c]), 7);
+		writer.write(uint32_t(best1[c]), 7);
+	}
+	writer.write(bestP0, 1);
+	writer.write(bestP1, 1);
+	writer.write(bestIndices[0], 3);
+	for (int i = 1; i < 16; i++)
+	{
+		writer.write(bestIndices[i], 4);
+	}
+}
+
+static void decodeColorBlock(const uint8_t* block, bool allowThreeColors, uint8_t texels[64])
+{
+	uint16_t packed0, packed1;
+	uint32_t indices;
+	memcpy(&packed0, block, 2);
+	memcpy(&packed1, block + 2, 2);
+	memcpy(&indices, block + 4, 4);
+
+	int palette[4][4];
+	from565(packed0, palette[0]);
+	from565(packed1, palette[1]);
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+	for (int c = 0; c < 3; c++)
+	{
+		if (packed0 > packed1 || !allowThreeColors)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	if (packed0 <= packed1 && allowThreeColors)
+	{
+		palette[3][3] = 0;
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		const int* color = palette[(indices >> (i * 2)) & 3];
+		for (int c = 0; c < 4; c++)
+		{
+			texels[i * 4 + c] = uint8_t(color[c]);
+		}
+	}
+}
+
+static void decodeChannelBlock(const uint8_t* block, int channel, uint8_t texels[64])
+{
+	int value0 = block[0];
+	int value1 = block[1];
+	int palette[8] = { value0, value1 };
+	if (value0 > value1)
+	{
+		for (int i = 2; i < 8; i++)
+		{
+			palette[i] = ((8 - i) * value0 + (i - 1) * value1) / 7;
+		}
+	}
+	else
+	{
+		for (int i = 2; i < 6; i++)
+		{
+			palette[i] = ((6 - i) * value0 + (i - 1) * value1) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		indices |= uint64_t(block[2 + i]) << (i * 8);
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		texels[i * 4 + channel] = uint8_t(palette[(indices >> (i * 3)) & 7]);
+	}
+}
+
+// Only mode 6, the one the encoder writes. Other modes come out magenta
+static void decodeBC7Block(const uint8_t* block, uint8_t texels[64])
+{
+	BitReader reader{ block, 0 };
+	uint32_t mode = 0;
+	while (mode < 8 && reader.read(1) == 0)
+	{
+		mode++;
+	}
+
+	if (mode != 6)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			texels[i * 4 + 0] = 255;
+			texels[i * 4 + 1] = 0;
+			texels[i * 4 + 2] = 255;
+			texels[i * 4 + 3] = 255;
+		}
+		return;
+	}
+
+	int endpoints[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = int(reader.read(7));
+		endpoints[1][c] = int(reader.read(7));
+	}
+	uint32_t p0 = reader.read(1);
+	uint32_t p1 = reader.read(1);
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = (endpoints[0][c] << 1) | int(p0);
+		endpoints[1][c] = (endpoints[1][c] << 1) | int(p1);
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		int weight = BC7_WEIGHTS[reader.read(i == 0 ? 3 : 4)];
+		for (int c = 0; c < 4; c++)
+		{
+			texels[i * 4 + c] = uint8_t(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+		}
+	}
+}
+
+const char* BCn::formatName(BCFormat format)
+{
+	switch (format)
+	{
+	case BCFormat::BC1: return "BC1";
+	case BCFormat::BC3: return "BC3";
+	case BCFormat::BC5: return "BC5";
+	case BCFormat::BC7: return "BC7";
+	default: return "unknown";
+	}
+}
+
+const char* BCn::qualityName(BCQuality quality)
+{
+	switch (quality)
+	{
+	case BCQuality::FAST: return "fast";
+	case BCQuality::NORMAL: return "normal";
+	case BCQuality::HIGH: return "high";
+	default: return "unknown";
+	}
+}
+
+uint32_t BCn::blockBytes(BCFormat format)
+{
+	return format == BCFormat::BC1 ? 8 : 16;
+}
+
+size_t BCn::imageBytes(BCFormat format, uint32_t width, uint32_t height)
+{
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+void BCn::encodeBlock(BCFormat format, BCQuality quality, const uint8_t texels[64], uint8_t* block)
+{
+	QualitySettings settings = qualitySettings(quality);
+	switch (format)
+	{
+	case BCFormat::BC1:
+		encodeColorBlock(texels, settings, block);
+		break;
+	case BCFormat::BC3:
+		encodeChannelBlock(texels, 3, settings, block);
+		encodeColorBlock(texels, settings, block + 8);
+		break;
+	case BCFormat::BC5:
+		encodeChannelBlock(texels, 0, settings, block);
+		encodeChannelBlock(texels, 1, settings, block + 8);
+		break;
+	case BCFormat::BC7:
+		encodeBC7Block(texels, settings, block);
+		break;
+	}
+}
+
+void BCn::decodeBlock(BCFormat format, const uint8_t* block, uint8_t texels[64])
+{
+	switch (format)
+	{
+	case BCFormat::BC1:
+		decodeColorBlock(block, true, texels);
+		break;
+	case BCFormat::BC3:
+		decodeColorBlock(block + 8, false, texels);
+		decodeChannelBlock(block, 3, texels);
+		break;
+	case BCFormat::BC5:
+		decodeChannelBlock(block, 0, texels);
+		decodeChannelBlock(block + 8, 1, texels);
+		for (int i = 0; i < 16; i++)
+		{
+			texels[i * 4 + 2] = 0;
+			texels[i * 4 + 3] = 255;
+		}
+		break;
+	case BCFormat::BC7:
+		decodeBC7Block(block, texels);
+		break;
+	}
+}
+
+std::vector<uint8_t> BCn::encodeImage(JobSystem& jobs, BCFormat format, BCQuality quality, const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+	uint32_t bytes = blockBytes(format);
+	std::vector<uint8_t> blocks(size_t(blocksX) * blocksY * bytes);
+
+	// every worker keeps taking the next row of blocks until none are left
+	std::atomic<uint32_t> nextRow{ 0 };
+	auto encodeRows = [&]()
+		{
+			uint8_t texels[64];
+			for (uint32_t row = nextRow++; row < blocksY; row = nextRow++)
+			{
+				for (uint32_t column = 0; column < blocksX; column++)
+				{
+					// blocks hanging over the edge repeat the last row and column
+					for (uint32_t y = 0; y < 4; y++)
+					{
+						uint32_t sourceY = std::min(row * 4 + y, height - 1);
+						for (uint32_t x = 0; x < 4; x++)
+						{
+							uint32_t sourceX = std::min(column * 4 + x, width - 1);
+							memcpy(&texels[(y * 4 + x) * 4], &rgba[(size_t(sourceY) * width + sourceX) * 4], 4);
+						}
+					}
+					encodeBlock(format, quality, texels, &blocks[(size_t(row) * blocksX + column) * bytes]);
+				}
+			}
+		};
+
+	uint32_t workers = std::min(jobs.threadCount(), blocksY);
+	if (workers == 0)
+	{
+		encodeRows();
+		return blocks;
+	}
+
+	std::latch done(workers);
+	for (uint32_t i = 0; i < workers; i++)
+	{
+		jobs.submit([&]()
+			{
+				encodeRows();
+				done.count_down();
+			});
+	}
+	done.wait();
+
+	return blocks;
+}
+
+std::vector<uint8_t> BCn::decodeImage(BCFormat format, const uint8_t* blocks, uint32_t width, uint32_t height)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+	uint32_t bytes = blockBytes(format);
+	std::vector<uint8_t> rgba(size_t(width) * height * 4);
+
+	uint8_t texels[64];
+	for (uint32_t row = 0; row < blocksY; row++)
+	{
+		for (uint32_t column = 0; column < blocksX; column++)
+		{
+			decodeBlock(format, &blocks[(size_t(row) * blocksX + column) * bytes], texels);
+			for (uint32_t y = 0; y < 4 && row * 4 + y < height; y++)
+			{
+				for (uint32_t x = 0; x < 4 && column * 4 + x < width; x++)
+				{
+					memcpy(&rgba[((size_t(row) * 4 + y) * width + column * 4 + x) * 4], &texels[(y * 4 + x) * 4], 4);
+				}
+			}
+		}
+	}
+
+	return rgba;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Block compressed formats the cooker writes, every 4x4 block of texels becomes 8 or 16 bytes
+enum class BCFormat : uint32_t
+{
+	// opaque rgb, 8 bytes
+	BC1,
+	// rgb plus an interpolated alpha block, 16 bytes
+	BC3,
+	// two independent channels, normal maps keep x and y and rebuild z in the shader, 16 bytes
+	BC5,
+	// rgba, written in mode 6 only, 16 bytes
+	BC7,
+};
+
+enum class BCQuality : uint32_t
+{
+	// principal axis endpoints, one index fit
+	FAST,
+	// endpoints refined by least squares against the fitted indices
+	NORMAL,
+	// more refinement rounds, every p-bit combination for BC7
+	HIGH,
+};
+
+// CPU encoder and decoder for the formats above. Endpoints come from the principal axis of the
+// block's colors and get refined by least squares against the chosen indices; the index fit,
+// where most of the time goes, runs four texels at a time with SSE2 when the compiler has it.
+namespace BCn
+{
+	const char* formatName(BCFormat format);
+	const char* qualityName(BCQuality quality);
+	uint32_t blockBytes(BCFormat format);
+	// bytes of a whole image, partial blocks at the edges round up
+	size_t imageBytes(BCFormat format, uint32_t width, uint32_t height);
+
+	// texels is a 4x4 block of rgba8, row by row
+	void encodeBlock(BCFormat format, BCQuality quality, const uint8_t texels[64], uint8_t* block);
+	void decodeBlock(BCFormat format, const uint8_t* block, uint8_t texels[64]);
+
+	// Encodes rgba8 texels, rows of blocks are spread over the job pool. Don't call from a job
+	std::vector<uint8_t> encodeImage(JobSystem& jobs, BCFormat format, BCQuality quality, const uint8_t* rgba, uint32_t width, uint32_t height);
+	// Back to rgba8, on the calling thread. BC5 decodes to (x, y, 0, 255) like the sampler returns it
+	std::vector<uint8_t> decodeImage(BCFormat format, const uint8_t* blocks, uint32_t width, uint32_t height);
+}
@@ -0,0 +1,705 @@
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <sstream>
+
+#include <GLFW/glfw3.h>
+#include <fmt/core.h>
+#include <fmt/color.h>
+#include <imgui.h>
+#include <imgui_impl_glfw.h>
+#include <imgui_impl_vulkan.h>
+
+#include "vk_benchmark.h"
+#include "vk_engine.h"
+#include "vk_meshes.h"
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+	// runs of the non-frame scenarios thrown away first, the first pipeline or allocation of a kind is always slower
+	constexpr uint32_t ITERATION_WARMUP = 2;
+	// millisecond metrics moving by less than this never count as regressions, timer noise on tiny scopes
+	constexpr double NOISE_FLOOR_MS = 0.05;
+
+	struct Options
+	{
+		uint32_t warmup{ 30 };
+		uint32_t frames{ 120 };
+		uint32_t iterations{ 10 };
+		std::string filter;
+		std::string out{ "bench_results.json" };
+		std::string baseline;
+		double tolerance{ 0.1 };
+		std::string percentile{ "p50" };
+	};
+
+	struct Metric
+	{
+		std::string name;
+		// throughputs, everything else is a time
+		bool higherIsBetter;
+		std::vector<double> samples;
+	};
+
+	struct ScenarioResult
+	{
+		std::string name;
+		std::vector<Metric> metrics;
+	};
+
+	double millisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	double pick(const GpuBenchmark::Percentiles& percentiles, const std::string& name)
+	{
+		if (name == "p99")
+		{
+			return percentiles.p99;
+		}
+		return name == "p95" ? percentiles.p95 : percentiles.p50;
+	}
+
+	std::string jsonEscape(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				escaped += '\\';
+			}
+			escaped += c;
+		}
+		return escaped;
+	}
+
+	// Just enough JSON for the results files: objects, strings, numbers, true, false and null
+	struct JsonReader
+	{
+		const std::string& text;
+		std::map<std::string, double>& numbers;
+		size_t at{ 0 };
+
+		void skipSpace()
+		{
+			while (at < text.size() && std::isspace(static_cast<unsigned char>(text[at])))
+			{
+				at++;
+			}
+		}
+
+		bool consume(char c)
+		{
+			skipSpace();
+			if (at < text.size() && text[at] == c)
+			{
+				at++;
+				return true;
+			}
+			return false;
+		}
+
+		bool readString(std::string& out)
+		{
+			if (!consume('"'))
+			{
+				return false;
+			}
+			out.clear();
+			while (at < text.size() && text[at] != '"')
+			{
+				if (text[at] == '\\' && at + 1 < text.size())
+				{
+					at++;
+				}
+				out += text[at++];
+			}
+			at++;
+			return at <= text.size();
+		}
+
+		bool readValue(const std::string& path)
+		{
+			skipSpace();
+			if (at >= text.size())
+			{
+				return false;
+			}
+
+			if (text[at] == '{')
+			{
+				at++;
+				if (consume('}'))
+				{
+					return true;
+				}
+				do
+				{
+					std::string key;
+					if (!readString(key) || !consume(':') || !readValue(path.empty() ? key : path + "." + key))
+					{
+						return false;
+					}
+				} while (consume(','));
+				return consume('}');
+			}
+			if (text[at] == '"')
+			{
+				std::string ignored;
+				return readString(ignored);
+			}
+			for (const char* word : { "true", "false", "null" })
+			{
+				size_t length = strlen(word);
+				if (text.compare(at, length, word) == 0)
+				{
+					at += length;
+					return true;
+				}
+			}
+
+			const char* start = text.c_str() + at;
+			char* end = nullptr;
+			double value = std::strtod(start, &end);
+			if (end == start)
+			{
+				return false;
+			}
+			at += size_t(end - start);
+			numbers[path] = value;
+			return true;
+		}
+	};
+
+	// An empty UI frame, then a frame of the engine
+	void drawFrame(VulkanEngine& engine)
+	{
+		glfwPollEvents();
+		ImGui_ImplVulkan_NewFrame();
+		ImGui_ImplGlfw_NewFrame();
+		ImGui::NewFrame();
+		ImGui::Render();
+		engine.DrawFrame();
+	}
+
+	// The null platform resizes right away, the swapchain follows at the start of the next frame
+	void setResolution(VulkanEngine& engine, uint32_t width, uint32_t height)
+	{
+		glfwSetWindowSize(engine.m_Window, int(width), int(height));
+		engine.m_ResizeRequested = true;
+	}
+
+	// Times every measured frame on the cpu, from the fence wait to the present, and collects the
+	// gpu scopes of those same frames. The warmup also covers the resize and the first uploads
+	ScenarioResult measureFrames(VulkanEngine& engine, const Options& options, const std::string& name, std::span<const char* const> gpuScopes)
+	{
+		ScenarioResult result{ name };
+		result.metrics.push_back({ "cpu_ms", false, {} });
+		for (const char* scope : gpuScopes)
+		{
+			result.metrics.push_back({ fmt::format("gpu_{}_ms", scope), false, {} });
+		}
+
+		for (uint32_t frame = 0; frame < options.warmup; frame++)
+		{
+			drawFrame(engine);
+		}
+
+		const GpuProfiler& profiler = engine.m_Profiler;
+		uint32_t firstFrame = uint32_t(engine.m_FrameNumber);
+		uint32_t lastFrame = firstFrame + options.frames;
+		uint32_t collected = profiler.resultsFrameNumber();
+		auto collectGpu = [&]()
+			{
+				uint32_t resultsFrame = profiler.resultsFrameNumber();
+				if (!profiler.isEnabled() || resultsFrame == collected || resultsFrame < firstFrame || resultsFrame >= lastFrame)
+				{
+					return;
+				}
+				collected = resultsFrame;
+				for (size_t i = 0; i < gpuScopes.size(); i++)
+				{
+					double milliseconds = profiler.find(gpuScopes[i]);
+					if (milliseconds >= 0.0)
+					{
+						result.metrics[i + 1].samples.push_back(milliseconds);
+					}
+				}
+			};
+
+		for (uint32_t frame = 0; frame < options.frames; frame++)
+		{
+			Clock::time_point start = Clock::now();
+			drawFrame(engine);
+			result.metrics[0].samples.push_back(millisecondsSince(start));
+			collectGpu();
+		}
+		// the profiler lags MAX_FRAMES_IN_FLIGHT frames behind, the last measured frames come back with these
+		for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT + 1; frame++)
+		{
+			drawFrame(engine);
+			collectGpu();
+		}
+		return result;
+	}
+
+	// Staging to device local copies, the memcpy into the staging buffer included
+	ScenarioResult measureUpload(VulkanEngine& engine, const Options& options, size_t size)
+	{
+		ScenarioResult result{ fmt::format("upload/{}MiB", size >> 20) };
+		result.metrics.push_back({ "cpu_ms", false, {} });
+		result.metrics.push_back({ "gb_per_s", true, {} });
+
+		AllocatedBuffer staging = engine.CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_STAGING);
+		AllocatedBuffer target = engine.CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_GEOMETRY);
+		std::vector<uint8_t> source(size);
+		for (size_t i = 0; i < size; i++)
+		{
+			source[i] = uint8_t(i * 31);
+		}
+
+		for (uint32_t iteration = 0; iteration < ITERATION_WARMUP + options.iterations; iteration++)
+		{
+			Clock::time_point start = Clock::now();
+			memcpy(staging.info.pMappedData, source.data(), size);
+			engine.ImmediateSubmit([&](VkCommandBuffer cmd)
+				{
+					VkBufferCopy copy{ 0, 0, size };
+					vkCmdCopyBuffer(cmd, staging.buffer, target.buffer, 1, &copy);
+				});
+			double milliseconds = millisecondsSince(start);
+
+			if (iteration >= ITERATION_WARMUP)
+			{
+				result.metrics[0].samples.push_back(milliseconds);
+				result.metrics[1].samples.push_back(double(size) / (milliseconds * 1e6));
+			}
+		}
+
+		engine.DestroyBuffer(staging);
+		engine.DestroyBuffer(target);
+		return result;
+	}
+
+	// The mesh pipelines the way a draw format switch rebuilds them, and every background effect.
+	// Shader modules stay cached, this is the driver compiling
+	ScenarioResult measurePipelines(VulkanEngine& engine, const Options& options)
+	{
+		ScenarioResult result{ "pipelines" };
+		result.metrics.push_back({ "mesh_ms", false, {} });
+		result.metrics.push_back({ "compute_ms", false, {} });
+
+		// the mesh pass destroys its pipelines in place
+		vkDeviceWaitIdle(engine.m_Device);
+
+		for (uint32_t iteration = 0; iteration < ITERATION_WARMUP + options.iterations; iteration++)
+		{
+			Clock::time_point start = Clock::now();
+			engine.m_MeshPass.createPipelines();
+			double meshMilliseconds = millisecondsSince(start);
+
+			start = Clock::now();
+			for (const ComputeEffect& effect : engine.m_BGEffects)
+			{
+				std::string shaderFile = VkUtils::shaderPermutationFile(effect.shaderName, effect.permutation);
+				VkShaderModule shader = engine.m_ShaderCache.get(engine.m_Device, shaderFile.c_str());
+				VkPipeline pipeline = VkUtils::createComputePipeline(engine.m_Device, effect.layout, shader, effect.workgroupSize, effect.subgroupSize);
+				vkDestroyPipeline(engine.m_Device, pipeline, nullptr);
+			}
+			double computeMilliseconds = millisecondsSince(start);
+
+			if (iteration >= ITERATION_WARMUP)
+			{
+				result.metrics[0].samples.push_back(meshMilliseconds);
+				result.metrics[1].samples.push_back(computeMilliseconds);
+			}
+		}
+		return result;
+	}
+
+	// The cpu side of InitScene: the meshes and their lods, the tree, its world transforms and the BVH.
+	// Uploads are what the upload scenario measures
+	ScenarioResult measureSceneLoad(VulkanEngine& engine, const Options& options)
+	{
+		ScenarioResult result{ "scene_load" };
+		result.metrics.push_back({ "cpu_ms", false, {} });
+		result.metrics.push_back({ "meshes_ms", false, {} });
+
+		for (uint32_t iteration = 0; iteration < ITERATION_WARMUP + options.iterations; iteration++)
+		{
+			Clock::time_point start = Clock::now();
+
+			// kept on the cpu, never uploaded, so it needs no engine
+			MeshLibrary meshes;
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			MeshLibrary::makeCube(vertices, indices);
+			meshes.add("cube", vertices, indices);
+			MeshLibrary::makeSphere(24, 48, vertices, indices);
+			meshes.add("sphere", vertices, indices);
+			MeshLibrary::makePyramid(vertices, indices);
+			meshes.add("pyramid", vertices, indices);
+			double meshMilliseconds = millisecondsSince(start);
+
+			Scene scene;
+			TransformHierarchy hierarchy;
+			Bvh bvh;
+			std::vector<HierarchyNode> nodes;
+			VulkanEngine::BuildSceneTree(scene, nodes, meshes.count());
+			hierarchy.build(nodes);
+			for (uint32_t node : hierarchy.update(&engine.m_Jobs))
+			{
+				uint32_t object = hierarchy.object(node);
+				if (object != TransformHierarchy::NO_OBJECT)
+				{
+					scene.setTransform(object, hierarchy.world(node));
+				}
+			}
+			scene.updateWorldBounds(&engine.m_Jobs);
+			bvh.build(scene, &engine.m_Jobs);
+			double milliseconds = millisecondsSince(start);
+
+			if (iteration >= ITERATION_WARMUP)
+			{
+				result.metrics[0].samples.push_back(milliseconds);
+				result.metrics[1].samples.push_back(meshMilliseconds);
+			}
+		}
+		return result;
+	}
+
+	void printResult(const ScenarioResult& result)
+	{
+		fmt::print("  {}\n", fmt::styled(result.name, fmt::emphasis::bold));
+		for (const Metric& metric : result.metrics)
+		{
+			if (metric.samples.empty())
+			{
+				fmt::print("    {:<20} no samples\n", metric.name);
+				continue;
+			}
+			GpuBenchmark::Percentiles percentiles = GpuBenchmark::percentiles(metric.samples);
+			fmt::print("    {:<20} p50 {:9.3f}  p95 {:9.3f}  p99 {:9.3f}  mean {:9.3f}  ({} samples)\n", metric.name, percentiles.p50,
+				percentiles.p95, percentiles.p99, percentiles.mean, percentiles.samples);
+		}
+	}
+
+	bool writeResults(const std::string& path, const Options& options, const std::string& device, const std::vector<ScenarioResult>& results)
+	{
+		std::ofstream file(path, std::ios::trunc);
+		if (!file)
+		{
+			return false;
+		}
+
+		std::string json = fmt::format("{{\n  \"device\": \"{}\",\n  \"warmup_frames\": {},\n  \"measured_frames\": {},\n  \"iterations\": {},\n"
+			"  \"scenarios\": {{", jsonEscape(device), options.warmup, options.frames, options.iterations);
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			json += fmt::format("{}\n    \"{}\": {{", i ? "," : "", jsonEscape(results[i].name));
+			bool first = true;
+			for (const Metric& metric : results[i].metrics)
+			{
+				if (metric.samples.empty())
+				{
+					continue;
+				}
+				GpuBenchmark::Percentiles percentiles = GpuBenchmark::percentiles(metric.samples);
+				json += fmt::format("{}\n      \"{}\": {{ \"p50\": {:.6f}, \"p95\": {:.6f}, \"p99\": {:.6f}, \"mean\": {:.6f}, \"samples\": {} }}",
+					first ? "" : ",", metric.name, percentiles.p50, percentiles.p95, percentiles.p99, percentiles.mean, percentiles.samples);
+				first = false;
+			}
+			json += "\n    }";
+		}
+		json += "\n  }\n}\n";
+
+		file << json;
+		return bool(file);
+	}
+
+	// Prints every metric next to its baseline, returns false when any regressed past the tolerance
+	bool compareBaseline(const Options& options, const std::vector<ScenarioResult>& results)
+	{
+		std::map<std::string, double> baseline;
+		if (!GpuBenchmark::readNumbers(options.baseline, baseline))
+		{
+			fmt::print(fmt::fg(fmt::color::red), "Can't read the baseline {}\n", options.baseline);
+			return false;
+		}
+
+		fmt::print("{} {} within {:.0f}% of {}\n", fmt::styled("Baseline:", fmt::fg(fmt::color::white) | fmt::emphasis::bold), options.percentile,
+			options.tolerance * 100.0, options.baseline);
+
+		uint32_t regressions = 0;
+		for (const ScenarioResult& result : results)
+		{
+			for (const Metric& metric : result.metrics)
+			{
+				if (metric.samples.empty())
+				{
+					continue;
+				}
+				std::string label = result.name + " " + metric.name;
+				double current = pick(GpuBenchmark::percentiles(metric.samples), options.percentile);
+				auto found = baseline.find("scenarios." + result.name + "." + metric.name + "." + options.percentile);
+				if (found == baseline.end())
+				{
+					fmt::print(fmt::fg(fmt::color::yellow), "  {:<48} {:9.3f}  new\n", label, current);
+					continue;
+				}
+
+				double reference = found->second;
+				double change = reference != 0.0 ? (current - reference) / reference : 0.0;
+				// positive is worse either way
+				double worse = metric.higherIsBetter ? -change : change;
+				bool noise = !metric.higherIsBetter && std::abs(current - reference) < NOISE_FLOOR_MS;
+				bool regressed = worse > options.tolerance && !noise;
+				bool improved = -worse > options.tolerance && !noise;
+				regressions += regressed ? 1 : 0;
+
+				fmt::text_style style = regressed ? fmt::fg(fmt::color::red) : improved ? fmt::fg(fmt::color::green) : fmt::text_style();
+				fmt::print(style, "  {:<48} {:9.3f} -> {:9.3f}  {:+6.1f}%{}\n", label, reference, current, change * 100.0,
+					regressed ? "  REGRESSION" : "");
+			}
+		}
+
+		if (regressions > 0)
+		{
+			fmt::print(fmt::fg(fmt::color::red), "Benchmark failed, {} metrics regressed\n", regressions);
+			return false;
+		}
+		fmt::print(fmt::fg(fmt::color::green), "Benchmark passed\n");
+		return true;
+	}
+
+	bool parseOptions(int argc, char* argv[], Options& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string argument = argv[i];
+			if (i + 1 >= argc)
+			{
+				fmt::print(fmt::fg(fmt::color::red), "Missing value for {}\n", argument);
+				return false;
+			}
+			std::string value = argv[++i];
+
+			try
+			{
+				if (argument == "--warmup")
+				{
+					options.warmup = uint32_t(std::stoul(value));
+				}
+				else if (argument == "--frames")
+				{
+					options.frames = std::max(uint32_t(std::stoul(value)), 1u);
+				}
+				else if (argument == "--iterations")
+				{
+					options.iterations = std::max(uint32_t(std::stoul(value)), 1u);
+				}
+				else if (argument == "--filter")
+				{
+					options.filter = value;
+				}
+				else if (argument == "--out")
+				{
+					options.out = value;
+				}
+				else if (argument == "--baseline")
+				{
+					options.baseline = value;
+				}
+				else if (argument == "--tolerance")
+				{
+					options.tolerance = std::stod(value);
+				}
+				else if (argument == "--percentile" && (value == "p50" || value == "p95" || value == "p99"))
+				{
+					options.percentile = value;
+				}
+				else
+				{
+					fmt::print(fmt::fg(fmt::color::red), "Unknown option {} {}\n", argument, value);
+					return false;
+				}
+			}
+			catch (const std::exception&)
+			{
+				fmt::print(fmt::fg(fmt::color::red), "Bad value for {}: {}\n", argument, value);
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+GpuBenchmark::Percentiles GpuBenchmark::percentiles(std::vector<double> samples)
+{
+	Percentiles result{};
+	result.samples = uint32_t(samples.size());
+	if (samples.empty())
+	{
+		return result;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	auto rank = [&](double percentile)
+		{
+			size_t index = size_t(std::ceil(percentile * samples.size()));
+			return samples[std::clamp<size_t>(index, 1, samples.size()) - 1];
+		};
+	result.p50 = rank(0.50);
+	result.p95 = rank(0.95);
+	result.p99 = rank(0.99);
+
+	double sum = 0.0;
+	for (double sample : samples)
+	{
+		sum += sample;
+	}
+	result.mean = sum / samples.size();
+	return result;
+}
+
+bool GpuBenchmark::readNumbers(const std::string& path, std::map<std::string, double>& numbers)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	std::string text = contents.str();
+
+	JsonReader reader{ text, numbers };
+	return reader.readValue("");
+}
+
+int GpuBenchmark::run(int argc, char* argv[])
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		fmt::print("Usage: VulkanRendererBench [--warmup N] [--frames M] [--iterations K] [--filter TEXT] [--out FILE] [--baseline FILE] "
+			"[--tolerance T] [--percentile p50|p95|p99]\n");
+		return 2;
+	}
+
+	// mesa keeps compiled shaders on disk, which would turn the pipeline numbers into cache lookups
+#ifdef _WIN32
+	_putenv_s("MESA_SHADER_CACHE_DISABLE", "true");
+#else
+	setenv("MESA_SHADER_CACHE_DISABLE", "true", 0);
+#endif
+
+	VulkanEngine engine;
+	engine.m_Headless = true;
+	// every frame renders the scene, a cached frame would only measure the resolve
+	engine.m_Activity.cacheScene = false;
+	try
+	{
+		engine.Init();
+	}
+	catch (const std::exception& error)
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Benchmark couldn't start the engine: {}\n", error.what());
+		return 1;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(engine.m_PhysicalDevice, &properties);
+	std::string device = properties.deviceName;
+	fmt::print("{} {}, {} warmup and {} measured frames, {} iterations\n", fmt::styled("GPU benchmark:", fmt::fg(fmt::color::white) | fmt::emphasis::bold),
+		device, options.warmup, options.frames, options.iterations);
+	if (!engine.m_Profiler.isEnabled())
+	{
+		fmt::print(fmt::fg(fmt::color::yellow), "No gpu timestamps on this device, only cpu times are measured\n");
+	}
+
+	std::vector<ScenarioResult> results;
+	auto wanted = [&](const std::string& name)
+		{
+			return options.filter.empty() || name.find(options.filter) != std::string::npos;
+		};
+	auto add = [&](ScenarioResult&& result)
+		{
+			printResult(result);
+			results.push_back(std::move(result));
+		};
+
+	// every background effect alone, the rest of the scene switched off so only its dispatch is left
+	const VkExtent2D resolutions[] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 } };
+	const char* const backgroundScopes[] = { "background", "frame" };
+	engine.m_MeshPass.enabled = false;
+	engine.m_Shadows.enabled = false;
+	engine.m_Lights.enabled = false;
+	for (int effect = 0; effect < int(engine.m_BGEffects.size()); effect++)
+	{
+		for (VkExtent2D resolution : resolutions)
+		{
+			std::string name = fmt::format("background/{}/{}x{}", engine.m_BGEffects[effect].name, resolution.width, resolution.height);
+			if (!wanted(name))
+			{
+				continue;
+			}
+			engine.m_CurrentBGEffect = effect;
+			setResolution(engine, resolution.width, resolution.height);
+			add(measureFrames(engine, options, name, backgroundScopes));
+		}
+	}
+	engine.m_CurrentBGEffect = 0;
+	engine.m_MeshPass.enabled = true;
+	engine.m_Shadows.enabled = true;
+	engine.m_Lights.enabled = true;
+
+	// the whole scene as the renderer starts up
+	const char* const sceneScopes[] = { "frame", "background", "meshes", "shadows", "lights" };
+	if (wanted("scene/1280x720"))
+	{
+		setResolution(engine, 1280, 720);
+		add(measureFrames(engine, options, "scene/1280x720", sceneScopes));
+	}
+
+	vkDeviceWaitIdle(engine.m_Device);
+	for (size_t size : { size_t(4) << 20, size_t(64) << 20 })
+	{
+		if (wanted(fmt::format("upload/{}MiB", size >> 20)))
+		{
+			add(measureUpload(engine, options, size));
+		}
+	}
+	if (wanted("pipelines"))
+	{
+		add(measurePipelines(engine, options));
+	}
+	if (wanted("scene_load"))
+	{
+		add(measureSceneLoad(engine, options));
+	}
+
+	engine.Cleanup();
+
+	if (!writeResults(options.out, options, device, results))
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Can't write {}\n", options.out);
+		return 1;
+	}
+	fmt::print("Results written to {}\n", options.out);
+
+	if (options.baseline.empty())
+	{
+		return 0;
+	}
+	return compareBaseline(options, results) ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// What the VulkanRendererBench target runs: fixed scenarios on a headless engine, every frame
+// scenario for a number of warmup frames and then measured frames, the others for a number of
+// iterations. The percentiles of every metric are written as JSON and compared against a baseline
+// written by an earlier run, a metric past the tolerance fails the run.
+//
+// Options:
+//   --warmup N        frames before measuring, default 30
+//   --frames M        measured frames, default 120
+//   --iterations K    measured runs of the non-frame scenarios, default 10
+//   --filter TEXT     only scenarios with TEXT in their name
+//   --out FILE        where the results go, default bench_results.json
+//   --baseline FILE   compare against an earlier results file
+//   --tolerance T     allowed relative regression, default 0.1
+//   --percentile P    p50, p95 or p99 is what gets compared, default p50
+namespace GpuBenchmark
+{
+	struct Percentiles
+	{
+		double p50;
+		double p95;
+		double p99;
+		double mean;
+		uint32_t samples;
+	};
+
+	// Nearest rank percentiles
+	Percentiles percentiles(std::vector<double> samples);
+	// Every number in the JSON by its keys joined with '.', all the baseline comparison needs.
+	// Arrays aren't supported, the results don't use them
+	bool readNumbers(const std::string& path, std::map<std::string, double>& numbers);
+
+	int run(int argc, char* argv[]);
+}
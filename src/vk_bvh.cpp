@@ -0,0 +1,935 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <string>
+
+#include <fmt/core.h>
+#include <fmt/color.h>
+
+#include "vk_bvh.h"
+#include "vk_jobs.h"
+
+// Nodes are always four wide, so the tests use 128 bit vectors even in AVX2 builds
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_SSE2 1
+#define BVH_SIMD 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#define BVH_NEON 1
+#define BVH_SIMD 1
+#include <arm_neon.h>
+#else
+#define BVH_SIMD 0
+#endif
+
+#if defined(BVH_SSE2)
+using Quad = __m128;
+static inline Quad quadLoad(const float* p) { return _mm_load_ps(p); }
+static inline Quad quadSplat(float a) { return _mm_set1_ps(a); }
+static inline Quad quadAdd(Quad a, Quad b) { return _mm_add_ps(a, b); }
+static inline Quad quadSub(Quad a, Quad b) { return _mm_sub_ps(a, b); }
+static inline Quad quadMul(Quad a, Quad b) { return _mm_mul_ps(a, b); }
+static inline Quad quadMin(Quad a, Quad b) { return _mm_min_ps(a, b); }
+static inline Quad quadMax(Quad a, Quad b) { return _mm_max_ps(a, b); }
+static inline Quad quadGreaterEqual(Quad a, Quad b) { return _mm_cmpge_ps(a, b); }
+static inline Quad quadAnd(Quad a, Quad b) { return _mm_and_ps(a, b); }
+static inline uint32_t quadMask(Quad a) { return uint32_t(_mm_movemask_ps(a)); }
+static inline void quadStore(float* p, Quad a) { _mm_storeu_ps(p, a); }
+#elif defined(BVH_NEON)
+using Quad = float32x4_t;
+static inline Quad quadLoad(const float* p) { return vld1q_f32(p); }
+static inline Quad quadSplat(float a) { return vdupq_n_f32(a); }
+static inline Quad quadAdd(Quad a, Quad b) { return vaddq_f32(a, b); }
+static inline Quad quadSub(Quad a, Quad b) { return vsubq_f32(a, b); }
+static inline Quad quadMul(Quad a, Quad b) { return vmulq_f32(a, b); }
+static inline Quad quadMin(Quad a, Quad b) { return vminq_f32(a, b); }
+static inline Quad quadMax(Quad a, Quad b) { return vmaxq_f32(a, b); }
+static inline Quad quadGreaterEqual(Quad a, Quad b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+static inline Quad quadAnd(Quad a, Quad b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+static inline uint32_t quadMask(Quad a)
+{
+	const uint32x4_t bits = { 1, 2, 4, 8 };
+	return vaddvq_u32(vandq_u32(vreinterpretq_u32_f32(a), bits));
+}
+static inline void quadStore(float* p, Quad a) { vst1q_f32(p, a); }
+#endif
+
+// objects per chunk when a large range bins on the job pool
+static const uint32_t BIN_GRAIN = 8192;
+
+static Aabb emptyBounds()
+{
+	return { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+}
+
+static void grow(Aabb& bounds, const Aabb& other)
+{
+	bounds.min = glm::min(bounds.min, other.min);
+	bounds.max = glm::max(bounds.max, other.max);
+}
+
+static void grow(Aabb& bounds, const glm::vec3& point)
+{
+	bounds.min = glm::min(bounds.min, point);
+	bounds.max = glm::max(bounds.max, point);
+}
+
+// half the surface area, which is all SAH needs
+static float area(const Aabb& bounds)
+{
+	glm::vec3 size = bounds.max - bounds.min;
+	if (size.x < 0.0f || size.y < 0.0f || size.z < 0.0f)
+	{
+		return 0.0f;
+	}
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+static Aabb slotBounds(const BvhNode& node, uint32_t slot)
+{
+	return { glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]), glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]) };
+}
+
+static void setSlotBounds(BvhNode& node, uint32_t slot, const Aabb& bounds)
+{
+	node.minX[slot] = bounds.min.x;
+	node.minY[slot] = bounds.min.y;
+	node.minZ[slot] = bounds.min.z;
+	node.maxX[slot] = bounds.max.x;
+	node.maxY[slot] = bounds.max.y;
+	node.maxZ[slot] = bounds.max.z;
+}
+
+static Aabb nodeBounds(const BvhNode& node)
+{
+	Aabb bounds = emptyBounds();
+	for (uint32_t slot = 0; slot < 4; slot++)
+	{
+		grow(bounds, slotBounds(node, slot));
+	}
+	return bounds;
+}
+
+struct Bvh::BuildContext
+{
+	JobSystem* jobs;
+	std::vector<Aabb> bounds;
+	std::vector<glm::vec3> centroids;
+	// becomes m_Objects
+	std::vector<uint32_t> objects;
+	std::vector<BuildNode> nodes;
+	std::atomic<uint32_t> nodeCount;
+};
+
+struct RangeBounds
+{
+	Aabb bounds;
+	Aabb centroids;
+};
+
+struct SahBins
+{
+	Aabb bounds[3][Bvh::BIN_COUNT];
+	uint32_t counts[3][Bvh::BIN_COUNT];
+};
+
+static uint32_t binIndex(float centroid, float minimum, float scale, uint32_t binCount)
+{
+	return std::min(uint32_t(std::max((centroid - minimum) * scale, 0.0f)), binCount - 1);
+}
+
+void Bvh::build(const Scene& scene, JobSystem* jobs)
+{
+	uint32_t count = scene.size();
+
+	BuildContext context;
+	context.jobs = jobs;
+	context.bounds.resize(count);
+	context.centroids.resize(count);
+	context.objects.resize(count);
+	auto gather = [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				context.bounds[i] = scene.worldBounds(i);
+				context.centroids[i] = (context.bounds[i].min + context.bounds[i].max) * 0.5f;
+				context.objects[i] = i;
+			}
+		};
+	if (jobs)
+	{
+		jobs->parallelFor(count, BIN_GRAIN, gather);
+	}
+	else
+	{
+		gather(0, count);
+	}
+
+	m_Nodes.clear();
+	m_Parents.clear();
+	m_LevelStarts.clear();
+	m_Objects.clear();
+	m_ObjectNodes.assign(count, EMPTY);
+	m_RefitMarks.clear();
+	if (count == 0)
+	{
+		return;
+	}
+
+	// a binary tree with one object per leaf
+	context.nodes.resize(2 * size_t(count) - 1);
+	context.nodeCount = 1;
+	buildRange(context, 0, 0, count);
+
+	m_Objects = std::move(context.objects);
+	collapse(context.nodes);
+	m_RefitMarks.assign(m_Nodes.size(), 0);
+}
+
+void Bvh::buildRange(BuildContext& context, uint32_t node, uint32_t begin, uint32_t end)
+{
+	uint32_t count = end - begin;
+	bool parallel = context.jobs && count > PARALLEL_THRESHOLD;
+	BuildNode& buildNode = context.nodes[node];
+
+	// bounds of the objects and of their centroids
+	auto boundRange = [&](uint32_t first, uint32_t last)
+		{
+			RangeBounds range = { emptyBounds(), emptyBounds() };
+			for (uint32_t i = first; i < last; i++)
+			{
+				uint32_t object = context.objects[i];
+				grow(range.bounds, context.bounds[object]);
+				grow(range.centroids, context.centroids[object]);
+			}
+			return range;
+		};
+
+	RangeBounds range = { emptyBounds(), emptyBounds() };
+	if (parallel)
+	{
+		std::vector<RangeBounds> chunks((count + BIN_GRAIN - 1) / BIN_GRAIN);
+		context.jobs->parallelFor(count, BIN_GRAIN, [&](uint32_t first, uint32_t last)
+			{
+				chunks[first / BIN_GRAIN] = boundRange(begin + first, begin + last);
+			});
+		for (const RangeBounds& chunk : chunks)
+		{
+			grow(range.bounds, chunk.bounds);
+			grow(range.centroids, chunk.centroids);
+		}
+	}
+	else
+	{
+		range = boundRange(begin, end);
+	}
+	buildNode.bounds = range.bounds;
+	buildNode.first = begin;
+	buildNode.count = count;
+
+	if (count == 1)
+	{
+		buildNode.left = NO_HIT;
+		buildNode.right = NO_HIT;
+		return;
+	}
+
+	// most ranges are small near the leaves, sweeping all the bins would cost more than the binning
+	uint32_t binCount = std::min(BIN_COUNT, 2 * count);
+	glm::vec3 centroidSize = range.centroids.max - range.centroids.min;
+	glm::vec3 scale;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		scale[axis] = centroidSize[axis] > 0.0f ? float(binCount) / centroidSize[axis] : 0.0f;
+	}
+
+	auto binRange = [&](uint32_t first, uint32_t last, SahBins& bins)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				for (uint32_t bin = 0; bin < binCount; bin++)
+				{
+					bins.bounds[axis][bin] = emptyBounds();
+					bins.counts[axis][bin] = 0;
+				}
+			}
+			for (uint32_t i = first; i < last; i++)
+			{
+				uint32_t object = context.objects[i];
+				for (int axis = 0; axis < 3; axis++)
+				{
+					uint32_t bin = binIndex(context.centroids[object][axis], range.centroids.min[axis], scale[axis], binCount);
+					grow(bins.bounds[axis][bin], context.bounds[object]);
+					bins.counts[axis][bin]++;
+				}
+			}
+		};
+
+	SahBins bins;
+	if (parallel)
+	{
+		std::vector<SahBins> chunks((count + BIN_GRAIN - 1) / BIN_GRAIN);
+		context.jobs->parallelFor(count, BIN_GRAIN, [&](uint32_t first, uint32_t last)
+			{
+				binRange(begin + first, begin + last, chunks[first / BIN_GRAIN]);
+			});
+		bins = chunks[0];
+		for (size_t chunk = 1; chunk < chunks.size(); chunk++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				for (uint32_t bin = 0; bin < binCount; bin++)
+				{
+					grow(bins.bounds[axis][bin], chunks[chunk].bounds[axis][bin]);
+					bins.counts[axis][bin] += chunks[chunk].counts[axis][bin];
+				}
+			}
+		}
+	}
+	else
+	{
+		binRange(begin, end, bins);
+	}
+
+	// cheapest plane between two bins, area times objects on each side
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+	float bestCost = std::numeric_limits<float>::max();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (scale[axis] == 0.0f)
+		{
+			continue;
+		}
+
+		float rightCosts[BIN_COUNT];
+		Aabb rightBounds = emptyBounds();
+		uint32_t rightCount = 0;
+		for (uint32_t bin = binCount - 1; bin > 0; bin--)
+		{
+			grow(rightBounds, bins.bounds[axis][bin]);
+			rightCount += bins.counts[axis][bin];
+			rightCosts[bin] = area(rightBounds) * rightCount;
+		}
+
+		Aabb leftBounds = emptyBounds();
+		uint32_t leftCount = 0;
+		for (uint32_t split = 1; split < binCount; split++)
+		{
+			grow(leftBounds, bins.bounds[axis][split - 1]);
+			leftCount += bins.counts[axis][split - 1];
+			if (leftCount == 0 || leftCount == count)
+			{
+				continue;
+			}
+
+			float cost = area(leftBounds) * leftCount + rightCosts[split];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	uint32_t middle = begin + count / 2;
+	if (bestAxis >= 0)
+	{
+		auto split = std::partition(context.objects.begin() + begin, context.objects.begin() + end, [&](uint32_t object)
+			{
+				return binIndex(context.centroids[object][bestAxis], range.centroids.min[bestAxis], scale[bestAxis], binCount) < bestSplit;
+			});
+		middle = uint32_t(split - context.objects.begin());
+	}
+	// every centroid in one spot, any split is as good as another
+	if (middle == begin || middle == end)
+	{
+		middle = begin + count / 2;
+	}
+
+	uint32_t left = context.nodeCount.fetch_add(2);
+	buildNode.left = left;
+	buildNode.right = left + 1;
+
+	if (parallel)
+	{
+		context.jobs->parallelFor(2, 1, [&](uint32_t first, uint32_t last)
+			{
+				for (uint32_t child = first; child < last; child++)
+				{
+					if (child == 0)
+					{
+						buildRange(context, left, begin, middle);
+					}
+					else
+					{
+						buildRange(context, left + 1, middle, end);
+					}
+				}
+			});
+	}
+	else
+	{
+		buildRange(context, left, begin, middle);
+		buildRange(context, left + 1, middle, end);
+	}
+}
+
+void Bvh::collapse(const std::vector<BuildNode>& buildNodes)
+{
+	struct PendingNode
+	{
+		uint32_t buildNode;
+		uint32_t parent;
+		uint32_t level;
+	};
+
+	// breadth first, a node's index is its position in the queue
+	std::vector<PendingNode> queue{ { 0, EMPTY, 0 } };
+	m_Nodes.reserve(buildNodes.size() / 2 + 1);
+	m_Parents.reserve(buildNodes.size() / 2 + 1);
+	for (uint32_t index = 0; index < queue.size(); index++)
+	{
+		PendingNode pending = queue[index];
+		if (pending.level == m_LevelStarts.size())
+		{
+			m_LevelStarts.push_back(index);
+		}
+
+		// open the largest inner child until four are gathered
+		uint32_t slots[4];
+		uint32_t slotCount = 0;
+		const BuildNode& root = buildNodes[pending.buildNode];
+		if (root.left == NO_HIT)
+		{
+			slots[slotCount++] = pending.buildNode;
+		}
+		else
+		{
+			slots[slotCount++] = root.left;
+			slots[slotCount++] = root.right;
+		}
+		while (slotCount < 4)
+		{
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (uint32_t slot = 0; slot < slotCount; slot++)
+			{
+				const BuildNode& candidate = buildNodes[slots[slot]];
+				if (candidate.left != NO_HIT && area(candidate.bounds) > largestArea)
+				{
+					largest = int(slot);
+					largestArea = area(candidate.bounds);
+				}
+			}
+			if (largest < 0)
+			{
+				break;
+			}
+
+			const BuildNode& opened = buildNodes[slots[largest]];
+			slots[largest] = opened.left;
+			slots[slotCount++] = opened.right;
+		}
+
+		BvhNode& node = m_Nodes.emplace_back();
+		node.slotMask = 0;
+		node.firstObject = root.first;
+		node.objectCount = root.count;
+		m_Parents.push_back(pending.parent);
+		for (uint32_t slot = 0; slot < 4; slot++)
+		{
+			if (slot >= slotCount)
+			{
+				setSlotBounds(node, slot, emptyBounds());
+				node.child[slot] = EMPTY;
+				continue;
+			}
+
+			const BuildNode& child = buildNodes[slots[slot]];
+			setSlotBounds(node, slot, child.bounds);
+			node.slotMask |= 1u << slot;
+			if (child.left == NO_HIT)
+			{
+				uint32_t object = m_Objects[child.first];
+				node.child[slot] = LEAF_BIT | object;
+				m_ObjectNodes[object] = index;
+			}
+			else
+			{
+				node.child[slot] = uint32_t(queue.size());
+				queue.push_back({ slots[slot], index, pending.level + 1 });
+			}
+		}
+	}
+	m_LevelStarts.push_back(uint32_t(m_Nodes.size()));
+}
+
+void Bvh::refitNode(const Scene& scene, uint32_t node)
+{
+	BvhNode& bvhNode = m_Nodes[node];
+	for (uint32_t slot = 0; slot < 4; slot++)
+	{
+		uint32_t child = bvhNode.child[slot];
+		if (child == EMPTY)
+		{
+			continue;
+		}
+		setSlotBounds(bvhNode, slot, child & LEAF_BIT ? scene.worldBounds(child & ~LEAF_BIT) : nodeBounds(m_Nodes[child]));
+	}
+}
+
+void Bvh::refit(const Scene& scene, JobSystem* jobs)
+{
+	// children sit a level below their parent, so a level only reads finished ones
+	for (uint32_t level = depth(); level-- > 0;)
+	{
+		uint32_t begin = m_LevelStarts[level];
+		uint32_t end = m_LevelStarts[level + 1];
+		if (jobs)
+		{
+			jobs->parallelFor(end - begin, REFIT_GRAIN, [&](uint32_t first, uint32_t last)
+				{
+					for (uint32_t node = begin + first; node < begin + last; node++)
+					{
+						refitNode(scene, node);
+					}
+				});
+		}
+		else
+		{
+			for (uint32_t node = begin; node < end; node++)
+			{
+				refitNode(scene, node);
+			}
+		}
+	}
+}
+
+void Bvh::refit(const Scene& scene, std::span<const uint32_t> objects)
+{
+	m_RefitNodes.clear();
+	for (uint32_t object : objects)
+	{
+		for (uint32_t node = m_ObjectNodes[object]; node != EMPTY && !m_RefitMarks[node]; node = m_Parents[node])
+		{
+			m_RefitMarks[node] = 1;
+			m_RefitNodes.push_back(node);
+		}
+	}
+
+	// breadth first order puts children after their parents
+	std::sort(m_RefitNodes.begin(), m_RefitNodes.end(), std::greater<uint32_t>());
+	for (uint32_t node : m_RefitNodes)
+	{
+		refitNode(scene, node);
+		m_RefitMarks[node] = 0;
+	}
+}
+
+Aabb Bvh::bounds() const
+{
+	return m_Nodes.empty() ? emptyBounds() : nodeBounds(m_Nodes[0]);
+}
+
+float Bvh::cost() const
+{
+	float rootArea = area(bounds());
+	if (rootArea <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	// the chance a ray through the root also enters each node
+	float total = 0.0f;
+	for (const BvhNode& node : m_Nodes)
+	{
+		total += area(nodeBounds(node));
+	}
+	return total / rootArea;
+}
+
+uint32_t Bvh::intersectFrustum(const BvhNode& node, const Frustum& frustum, uint32_t& fullyInside) const
+{
+#if BVH_SIMD
+	if (useSimd)
+	{
+		Quad half = quadSplat(0.5f);
+		Quad minimum[3] = { quadLoad(node.minX), quadLoad(node.minY), quadLoad(node.minZ) };
+		Quad maximum[3] = { quadLoad(node.maxX), quadLoad(node.maxY), quadLoad(node.maxZ) };
+		Quad center[3];
+		Quad extent[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			center[axis] = quadMul(quadAdd(minimum[axis], maximum[axis]), half);
+			extent[axis] = quadMul(quadSub(maximum[axis], minimum[axis]), half);
+		}
+
+		Quad zero = quadSplat(0.0f);
+		Quad touching = quadGreaterEqual(zero, zero);
+		Quad inside = touching;
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			Quad distance = quadAdd(quadAdd(quadMul(quadSplat(plane.x), center[0]), quadMul(quadSplat(plane.y), center[1])),
+				quadAdd(quadMul(quadSplat(plane.z), center[2]), quadSplat(plane.w)));
+			Quad radius = quadAdd(quadAdd(quadMul(quadSplat(std::abs(plane.x)), extent[0]), quadMul(quadSplat(std::abs(plane.y)), extent[1])),
+				quadMul(quadSplat(std::abs(plane.z)), extent[2]));
+			touching = quadAnd(touching, quadGreaterEqual(quadAdd(distance, radius), zero));
+			inside = quadAnd(inside, quadGreaterEqual(distance, radius));
+		}
+
+		fullyInside = quadMask(inside) & node.slotMask;
+		return quadMask(touching) & node.slotMask;
+	}
+#endif
+
+	uint32_t touching = 0;
+	fullyInside = 0;
+	for (uint32_t slot = 0; slot < 4; slot++)
+	{
+		if (!(node.slotMask & (1u << slot)))
+		{
+			continue;
+		}
+
+		Aabb bounds = slotBounds(node, slot);
+		glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+		glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+		bool touches = true;
+		bool inside = true;
+		for (int p = 0; p < 6 && touches; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+			float radius = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+			touches = distance + radius >= 0.0f;
+			inside = inside && distance >= radius;
+		}
+		touching |= touches ? 1u << slot : 0;
+		fullyInside |= touches && inside ? 1u << slot : 0;
+	}
+	return touching;
+}
+
+void Bvh::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	visible.clear();
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	thread_local std::vector<uint32_t> stack;
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const BvhNode& node = m_Nodes[stack.back()];
+		stack.pop_back();
+
+		uint32_t fullyInside;
+		uint32_t touching = intersectFrustum(node, frustum, fullyInside);
+		for (uint32_t mask = touching; mask != 0; mask &= mask - 1)
+		{
+			uint32_t slot = uint32_t(std::countr_zero(mask));
+			uint32_t child = node.child[slot];
+			if (child & LEAF_BIT)
+			{
+				visible.push_back(child & ~LEAF_BIT);
+			}
+			else if (fullyInside & (1u << slot))
+			{
+				// nothing below needs testing
+				const BvhNode& inside = m_Nodes[child];
+				visible.insert(visible.end(), m_Objects.begin() + inside.firstObject, m_Objects.begin() + inside.firstObject + inside.objectCount);
+			}
+			else
+			{
+				stack.push_back(child);
+			}
+		}
+	}
+}
+
+uint32_t Bvh::intersectRay(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance,
+	float distances[4]) const
+{
+#if BVH_SIMD
+	if (useSimd)
+	{
+		const float* minimum[3] = { node.minX, node.minY, node.minZ };
+		const float* maximum[3] = { node.maxX, node.maxY, node.maxZ };
+		Quad nearest = quadSplat(0.0f);
+		Quad farthest = quadSplat(maxDistance);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			Quad start = quadSplat(origin[axis]);
+			Quad inverse = quadSplat(inverseDirection[axis]);
+			Quad t0 = quadMul(quadSub(quadLoad(minimum[axis]), start), inverse);
+			Quad t1 = quadMul(quadSub(quadLoad(maximum[axis]), start), inverse);
+			nearest = quadMax(nearest, quadMin(t0, t1));
+			farthest = quadMin(farthest, quadMax(t0, t1));
+		}
+		quadStore(distances, nearest);
+		return quadMask(quadGreaterEqual(farthest, nearest)) & node.slotMask;
+	}
+#endif
+
+	uint32_t hits = 0;
+	for (uint32_t slot = 0; slot < 4; slot++)
+	{
+		if (!(node.slotMask & (1u << slot)))
+		{
+			continue;
+		}
+
+		Aabb bounds = slotBounds(node, slot);
+		float nearest = 0.0f;
+		float farthest = maxDistance;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float t0 = (bounds.min[axis] - origin[axis]) * inverseDirection[axis];
+			float t1 = (bounds.max[axis] - origin[axis]) * inverseDirection[axis];
+			nearest = std::max(nearest, std::min(t0, t1));
+			farthest = std::min(farthest, std::max(t0, t1));
+		}
+		distances[slot] = nearest;
+		hits |= farthest >= nearest ? 1u << slot : 0;
+	}
+	return hits;
+}
+
+RayHit Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+{
+	RayHit hit = { NO_HIT, maxDistance };
+	if (m_Nodes.empty())
+	{
+		return hit;
+	}
+
+	// zero components become infinities, which the slab test handles
+	glm::vec3 inverseDirection = 1.0f / direction;
+
+	struct StackEntry
+	{
+		uint32_t node;
+		float distance;
+	};
+	thread_local std::vector<StackEntry> stack;
+	stack.clear();
+	stack.push_back({ 0, 0.0f });
+	while (!stack.empty())
+	{
+		StackEntry entry = stack.back();
+		stack.pop_back();
+		// something closer was found since it was pushed
+		if (entry.distance > hit.distance)
+		{
+			continue;
+		}
+
+		const BvhNode& node = m_Nodes[entry.node];
+		alignas(16) float distances[4];
+		uint32_t hits = intersectRay(node, origin, inverseDirection, hit.distance, distances);
+
+		// inner children are pushed farthest first so the nearest is opened next
+		StackEntry children[4];
+		uint32_t childCount = 0;
+		for (uint32_t mask = hits; mask != 0; mask &= mask - 1)
+		{
+			uint32_t slot = uint32_t(std::countr_zero(mask));
+			uint32_t child = node.child[slot];
+			if (child & LEAF_BIT)
+			{
+				if (distances[slot] < hit.distance || hit.object == NO_HIT)
+				{
+					hit = { child & ~LEAF_BIT, distances[slot] };
+				}
+				continue;
+			}
+
+			uint32_t position = childCount++;
+			while (position > 0 && children[position - 1].distance < distances[slot])
+			{
+				children[position] = children[position - 1];
+				position--;
+			}
+			children[position] = { child, distances[slot] };
+		}
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			stack.push_back(children[i]);
+		}
+	}
+	return hit;
+}
+
+// Closest world bounds the ray enters by checking every object, for the benchmark to compare against
+static RayHit raycastLinear(const Scene& scene, const glm::vec3& origin, const glm::vec3& direction, float maxDistance)
+{
+	glm::vec3 inverseDirection = 1.0f / direction;
+	RayHit hit = { Bvh::NO_HIT, maxDistance };
+	for (uint32_t object = 0; object < scene.size(); object++)
+	{
+		Aabb bounds = scene.worldBounds(object);
+		float nearest = 0.0f;
+		float farthest = hit.distance;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float t0 = (bounds.min[axis] - origin[axis]) * inverseDirection[axis];
+			float t1 = (bounds.max[axis] - origin[axis]) * inverseDirection[axis];
+			nearest = std::max(nearest, std::min(t0, t1));
+			farthest = std::min(farthest, std::max(t0, t1));
+		}
+		if (farthest >= nearest && (nearest < hit.distance || hit.object == Bvh::NO_HIT))
+		{
+			hit = { object, nearest };
+		}
+	}
+	return hit;
+}
+
+bool BvhBenchmark::run(JobSystem& jobs, uint32_t objectCount)
+{
+	using SceneBenchmark::bestOf;
+	constexpr int runs = 5;
+
+	Scene scene;
+	Frustum frustum;
+	SceneBenchmark::buildScene(scene, objectCount, frustum);
+	scene.updateWorldBounds(&jobs);
+
+	fmt::print("{} {} objects, {} node tests, {} workers\n", fmt::styled("BVH benchmark:", fmt::fg(fmt::color::white) | fmt::emphasis::bold),
+		objectCount, BVH_SIMD ? "4 wide SIMD" : "scalar", jobs.threadCount());
+
+	Bvh bvh;
+	double buildMilliseconds = bestOf(runs, [&]() { bvh.build(scene); });
+	double parallelBuildMilliseconds = bestOf(runs, [&]() { bvh.build(scene, &jobs); });
+	float builtCost = bvh.cost();
+	fmt::print("  build            {:7.2f} ms, parallel {:7.2f} ms  {} nodes, depth {}, cost {:.1f}\n", buildMilliseconds,
+		parallelBuildMilliseconds, bvh.nodeCount(), bvh.depth(), builtCost);
+
+	bool passed = true;
+
+	// culling against the linear SIMD scan
+	std::vector<uint32_t> reference;
+	double linearMilliseconds = bestOf(runs, [&]() { scene.cull(frustum, reference); });
+	for (bool simd : { false, true })
+	{
+		bvh.useSimd = simd;
+		std::vector<uint32_t> visible;
+		double cullMilliseconds = bestOf(runs, [&]() { bvh.cull(frustum, visible); });
+
+		// the node bounds are rebuilt from min and max, boxes touching a plane may round either way
+		bool matches = SceneBenchmark::sameVisible(visible, reference);
+		passed = passed && matches;
+		fmt::print("  cull {:<11} {:7.2f} ms, linear {:7.2f} ms  {} visible{}\n", simd ? "simd" : "scalar", cullMilliseconds,
+			linearMilliseconds, visible.size(), matches ? "" : "  MISMATCH");
+	}
+
+	// refits, all of it and then after a hundredth of the objects moved
+	double refitMilliseconds = bestOf(runs, [&]() { bvh.refit(scene); });
+	double parallelRefitMilliseconds = bestOf(runs, [&]() { bvh.refit(scene, &jobs); });
+
+	std::mt19937 random(7);
+	std::uniform_int_distribution<uint32_t> pick(0, objectCount - 1);
+	std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+	std::vector<uint32_t> moved;
+	auto moveObjects = [&]()
+		{
+			moved.clear();
+			for (uint32_t i = 0; i < std::max(objectCount / 100, 1u); i++)
+			{
+				uint32_t object = pick(random);
+				glm::mat4 transform = scene.transform(object);
+				transform[3] = transform[3] + glm::vec4(offset(random), offset(random), offset(random), 0.0f);
+				scene.setTransform(object, transform);
+				moved.push_back(object);
+			}
+			scene.updateWorldBounds(&jobs);
+		};
+	double partialRefitMilliseconds = bestOf(runs, [&]() { bvh.refit(scene, moved); }, moveObjects);
+	fmt::print("  refit            {:7.2f} ms, parallel {:7.2f} ms, {} moved {:7.3f} ms  cost {:.1f}\n", refitMilliseconds,
+		parallelRefitMilliseconds, moved.size(), partialRefitMilliseconds, bvh.cost());
+
+	// rays from random points in random directions, a few checked against every object
+	constexpr uint32_t rayCount = 1 << 20;
+	constexpr uint32_t checkedRays = 256;
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<glm::vec3> origins(rayCount);
+	std::vector<glm::vec3> directions(rayCount);
+	for (uint32_t i = 0; i < rayCount; i++)
+	{
+		origins[i] = glm::vec3(position(random), position(random), position(random));
+		directions[i] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + 1e-3f);
+	}
+
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < checkedRays; i++)
+	{
+		RayHit expected = raycastLinear(scene, origins[i], directions[i], 2000.0f);
+		RayHit hit = bvh.raycast(origins[i], directions[i], 2000.0f);
+		// equally close boxes may come back in either order
+		bool same = hit.object == expected.object || (hit.object != Bvh::NO_HIT && expected.object != Bvh::NO_HIT &&
+			std::abs(hit.distance - expected.distance) <= 1e-3f);
+		mismatches += same ? 0 : 1;
+	}
+	passed = passed && mismatches == 0;
+	if (mismatches)
+	{
+		fmt::print("  rays             {} of {} checked rays hit something else than the linear scan  MISMATCH\n", mismatches, checkedRays);
+	}
+
+	std::vector<RayHit> hits(rayCount);
+	for (bool parallel : { false, true })
+	{
+		for (bool simd : { false, true })
+		{
+			bvh.useSimd = simd;
+			auto trace = [&](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t i = begin; i < end; i++)
+					{
+						hits[i] = bvh.raycast(origins[i], directions[i], 2000.0f);
+					}
+				};
+
+			double rayMilliseconds = bestOf(3, [&]()
+				{
+					if (parallel)
+					{
+						jobs.parallelFor(rayCount, 4096, trace);
+					}
+					else
+					{
+						trace(0, rayCount);
+					}
+				});
+
+			uint32_t hitCount = uint32_t(std::count_if(hits.begin(), hits.end(), [](const RayHit& hit) { return hit.object != Bvh::NO_HIT; }));
+			fmt::print("  rays {:<11} {:7.2f} ms  {:6.2f} M rays/s, {} hit\n", fmt::format("{}{}", simd ? "simd" : "scalar",
+				parallel ? " parallel" : ""), rayMilliseconds, rayCount / rayMilliseconds / 1e3, hitCount);
+		}
+	}
+
+	if (passed)
+	{
+		fmt::print(fmt::fg(fmt::color::green), "BVH benchmark passed\n");
+	}
+	else
+	{
+		fmt::print(fmt::fg(fmt::color::red), "BVH benchmark failed, the BVH and the linear paths disagree\n");
+	}
+	return passed;
+}
+
+bool BvhBenchmark::runCommandLine(int argc, char* argv[], int& exitCode)
+{
+	return SceneBenchmark::runCommandLine(argc, argv, exitCode, "--bench-bvh", &run);
+}
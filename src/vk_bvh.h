@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_scene.h"
+
+class JobSystem;
+
+// Four children, bounds stored per axis so one SIMD compare covers all of them. Padded to two cache lines
+struct alignas(64) BvhNode
+{
+	float minX[4];
+	float minY[4];
+	float minZ[4];
+	float maxX[4];
+	float maxY[4];
+	float maxZ[4];
+	// inner node index, LEAF_BIT | object for leaves, EMPTY for unused slots
+	uint32_t child[4];
+	// a bit per used slot, unused ones have inverted bounds which refits can union but rays don't miss
+	uint32_t slotMask;
+	// every object below, for subtrees found entirely inside a frustum
+	uint32_t firstObject;
+	uint32_t objectCount;
+};
+
+struct RayHit
+{
+	// Bvh::NO_HIT when nothing was hit
+	uint32_t object;
+	float distance;
+};
+
+// Bounding volume hierarchy over the world bounds of the Scene objects, one object per leaf. Built
+// top down with binned SAH, large ranges bin on the job pool and their two halves build as separate
+// jobs, then the binary tree is collapsed into four wide nodes laid out breadth first, so every
+// depth is a contiguous range and children always come after their parent. Moving objects refit the
+// bounds above them instead of rebuilding; cost() tracks how much that loosened the tree.
+class Bvh
+{
+public:
+
+	static constexpr uint32_t LEAF_BIT = 1u << 31;
+	static constexpr uint32_t EMPTY = ~0u;
+	static constexpr uint32_t NO_HIT = ~0u;
+	// at most, small ranges use two per object
+	static constexpr uint32_t BIN_COUNT = 16;
+	// ranges larger than this bin in parallel and hand a half to another job
+	static constexpr uint32_t PARALLEL_THRESHOLD = 16384;
+	// nodes per job in the full refit
+	static constexpr uint32_t REFIT_GRAIN = 512;
+
+	// SIMD node tests when the build has them, turned off to compare against the scalar code
+	bool useSimd{ true };
+
+	void build(const Scene& scene, JobSystem* jobs = nullptr);
+	// Every node from the current world bounds, a level at a time from the bottom, spread over jobs when given
+	void refit(const Scene& scene, JobSystem* jobs = nullptr);
+	// Only the nodes above the given objects
+	void refit(const Scene& scene, std::span<const uint32_t> objects);
+
+	uint32_t nodeCount() const { return uint32_t(m_Nodes.size()); }
+	uint32_t objectCount() const { return uint32_t(m_Objects.size()); }
+	uint32_t depth() const { return m_LevelStarts.empty() ? 0 : uint32_t(m_LevelStarts.size()) - 1; }
+	Aabb bounds() const;
+	// SAH cost of the tree in node visits, relative to the root. Compare against the cost right after
+	// build to tell when refits made it worth rebuilding
+	float cost() const;
+
+	// Objects whose world bounds touch the frustum, in no particular order
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+	// Closest object whose world bounds the ray enters. Distances are in multiples of direction, 0 when
+	// the ray starts inside
+	RayHit raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance = std::numeric_limits<float>::max()) const;
+
+private:
+
+	struct BuildNode
+	{
+		Aabb bounds;
+		// children, NO_HIT for leaves
+		uint32_t left;
+		uint32_t right;
+		// range of m_Objects below, a single one for leaves
+		uint32_t first;
+		uint32_t count;
+	};
+
+	struct BuildContext;
+
+	void buildRange(BuildContext& context, uint32_t node, uint32_t begin, uint32_t end);
+	void collapse(const std::vector<BuildNode>& buildNodes);
+	void refitNode(const Scene& scene, uint32_t node);
+
+	// slot bounds hit by the box test, a bit per slot
+	uint32_t intersectFrustum(const BvhNode& node, const Frustum& frustum, uint32_t& fullyInside) const;
+	uint32_t intersectRay(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance,
+		float distances[4]) const;
+
+	std::vector<BvhNode> m_Nodes;
+	std::vector<uint32_t> m_Parents;
+	// first node of every depth, plus the node count at the end
+	std::vector<uint32_t> m_LevelStarts;
+	// objects in tree order, every node's objects are a contiguous range
+	std::vector<uint32_t> m_Objects;
+	// node holding each object's leaf
+	std::vector<uint32_t> m_ObjectNodes;
+	// nodes above the objects of a partial refit
+	std::vector<uint8_t> m_RefitMarks;
+	std::vector<uint32_t> m_RefitNodes;
+};
+
+// "--bench-bvh [objects]": build, refit, cull and ray timings over the cull benchmark's random
+// objects, default one million, checked against the linear paths. Returns true when it ran,
+// exitCode is set to its result
+namespace BvhBenchmark
+{
+	bool run(JobSystem& jobs, uint32_t objectCount);
+	bool runCommandLine(int argc, char* argv[], int& exitCode);
+}
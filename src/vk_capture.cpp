@@ -0,0 +1,357 @@
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/color.h>
+#include <imgui.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include "vk_capture.h"
+#include "vk_engine.h"
+#include "vk_images.h"
+
+static const char* CAPTURE_DIRECTORY = "captures";
+
+// Formats the draw image, the post chain, the upscaler and the swapchain come in
+struct CaptureTexelFormat
+{
+	VkFormat format;
+	uint32_t bytes;
+	const char* name;
+};
+
+static const CaptureTexelFormat CAPTURE_FORMATS[] =
+{
+	{ VK_FORMAT_R8G8B8A8_UNORM, 4, "rgba8" },
+	{ VK_FORMAT_R8G8B8A8_SRGB, 4, "rgba8_srgb" },
+	{ VK_FORMAT_B8G8R8A8_UNORM, 4, "bgra8" },
+	{ VK_FORMAT_B8G8R8A8_SRGB, 4, "bgra8_srgb" },
+	{ VK_FORMAT_B10G11R11_UFLOAT_PACK32, 4, "r11g11b10f" },
+	{ VK_FORMAT_E5B9G9R9_UFLOAT_PACK32, 4, "rgb9e5" },
+	{ VK_FORMAT_R16G16B16A16_SFLOAT, 8, "rgba16f" },
+	{ VK_FORMAT_R32G32B32A32_SFLOAT, 16, "rgba32f" },
+};
+
+static const CaptureTexelFormat* findTexelFormat(VkFormat format)
+{
+	for (const CaptureTexelFormat& texelFormat : CAPTURE_FORMATS)
+	{
+		if (texelFormat.format == format)
+		{
+			return &texelFormat;
+		}
+	}
+	return nullptr;
+}
+
+static void storeRgba8(uint8_t* destination, const glm::vec4& color)
+{
+	glm::vec4 scaled = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+	destination[0] = uint8_t(scaled.r);
+	destination[1] = uint8_t(scaled.g);
+	destination[2] = uint8_t(scaled.b);
+	destination[3] = uint8_t(scaled.a);
+}
+
+// Values go over as they are, like the blit to the unorm swapchain does, float formats clamp
+static void convertToRgba8(VkFormat format, const uint8_t* source, uint8_t* destination, size_t texels)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		memcpy(destination, source, texels * 4);
+		break;
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		for (size_t i = 0; i < texels; i++)
+		{
+			destination[i * 4 + 0] = source[i * 4 + 2];
+			destination[i * 4 + 1] = source[i * 4 + 1];
+			destination[i * 4 + 2] = source[i * 4 + 0];
+			destination[i * 4 + 3] = source[i * 4 + 3];
+		}
+		break;
+	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+	case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+		for (size_t i = 0; i < texels; i++)
+		{
+			uint32_t packed;
+			memcpy(&packed, source + i * 4, sizeof(packed));
+			glm::vec3 color = format == VK_FORMAT_B10G11R11_UFLOAT_PACK32 ? glm::unpackF2x11_1x10(packed) : glm::unpackF3x9_E1x5(packed);
+			storeRgba8(destination + i * 4, glm::vec4(color, 1.0f));
+		}
+		break;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		for (size_t i = 0; i < texels; i++)
+		{
+			uint64_t packed;
+			memcpy(&packed, source + i * 8, sizeof(packed));
+			storeRgba8(destination + i * 4, glm::unpackHalf4x16(packed));
+		}
+		break;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		for (size_t i = 0; i < texels; i++)
+		{
+			glm::vec4 color;
+			memcpy(&color, source + i * 16, sizeof(color));
+			storeRgba8(destination + i * 4, color);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void FrameCapture::init(VulkanEngine* engine)
+{
+	m_Engine = engine;
+
+	// the slots get their buffers on first use, sized for what they are asked to hold
+	engine->m_MainDeletionQueue.pushFunction([this]()
+		{
+			for (Slot& slot : m_Slots)
+			{
+				if (slot.buffer.buffer != VK_NULL_HANDLE)
+				{
+					m_Engine->DestroyBuffer(slot.buffer);
+				}
+			}
+		});
+}
+
+void FrameCapture::requestScreenshot()
+{
+	std::error_code error;
+	std::filesystem::create_directories(CAPTURE_DIRECTORY, error);
+	m_ScreenshotRequested = true;
+}
+
+void FrameCapture::startSequence()
+{
+	// a new folder every time, earlier recordings stay. Folders are made up front, not per frame
+	std::error_code error;
+	do
+	{
+		m_Sequence++;
+	} while (std::filesystem::exists(std::filesystem::path(CAPTURE_DIRECTORY) / fmt::format("sequence_{:03}", m_Sequence), error));
+	std::filesystem::create_directories(std::filesystem::path(CAPTURE_DIRECTORY) / fmt::format("sequence_{:03}", m_Sequence), error);
+	m_SequenceFrame = 0;
+	m_Recording = true;
+}
+
+bool FrameCapture::busy() const
+{
+	for (const Slot& slot : m_Slots)
+	{
+		if (slot.state.load() != SLOT_FREE)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string FrameCapture::nextPath(uint32_t frameNumber, VkExtent2D extent, VkFormat imageFormat)
+{
+	std::filesystem::path directory = CAPTURE_DIRECTORY;
+	std::string name;
+	if (m_Recording)
+	{
+		directory /= fmt::format("sequence_{:03}", m_Sequence);
+		name = fmt::format("frame_{:05}", m_SequenceFrame++);
+	}
+	else
+	{
+		name = fmt::format("screenshot_{:06}", frameNumber);
+	}
+
+	if (format == CAPTURE_RAW)
+	{
+		name += fmt::format("_{}x{}_{}.raw", extent.width, extent.height, findTexelFormat(imageFormat)->name);
+	}
+	else
+	{
+		name += ".png";
+	}
+	return (directory / name).string();
+}
+
+void FrameCapture::record(VkCommandBuffer cmd, VkImage image, VkImageLayout layout, VkExtent2D extent, VkFormat imageFormat, uint32_t frameNumber)
+{
+	const CaptureTexelFormat* texelFormat = findTexelFormat(imageFormat);
+	if (texelFormat == nullptr)
+	{
+		fmt::print(fmt::fg(fmt::color::yellow), "Can't capture images of format {}\n", int(imageFormat));
+		m_ScreenshotRequested = false;
+		m_Recording = false;
+		return;
+	}
+
+	// never waits for a slot, the frame is lost instead
+	Slot* slot = nullptr;
+	for (Slot& candidate : m_Slots)
+	{
+		if (candidate.state.load(std::memory_order_acquire) == SLOT_FREE)
+		{
+			slot = &candidate;
+			break;
+		}
+	}
+	if (slot == nullptr)
+	{
+		m_Dropped++;
+		return;
+	}
+
+	// free slots are neither read by the gpu nor by a job, so they can be regrown right away
+	VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * texelFormat->bytes;
+	if (slot->capacity < size)
+	{
+		if (slot->buffer.buffer != VK_NULL_HANDLE)
+		{
+			m_Engine->DestroyBuffer(slot->buffer);
+		}
+		slot->buffer = m_Engine->CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU, MEMORY_STAGING);
+		slot->capacity = size;
+	}
+
+	VkUtils::transitionImage(cmd, image, layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	VkBufferImageCopy copy{};
+	copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	copy.imageExtent = { extent.width, extent.height, 1 };
+	vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer.buffer, 1, &copy);
+	VkUtils::transitionImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, layout);
+
+	VkMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+	VkDependencyInfo dependencyInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dependencyInfo.memoryBarrierCount = 1;
+	dependencyInfo.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+
+	slot->frame = frameNumber;
+	slot->extent = extent;
+	slot->format = imageFormat;
+	slot->fileFormat = format;
+	slot->path = nextPath(frameNumber, extent, imageFormat);
+	slot->state.store(SLOT_RECORDED, std::memory_order_relaxed);
+	m_LastPath = slot->path;
+	m_Recorded++;
+	m_ScreenshotRequested = false;
+}
+
+void FrameCapture::update(uint32_t frameNumber)
+{
+	for (Slot& slot : m_Slots)
+	{
+		// the fence of the frame that copied into it has been waited on by now
+		if (slot.state.load(std::memory_order_relaxed) == SLOT_RECORDED && frameNumber >= slot.frame + MAX_FRAMES_IN_FLIGHT)
+		{
+			submitWrite(slot);
+		}
+	}
+}
+
+void FrameCapture::flush()
+{
+	for (Slot& slot : m_Slots)
+	{
+		if (slot.state.load(std::memory_order_relaxed) == SLOT_RECORDED)
+		{
+			submitWrite(slot);
+		}
+	}
+}
+
+void FrameCapture::submitWrite(Slot& slot)
+{
+	vmaInvalidateAllocation(m_Engine->m_Memory.allocator(), slot.buffer.allocation, 0, VK_WHOLE_SIZE);
+	slot.state.store(SLOT_WRITING, std::memory_order_relaxed);
+	m_Engine->m_Jobs.submit([this, &slot]()
+		{
+			write(slot);
+		});
+}
+
+void FrameCapture::write(Slot& slot)
+{
+	auto start = std::chrono::steady_clock::now();
+	const uint8_t* data = static_cast<const uint8_t*>(slot.buffer.info.pMappedData);
+	size_t texels = size_t(slot.extent.width) * slot.extent.height;
+
+	bool written = false;
+	if (slot.fileFormat == CAPTURE_RAW)
+	{
+		std::ofstream file(slot.path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(data), std::streamsize(texels * findTexelFormat(slot.format)->bytes));
+		written = file.good();
+	}
+	else
+	{
+		std::vector<uint8_t> pixels(texels * 4);
+		convertToRgba8(slot.format, data, pixels.data(), texels);
+		written = stbi_write_png(slot.path.c_str(), int(slot.extent.width), int(slot.extent.height), 4, pixels.data(), int(slot.extent.width * 4)) != 0;
+	}
+
+	if (written)
+	{
+		m_Written++;
+	}
+	else
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Failed to write {}\n", slot.path);
+		m_Failed++;
+	}
+	m_WriteMilliseconds.store(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+	// the next record may take it again
+	slot.state.store(SLOT_FREE, std::memory_order_release);
+}
+
+void FrameCapture::drawUI()
+{
+	if (ImGui::Begin("capture"))
+	{
+		ImGui::RadioButton("Swapchain", reinterpret_cast<int*>(&source), CAPTURE_SWAPCHAIN);
+		ImGui::SameLine();
+		ImGui::RadioButton("Scene", reinterpret_cast<int*>(&source), CAPTURE_SCENE);
+		ImGui::RadioButton("PNG", reinterpret_cast<int*>(&format), CAPTURE_PNG);
+		ImGui::SameLine();
+		ImGui::RadioButton("Raw", reinterpret_cast<int*>(&format), CAPTURE_RAW);
+
+		if (ImGui::Button("Screenshot"))
+		{
+			requestScreenshot();
+		}
+		ImGui::SameLine();
+		if (m_Recording ? ImGui::Button("Stop recording") : ImGui::Button("Record sequence"))
+		{
+			m_Recording ? stopSequence() : startSequence();
+		}
+
+		uint32_t inFlight = 0;
+		for (const Slot& slot : m_Slots)
+		{
+			inFlight += slot.state.load() != SLOT_FREE;
+		}
+		ImGui::Text("Readbacks in flight: %u of %u", inFlight, READBACK_SLOTS);
+		ImGui::Text("Captured %u, written %u, failed %u, dropped %u", m_Recorded, m_Written.load(), m_Failed.load(), m_Dropped);
+		ImGui::Text("Last write: %.1f ms", m_WriteMilliseconds.load());
+		if (!m_LastPath.empty())
+		{
+			ImGui::TextWrapped("%s", m_LastPath.c_str());
+		}
+	}
+	ImGui::End();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "vk_types.h"
+
+class VulkanEngine;
+
+enum CaptureSource : int
+{
+	// the presented image, UI included
+	CAPTURE_SWAPCHAIN,
+	// the scene after post processing and upscaling, without UI
+	CAPTURE_SCENE
+};
+
+enum CaptureFormat : int
+{
+	CAPTURE_PNG,
+	// the texels as the gpu had them, the size and format go in the file name
+	CAPTURE_RAW
+};
+
+// Screenshots and frame sequences without ever waiting on the gpu. A capture is a copy of the image
+// into one of READBACK_SLOTS persistently mapped buffers, recorded into the frame's own command
+// buffer. Once that frame's fence has been waited on, MAX_FRAMES_IN_FLIGHT frames later, the slot
+// goes to the job pool, which converts and writes it straight out of the mapped memory and frees
+// the slot when done. Frames that find every slot still busy are dropped and counted instead.
+class FrameCapture
+{
+public:
+
+	static constexpr uint32_t READBACK_SLOTS = 8;
+
+	CaptureSource source{ CAPTURE_SWAPCHAIN };
+	CaptureFormat format{ CAPTURE_PNG };
+
+	void init(VulkanEngine* engine);
+
+	void requestScreenshot();
+	// Captures every frame into a new numbered folder until stopped
+	void startSequence();
+	void stopSequence() { m_Recording = false; }
+	bool recording() const { return m_Recording; }
+	// whether this frame should call record
+	bool wantsFrame() const { return m_Recording || m_ScreenshotRequested; }
+	// readbacks waiting on the gpu or on the job pool
+	bool busy() const;
+
+	// Once per frame after the frame fence was waited on: hands the slots whose frame has finished to the job pool
+	void update(uint32_t frameNumber);
+	// Copies the image into a free slot and puts it back into layout. Call after the last write to it
+	void record(VkCommandBuffer cmd, VkImage image, VkImageLayout layout, VkExtent2D extent, VkFormat imageFormat, uint32_t frameNumber);
+	// With the device idle, queues whatever is left so the job pool writes it before shutting down
+	void flush();
+
+	void drawUI();
+
+private:
+
+	enum SlotState : uint32_t
+	{
+		SLOT_FREE,
+		SLOT_RECORDED,
+		SLOT_WRITING
+	};
+
+	struct Slot
+	{
+		AllocatedBuffer buffer{};
+		VkDeviceSize capacity{ 0 };
+		// written by the job that frees the slot
+		std::atomic<uint32_t> state{ SLOT_FREE };
+		uint32_t frame{ 0 };
+		VkExtent2D extent{};
+		VkFormat format{ VK_FORMAT_UNDEFINED };
+		CaptureFormat fileFormat{ CAPTURE_PNG };
+		std::string path;
+	};
+
+	void submitWrite(Slot& slot);
+	// on a job, converts and writes the slot out of its mapped buffer and frees it
+	void write(Slot& slot);
+	std::string nextPath(uint32_t frameNumber, VkExtent2D extent, VkFormat imageFormat);
+
+	VulkanEngine* m_Engine{ nullptr };
+	Slot m_Slots[READBACK_SLOTS];
+
+	bool m_ScreenshotRequested{ false };
+	bool m_Recording{ false };
+	uint32_t m_Sequence{ 0 };
+	uint32_t m_SequenceFrame{ 0 };
+
+	uint32_t m_Recorded{ 0 };
+	uint32_t m_Dropped{ 0 };
+	std::atomic<uint32_t> m_Written{ 0 };
+	std::atomic<uint32_t> m_Failed{ 0 };
+	std::atomic<double> m_WriteMilliseconds{ 0.0 };
+	std::string m_LastPath;
+};
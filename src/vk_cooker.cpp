@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include <fmt/core.h>
+#include <fmt/color.h>
+#include <stb_image.h>
+
+#include "vk_cooker.h"
+#include "vk_jobs.h"
+
+static const char COOKED_TEXTURE_MAGIC[4] = { 'V', 'K', 'T', 'X' };
+static const uint32_t COOKED_TEXTURE_VERSION = 1;
+
+using Clock = std::chrono::steady_clock;
+
+static float srgbToLinear(uint8_t value)
+{
+	float color = value / 255.0f;
+	return color <= 0.04045f ? color / 12.92f : std::pow((color + 0.055f) / 1.055f, 2.4f);
+}
+
+static uint8_t linearToSrgb(float color)
+{
+	color = color <= 0.0031308f ? color * 12.92f : 1.055f * std::pow(color, 1.0f / 2.4f) - 0.055f;
+	return uint8_t(std::clamp(color * 255.0f + 0.5f, 0.0f, 255.0f));
+}
+
+// Next mip level with a 2x2 box filter. Color is averaged in linear space and normals are
+// renormalized, so neither darkens nor flattens down the chain
+static std::vector<uint8_t> downsample(const std::vector<uint8_t>& source, uint32_t width, uint32_t height, const CookSettings& settings)
+{
+	static float srgbTable[256];
+	static bool srgbTableReady = false;
+	if (!srgbTableReady)
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			srgbTable[i] = srgbToLinear(uint8_t(i));
+		}
+		srgbTableReady = true;
+	}
+
+	uint32_t nextWidth = std::max(width / 2, 1u);
+	uint32_t nextHeight = std::max(height / 2, 1u);
+	std::vector<uint8_t> result(size_t(nextWidth) * nextHeight * 4);
+
+	for (uint32_t y = 0; y < nextHeight; y++)
+	{
+		for (uint32_t x = 0; x < nextWidth; x++)
+		{
+			float sum[4] = {};
+			for (uint32_t tap = 0; tap < 4; tap++)
+			{
+				uint32_t sourceX = std::min(x * 2 + (tap & 1), width - 1);
+				uint32_t sourceY = std::min(y * 2 + (tap >> 1), height - 1);
+				const uint8_t* texel = &source[(size_t(sourceY) * width + sourceX) * 4];
+
+				if (settings.normalMap)
+				{
+					float nx = texel[0] / 127.5f - 1.0f;
+					float ny = texel[1] / 127.5f - 1.0f;
+					sum[0] += nx;
+					sum[1] += ny;
+					sum[2] += std::sqrt(std::max(1.0f - nx * nx - ny * ny, 0.0f));
+				}
+				else
+				{
+					for (int c = 0; c < 3; c++)
+					{
+						sum[c] += settings.srgb ? srgbTable[texel[c]] : texel[c] / 255.0f;
+					}
+				}
+				sum[3] += texel[3] / 255.0f;
+			}
+
+			uint8_t* texel = &result[(size_t(y) * nextWidth + x) * 4];
+			if (settings.normalMap)
+			{
+				float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+				length = length > 0.0f ? 1.0f / length : 0.0f;
+				for (int c = 0; c < 3; c++)
+				{
+					texel[c] = uint8_t(std::clamp((sum[c] * length * 0.5f + 0.5f) * 255.0f + 0.5f, 0.0f, 255.0f));
+				}
+			}
+			else
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					float value = sum[c] * 0.25f;
+					texel[c] = settings.srgb ? linearToSrgb(value) : uint8_t(std::clamp(value * 255.0f + 0.5f, 0.0f, 255.0f));
+				}
+			}
+			texel[3] = uint8_t(std::clamp(sum[3] * 0.25f * 255.0f + 0.5f, 0.0f, 255.0f));
+		}
+	}
+
+	return result;
+}
+
+// the channels a format keeps, BC1 drops alpha and BC5 only has two
+static uint32_t formatChannelMask(BCFormat format)
+{
+	switch (format)
+	{
+	case BCFormat::BC1: return 0x7;
+	case BCFormat::BC5: return 0x3;
+	default: return 0xf;
+	}
+}
+
+static double peakSignalToNoise(const uint8_t* original, const uint8_t* decoded, size_t texels, uint32_t channelMask)
+{
+	double squaredError = 0.0;
+	uint32_t channels = 0;
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		if (!(channelMask & (1 << c)))
+		{
+			continue;
+		}
+		channels++;
+		for (size_t i = 0; i < texels; i++)
+		{
+			double difference = double(original[i * 4 + c]) - double(decoded[i * 4 + c]);
+			squaredError += difference * difference;
+		}
+	}
+
+	double meanSquaredError = squaredError / double(texels * channels);
+	return meanSquaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) : 99.0;
+}
+
+bool TextureCooker::cook(JobSystem& jobs, const char* inputPath, const char* outputPath, const CookSettings& settings)
+{
+	CookSettings cookSettings = settings;
+	if (cookSettings.normalMap)
+	{
+		cookSettings.format = BCFormat::BC5;
+		cookSettings.srgb = false;
+	}
+
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(inputPath, &width, &height, &channels, 4);
+	if (!pixels)
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Failed to load {}: {}\n", inputPath, stbi_failure_reason());
+		return false;
+	}
+
+	std::vector<std::vector<uint8_t>> levels;
+	levels.emplace_back(pixels, pixels + size_t(width) * height * 4);
+	stbi_image_free(pixels);
+
+	uint32_t levelWidth = uint32_t(width);
+	uint32_t levelHeight = uint32_t(height);
+	while (levelWidth > 1 || levelHeight > 1)
+	{
+		levels.push_back(downsample(levels.back(), levelWidth, levelHeight, cookSettings));
+		levelWidth = std::max(levelWidth / 2, 1u);
+		levelHeight = std::max(levelHeight / 2, 1u);
+	}
+
+	CookedTextureHeader header{};
+	memcpy(header.magic, COOKED_TEXTURE_MAGIC, sizeof(header.magic));
+	header.version = COOKED_TEXTURE_VERSION;
+	header.format = cookSettings.format;
+	header.flags = (cookSettings.srgb ? uint32_t(COOKED_TEXTURE_SRGB) : 0u) | (cookSettings.normalMap ? uint32_t(COOKED_TEXTURE_NORMAL_MAP) : 0u);
+	header.width = uint32_t(width);
+	header.height = uint32_t(height);
+	header.mipLevels = uint32_t(levels.size());
+
+	Clock::time_point start = Clock::now();
+	std::vector<uint8_t> data;
+	std::vector<uint8_t> firstLevel;
+	for (uint32_t level = 0; level < header.mipLevels; level++)
+	{
+		std::vector<uint8_t> blocks = BCn::encodeImage(jobs, cookSettings.format, cookSettings.quality, levels[level].data(),
+			std::max(header.width >> level, 1u), std::max(header.height >> level, 1u));
+		if (level == 0)
+		{
+			firstLevel = blocks;
+		}
+		data.insert(data.end(), blocks.begin(), blocks.end());
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::ofstream file(outputPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Could not write {}\n", outputPath);
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+
+	size_t uncompressedBytes = 0;
+	for (const std::vector<uint8_t>& level : levels)
+	{
+		uncompressedBytes += level.size();
+	}
+	std::vector<uint8_t> decoded = BCn::decodeImage(cookSettings.format, firstLevel.data(), header.width, header.height);
+	double psnr = peakSignalToNoise(levels[0].data(), decoded.data(), size_t(header.width) * header.height, formatChannelMask(cookSettings.format));
+
+	fmt::print("{} -> {}: {}x{} {} {}, {} mips, {:.1f}:1, {:.2f} dB, {:.1f} MPix/s\n", inputPath, outputPath, header.width, header.height,
+		BCn::formatName(cookSettings.format), BCn::qualityName(cookSettings.quality), header.mipLevels,
+		double(uncompressedBytes) / double(data.size()), psnr, uncompressedBytes / 4 / seconds / 1e6);
+	return true;
+}
+
+// Opens a cooked texture and checks its header, leaves the stream at the first level
+static bool openCooked(const char* path, std::ifstream& file, CookedTextureHeader& header, size_t& fileSize)
+{
+	file.open(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Could not open {}\n", path);
+		return false;
+	}
+
+	fileSize = size_t(file.tellg());
+	file.seekg(0);
+	if (fileSize < sizeof(CookedTextureHeader))
+	{
+		fmt::print(fmt::fg(fmt::color::red), "{} is too small for a cooked texture\n", path);
+		return false;
+	}
+
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (memcmp(header.magic, COOKED_TEXTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != COOKED_TEXTURE_VERSION ||
+		header.format > BCFormat::BC7 || header.mipLevels == 0 || header.mipLevels > 32)
+	{
+		fmt::print(fmt::fg(fmt::color::red), "{} is not a version {} cooked texture\n", path, COOKED_TEXTURE_VERSION);
+		return false;
+	}
+	return true;
+}
+
+bool TextureCooker::readHeader(const char* path, CookedTextureHeader& outHeader)
+{
+	std::ifstream file;
+	size_t fileSize;
+	return openCooked(path, file, outHeader, fileSize);
+}
+
+bool TextureCooker::load(const char* path, CookedTexture& outTexture, uint32_t firstMip, uint32_t levelCount)
+{
+	std::ifstream file;
+	size_t fileSize;
+	CookedTextureHeader& header = outTexture.header;
+	if (!openCooked(path, file, header, fileSize))
+	{
+		return false;
+	}
+	if (firstMip >= header.mipLevels)
+	{
+		fmt::print(fmt::fg(fmt::color::red), "{} has no mip {}\n", path, firstMip);
+		return false;
+	}
+
+	// the skipped levels come first in the file
+	size_t skipped = 0;
+	size_t dataSize = 0;
+	outTexture.mipOffsets.clear();
+	for (uint32_t level = 0; level < header.mipLevels; level++)
+	{
+		size_t levelSize = BCn::imageBytes(header.format, std::max(header.width >> level, 1u), std::max(header.height >> level, 1u));
+		if (level < firstMip)
+		{
+			skipped += levelSize;
+			continue;
+		}
+		if (level - firstMip >= levelCount)
+		{
+			break;
+		}
+		outTexture.mipOffsets.push_back(dataSize);
+		dataSize += levelSize;
+	}
+	if (fileSize - sizeof(header) < skipped + dataSize)
+	{
+		fmt::print(fmt::fg(fmt::color::red), "{} is truncated\n", path);
+		return false;
+	}
+
+	outTexture.data.resize(dataSize);
+	file.seekg(std::streamoff(sizeof(header) + skipped));
+	file.read(reinterpret_cast<char*>(outTexture.data.data()), std::streamsize(dataSize));
+	return true;
+}
+
+// Deterministic test content: soft gradients, fine stripes and hard edges with an alpha ramp,
+// and a normal map of round bumps
+static std::vector<uint8_t> makeColorImage(uint32_t size)
+{
+	std::vector<uint8_t> image(size_t(size) * size * 4);
+	uint32_t noise = 12345;
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			noise = noise * 1664525u + 1013904223u;
+			float u = float(x) / size;
+			float v = float(y) / size;
+			float stripes = 0.5f + 0.5f * std::sin(u * 40.0f + v * 13.0f);
+			bool checker = ((x / 32) + (y / 32)) & 1;
+
+			uint8_t* texel = &image[(size_t(y) * size + x) * 4];
+			texel[0] = uint8_t(std::clamp(255.0f * u * (checker ? 1.0f : 0.6f) + float(noise >> 29), 0.0f, 255.0f));
+			texel[1] = uint8_t(std::clamp(255.0f * (0.3f + 0.7f * stripes * v), 0.0f, 255.0f));
+			texel[2] = uint8_t(std::clamp(255.0f * (1.0f - u) * (1.0f - v) + float((noise >> 26) & 7), 0.0f, 255.0f));
+			texel[3] = uint8_t(255.0f * (0.5f + 0.5f * std::cos(u * 6.0f)));
+		}
+	}
+	return image;
+}
+
+static std::vector<uint8_t> makeNormalImage(uint32_t size)
+{
+	std::vector<uint8_t> image(size_t(size) * size * 4);
+	auto height = [](float x, float y) { return std::sin(x * 0.15f) * std::cos(y * 0.11f) * 4.0f; };
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			float dx = height(x + 1.0f, float(y)) - height(x - 1.0f, float(y));
+			float dy = height(float(x), y + 1.0f) - height(float(x), y - 1.0f);
+			float length = std::sqrt(dx * dx + dy * dy + 4.0f);
+
+			uint8_t* texel = &image[(size_t(y) * size + x) * 4];
+			texel[0] = uint8_t((-dx / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+			texel[1] = uint8_t((-dy / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+			texel[2] = uint8_t((2.0f / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+			texel[3] = 255;
+		}
+	}
+	return image;
+}
+
+bool TextureCooker::runSelfTest(JobSystem& jobs)
+{
+	const uint32_t size = 512;
+	std::vector<uint8_t> colorImage = makeColorImage(size);
+	std::vector<uint8_t> normalImage = makeNormalImage(size);
+
+	struct Case
+	{
+		BCFormat format;
+		const std::vector<uint8_t>* image;
+		// lowest acceptable PSNR of the normal preset, high has to reach at least as much
+		double minimumPsnr;
+	};
+	const Case cases[] =
+	{
+		{ BCFormat::BC1, &colorImage, 33.0 },
+		{ BCFormat::BC3, &colorImage, 33.0 },
+		{ BCFormat::BC5, &normalImage, 40.0 },
+		{ BCFormat::BC7, &colorImage, 38.0 },
+	};
+	const BCQuality qualities[] = { BCQuality::FAST, BCQuality::NORMAL, BCQuality::HIGH };
+
+	fmt::print("Block compression self test, {}x{} images on {} workers\n", size, size, jobs.threadCount());
+	bool passed = true;
+	for (const Case& test : cases)
+	{
+		double normalPsnr = 0.0;
+		for (BCQuality quality : qualities)
+		{
+			Clock::time_point start = Clock::now();
+			std::vector<uint8_t> blocks = BCn::encodeImage(jobs, test.format, quality, test.image->data(), size, size);
+			double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+			std::vector<uint8_t> decoded = BCn::decodeImage(test.format, blocks.data(), size, size);
+			double psnr = peakSignalToNoise(test.image->data(), decoded.data(), size_t(size) * size, formatChannelMask(test.format));
+
+			bool ok = true;
+			if (quality == BCQuality::NORMAL)
+			{
+				normalPsnr = psnr;
+				ok = psnr >= test.minimumPsnr;
+			}
+			else if (quality == BCQuality::HIGH)
+			{
+				ok = psnr >= normalPsnr - 0.01;
+			}
+			passed = passed && ok;
+
+			fmt::print(ok ? fmt::text_style() : fmt::fg(fmt::color::red), "  {} {:<6} {:6.2f} dB {:8.2f} MPix/s{}\n",
+				BCn::formatName(test.format), BCn::qualityName(quality), psnr, double(size) * size / seconds / 1e6, ok ? "" : "  FAILED");
+		}
+	}
+
+	fmt::print(passed ? fmt::fg(fmt::color::green) : fmt::fg(fmt::color::red), "Block compression self test {}\n", passed ? "passed" : "failed");
+	return passed;
+}
+
+bool TextureCooker::runCommandLine(int argc, char* argv[], int& exitCode)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--compression-selftest") == 0)
+		{
+			JobSystem jobs;
+			jobs.init();
+			exitCode = runSelfTest(jobs) ? 0 : 1;
+			jobs.shutdown();
+			return true;
+		}
+
+		if (strcmp(argv[i], "--cook") == 0)
+		{
+			if (i + 2 >= argc)
+			{
+				fmt::print("Usage: --cook <input> <output> [bc1|bc3|bc5|bc7] [fast|normal|high] [--linear] [--normal]\n");
+				exitCode = 1;
+				return true;
+			}
+
+			CookSettings settings;
+			for (int option = i + 3; option < argc; option++)
+			{
+				std::string value = argv[option];
+				if (value == "bc1") settings.format = BCFormat::BC1;
+				else if (value == "bc3") settings.format = BCFormat::BC3;
+				else if (value == "bc5") settings.format = BCFormat::BC5;
+				else if (value == "bc7") settings.format = BCFormat::BC7;
+				else if (value == "fast") settings.quality = BCQuality::FAST;
+				else if (value == "normal") settings.quality = BCQuality::NORMAL;
+				else if (value == "high") settings.quality = BCQuality::HIGH;
+				else if (value == "--linear") settings.srgb = false;
+				else if (value == "--normal") settings.normalMap = true;
+				else fmt::print(fmt::fg(fmt::color::yellow), "Ignoring unknown cook option {}\n", value);
+			}
+
+			JobSystem jobs;
+			jobs.init();
+			exitCode = cook(jobs, argv[i + 1], argv[i + 2], settings) ? 0 : 1;
+			jobs.shutdown();
+			return true;
+		}
+	}
+
+	return false;
+}
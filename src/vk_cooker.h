@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vk_bcn.h"
+
+class JobSystem;
+
+// Cooked texture files (.vktex): this header followed by every mip level's blocks, largest first.
+// Level sizes follow from the format and the extent, so no offsets are stored.
+struct CookedTextureHeader
+{
+	char magic[4];
+	uint32_t version;
+	BCFormat format;
+	uint32_t flags;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipLevels;
+	uint32_t reserved;
+};
+
+enum CookedTextureFlagBits : uint32_t
+{
+	COOKED_TEXTURE_SRGB = 1 << 0,
+	// BC5 tangent space normal, z is rebuilt from x and y
+	COOKED_TEXTURE_NORMAL_MAP = 1 << 1,
+};
+
+struct CookedTexture
+{
+	CookedTextureHeader header;
+	std::vector<uint8_t> data;
+	// byte offset of every mip level that was read into data, starting with the first one read
+	std::vector<size_t> mipOffsets;
+};
+
+struct CookSettings
+{
+	BCFormat format{ BCFormat::BC7 };
+	BCQuality quality{ BCQuality::NORMAL };
+	// color data, mips are filtered in linear space
+	bool srgb{ true };
+	// renormalizes the filtered mips, implies BC5
+	bool normalMap{ false };
+};
+
+// Offline texture processing: decodes an image, builds its mip chain on the cpu and block
+// compresses every level on the job pool
+namespace TextureCooker
+{
+	bool cook(JobSystem& jobs, const char* inputPath, const char* outputPath, const CookSettings& settings);
+	bool readHeader(const char* path, CookedTextureHeader& outHeader);
+	// Reads levelCount levels from firstMip on only, the streamer's way of fetching the levels it is missing
+	bool load(const char* path, CookedTexture& outTexture, uint32_t firstMip = 0, uint32_t levelCount = ~0u);
+
+	// Encodes generated images with every format and quality and reports PSNR and throughput.
+	// Returns false when a format falls below its quality bar, needs no gpu
+	bool runSelfTest(JobSystem& jobs);
+
+	// "--cook <input> <output> [bc1|bc3|bc5|bc7] [fast|normal|high] [--linear] [--normal]" and
+	// "--compression-selftest". Returns true when one of them ran, exitCode is set to its result
+	bool runCommandLine(int argc, char* argv[], int& exitCode);
+}
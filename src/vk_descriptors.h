@@ -1,6 +1,8 @@
 #pragma once
 
+#include <deque>
 #include <span>
+#include <vector>
 
 #include "vk_types.h"
 
@@ -8,7 +10,7 @@ struct DescriptorLayoutBuilder
 {
     std::vector<VkDescriptorSetLayoutBinding> bindings;
 
-    void addBinding(uint32_t binding, VkDescriptorType type);
+    void addBinding(uint32_t binding, VkDescriptorType type, uint32_t count = 1);
     void clear();
     VkDescriptorSetLayout build(VkDevice device, VkShaderStageFlags shaderStages, void* pNext = nullptr, VkDescriptorSetLayoutCreateFlags flags = 0);
 };
@@ -27,4 +29,18 @@ struct DescriptorAllocator
     void clearDescriptors(VkDevice device);
     void destroyPool(VkDevice device);
     VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout);
-};
\ No newline at end of file
+};
+
+// Collects descriptor writes and submits them in one vkUpdateDescriptorSets call
+struct DescriptorWriter
+{
+    std::deque<VkDescriptorImageInfo> imageInfos;
+    std::deque<VkDescriptorBufferInfo> bufferInfos;
+    std::vector<VkWriteDescriptorSet> writes;
+
+    void writeImage(uint32_t binding, VkImageView image, VkSampler sampler, VkImageLayout layout, VkDescriptorType type, uint32_t arrayElement = 0);
+    void writeBuffer(uint32_t binding, VkBuffer buffer, size_t size, size_t offset, VkDescriptorType type);
+
+    void clear();
+    void updateSet(VkDevice device, VkDescriptorSet set);
+};
@@ -1,7 +1,12 @@
+#include <algorithm>
 #include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
 #define VMA_IMPLEMENTATION
 #include "vk_mem_alloc.h"
 #include <VkBootstrap.h>
@@ -15,6 +20,18 @@
 #include "vk_engine.h"
 #include "vk_pipelines.h"
 
+// post processing samples the draw image for bloom and the resolve, the blit path copies from it.
+// Only formats that can be rendered to get the attachment usage, rgb9e5 can't
+static VkImageUsageFlags drawImageUsage(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (VkUtils::formatFeatures(physicalDevice, format) & VK_FORMAT_FEATURE_2_COLOR_ATTACHMENT_BIT)
+	{
+		usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	}
+	return usage;
+}
+
 #ifdef NDEBUG
 static const bool bUseValidationLayers = false;
 #else
@@ -25,17 +42,41 @@ void VulkanEngine::Init()
 {
 	fmt::print(fmt::fg(fmt::color::green), "Application Created\n");
 
+	// the null platform has no display connection, only the Vulkan surface
+	if (m_Headless)
+	{
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	}
 	glfwInit();
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 	m_Window = glfwCreateWindow(m_WindowExtent.width, m_WindowExtent.height, "Vulkan Engine", nullptr, nullptr);
 
+	glfwSetWindowUserPointer(m_Window, this);
+	glfwSetFramebufferSizeCallback(m_Window, [](GLFWwindow* window, int width, int height)
+		{
+			static_cast<VulkanEngine*>(glfwGetWindowUserPointer(window))->m_ResizeRequested = true;
+		});
+	// the event loop is blocked while the window is dragged on some platforms, keep presenting from here
+	glfwSetWindowRefreshCallback(m_Window, [](GLFWwindow* window)
+		{
+			VulkanEngine* engine = static_cast<VulkanEngine*>(glfwGetWindowUserPointer(window));
+			if (engine->m_IsInitialized && ImGui::GetDrawData())
+			{
+				engine->DrawFrame();
+			}
+		});
+
+	m_Jobs.init();
+
 	InitVulkan();
+	QueryDrawFormats();
 	InitSwapchain();
 	InitCommands();
 	InitSyncStructures();
 	InitDescriptors();
 	InitPipelines();
+	InitScene();
 	InitImGui();
 
 	m_IsInitialized = true;
@@ -45,6 +86,10 @@ void VulkanEngine::Cleanup()
 	if (m_IsInitialized)
 	{
 		vkDeviceWaitIdle(m_Device);
+		// captures of the last frames still get written
+		m_Capture.flush();
+		// decode jobs hand their results to the texture loader, let them finish before it goes
+		m_Jobs.shutdown();
 
 		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 		{
@@ -56,6 +101,7 @@ void VulkanEngine::Cleanup()
 
 			m_Frames[i].deletionQueue.flush();
 		}
+		m_UnsubmittedDeletions.flush();
 
 		// Flush global deletion queue
 		m_MainDeletionQueue.flush();
@@ -74,36 +120,317 @@ void VulkanEngine::Cleanup()
 	}
 }
 
+// FNV-1a style hash for change tracking, eight bytes at a time since it also runs over the UI vertices
+static void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, bytes + i, sizeof(word));
+		hash = (hash ^ word) * 1099511628211ull;
+		hash ^= hash >> 32;
+	}
+	for (; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+}
+
+template<typename T>
+static void hashValue(uint64_t& hash, const T& value)
+{
+	hashBytes(hash, &value, sizeof(T));
+}
+
+static void hashDrawData(uint64_t& hash, const ImDrawData* drawData)
+{
+	if (!drawData)
+	{
+		return;
+	}
+
+	hashValue(hash, drawData->DisplayPos);
+	hashValue(hash, drawData->DisplaySize);
+	hashValue(hash, drawData->FramebufferScale);
+	for (const ImDrawList* list : drawData->CmdLists)
+	{
+		hashBytes(hash, list->VtxBuffer.Data, list->VtxBuffer.size_in_bytes());
+		hashBytes(hash, list->IdxBuffer.Data, list->IdxBuffer.size_in_bytes());
+		for (const ImDrawCmd& command : list->CmdBuffer)
+		{
+			hashValue(hash, command.ClipRect);
+			hashValue(hash, command.GetTexID());
+			hashValue(hash, command.VtxOffset);
+			hashValue(hash, command.IdxOffset);
+			hashValue(hash, command.ElemCount);
+			hashValue(hash, command.UserCallback);
+		}
+	}
+}
+
+// any input the UI saw this frame, hovering and dragging included
+static bool imguiReceivedInput()
+{
+	const ImGuiIO& io = ImGui::GetIO();
+	if (io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f || io.MouseWheel != 0.0f || io.MouseWheelH != 0.0f ||
+		!io.InputQueueCharacters.empty() || ImGui::IsAnyMouseDown() || ImGui::IsAnyItemActive())
+	{
+		return true;
+	}
+
+	for (int key = ImGuiKey_NamedKey_BEGIN; key < ImGuiKey_NamedKey_END; key++)
+	{
+		if (ImGui::IsKeyDown(ImGuiKey(key)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+uint64_t VulkanEngine::HashSceneState(VkExtent2D outputExtent) const
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	// reallocated images come with new handles and undefined contents
+	hashValue(hash, m_DrawImage.image);
+	hashValue(hash, m_DrawExtent);
+	hashValue(hash, outputExtent);
+
+	hashValue(hash, m_CurrentBGEffect);
+	hashValue(hash, m_BGEffects[m_CurrentBGEffect].pipeline);
+	hashValue(hash, m_BGEffects[m_CurrentBGEffect].data);
+
+	for (const PostPass& pass : m_PostProcess.passes)
+	{
+		hashValue(hash, pass.enabled);
+	}
+	hashValue(hash, m_PostProcess.fusePasses);
+	hashValue(hash, m_PostProcess.effect.data);
+
+	hashValue(hash, m_Upscaler.enabled);
+	hashValue(hash, m_Upscaler.historyWeight);
+	hashValue(hash, m_Upscaler.sharpness);
+
+	// streamed in or evicted mips
+	hashValue(hash, m_Streamer.version());
+
+	hashValue(hash, m_SceneVersion);
+	hashValue(hash, m_CameraTarget);
+	hashValue(hash, m_CameraYaw);
+	hashValue(hash, m_CameraPitch);
+	hashValue(hash, m_CameraDistance);
+	hashValue(hash, m_CameraFov);
+	hashValue(hash, m_MeshPass.enabled);
+	hashValue(hash, m_MeshPass.batcher.merge);
+	hashValue(hash, m_MeshPass.batcher.depthBuckets);
+	hashValue(hash, m_MeshPass.lodThreshold);
+	hashValue(hash, m_MeshPass.lodHysteresis);
+	hashValue(hash, m_MeshPass.forcedLod);
+	hashValue(hash, m_Lights.enabled);
+	hashValue(hash, m_Lights.version());
+	hashValue(hash, m_Shadows.enabled);
+	hashValue(hash, m_Shadows.caching);
+	hashValue(hash, m_Shadows.sunDirection);
+	hashValue(hash, m_Shadows.distance);
+	hashValue(hash, m_Shadows.splitLambda);
+	hashValue(hash, m_Shadows.version());
+
+	return hash;
+}
+
 void VulkanEngine::DrawFrame()
 {
 	// Wait until the gpu has finished rendering the last frame. Timeout of 1e9 ns
+	double waitStart = glfwGetTime();
 	VK_CHECK(vkWaitForFences(m_Device, 1, &GetCurrentFrame().renderFence, true, 1000000000));
+	m_Activity.addWaitTime(glfwGetTime() - waitStart);
 	GetCurrentFrame().deletionQueue.flush();
-	VK_CHECK(vkResetFences(m_Device, 1, &GetCurrentFrame().renderFence));
+	m_FrameRing.beginFrame(m_FrameNumber);
+
+	if (m_ResizeRequested)
+	{
+		ResizeSwapchain();
+		// still minimized, nothing to present to
+		if (m_ResizeRequested)
+		{
+			m_UnsubmittedDeletions.append(GetCurrentFrame().deletionQueue);
+			return;
+		}
+	}
 
 	uint32_t swapchainImageIndex;
-	VK_CHECK(vkAcquireNextImageKHR(m_Device, m_Swapchain, 1000000000, GetCurrentFrame().swapchainSemaphore, nullptr, &swapchainImageIndex));
+	waitStart = glfwGetTime();
+	VkResult acquireResult = vkAcquireNextImageKHR(m_Device, m_Swapchain, 1000000000, GetCurrentFrame().swapchainSemaphore, nullptr, &swapchainImageIndex);
+	m_Activity.addWaitTime(glfwGetTime() - waitStart);
+	if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		// nothing was submitted, the fence is left signaled for the next attempt. So waiting on it says
+		// nothing about the other frame in flight, which may still use what the resize just retired
+		m_ResizeRequested = true;
+		m_UnsubmittedDeletions.append(GetCurrentFrame().deletionQueue);
+		return;
+	}
+	if (acquireResult == VK_SUBOPTIMAL_KHR)
+	{
+		// the image is still presentable, rebuild on the next frame
+		m_ResizeRequested = true;
+	}
+	else
+	{
+		VK_CHECK(acquireResult);
+	}
+
+	// only reset once work is certain to be submitted with it
+	VK_CHECK(vkResetFences(m_Device, 1, &GetCurrentFrame().renderFence));
 
 	VkCommandBuffer currentCMD = GetCurrentFrame().commandBuffer;
 	VK_CHECK(vkResetCommandBuffer(currentCMD, 0));
 
-	m_DrawExtent.width = m_DrawImage.imageExtent.width;
-	m_DrawExtent.height = m_DrawImage.imageExtent.height;
+	// scale from the GPU time of the latest frame the profiler has results for
+	m_DynamicResolution.update(m_Profiler.find("frame"), m_Profiler.resultsFrameNumber());
+	VkExtent2D outputExtent =
+	{
+		std::min(m_SwapchainExtent.width, m_DrawImage.imageExtent.width),
+		std::min(m_SwapchainExtent.height, m_DrawImage.imageExtent.height)
+	};
+	// temporal upscaling shades below the output resolution on top of the dynamic scale
+	VkExtent2D renderExtent = outputExtent;
+	if (m_Upscaler.enabled)
+	{
+		renderExtent.width = std::max(uint32_t(outputExtent.width * m_Upscaler.renderScale), 1u);
+		renderExtent.height = std::max(uint32_t(outputExtent.height * m_Upscaler.renderScale), 1u);
+	}
+	m_DrawExtent = m_DynamicResolution.apply(renderExtent);
 
 	// Tell gpu that 1 submit per frame is happening so it optimizes for that
 	VkCommandBufferBeginInfo currentCMDBeginInfo = VkInit::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 	VK_CHECK(vkBeginCommandBuffer(currentCMD, &currentCMDBeginInfo));
 
-	VkUtils::transitionImage(currentCMD, m_DrawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-	
-	DrawBackground(currentCMD);
+	// cached frames get their own scope so dynamic resolution only sees the cost of real renders
+	m_Profiler.beginFrame(currentCMD, m_FrameNumber);
+	// budgets, and the next defragmentation pass whose copies go in front of the frame
+	m_Memory.update(currentCMD, m_FrameNumber);
+	// finished decodes get uploaded and their mips built before anything in the frame samples them
+	m_Textures.update(currentCMD, m_Profiler, m_FrameNumber);
+	// last feedback read back, mips that arrived swapped in and evictions recorded
+	m_Streamer.update(currentCMD, m_FrameNumber);
+	// captures whose frame has finished go to the job pool to be written
+	m_Capture.update(m_FrameNumber);
+	UpdateScene(currentCMD);
+
+	// unchanged scenes skip straight to the resolve of the previous result. After the scene update,
+	// so objects that moved this frame are drawn this frame
+	bool renderScene = m_Activity.needsSceneRender(HashSceneState(outputExtent), m_Upscaler.enabled) || m_SceneResult == nullptr ||
+		m_SceneResultIncomplete || m_LightBenchmark.running();
+	uint32_t frameScope = m_Profiler.beginScope(currentCMD, renderScene ? "frame" : "cached frame");
+
+	if (renderScene)
+	{
+		VkUtils::transitionImage(currentCMD, m_DrawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+		if (m_Upscaler.enabled)
+		{
+			m_Upscaler.clearMotionVectors(currentCMD);
+		}
+
+		// everything recorded before went around the recorder
+		m_Recorder.begin(currentCMD);
+		uint32_t backgroundScope = m_Profiler.beginScope(currentCMD, "background");
+		DrawBackground(currentCMD);
+		m_Profiler.endScope(currentCMD, backgroundScope);
+
+		uint32_t meshScope = m_Profiler.beginScope(currentCMD, "meshes");
+		DrawMeshes(currentCMD);
+		m_Profiler.endScope(currentCMD, meshScope);
+		// and so does everything after
+		m_Recorder.invalidate();
+		// meshes or lights were skipped, the ring is grown by the time this frame slot comes around again
+		m_SceneResultIncomplete = m_FrameRing.overflowed();
+
+		// the chain either works in place on the draw image or hands back its scratch image
+		m_SceneResult = &m_PostProcess.draw(currentCMD, m_Profiler);
+		m_SceneResultExtent = m_DrawExtent;
+		m_SceneResultLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		if (m_Upscaler.enabled)
+		{
+			m_SceneResult = &m_Upscaler.draw(currentCMD, *m_SceneResult, m_DrawExtent, outputExtent, m_Profiler);
+			m_SceneResultExtent = outputExtent;
+		}
+		else
+		{
+			// start from a clean history whenever it gets turned back on
+			m_Upscaler.reset();
+		}
+	}
+
+	AllocatedImage* resultImage = m_SceneResult;
+	VkExtent2D resultExtent = m_SceneResultExtent;
+
+	// ImGui goes into the cached overlay the compute resolve composites, or straight into the swapchain.
+	// The resolve binds the overlay either way, so it gets initialised once even when unused
+	bool computeResolve = m_UseComputeResolve && m_SwapchainStorage;
+	bool useOverlay = m_CacheOverlay && computeResolve;
+	if (useOverlay || (computeResolve && !m_OverlayValid))
+	{
+		DrawOverlay(currentCMD);
+	}
 
-	VkUtils::transitionImage(currentCMD, m_DrawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-	VkUtils::transitionImage(currentCMD, m_SwapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	VkUtils::copyImageToImage(currentCMD, m_DrawImage.image, m_SwapchainImages[swapchainImageIndex], m_DrawExtent, m_SwapchainExtent);
-	VkUtils::transitionImage(currentCMD, m_SwapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-	DrawImgui(currentCMD, m_SwapchainImageViews[swapchainImageIndex]);
-	VkUtils::transitionImage(currentCMD, m_SwapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	if (computeResolve)
+	{
+		// sample the result in place and write the swapchain directly, no transfer layouts involved
+		uint32_t resolveScope = m_Profiler.beginScope(currentCMD, "resolve");
+		if (m_SceneResultLayout == VK_IMAGE_LAYOUT_GENERAL)
+		{
+			VkUtils::computeBarrier(currentCMD);
+		}
+		else
+		{
+			// a cached result the blit path left behind
+			VkUtils::transitionImage(currentCMD, resultImage->image, m_SceneResultLayout, VK_IMAGE_LAYOUT_GENERAL);
+			m_SceneResultLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+		VkUtils::transitionImage(currentCMD, m_SwapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+		DrawResolve(currentCMD, *resultImage, resultExtent, swapchainImageIndex, useOverlay);
+		VkUtils::transitionImage(currentCMD, m_SwapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_GENERAL,
+			useOverlay ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		m_Profiler.endScope(currentCMD, resolveScope);
+	}
+	else
+	{
+		uint32_t blitScope = m_Profiler.beginScope(currentCMD, "blit");
+		VkUtils::transitionImage(currentCMD, resultImage->image, m_SceneResultLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		m_SceneResultLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		VkUtils::transitionImage(currentCMD, m_SwapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		VkUtils::copyImageToImage(currentCMD, resultImage->image, m_SwapchainImages[swapchainImageIndex], resultExtent, m_SwapchainExtent);
+		VkUtils::transitionImage(currentCMD, m_SwapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		m_Profiler.endScope(currentCMD, blitScope);
+	}
+	if (!useOverlay)
+	{
+		uint32_t uiScope = m_Profiler.beginScope(currentCMD, "ui");
+		DrawImgui(currentCMD, m_SwapchainImageViews[swapchainImageIndex]);
+		m_Profiler.endScope(currentCMD, uiScope);
+		VkUtils::transitionImage(currentCMD, m_SwapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	}
+
+	// copied into a readback buffer inside this command buffer, written out a couple of frames later
+	if (m_Capture.wantsFrame())
+	{
+		if (m_Capture.source == CAPTURE_SWAPCHAIN && m_SwapchainReadable)
+		{
+			m_Capture.record(currentCMD, m_SwapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, m_SwapchainExtent, m_SwapchainFormat,
+				m_FrameNumber);
+		}
+		else
+		{
+			m_Capture.record(currentCMD, resultImage->image, m_SceneResultLayout, resultExtent, resultImage->imageFormat, m_FrameNumber);
+		}
+	}
+
+	m_Profiler.endScope(currentCMD, frameScope);
 
 	VK_CHECK(vkEndCommandBuffer(currentCMD));
 
@@ -120,13 +447,8 @@ void VulkanEngine::DrawFrame()
 	//submit command buffer to the queue and execute it.
 	// _renderFence will now block until the graphic commands finish execution
 	VK_CHECK(vkQueueSubmit2(m_GraphicsQueue, 1, &submit, GetCurrentFrame().renderFence));
-
-	ImGuiIO& io = ImGui::GetIO(); (void)io;
-	if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
-	{
-		ImGui::UpdatePlatformWindows();
-		ImGui::RenderPlatformWindowsDefault();
-	}
+	// the fence also covers every submit before this one
+	GetCurrentFrame().deletionQueue.append(m_UnsubmittedDeletions);
 
 	//prepare present
 	// this will put the image we just rendered to into the visible window.
@@ -141,7 +463,21 @@ void VulkanEngine::DrawFrame()
 	presentInfo.waitSemaphoreCount = 1;
 	presentInfo.pImageIndices = &swapchainImageIndex;
 
-	VK_CHECK(vkQueuePresentKHR(m_GraphicsQueue, &presentInfo));
+	waitStart = glfwGetTime();
+	VkResult presentResult = vkQueuePresentKHR(m_GraphicsQueue, &presentInfo);
+	m_Activity.addWaitTime(glfwGetTime() - waitStart);
+	if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+	{
+		m_ResizeRequested = true;
+	}
+	else
+	{
+		VK_CHECK(presentResult);
+	}
+
+	double gpuMilliseconds = std::max(m_Profiler.find("frame"), m_Profiler.find("cached frame"));
+	m_Activity.endFrame(renderScene, gpuMilliseconds, m_Profiler.resultsFrameNumber());
+	m_LightBenchmark.update(m_Profiler, m_Lights);
 
 	m_FrameNumber++;
 }
@@ -175,20 +511,43 @@ void VulkanEngine::MainLoop()
 {
 	while (!glfwWindowShouldClose(m_Window))
 	{
-		//if (glfwGetWindowAttrib(m_Window, GLFW_ICONIFIED))
-		//{
-		//	// Window is minimized, skip rendering
-		//	std::this_thread::sleep_for(std::chrono::milliseconds(100));
-		//	continue;
-		//}
+		// nothing changed for a while, sleep until an event arrives or the stats are due
+		double waitStart = glfwGetTime();
+		if (m_Activity.isIdle())
+		{
+			glfwWaitEventsTimeout(m_Activity.idleTimeout);
+		}
+		else
+		{
+			glfwPollEvents();
+		}
+		m_Activity.addWaitTime(glfwGetTime() - waitStart);
 
-		glfwPollEvents();
+		// minimized, sleep instead of spinning on a zero sized swapchain or rebuilding a UI nobody sees
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(m_Window, &framebufferWidth, &framebufferHeight);
+		if (framebufferWidth == 0 || framebufferHeight == 0 || glfwGetWindowAttrib(m_Window, GLFW_ICONIFIED))
+		{
+			waitStart = glfwGetTime();
+			glfwWaitEventsTimeout(m_Activity.idleTimeout);
+			m_Activity.addWaitTime(glfwGetTime() - waitStart);
+			continue;
+		}
 
 		// imgui new frame
 		ImGui_ImplVulkan_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
 
+		// whatever the UI reacts to keeps the loop at full rate until it settles
+		m_UIInput = imguiReceivedInput();
+		// loads in flight finish without waiting for the next input event
+		if (m_UIInput || m_Textures.loading() || m_Streamer.busy() || m_AnimateScene || (m_Lights.enabled && m_Lights.animate) ||
+			m_LightBenchmark.running() || m_Capture.recording())
+		{
+			m_Activity.markActive();
+		}
+
 		//some imgui UI to test
 		//ImGui::ShowDemoWindow();
 
@@ -198,10 +557,166 @@ void VulkanEngine::MainLoop()
 
 			ImGui::Text("Selected effect: ", selected.name);
 			ImGui::SliderInt("Effect Index", &m_CurrentBGEffect, 0, m_BGEffects.size() - 1);
-			ImGui::ColorEdit4("data1", (float*)&selected.data.data1);
-			ImGui::ColorEdit4("data2", (float*)&selected.data.data2);
-			ImGui::ColorEdit4("data3", (float*)&selected.data.data3);
-			ImGui::ColorEdit4("data4", (float*)&selected.data.data4);
+			ImGui::Text("Workgroup: %ux%u", selected.workgroupSize.x, selected.workgroupSize.y);
+			ImGui::Text("Variant: %s", VkUtils::shaderPermutationLabel(selected.permutation).c_str());
+			ImGui::Text("Subgroup size: %u", selected.subgroupSize ? selected.subgroupSize : m_DeviceCaps.subgroupSize);
+			if (selected.streamedTextures)
+			{
+				// zooming out drops the requested mips, zooming in streams finer ones
+				ImGui::SliderFloat("Tile size", &selected.data.data1.x, 4.0f, 4096.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+				ImGui::DragFloat2("Pan", &selected.data.data1.y, 4.0f);
+				ImGui::SliderFloat("Columns", &selected.data.data1.w, 1.0f, 32.0f, "%.0f");
+				ImGui::SliderFloat("Lod bias", &selected.data.data2.x, -2.0f, 2.0f);
+				bool tint = selected.data.data2.y > 0.5f;
+				if (ImGui::Checkbox("Tint by mip", &tint))
+				{
+					selected.data.data2.y = tint ? 1.0f : 0.0f;
+				}
+			}
+			else
+			{
+				ImGui::ColorEdit4("data1", (float*)&selected.data.data1);
+				ImGui::ColorEdit4("data2", (float*)&selected.data.data2);
+				ImGui::ColorEdit4("data3", (float*)&selected.data.data3);
+				ImGui::ColorEdit4("data4", (float*)&selected.data.data4);
+			}
+		}
+		ImGui::End();
+
+		m_PostProcess.drawUI(m_Profiler);
+		m_Memory.drawUI();
+		m_Textures.drawUI();
+		m_Streamer.drawUI();
+		m_Capture.drawUI();
+
+		if (ImGui::Begin("scene"))
+		{
+			ImGui::Text("%u nodes in %u levels", m_Hierarchy.size(), m_Hierarchy.levelCount());
+			ImGui::Checkbox("Animate", &m_AnimateScene);
+			ImGui::SliderInt("Animated level", &m_AnimatedLevel, 0, int(m_Hierarchy.levelCount()) - 1);
+			ImGui::SliderInt("Every nth node", &m_AnimatedStride, 1, 64);
+			ImGui::Text("World matrices updated: %u, %.3f ms", m_SceneUpdatedNodes, m_SceneUpdateMilliseconds);
+			ImGui::Text("Instances uploaded: %u in %u regions", m_Instances.uploadedInstances(), m_Instances.uploadedRegions());
+			ImGui::Text("Upload: %.1f of %.1f KB", m_Instances.uploadedBytes() / 1024.0, m_Instances.bufferBytes() / 1024.0);
+
+			ImGui::Separator();
+			ImGui::DragFloat3("Camera target", &m_CameraTarget.x, 0.1f);
+			ImGui::SliderFloat("Camera yaw", &m_CameraYaw, -180.0f, 180.0f);
+			ImGui::SliderFloat("Camera pitch", &m_CameraPitch, -89.0f, 89.0f);
+			ImGui::SliderFloat("Camera distance", &m_CameraDistance, 1.0f, 100.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+			ImGui::SliderFloat("Field of view", &m_CameraFov, 20.0f, 120.0f);
+			m_MeshPass.drawUI();
+			ImGui::Text("%zu of %u objects visible, meshes %.3f ms", m_VisibleObjects.size(), m_Scene.size(), m_Profiler.find("meshes"));
+
+			ImGui::Separator();
+			m_Shadows.drawUI(m_Profiler.find("shadows"));
+
+			ImGui::Separator();
+			m_Lights.drawUI();
+			ImGui::Text("Light binning: %.3f ms", m_Profiler.find("lights"));
+			if (m_LightBenchmark.running())
+			{
+				ImGui::Text("Benchmarking light counts, step %u of %u", m_LightBenchmark.step() + 1, m_LightBenchmark.stepCount());
+			}
+			else if (ImGui::Button("Benchmark light counts"))
+			{
+				// results go to the console
+				m_LightBenchmark.start(m_Lights);
+			}
+			ImGui::Separator();
+
+			ImGui::Text("Frame ring: %.1f of %.1f KB", m_FrameRing.used() / 1024.0, m_FrameRing.capacity() / 1024.0);
+			// of the last rendered frame, recorded and dropped as redundant
+			const CommandRecorder::Stats& binds = m_Recorder.stats();
+			ImGui::Text("Pipeline binds: %u, %u skipped", binds.pipelineBinds, binds.pipelineBindsSkipped);
+			ImGui::Text("Descriptor binds: %u, %u skipped", binds.descriptorBinds, binds.descriptorBindsSkipped);
+			ImGui::Text("Push constants: %u, %u skipped", binds.pushConstants, binds.pushConstantsSkipped);
+
+			ImGui::Separator();
+			ImGui::Text("BVH: %u nodes, depth %u", m_Bvh.nodeCount(), m_Bvh.depth());
+			ImGui::Text("Cost %.1f, %.1f when built, %u rebuilds", m_Bvh.cost(), m_BvhBuiltCost, m_BvhRebuilds);
+			ImGui::Text("Last build or refit: %.3f ms", m_BvhMilliseconds);
+			ImGui::SliderFloat("Rebuild at cost ratio", &m_BvhRebuildRatio, 1.05f, 4.0f);
+
+			ImGui::DragFloat3("Pick origin", &m_PickOrigin.x, 0.1f);
+			ImGui::DragFloat3("Pick direction", &m_PickDirection.x, 0.01f);
+			RayHit hit = { Bvh::NO_HIT, 0.0f };
+			if (glm::length(m_PickDirection) > 0.0f)
+			{
+				hit = m_Bvh.raycast(m_PickOrigin, glm::normalize(m_PickDirection));
+			}
+			if (hit.object != Bvh::NO_HIT)
+			{
+				ImGui::Text("Hit object %u at %.2f", hit.object, hit.distance);
+			}
+			else
+			{
+				ImGui::Text("Nothing hit");
+			}
+		}
+		ImGui::End();
+
+		if (ImGui::Begin("output"))
+		{
+			if (m_SwapchainStorage)
+			{
+				ImGui::Checkbox("Compute resolve", &m_UseComputeResolve);
+				ImGui::CheckboxFlags("Tonemap", &m_ResolveFlags, RESOLVE_TONEMAP);
+				ImGui::CheckboxFlags("Encode sRGB", &m_ResolveFlags, RESOLVE_ENCODE_SRGB);
+				ImGui::CheckboxFlags("Dither", &m_ResolveFlags, RESOLVE_DITHER);
+			}
+			else
+			{
+				ImGui::Text("Swapchain has no storage usage, blitting");
+			}
+			ImGui::Text("GPU frame: %.3f ms", m_Activity.stats().gpuMilliseconds);
+
+			if (ImGui::BeginCombo("Draw format", m_DrawFormats[m_DrawFormatIndex].name))
+			{
+				for (int i = 0; i < int(m_DrawFormats.size()); i++)
+				{
+					const DrawFormatOption& option = m_DrawFormats[i];
+					ImGuiSelectableFlags flags = option.supported ? 0 : ImGuiSelectableFlags_Disabled;
+					if (ImGui::Selectable(option.name, i == m_DrawFormatIndex, flags))
+					{
+						SetDrawFormat(i);
+					}
+				}
+				ImGui::EndCombo();
+			}
+
+			ImGui::Separator();
+			ImGui::Checkbox("Dynamic resolution", &m_DynamicResolution.enabled);
+			ImGui::SliderFloat("Frame budget (ms)", &m_DynamicResolution.targetMilliseconds, 2.0f, 33.3f);
+			ImGui::SliderFloat("Min scale", &m_DynamicResolution.minScale, 0.25f, m_DynamicResolution.maxScale);
+			ImGui::SliderFloat("Max scale", &m_DynamicResolution.maxScale, m_DynamicResolution.minScale, 1.0f);
+			ImGui::Text("Render scale: %.2f (%ux%u)", m_DynamicResolution.scale, m_DrawExtent.width, m_DrawExtent.height);
+
+			ImGui::Separator();
+			ImGui::Checkbox("Temporal upscaling", &m_Upscaler.enabled);
+			ImGui::SliderFloat("Upscale render scale", &m_Upscaler.renderScale, 0.5f, 1.0f);
+			ImGui::SliderFloat("History weight", &m_Upscaler.historyWeight, 0.5f, 0.98f);
+			ImGui::SliderFloat("Upscale sharpness", &m_Upscaler.sharpness, 0.0f, 1.0f);
+			ImGui::Text("Upscale: %.3f ms", m_Profiler.find("upscale"));
+			ImGui::Text("Resolve: %.3f ms", m_UseComputeResolve && m_SwapchainStorage ? m_Profiler.find("resolve") : m_Profiler.find("blit"));
+			ImGui::Checkbox("Cached UI overlay", &m_CacheOverlay);
+			double uiMilliseconds = m_Profiler.find("ui");
+			if (uiMilliseconds >= 0.0)
+			{
+				ImGui::Text("UI: %.3f ms", uiMilliseconds);
+			}
+			else
+			{
+				ImGui::Text("UI: cached");
+			}
+
+			ImGui::Separator();
+			const FrameActivity::Stats& stats = m_Activity.stats();
+			ImGui::Checkbox("Re-present unchanged frames", &m_Activity.cacheScene);
+			ImGui::Checkbox("Sleep when idle", &m_Activity.throttle);
+			ImGui::Text("%s: %.1f fps, %.1f scene renders/s", m_Activity.isIdle() ? "Idle" : "Active", stats.framesPerSecond, stats.sceneFramesPerSecond);
+			ImGui::Text("CPU: %.2f ms/frame, %.0f%% busy", stats.cpuMilliseconds, stats.cpuBusy * 100.0f);
+			ImGui::Text("GPU: %.0f%% busy", stats.gpuBusy * 100.0f);
 		}
 		ImGui::End();
 
@@ -210,6 +725,27 @@ void VulkanEngine::MainLoop()
 
 		AddFPSToTitle();
 		DrawFrame();
+
+		// after the main window, once per ImGui frame since DrawFrame can also run from the refresh callback
+		ImGuiIO& io = ImGui::GetIO(); (void)io;
+		if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
+		{
+			ImGui::UpdatePlatformWindows();
+
+			// the other OS windows keep their last image, they are only re-rendered when their contents change
+			uint64_t platformHash = 14695981039346656037ull;
+			const ImGuiPlatformIO& platformIO = ImGui::GetPlatformIO();
+			for (int i = 1; i < platformIO.Viewports.Size; i++)
+			{
+				hashValue(platformHash, platformIO.Viewports[i]->ID);
+				hashDrawData(platformHash, platformIO.Viewports[i]->DrawData);
+			}
+			if (!m_CacheOverlay || m_UIInput || platformHash != m_PlatformWindowsHash)
+			{
+				m_PlatformWindowsHash = platformHash;
+				ImGui::RenderPlatformWindowsDefault();
+			}
+		}
 	}
 }
 
@@ -217,6 +753,18 @@ void VulkanEngine::InitVulkan()
 {
 	vkb::InstanceBuilder builder;
 
+	// vk-bootstrap only knows the surface extensions of the real window systems
+	if (m_Headless)
+	{
+		uint32_t extensionCount = 0;
+		const char** extensions = glfwGetRequiredInstanceExtensions(&extensionCount);
+		if (extensions == nullptr)
+		{
+			throw std::runtime_error("No headless Vulkan surface available!");
+		}
+		builder.enable_extensions(extensionCount, extensions);
+	}
+
 	auto returnedInstance = builder.set_app_name("Vulkan GameEngine")
 		.request_validation_layers(bUseValidationLayers)
 		.use_default_debug_messenger()
@@ -240,16 +788,45 @@ void VulkanEngine::InitVulkan()
 	VkPhysicalDeviceVulkan12Features features12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
 	features12.bufferDeviceAddress = true;
 	features12.descriptorIndexing = true;
+	// the bindless set of the streamed textures, both come with descriptorIndexing
+	features12.descriptorBindingPartiallyBound = true;
+	features12.shaderSampledImageArrayNonUniformIndexing = true;
 
-	vkb::PhysicalDeviceSelector selector{ vkbInstance };
-	vkb::PhysicalDevice physicalDevice = selector
-		.set_minimum_version(1, 3)
-		.set_required_features_13(features) 
-		.set_required_features_12(features12)
-		.allow_any_gpu_device_type(false)
-		.set_surface(m_Surface)
-		.select()
-		.value();
+	VkPhysicalDeviceFeatures features10{};
+
+	auto selectPhysicalDevice = [&]()
+		{
+			vkb::PhysicalDeviceSelector selector{ vkbInstance };
+			return selector
+				.set_minimum_version(1, 3)
+				.set_required_features_13(features)
+				.set_required_features_12(features12)
+				.set_required_features(features10)
+				// software rasterizers are cpu devices
+				.allow_any_gpu_device_type(m_Headless)
+				.set_surface(m_Surface)
+				.select()
+				.value();
+		};
+
+	vkb::PhysicalDevice physicalDevice = selectPhysicalDevice();
+
+	// optional features are only requested when the selected gpu has them, which enables the matching shader permutations
+	QueryDeviceCapabilities(physicalDevice.physical_device);
+	if (m_DeviceCaps.shaderFloat16 || m_DeviceCaps.subgroupSizeControl || m_DeviceCaps.storageImageWriteWithoutFormat ||
+		m_DeviceCaps.storageImageReadWithoutFormat || m_DeviceCaps.storageImageExtendedFormats || m_DeviceCaps.textureCompressionBC)
+	{
+		features12.shaderFloat16 = m_DeviceCaps.shaderFloat16;
+		features.subgroupSizeControl = m_DeviceCaps.subgroupSizeControl;
+		features10.shaderStorageImageWriteWithoutFormat = m_DeviceCaps.storageImageWriteWithoutFormat;
+		features10.shaderStorageImageReadWithoutFormat = m_DeviceCaps.storageImageReadWithoutFormat;
+		features10.shaderStorageImageExtendedFormats = m_DeviceCaps.storageImageExtendedFormats;
+		features10.textureCompressionBC = m_DeviceCaps.textureCompressionBC;
+		physicalDevice = selectPhysicalDevice();
+	}
+
+	// real per heap budgets and usage instead of VMA's estimate from its own allocations
+	bool memoryBudget = physicalDevice.enable_extension_if_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 
 	vkb::DeviceBuilder deviceBuilder{ physicalDevice };
 	vkb::Device vkbDevice = deviceBuilder.build().value();
@@ -270,55 +847,166 @@ void VulkanEngine::InitVulkan()
 	m_GraphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
 	m_GraphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
-	VmaAllocatorCreateInfo allocatorInfo = {};
-	allocatorInfo.physicalDevice = m_PhysicalDevice;
-	allocatorInfo.device = m_Device;
-	allocatorInfo.instance = m_Instance;
-	// To use GPU pointers
-	allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
-	vmaCreateAllocator(&allocatorInfo, &m_Allocator);
+	m_Memory.init(m_Instance, m_PhysicalDevice, m_Device, memoryBudget);
 	m_MainDeletionQueue.pushFunction([&]()
 		{
-			vmaDestroyAllocator(m_Allocator);
+			m_Memory.destroy();
 		});
 }
 
+void VulkanEngine::QueryDeviceCapabilities(VkPhysicalDevice physicalDevice)
+{
+	VkPhysicalDeviceVulkan13Features features13{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+	VkPhysicalDeviceVulkan12Features features12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES, .pNext = &features13 };
+	VkPhysicalDeviceFeatures2 features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &features12 };
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+	VkPhysicalDeviceVulkan13Properties properties13{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_PROPERTIES };
+	VkPhysicalDeviceVulkan11Properties properties11{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES, .pNext = &properties13 };
+	VkPhysicalDeviceProperties2 properties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &properties11 };
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+	// the ballot tells the shuffles which lanes actually ran
+	const VkSubgroupFeatureFlags shuffleOperations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT |
+		VK_SUBGROUP_FEATURE_SHUFFLE_RELATIVE_BIT;
+
+	m_DeviceCaps = {};
+	m_DeviceCaps.shaderFloat16 = features12.shaderFloat16;
+	m_DeviceCaps.subgroupShuffle = (properties11.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+		(properties11.subgroupSupportedOperations & shuffleOperations) == shuffleOperations;
+	m_DeviceCaps.subgroupSizeControl = features13.subgroupSizeControl &&
+		(properties13.requiredSubgroupSizeStages & VK_SHADER_STAGE_COMPUTE_BIT);
+	m_DeviceCaps.storageImageWriteWithoutFormat = features.features.shaderStorageImageWriteWithoutFormat;
+	m_DeviceCaps.storageImageReadWithoutFormat = features.features.shaderStorageImageReadWithoutFormat;
+	m_DeviceCaps.storageImageExtendedFormats = features.features.shaderStorageImageExtendedFormats;
+	m_DeviceCaps.textureCompressionBC = features.features.textureCompressionBC;
+	m_DeviceCaps.subgroupSize = properties11.subgroupSize;
+	m_DeviceCaps.minSubgroupSize = properties13.minSubgroupSize;
+	m_DeviceCaps.maxSubgroupSize = properties13.maxSubgroupSize;
+
+	m_DeviceCaps.shaderPermutations = 0;
+	if (m_DeviceCaps.shaderFloat16)
+	{
+		m_DeviceCaps.shaderPermutations |= SHADER_PERMUTATION_FP16;
+	}
+	if (m_DeviceCaps.subgroupShuffle)
+	{
+		m_DeviceCaps.shaderPermutations |= SHADER_PERMUTATION_SUBGROUP;
+	}
+}
+
+void VulkanEngine::QueryDrawFormats()
+{
+	// smaller formats halve or quarter the bandwidth of every pass over the draw image.
+	// rgb9e5 has no GLSL format qualifier, so it is written through the untyped shader variants
+	m_DrawFormats =
+	{
+		{ VK_FORMAT_R16G16B16A16_SFLOAT, "RGBA16F", 0 },
+		{ VK_FORMAT_B10G11R11_UFLOAT_PACK32, "R11G11B10F", SHADER_PERMUTATION_DRAW_R11G11B10 },
+		{ VK_FORMAT_E5B9G9R9_UFLOAT_PACK32, "RGB9E5", SHADER_PERMUTATION_DRAW_UNTYPED },
+		{ VK_FORMAT_R8G8B8A8_UNORM, "RGBA8 (LDR)", SHADER_PERMUTATION_DRAW_RGBA8 },
+	};
+
+	// written by the effects, sampled by bloom, the upscaler and the resolve, and blitted without compute resolve
+	const VkFormatFeatureFlags2 required = VK_FORMAT_FEATURE_2_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_2_SAMPLED_IMAGE_FILTER_LINEAR_BIT |
+		VK_FORMAT_FEATURE_2_BLIT_SRC_BIT;
+	// the untyped variants also need the format itself to allow it, not only the device features
+	const VkFormatFeatureFlags2 untyped = VK_FORMAT_FEATURE_2_STORAGE_READ_WITHOUT_FORMAT_BIT | VK_FORMAT_FEATURE_2_STORAGE_WRITE_WITHOUT_FORMAT_BIT;
+
+	for (DrawFormatOption& option : m_DrawFormats)
+	{
+		VkFormatFeatureFlags2 features = VkUtils::formatFeatures(m_PhysicalDevice, option.format);
+		option.supported = (features & required) == required;
+
+		if (option.permutation & SHADER_PERMUTATION_DRAW_R11G11B10)
+		{
+			option.supported = option.supported && m_DeviceCaps.storageImageExtendedFormats;
+		}
+		if (option.permutation & SHADER_PERMUTATION_DRAW_UNTYPED)
+		{
+			option.supported = option.supported && m_DeviceCaps.storageImageReadWithoutFormat && m_DeviceCaps.storageImageWriteWithoutFormat &&
+				(features & untyped) == untyped;
+		}
+	}
+
+	m_DrawFormatIndex = 0;
+	m_DrawFormatPermutation = m_DrawFormats[0].permutation;
+}
+
 void VulkanEngine::InitSwapchain()
 {
 	CreateSwapchain(m_WindowExtent.width, m_WindowExtent.height);
 
+	// Allocated once at the largest size it will be rendered at, the monitor resolution.
+	// Dynamic resolution only changes the corner of it that gets drawn into
+	const GLFWvidmode* videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
 	VkExtent3D drawImageExtent =
 	{
-		m_WindowExtent.width,
-		m_WindowExtent.height,
+		std::max(m_WindowExtent.width, videoMode ? uint32_t(videoMode->width) : 0u),
+		std::max(m_WindowExtent.height, videoMode ? uint32_t(videoMode->height) : 0u),
 		1
 	};
 
-	m_DrawImage.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-	m_DrawImage.imageExtent = drawImageExtent;
-	
-	VkImageUsageFlags drawImageUsages{};
-	drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-	drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	drawImageUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
-	drawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	VkFormat drawFormat = m_DrawFormats[m_DrawFormatIndex].format;
+	m_DrawImage = CreateImage(drawImageExtent, drawFormat, drawImageUsage(m_PhysicalDevice, drawFormat));
+
+	m_MainDeletionQueue.pushFunction([&]()
+		{
+			DestroyImage(m_DrawImage);
+		});
+}
+
+AllocatedImage VulkanEngine::CreateImage(VkExtent3D extent, VkFormat format, VkImageUsageFlags usage, uint32_t mipLevels, MemoryCategory category)
+{
+	AllocatedImage newImage;
+	newImage.imageFormat = format;
+	newImage.imageExtent = extent;
 
-	VkImageCreateInfo imageInfo = VkInit::imageCreateInfo(m_DrawImage.imageFormat, drawImageUsages, drawImageExtent);
+	VkImageCreateInfo imageInfo = VkInit::imageCreateInfo(format, usage, extent);
+	imageInfo.mipLevels = mipLevels;
 
 	// Allocate GPU memory
 	VmaAllocationCreateInfo imageAllocationInfo = {};
 	imageAllocationInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 	imageAllocationInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	vmaCreateImage(m_Allocator, &imageInfo, &imageAllocationInfo, &m_DrawImage.image, &m_DrawImage.allocation, nullptr);
-	VkImageViewCreateInfo imageviewInfo = VkInit::imageviewCreateInfo(m_DrawImage.imageFormat, m_DrawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
-	VK_CHECK(vkCreateImageView(m_Device, &imageviewInfo, nullptr, &m_DrawImage.imageView));
+	VK_CHECK(m_Memory.createImage(imageInfo, imageAllocationInfo, category, &newImage.image, &newImage.allocation));
+	// depth formats get a depth view
+	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	if (format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_X8_D24_UNORM_PACK32)
+	{
+		aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	}
+	VkImageViewCreateInfo imageviewInfo = VkInit::imageviewCreateInfo(format, newImage.image, aspect);
+	VK_CHECK(vkCreateImageView(m_Device, &imageviewInfo, nullptr, &newImage.imageView));
 
-	m_MainDeletionQueue.pushFunction([&]()
-		{
-			vkDestroyImageView(m_Device, m_DrawImage.imageView, nullptr);
-			vmaDestroyImage(m_Allocator, m_DrawImage.image, m_DrawImage.allocation);
-		});
+	return newImage;
+}
+
+void VulkanEngine::DestroyImage(const AllocatedImage& image)
+{
+	vkDestroyImageView(m_Device, image.imageView, nullptr);
+	m_Memory.destroyImage(image.image, image.allocation);
+}
+
+AllocatedBuffer VulkanEngine::CreateBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, MemoryCategory category)
+{
+	VkBufferCreateInfo bufferInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.size = allocSize;
+	bufferInfo.usage = usage;
+
+	VmaAllocationCreateInfo allocationInfo{};
+	allocationInfo.usage = memoryUsage;
+	allocationInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	AllocatedBuffer newBuffer;
+	VK_CHECK(m_Memory.createBuffer(bufferInfo, allocationInfo, category, &newBuffer.buffer, &newBuffer.allocation, &newBuffer.info));
+	return newBuffer;
+}
+
+void VulkanEngine::DestroyBuffer(const AllocatedBuffer& buffer)
+{
+	m_Memory.destroyBuffer(buffer.buffer, buffer.allocation);
 }
 
 void VulkanEngine::InitCommands()
@@ -346,6 +1034,12 @@ void VulkanEngine::InitCommands()
 	m_MainDeletionQueue.pushFunction([=]() {
 		vkDestroyCommandPool(m_Device, m_ImmediateCommandPool, nullptr);
 		});
+
+	m_Profiler.init(m_Device, m_PhysicalDevice, m_GraphicsQueueFamily);
+	m_MainDeletionQueue.pushFunction([&]()
+		{
+			m_Profiler.destroy();
+		});
 }
 
 void VulkanEngine::InitSyncStructures()
@@ -372,13 +1066,13 @@ void VulkanEngine::InitSyncStructures()
 
 void VulkanEngine::InitDescriptors()
 {
-	//create a descriptor pool that will hold 10 sets with 1 image each
+	// the draw image set gets a pool of its own, replaced together with the draw image
 	std::vector<DescriptorAllocator::PoolSizeRatio> sizes =
 	{
 		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }
 	};
 
-	m_GlobalDescriptorAllocator.initPool(m_Device, 10, sizes);
+	m_DrawImageDescriptorAllocator.initPool(m_Device, 1, sizes);
 
 	//make the descriptor set layout for our compute draw
 	{
@@ -387,9 +1081,20 @@ void VulkanEngine::InitDescriptors()
 		m_DrawImageDescriptorLayout = builder.build(m_Device, VK_SHADER_STAGE_COMPUTE_BIT);
 	}
 
-	//allocate a descriptor set for our draw image
-	m_DrawImageDescriptors = m_GlobalDescriptorAllocator.allocate(m_Device, m_DrawImageDescriptorLayout);
+	m_DrawImageDescriptors = m_DrawImageDescriptorAllocator.allocate(m_Device, m_DrawImageDescriptorLayout);
+	WriteDrawImageDescriptors();
+
+	//make sure both the descriptor allocator and the new layout get cleaned up properly
+	m_MainDeletionQueue.pushFunction([&]()
+		{
+		m_DrawImageDescriptorAllocator.destroyPool(m_Device);
+
+		vkDestroyDescriptorSetLayout(m_Device, m_DrawImageDescriptorLayout, nullptr);
+		});
+}
 
+void VulkanEngine::WriteDrawImageDescriptors()
+{
 	VkDescriptorImageInfo imgInfo{};
 	imgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 	imgInfo.imageView = m_DrawImage.imageView;
@@ -405,19 +1110,28 @@ void VulkanEngine::InitDescriptors()
 	drawImageWrite.pImageInfo = &imgInfo;
 
 	vkUpdateDescriptorSets(m_Device, 1, &drawImageWrite, 0, nullptr);
-
-	//make sure both the descriptor allocator and the new layout get cleaned up properly
-	m_MainDeletionQueue.pushFunction([&]()
-		{
-		m_GlobalDescriptorAllocator.destroyPool(m_Device);
-
-		vkDestroyDescriptorSetLayout(m_Device, m_DrawImageDescriptorLayout, nullptr);
-		});
 }
 
 void VulkanEngine::InitPipelines()
 {
+	// the texture wall effect samples the streamed textures
+	m_Streamer.init(this);
 	InitBackgroundPipelines();
+	m_PostProcess.init(this);
+	m_Upscaler.init(this);
+	// the mesh pass samples the shadow maps
+	m_Shadows.init(this);
+	m_MeshPass.init(this);
+	m_Lights.init(this);
+	m_Textures.init(this);
+	m_Capture.init(this);
+	InitResolvePipeline();
+
+	// post processing builds its fused pipelines on demand, so the modules live as long as the engine
+	m_MainDeletionQueue.pushFunction([&]()
+		{
+			m_ShaderCache.destroy(m_Device);
+		});
 }
 
 void VulkanEngine::InitBackgroundPipelines()
@@ -430,7 +1144,7 @@ void VulkanEngine::InitBackgroundPipelines()
 
 	VkPushConstantRange	pushConstant{};
 	pushConstant.offset = 0;
-	pushConstant.size = sizeof(ComputePushConstants);
+	pushConstant.size = COMPUTE_PUSH_CONSTANTS_SIZE;
 	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
 	computeLayout.pPushConstantRanges = &pushConstant;
@@ -438,78 +1152,421 @@ void VulkanEngine::InitBackgroundPipelines()
 
 	VK_CHECK(vkCreatePipelineLayout(m_Device, &computeLayout, nullptr, &m_GradientPipelineLayout));
 
-	VkShaderModule gradientShader;
-	if (!VkUtils::loadShaderModule(SHADER_PATH "gradient_color.comp.spv", m_Device, &gradientShader))
-	{
-		fmt::print(fmt::fg(fmt::color::red), "Error when building gradient_color compute shader\n");
-	}
-
-	VkShaderModule skyShader;
-	if (!VkUtils::loadShaderModule(SHADER_PATH "sky.comp.spv", m_Device, &skyShader))
-	{	
-		fmt::print(fmt::fg(fmt::color::red), "Error when building sky compute shader\n");
-	}
-
-	VkPipelineShaderStageCreateInfo stageinfo{};
-	stageinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	stageinfo.pNext = nullptr;
-	stageinfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-	stageinfo.module = gradientShader;
-	stageinfo.pName = "main";
-
-	VkComputePipelineCreateInfo computePipelineCreateInfo{};
-	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	computePipelineCreateInfo.pNext = nullptr;
-	computePipelineCreateInfo.layout = m_GradientPipelineLayout;
-	computePipelineCreateInfo.stage = stageinfo;
+	// same push constants and set 0, so it stays compatible with the other effects
+	VkDescriptorSetLayout wallSetLayouts[] = { m_DrawImageDescriptorLayout, m_Streamer.setLayout() };
+	computeLayout.pSetLayouts = wallSetLayouts;
+	computeLayout.setLayoutCount = 2;
+	VK_CHECK(vkCreatePipelineLayout(m_Device, &computeLayout, nullptr, &m_TextureWallPipelineLayout));
 
 	ComputeEffect gradient;
 	gradient.layout = m_GradientPipelineLayout;
 	gradient.name = "gradient";
+	gradient.shaderName = "gradient_color.comp";
 	gradient.data = {};
 	gradient.data.data1 = glm::vec4(1, 0, 0, 1);
 	gradient.data.data2 = glm::vec4(0, 0, 1, 1);
 
-	VK_CHECK(vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &gradient.pipeline));
-
-	//change the shader module only to create the sky shader
-	computePipelineCreateInfo.stage.module = skyShader;
-
 	ComputeEffect sky;
 	sky.layout = m_GradientPipelineLayout;
 	sky.name = "sky";
+	sky.shaderName = "sky.comp";
 	sky.data = {};
 	//default sky parameters
 	sky.data.data1 = glm::vec4(0.1, 0.2, 0.4, 0.97);
 
-	VK_CHECK(vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &sky.pipeline));
+	ComputeEffect textureWall;
+	textureWall.layout = m_TextureWallPipelineLayout;
+	textureWall.name = "texture wall";
+	textureWall.shaderName = "texture_wall.comp";
+	textureWall.streamedTextures = true;
+	textureWall.data = {};
+	// 256 pixel tiles, 8 columns
+	textureWall.data.data1 = glm::vec4(256, 0, 0, 8);
 
-	//add the 2 background effects into the array
+	//add the background effects into the array
 	m_BGEffects.push_back(gradient);
 	m_BGEffects.push_back(sky);
+	m_BGEffects.push_back(textureWall);
+
+	// pick the workgroup size of every effect, timing the candidates the first time this device is seen
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(m_PhysicalDevice, &deviceProperties);
+	m_WorkgroupTuner.init(deviceProperties);
+	m_WorkgroupTuner.load(WorkgroupTuner::cachePath().c_str());
+
+	CreateBackgroundPipelines();
 
 	//destroy structures properly
-	vkDestroyShaderModule(m_Device, gradientShader, nullptr);
-	vkDestroyShaderModule(m_Device, skyShader, nullptr);
-	m_MainDeletionQueue.pushFunction([=]()
+	m_MainDeletionQueue.pushFunction([&]()
 		{
 			vkDestroyPipelineLayout(m_Device, m_GradientPipelineLayout, nullptr);
-			vkDestroyPipeline(m_Device, sky.pipeline, nullptr);
-			vkDestroyPipeline(m_Device, gradient.pipeline, nullptr);
+			vkDestroyPipelineLayout(m_Device, m_TextureWallPipelineLayout, nullptr);
+			for (ComputeEffect& effect : m_BGEffects)
+			{
+				vkDestroyPipeline(m_Device, effect.pipeline, nullptr);
+			}
 		});
 }
 
-void VulkanEngine::CreateSwapchain(uint32_t width, uint32_t height)
+void VulkanEngine::CreateBackgroundPipelines()
+{
+	bool forceRetune = std::getenv("VULKAN_RENDERER_RETUNE") != nullptr;
+	bool tunedAny = false;
+
+	for (ComputeEffect& effect : m_BGEffects)
+	{
+		// pipelines built for a previous draw format go once the frame in flight is done with them
+		if (effect.pipeline != VK_NULL_HANDLE)
+		{
+			VkPipeline oldPipeline = effect.pipeline;
+			GetCurrentFrame().deletionQueue.pushFunction([=, this]()
+				{
+					vkDestroyPipeline(m_Device, oldPipeline, nullptr);
+				});
+		}
+
+		// best variant this device can run, and a wave size hint for the ones sharing data across the subgroup
+		effect.permutation = VkUtils::selectShaderPermutation(effect.shaderName, m_DeviceCaps.shaderPermutations, m_DrawFormatPermutation);
+		effect.subgroupSize = 0;
+		if ((effect.permutation & SHADER_PERMUTATION_SUBGROUP) && m_DeviceCaps.subgroupSizeControl)
+		{
+			// wider subgroups leave fewer lanes at the edges that cannot borrow from a neighbour
+			effect.subgroupSize = m_DeviceCaps.maxSubgroupSize;
+		}
+
+		std::string shaderFile = VkUtils::shaderPermutationFile(effect.shaderName, effect.permutation);
+		VkShaderModule shader = m_ShaderCache.get(m_Device, shaderFile.c_str());
+
+		// the best shape depends on the variant too, so tuning results are stored per variant
+		if (forceRetune || !m_WorkgroupTuner.find(shaderFile.c_str(), effect.workgroupSize) ||
+			!WorkgroupTuner::fitsSubgroupSize(effect.workgroupSize, effect.subgroupSize))
+		{
+			effect.workgroupSize = TuneWorkgroupSize(effect, shader);
+			m_WorkgroupTuner.store(shaderFile.c_str(), effect.workgroupSize);
+			tunedAny = true;
+		}
+
+		effect.pipeline = VkUtils::createComputePipeline(m_Device, effect.layout, shader, effect.workgroupSize, effect.subgroupSize);
+	}
+
+	if (tunedAny)
+	{
+		m_WorkgroupTuner.save(WorkgroupTuner::cachePath().c_str());
+	}
+}
+
+void VulkanEngine::InitResolvePipeline()
+{
+	VkSamplerCreateInfo samplerInfo{ .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	VK_CHECK(vkCreateSampler(m_Device, &samplerInfo, nullptr, &m_LinearSampler));
+
+	// source and target live in separate sets, the target set is swapped per swapchain image
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		m_ResolveSourceLayout = builder.build(m_Device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		m_ResolveTargetLayout = builder.build(m_Device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+
+	std::vector<DescriptorAllocator::PoolSizeRatio> sourceSizes = { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 } };
+	m_ResolveDescriptorAllocator.initPool(m_Device, 8, sourceSizes);
+
+	VkDescriptorSetLayout setLayouts[] = { m_ResolveSourceLayout, m_ResolveTargetLayout };
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(ResolvePushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo layoutInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	layoutInfo.setLayoutCount = 2;
+	layoutInfo.pSetLayouts = setLayouts;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	VK_CHECK(vkCreatePipelineLayout(m_Device, &layoutInfo, nullptr, &m_ResolvePipelineLayout));
+
+	VkShaderModule shader = m_ShaderCache.get(m_Device, "resolve.comp.spv");
+	m_ResolvePipeline = VkUtils::createComputePipeline(m_Device, m_ResolvePipelineLayout, shader, { 8, 8 });
+
+	CreateOverlay();
+	WriteSwapchainDescriptors();
+
+	m_MainDeletionQueue.pushFunction([&]()
+		{
+			DestroyImage(m_Overlay);
+			vkDestroyPipeline(m_Device, m_ResolvePipeline, nullptr);
+			vkDestroyPipelineLayout(m_Device, m_ResolvePipelineLayout, nullptr);
+			m_ResolveDescriptorAllocator.destroyPool(m_Device);
+			m_SwapchainDescriptorAllocator.destroyPool(m_Device);
+			vkDestroyDescriptorSetLayout(m_Device, m_ResolveSourceLayout, nullptr);
+			vkDestroyDescriptorSetLayout(m_Device, m_ResolveTargetLayout, nullptr);
+			vkDestroySampler(m_Device, m_LinearSampler, nullptr);
+		});
+}
+
+void VulkanEngine::InitScene()
+{
+	m_Instances.init(this);
+	m_FrameRing.init(this, 256 * 1024);
+
+	// a mesh per level, cycling through the three shapes
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	MeshLibrary& meshes = m_MeshPass.meshes();
+	MeshLibrary::makeCube(vertices, indices);
+	meshes.add("cube", vertices, indices);
+	// fine enough for five simplified levels
+	MeshLibrary::makeSphere(24, 48, vertices, indices);
+	meshes.add("sphere", vertices, indices);
+	MeshLibrary::makePyramid(vertices, indices);
+	meshes.add("pyramid", vertices, indices);
+	meshes.upload();
+
+	// a material per direction a child is pushed out in
+	const glm::vec4 colors[] =
+	{
+		{ 0.9f, 0.35f, 0.3f, 1.0f },
+		{ 0.35f, 0.8f, 0.35f, 1.0f },
+		{ 0.3f, 0.45f, 0.9f, 1.0f },
+		{ 0.9f, 0.8f, 0.3f, 1.0f },
+	};
+	for (const glm::vec4& color : colors)
+	{
+		m_MeshPass.addMaterial(color);
+	}
+
+	// every combination, leaves are unlit. Index (pipeline * materials + material) * meshes + mesh
+	for (uint32_t pipeline = 0; pipeline < MESH_PIPELINE_COUNT; pipeline++)
+	{
+		for (uint32_t material = 0; material < 4; material++)
+		{
+			for (uint32_t mesh = 0; mesh < meshes.count(); mesh++)
+			{
+				m_MeshPass.addRenderItem({ pipeline, material, mesh });
+			}
+		}
+	}
+
+	// around the whole tree and a little above it
+	m_Lights.setArea({ glm::vec3(-7.0f, -1.0f, -7.0f), glm::vec3(7.0f, 3.0f, 7.0f) });
+
+	std::vector<HierarchyNode> nodes;
+	BuildSceneTree(m_Scene, nodes, meshes.count());
+
+	m_Hierarchy.build(nodes);
+	m_SceneRestPose.resize(m_Hierarchy.size());
+	for (uint32_t node = 0; node < m_Hierarchy.size(); node++)
+	{
+		m_SceneRestPose[node] = m_Hierarchy.local(node);
+	}
+	// everything starts dirty, the first frame uploads it all
+	m_Instances.resize(m_Scene.size());
+}
+
+void VulkanEngine::BuildSceneTree(Scene& scene, std::vector<HierarchyNode>& nodes, uint32_t meshCount)
+{
+	// a tree of boxes, every child half the size of its parent and pushed out in one of four
+	// directions. Made depth first, build sorts it into levels
+	const uint32_t branching = 4;
+	const uint32_t depth = 7;
+
+	struct PendingNode
+	{
+		uint32_t parent;
+		uint32_t level;
+		uint32_t child;
+	};
+
+	std::vector<PendingNode> stack{ { TransformHierarchy::NO_PARENT, 0, 0 } };
+	while (!stack.empty())
+	{
+		PendingNode pending = stack.back();
+		stack.pop_back();
+
+		glm::mat4 local(1.0f);
+		if (pending.parent != TransformHierarchy::NO_PARENT)
+		{
+			local = glm::rotate(local, glm::radians(90.0f * pending.child), glm::vec3(0.0f, 1.0f, 0.0f));
+			local = glm::translate(local, glm::vec3(3.0f, 1.0f, 0.0f));
+			local = glm::scale(local, glm::vec3(0.5f));
+		}
+
+		// node i places object i, the meshes all fit the unit box
+		uint32_t node = uint32_t(nodes.size());
+		nodes.push_back({ pending.parent, local, node });
+		uint32_t pipeline = pending.level + 1 == depth ? MESH_PIPELINE_UNLIT : MESH_PIPELINE_LIT;
+		uint32_t renderItem = (pipeline * 4 + pending.child) * meshCount + pending.level % meshCount;
+		scene.add(glm::mat4(1.0f), { glm::vec3(-1.0f), glm::vec3(1.0f) }, renderItem);
+
+		if (pending.level + 1 < depth)
+		{
+			for (uint32_t child = 0; child < branching; child++)
+			{
+				stack.push_back({ node, pending.level + 1, child });
+			}
+		}
+	}
+}
+
+void VulkanEngine::CreateOverlay()
+{
+	// same format as the swapchain, which the ImGui pipeline was built for
+	m_Overlay = CreateImage({ m_SwapchainExtent.width, m_SwapchainExtent.height, 1 }, m_SwapchainFormat,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 1, MEMORY_UI);
+	m_OverlayValid = false;
+}
+
+void VulkanEngine::WriteSwapchainDescriptors()
+{
+	// a new pool every time, the sets of the previous swapchain are retired along with it
+	std::vector<DescriptorAllocator::PoolSizeRatio> sizes =
+	{
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }
+	};
+	m_SwapchainDescriptorAllocator.initPool(m_Device, std::max<uint32_t>(uint32_t(m_SwapchainImageViews.size()), 1), sizes);
+	m_SwapchainDescriptors.clear();
+
+	if (!m_SwapchainStorage)
+	{
+		return;
+	}
+
+	DescriptorWriter writer;
+	for (VkImageView view : m_SwapchainImageViews)
+	{
+		VkDescriptorSet set = m_SwapchainDescriptorAllocator.allocate(m_Device, m_ResolveTargetLayout);
+		writer.clear();
+		writer.writeImage(0, view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		writer.writeImage(1, m_Overlay.imageView, m_LinearSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.updateSet(m_Device, set);
+		m_SwapchainDescriptors.push_back(set);
+	}
+}
+
+WorkgroupSize VulkanEngine::TuneWorkgroupSize(const ComputeEffect& effect, VkShaderModule shaderModule)
+{
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(m_PhysicalDevice, &deviceProperties);
+
+	// with a required subgroup size only widths made of full subgroups are valid, 16x16 might not be
+	std::vector<WorkgroupSize> candidates = WorkgroupTuner::candidates(deviceProperties.limits, effect.subgroupSize);
+	const WorkgroupSize fallback = effect.subgroupSize != 0 ? candidates.front() : WorkgroupSize{ 16, 16 };
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_PhysicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(m_PhysicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	// without timestamps there is nothing to measure with
+	if (shaderModule == VK_NULL_HANDLE || queueFamilies[m_GraphicsQueueFamily].timestampValidBits == 0)
+	{
+		return fallback;
+	}
+
+	// dispatches timed per candidate, after a couple of warmup ones
+	constexpr uint32_t warmupDispatches = 2;
+	constexpr uint32_t timedDispatches = 8;
+
+	VkQueryPoolCreateInfo queryPoolInfo{ .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 2;
+
+	VkQueryPool queryPool;
+	VK_CHECK(vkCreateQueryPool(m_Device, &queryPoolInfo, nullptr, &queryPool));
+
+	WorkgroupSize best = fallback;
+	double bestTime = std::numeric_limits<double>::max();
+
+	for (WorkgroupSize candidate : candidates)
+	{
+		VkPipeline pipeline = VkUtils::createComputePipeline(m_Device, effect.layout, shaderModule, candidate, effect.subgroupSize);
+
+		ImmediateSubmit([&](VkCommandBuffer cmd)
+			{
+				vkCmdResetQueryPool(cmd, queryPool, 0, 2);
+				VkUtils::transitionImage(cmd, m_DrawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+				BindEffectSets(cmd, effect);
+				VkUtils::pushComputeConstants(cmd, effect.layout, effect.data, { m_DrawImage.imageExtent.width, m_DrawImage.imageExtent.height });
+
+				uint32_t groupsX = VkUtils::divideRoundUp(m_DrawImage.imageExtent.width, candidate.x);
+				uint32_t groupsY = VkUtils::divideRoundUp(m_DrawImage.imageExtent.height, candidate.y);
+
+				for (uint32_t i = 0; i < warmupDispatches + timedDispatches; i++)
+				{
+					if (i == warmupDispatches)
+					{
+						vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, queryPool, 0);
+					}
+					// every dispatch writes the whole image, without a barrier they would overlap like no frame does
+					if (i > 0)
+					{
+						VkUtils::computeBarrier(cmd);
+					}
+					vkCmdDispatch(cmd, groupsX, groupsY, 1);
+				}
+
+				vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, queryPool, 1);
+			});
+
+		uint64_t timestamps[2];
+		VK_CHECK(vkGetQueryPoolResults(m_Device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+		double milliseconds = double(timestamps[1] - timestamps[0]) * deviceProperties.limits.timestampPeriod / 1e6 / timedDispatches;
+
+		if (milliseconds < bestTime)
+		{
+			bestTime = milliseconds;
+			best = candidate;
+		}
+
+		vkDestroyPipeline(m_Device, pipeline, nullptr);
+	}
+
+	vkDestroyQueryPool(m_Device, queryPool, nullptr);
+
+	fmt::print("{} {}x{} ({:.3f} ms)\n",
+		fmt::styled(fmt::format("Tuned {} workgroup:", effect.name), fmt::fg(fmt::color::white) | fmt::emphasis::bold),
+		best.x, best.y, bestTime);
+
+	return best;
+}
+
+void VulkanEngine::CreateSwapchain(uint32_t width, uint32_t height, VkSwapchainKHR oldSwapchain)
 {
 	vkb::SwapchainBuilder swapchainBuilder{ m_PhysicalDevice, m_Device, m_Surface };
 	m_SwapchainFormat = VK_FORMAT_B8G8R8A8_UNORM;
 
+	// the compute resolve writes the swapchain as a storage image, when the surface and format allow it
+	VkSurfaceCapabilitiesKHR surfaceCapabilities;
+	VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_PhysicalDevice, m_Surface, &surfaceCapabilities));
+	// resolve.comp writes it without a format qualifier, the format has to allow that too
+	VkFormatFeatureFlags2 formatFeatures = VkUtils::formatFeatures(m_PhysicalDevice, m_SwapchainFormat);
+
+	m_SwapchainStorage = m_DeviceCaps.storageImageWriteWithoutFormat &&
+		(surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) &&
+		(formatFeatures & VK_FORMAT_FEATURE_2_STORAGE_IMAGE_BIT) && (formatFeatures & VK_FORMAT_FEATURE_2_STORAGE_WRITE_WITHOUT_FORMAT_BIT);
+	m_SwapchainReadable = surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
 	vkb::Swapchain vkbSwapchain = swapchainBuilder
 		//.use_default_format_selection()
 		.set_desired_format(VkSurfaceFormatKHR{ .format = m_SwapchainFormat, .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR })
 		.set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
 		.set_desired_extent(width, height)
-		.add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		.set_old_swapchain(oldSwapchain)
+		.add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT | (m_SwapchainStorage ? VK_IMAGE_USAGE_STORAGE_BIT : 0) |
+			(m_SwapchainReadable ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0))
 		.build()
 		.value();
 
@@ -519,6 +1576,120 @@ void VulkanEngine::CreateSwapchain(uint32_t width, uint32_t height)
 	m_SwapchainImageViews = vkbSwapchain.get_image_views().value();
 }
 
+void VulkanEngine::ResizeSwapchain()
+{
+	int width, height;
+	glfwGetFramebufferSize(m_Window, &width, &height);
+	if (width == 0 || height == 0)
+	{
+		return;
+	}
+	m_ResizeRequested = false;
+
+	// The old swapchain is handed to the new one and retired with the frame, which still presents
+	// from it. Nothing waits for the device to go idle
+	VkSwapchainKHR oldSwapchain = m_Swapchain;
+	std::vector<VkImageView> oldImageViews = m_SwapchainImageViews;
+	VkDescriptorPool oldDescriptorPool = m_SwapchainDescriptorAllocator.pool;
+	AllocatedImage oldOverlay = m_Overlay;
+	GetCurrentFrame().deletionQueue.pushFunction([=, this]()
+		{
+			vkDestroyDescriptorPool(m_Device, oldDescriptorPool, nullptr);
+			DestroyImage(oldOverlay);
+			for (VkImageView view : oldImageViews)
+			{
+				vkDestroyImageView(m_Device, view, nullptr);
+			}
+			vkDestroySwapchainKHR(m_Device, oldSwapchain, nullptr);
+		});
+
+	CreateSwapchain(uint32_t(width), uint32_t(height), oldSwapchain);
+	CreateOverlay();
+	WriteSwapchainDescriptors();
+	m_WindowExtent = m_SwapchainExtent;
+
+	// the draw image is kept at its size while the window shrinks, only outgrowing it reallocates
+	if (m_SwapchainExtent.width > m_DrawImage.imageExtent.width || m_SwapchainExtent.height > m_DrawImage.imageExtent.height)
+	{
+		GrowDrawImage(m_SwapchainExtent);
+	}
+}
+
+void VulkanEngine::GrowDrawImage(VkExtent2D minimumExtent)
+{
+	// some headroom so dragging the window larger does not reallocate every frame
+	VkExtent3D extent =
+	{
+		std::max(m_DrawImage.imageExtent.width, (minimumExtent.width + 255) & ~255u),
+		std::max(m_DrawImage.imageExtent.height, (minimumExtent.height + 255) & ~255u),
+		1
+	};
+	ReallocateDrawImage(extent, m_DrawImage.imageFormat);
+
+	fmt::print("{} {}x{}\n", fmt::styled("Draw image grown to", fmt::fg(fmt::color::white) | fmt::emphasis::bold), extent.width, extent.height);
+}
+
+void VulkanEngine::ReallocateDrawImage(VkExtent3D extent, VkFormat format, bool deviceIdle)
+{
+	if (deviceIdle)
+	{
+		// nothing can still be using the old image or the sets pointing at it
+		DestroyImage(m_DrawImage);
+		m_ResolveDescriptorAllocator.clearDescriptors(m_Device);
+		m_DrawImage = CreateImage(extent, format, drawImageUsage(m_PhysicalDevice, format));
+	}
+	else
+	{
+		// a frame in flight may still use the old image, its sets go with their pools
+		AllocatedImage oldImage = m_DrawImage;
+		VkDescriptorPool oldResolvePool = m_ResolveDescriptorAllocator.pool;
+		VkDescriptorPool oldDrawImagePool = m_DrawImageDescriptorAllocator.pool;
+		GetCurrentFrame().deletionQueue.pushFunction([=, this]()
+			{
+				vkDestroyDescriptorPool(m_Device, oldResolvePool, nullptr);
+				vkDestroyDescriptorPool(m_Device, oldDrawImagePool, nullptr);
+				DestroyImage(oldImage);
+			});
+
+		m_DrawImage = CreateImage(extent, format, drawImageUsage(m_PhysicalDevice, format));
+		std::vector<DescriptorAllocator::PoolSizeRatio> drawImageSizes = { { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 } };
+		m_DrawImageDescriptorAllocator.initPool(m_Device, 1, drawImageSizes);
+		m_DrawImageDescriptors = m_DrawImageDescriptorAllocator.allocate(m_Device, m_DrawImageDescriptorLayout);
+
+		std::vector<DescriptorAllocator::PoolSizeRatio> sizes = { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 } };
+		m_ResolveDescriptorAllocator.initPool(m_Device, 8, sizes);
+	}
+	WriteDrawImageDescriptors();
+	m_ResolveSourceSets.clear();
+
+	m_PostProcess.resize();
+	m_Upscaler.resize();
+	m_MeshPass.resize();
+	m_Lights.resize();
+}
+
+void VulkanEngine::SetDrawFormat(int index)
+{
+	if (index == m_DrawFormatIndex || !m_DrawFormats[index].supported)
+	{
+		return;
+	}
+
+	// a rare switch from the UI, every pipeline storing to the draw image is rebuilt so it's simpler with the gpu idle
+	vkDeviceWaitIdle(m_Device);
+
+	m_DrawFormatIndex = index;
+	m_DrawFormatPermutation = m_DrawFormats[index].permutation;
+	ReallocateDrawImage(m_DrawImage.imageExtent, m_DrawFormats[index].format, true);
+	CreateBackgroundPipelines();
+	m_PostProcess.reloadShaders();
+	m_MeshPass.createPipelines();
+	m_Upscaler.reset();
+
+	fmt::print("{} {} ({} bytes per pixel)\n", fmt::styled("Draw format", fmt::fg(fmt::color::white) | fmt::emphasis::bold),
+		m_DrawFormats[index].name, VkUtils::bytesPerPixel(m_DrawFormats[index].format));
+}
+
 void VulkanEngine::DestroySwapchain()
 {
 	vkDestroySwapchainKHR(m_Device, m_Swapchain, nullptr);
@@ -529,6 +1700,71 @@ void VulkanEngine::DestroySwapchain()
 	}
 }
 
+void VulkanEngine::UpdateScene(VkCommandBuffer currentCMD)
+{
+	double start = glfwGetTime();
+
+	if (m_AnimateScene && uint32_t(m_AnimatedLevel) < m_Hierarchy.levelCount())
+	{
+		float angle = float(glfwGetTime());
+		uint32_t end = m_Hierarchy.levelEnd(m_AnimatedLevel);
+		for (uint32_t node = m_Hierarchy.levelBegin(m_AnimatedLevel); node < end; node += m_AnimatedStride)
+		{
+			m_Hierarchy.setLocal(node, glm::rotate(m_SceneRestPose[node], angle, glm::vec3(0.0f, 1.0f, 0.0f)));
+		}
+	}
+
+	// only the subtrees below moved nodes are walked, and only their instances uploaded
+	const std::vector<uint32_t>& changed = m_Hierarchy.update(&m_Jobs);
+	m_SceneMovedObjects.clear();
+	for (uint32_t node : changed)
+	{
+		uint32_t object = m_Hierarchy.object(node);
+		if (object == TransformHierarchy::NO_OBJECT)
+		{
+			continue;
+		}
+
+		const glm::mat4& world = m_Hierarchy.world(node);
+		m_Scene.setTransform(object, world);
+		m_Instances.set(object, { world, m_Scene.renderHandle(object) });
+		m_SceneMovedObjects.push_back(object);
+	}
+	if (!changed.empty())
+	{
+		m_Scene.updateWorldBounds(m_SceneMovedObjects, &m_Jobs);
+		m_SceneVersion++;
+	}
+
+	m_SceneUpdatedNodes = uint32_t(changed.size());
+	m_SceneUpdateMilliseconds = (glfwGetTime() - start) * 1000.0;
+
+	// refits loosen the tree as objects drift apart from their neighbours
+	start = glfwGetTime();
+	if (m_Bvh.objectCount() != m_Scene.size())
+	{
+		m_Bvh.build(m_Scene, &m_Jobs);
+		m_BvhBuiltCost = m_Bvh.cost();
+		m_BvhMilliseconds = (glfwGetTime() - start) * 1000.0;
+	}
+	else if (!m_SceneMovedObjects.empty())
+	{
+		m_Bvh.refit(m_Scene, m_SceneMovedObjects);
+		if (m_Bvh.cost() > m_BvhBuiltCost * m_BvhRebuildRatio)
+		{
+			m_Bvh.build(m_Scene, &m_Jobs);
+			m_BvhBuiltCost = m_Bvh.cost();
+			m_BvhRebuilds++;
+		}
+		m_BvhMilliseconds = (glfwGetTime() - start) * 1000.0;
+	}
+
+	m_Instances.upload(currentCMD, m_FrameNumber);
+
+	m_Lights.update(float(glfwGetTime()));
+	m_Shadows.update(m_SceneMovedObjects, m_Scene.size(), uint32_t(m_FrameNumber));
+}
+
 void VulkanEngine::DrawBackground(VkCommandBuffer& currentCMD)
 {
 	//VkClearColorValue clearValue;
@@ -542,19 +1778,144 @@ void VulkanEngine::DrawBackground(VkCommandBuffer& currentCMD)
 	ComputeEffect& effect = m_BGEffects[m_CurrentBGEffect];
 
 	// bind the gradient drawing compute pipeline
-	vkCmdBindPipeline(currentCMD, VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
+	m_Recorder.bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
 
 	// bind the descriptor set containing the draw image for the compute pipeline
-	vkCmdBindDescriptorSets(currentCMD, VK_PIPELINE_BIND_POINT_COMPUTE, m_GradientPipelineLayout, 0, 1, &m_DrawImageDescriptors, 0, nullptr);
+	m_Recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_COMPUTE, effect.layout, 0, 1, &m_DrawImageDescriptors);
+	if (effect.streamedTextures)
+	{
+		m_Streamer.bind(currentCMD, effect.layout, 1, m_FrameNumber);
+	}
+
+	// same two ranges as VkUtils::pushComputeConstants
+	ComputeFrameConstants frame{ glm::ivec2(m_DrawExtent.width, m_DrawExtent.height), m_Upscaler.jitter(m_FrameNumber) };
+	m_Recorder.pushConstants(effect.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &effect.data);
+	m_Recorder.pushConstants(effect.layout, VK_SHADER_STAGE_COMPUTE_BIT, COMPUTE_FRAME_OFFSET, sizeof(ComputeFrameConstants), &frame);
+	// execute the compute pipeline dispatch, covering the draw extent with the effect's tuned workgroup size
+	vkCmdDispatch(currentCMD, VkUtils::divideRoundUp(m_DrawExtent.width, effect.workgroupSize.x), VkUtils::divideRoundUp(m_DrawExtent.height, effect.workgroupSize.y), 1);
+
+	if (effect.streamedTextures)
+	{
+		m_Streamer.endFeedback(currentCMD);
+	}
+}
+
+void VulkanEngine::DrawMeshes(VkCommandBuffer currentCMD)
+{
+	float pitch = glm::radians(m_CameraPitch);
+	float yaw = glm::radians(m_CameraYaw);
+	glm::vec3 eye = m_CameraTarget + m_CameraDistance * glm::vec3(std::cos(pitch) * std::sin(yaw), std::sin(pitch), std::cos(pitch) * std::cos(yaw));
+	glm::mat4 view = glm::lookAt(eye, m_CameraTarget, glm::vec3(0.0f, 1.0f, 0.0f));
+
+	// Vulkan clip space: depth from 0 to 1 and y pointing down
+	const float nearPlane = 0.1f;
+	const float farPlane = 500.0f;
+	float aspect = float(m_DrawExtent.width) / float(m_DrawExtent.height);
+	glm::mat4 projection = glm::perspectiveRH_ZO(glm::radians(m_CameraFov), aspect, nearPlane, farPlane);
+	projection[1][1] *= -1.0f;
+
+	// culled without the jitter, it moves the image by less than a pixel
+	glm::mat4 viewProjection = projection * view;
+	m_VisibleObjects.clear();
+	m_Bvh.cull(Frustum::fromViewProjection(viewProjection), m_VisibleObjects);
+
+	uint32_t shadowScope = m_Profiler.beginScope(currentCMD, "shadows");
+	ShadowView shadowView{ view, glm::radians(m_CameraFov), aspect, nearPlane };
+	VkDeviceAddress shadowFrame = m_Shadows.draw(m_Recorder, shadowView, m_Bvh, m_Scene, m_Instances, m_FrameRing);
+	m_Profiler.endScope(currentCMD, shadowScope);
+
+	uint32_t lightScope = m_Profiler.beginScope(currentCMD, "lights");
+	VkDeviceAddress clusterFrame = m_Lights.build(m_Recorder, view, viewProjection, glm::radians(m_CameraFov), aspect, nearPlane, farPlane,
+		m_DrawExtent, m_FrameRing);
+	m_Profiler.endScope(currentCMD, lightScope);
+
+	// the meshes write no motion vectors, so the reprojected history only lines up while nothing moves
+	if (view != m_HistoryView || m_CameraFov != m_HistoryFov || m_SceneVersion != m_HistorySceneVersion)
+	{
+		m_Upscaler.reset();
+		m_HistoryView = view;
+		m_HistoryFov = m_CameraFov;
+		m_HistorySceneVersion = m_SceneVersion;
+	}
 
-	vkCmdPushConstants(currentCMD, m_GradientPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &effect.data);
-	// execute the compute pipeline dispatch. We are using 16x16 workgroup size so we need to divide by it
-	vkCmdDispatch(currentCMD, std::ceil(m_DrawExtent.width / 16.0f), std::ceil(m_DrawExtent.height / 16.0f), 1);
+	// shading a texel at +jitter is the geometry moving by -jitter, in ndc that's 2 / extent per texel
+	glm::vec2 jitter = m_Upscaler.jitter(m_FrameNumber);
+	projection[2][0] += 2.0f * jitter.x / float(m_DrawExtent.width);
+	projection[2][1] += 2.0f * jitter.y / float(m_DrawExtent.height);
+
+	// the lods only care about the vertical scale, the jitter leaves it alone
+	MeshView meshView{ projection * view, eye, std::abs(projection[1][1]) * 0.5f * float(m_DrawExtent.height), clusterFrame,
+		shadowFrame };
+	m_MeshPass.draw(m_Recorder, m_VisibleObjects, m_Scene, m_Instances, meshView, m_FrameRing, m_DrawExtent, &m_Jobs);
 }
 
-void VulkanEngine::DrawImgui(VkCommandBuffer currentCMD, VkImageView targetImageView)
+void VulkanEngine::BindEffectSets(VkCommandBuffer currentCMD, const ComputeEffect& effect)
 {
-	VkRenderingAttachmentInfo colorAttachment = VkInit::attachmentInfo(targetImageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	vkCmdBindDescriptorSets(currentCMD, VK_PIPELINE_BIND_POINT_COMPUTE, effect.layout, 0, 1, &m_DrawImageDescriptors, 0, nullptr);
+	if (effect.streamedTextures)
+	{
+		m_Streamer.bind(currentCMD, effect.layout, 1, m_FrameNumber);
+	}
+}
+
+void VulkanEngine::DrawResolve(VkCommandBuffer currentCMD, const AllocatedImage& source, VkExtent2D sourceExtent, uint32_t swapchainImageIndex, bool overlay)
+{
+	auto it = m_ResolveSourceSets.find(source.imageView);
+	if (it == m_ResolveSourceSets.end())
+	{
+		VkDescriptorSet set = m_ResolveDescriptorAllocator.allocate(m_Device, m_ResolveSourceLayout);
+		DescriptorWriter writer;
+		writer.writeImage(0, source.imageView, m_LinearSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.updateSet(m_Device, set);
+		it = m_ResolveSourceSets.emplace(source.imageView, set).first;
+	}
+
+	VkDescriptorSet sets[] = { it->second, m_SwapchainDescriptors[swapchainImageIndex] };
+
+	ResolvePushConstants push{};
+	push.sourceScale = glm::vec2(float(sourceExtent.width) / source.imageExtent.width, float(sourceExtent.height) / source.imageExtent.height);
+	push.outputSize = glm::ivec2(m_SwapchainExtent.width, m_SwapchainExtent.height);
+	push.flags = m_ResolveFlags;
+	// the post chain already tonemapped, do not apply the curve twice
+	if (m_PostProcess.tonemaps())
+	{
+		push.flags &= ~RESOLVE_TONEMAP;
+	}
+	if (overlay)
+	{
+		push.flags |= RESOLVE_OVERLAY;
+	}
+	push.frame = m_FrameNumber;
+
+	vkCmdBindPipeline(currentCMD, VK_PIPELINE_BIND_POINT_COMPUTE, m_ResolvePipeline);
+	vkCmdBindDescriptorSets(currentCMD, VK_PIPELINE_BIND_POINT_COMPUTE, m_ResolvePipelineLayout, 0, 2, sets, 0, nullptr);
+	vkCmdPushConstants(currentCMD, m_ResolvePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ResolvePushConstants), &push);
+	vkCmdDispatch(currentCMD, VkUtils::divideRoundUp(m_SwapchainExtent.width, 8), VkUtils::divideRoundUp(m_SwapchainExtent.height, 8), 1);
+}
+
+void VulkanEngine::DrawOverlay(VkCommandBuffer currentCMD)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hashDrawData(hash, ImGui::GetDrawData());
+	if (m_OverlayValid && hash == m_OverlayHash && !m_UIInput)
+	{
+		return;
+	}
+	m_OverlayHash = hash;
+	m_OverlayValid = true;
+
+	// cleared to transparent, ImGui's blending then leaves premultiplied colors for the resolve to composite
+	uint32_t uiScope = m_Profiler.beginScope(currentCMD, "ui");
+	VkClearValue clear{};
+	VkUtils::transitionImage(currentCMD, m_Overlay.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	DrawImgui(currentCMD, m_Overlay.imageView, &clear);
+	VkUtils::transitionImage(currentCMD, m_Overlay.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	m_Profiler.endScope(currentCMD, uiScope);
+}
+
+void VulkanEngine::DrawImgui(VkCommandBuffer currentCMD, VkImageView targetImageView, VkClearValue* clear)
+{
+	VkRenderingAttachmentInfo colorAttachment = VkInit::attachmentInfo(targetImageView, clear, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 	VkRenderingInfo renderInfo = VkInit::renderingInfo(m_SwapchainExtent, &colorAttachment, nullptr);
 
 	vkCmdBeginRendering(currentCMD, &renderInfo);
@@ -623,7 +1984,15 @@ void VulkanEngine::InitImGui()
 	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
 	io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
 	io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;         // Enable Docking
-	io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;       // Enable Multi-Viewport / Platform Windows
+	if (!m_Headless)
+	{
+		io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;   // Enable Multi-Viewport / Platform Windows
+	}
+	else
+	{
+		// nothing to lay out, and runs should not depend on a saved layout
+		io.IniFilename = nullptr;
+	}
 
 	// this initializes imgui for SDL
 	ImGui_ImplGlfw_InitForVulkan(m_Window, true);
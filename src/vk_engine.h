@@ -1,27 +1,57 @@
 #pragma once
 
+#include <unordered_map>
 #include <vector>
-#include <glm/glm.hpp>
 
 #include "vk_types.h"
 #include "vk_descriptors.h"
+#include "vk_pipelines.h"
+#include "vk_autotune.h"
+#include "vk_profiler.h"
+#include "vk_postprocess.h"
+#include "vk_resolution.h"
+#include "vk_upscale.h"
+#include "vk_activity.h"
+#include "vk_memory.h"
+#include "vk_jobs.h"
+#include "vk_textures.h"
+#include "vk_streaming.h"
+#include "vk_scene.h"
+#include "vk_bvh.h"
+#include "vk_instances.h"
+#include "vk_ringbuffer.h"
+#include "vk_recorder.h"
+#include "vk_meshpass.h"
+#include "vk_lights.h"
+#include "vk_shadows.h"
+#include "vk_capture.h"
 
-struct ComputePushConstants
+// Flags of the compute resolve into the swapchain, match resolve.comp
+enum ResolveFlagBits : uint32_t
 {
-	glm::vec4 data1;
-	glm::vec4 data2;
-	glm::vec4 data3;
-	glm::vec4 data4;
+	RESOLVE_TONEMAP = 1 << 0,
+	RESOLVE_ENCODE_SRGB = 1 << 1,
+	RESOLVE_DITHER = 1 << 2,
+	// composite the premultiplied UI overlay on top
+	RESOLVE_OVERLAY = 1 << 3,
 };
 
-struct ComputeEffect
+struct ResolvePushConstants
 {
-	const char* name;
-
-	VkPipeline pipeline;
-	VkPipelineLayout layout;
+	glm::vec2 sourceScale;
+	glm::ivec2 outputSize;
+	uint32_t flags;
+	uint32_t frame;
+};
 
-	ComputePushConstants data;
+// A format the draw image can be switched to, and the shader permutation storing to it
+struct DrawFormatOption
+{
+	VkFormat format;
+	const char* name;
+	uint32_t permutation;
+	// storage, linear filtering and blits work with it on this device
+	bool supported;
 };
 
 class VulkanEngine
@@ -29,7 +59,12 @@ class VulkanEngine
 public:
 
 	bool m_IsInitialized{ false };
+	// set before Init: no window system, the surface comes from VK_EXT_headless_surface and any device
+	// type is accepted, so the benchmarks run on CI machines with a software rasterizer like lavapipe
+	bool m_Headless{ false };
 	int m_FrameNumber{ 0 };
+	// set by resize events and out of date swapchains, the swapchain is rebuilt at the start of the next frame
+	bool m_ResizeRequested{ false };
 	float m_DeltaTime{ 0 };
 	VkExtent2D m_WindowExtent{ 1700 , 900 };
 	struct GLFWwindow* m_Window{ nullptr };
@@ -39,15 +74,22 @@ public:
 	VkExtent2D m_DrawExtent;
 	FrameData m_Frames[MAX_FRAMES_IN_FLIGHT];
 	DeletionQueue m_MainDeletionQueue;
-	VmaAllocator m_Allocator;
+	// what was retired during frames that returned before submitting, handed to the next frame that does
+	DeletionQueue m_UnsubmittedDeletions;
+	MemorySystem m_Memory;
 	AllocatedImage m_DrawImage;
-	DescriptorAllocator m_GlobalDescriptorAllocator;
+	std::vector<DrawFormatOption> m_DrawFormats;
+	int m_DrawFormatIndex{ 0 };
+	// SHADER_PERMUTATION_DRAW_* bit of the shaders writing the draw image, 0 for rgba16f
+	uint32_t m_DrawFormatPermutation{ 0 };
+	DescriptorAllocator m_DrawImageDescriptorAllocator;
 
 	VkQueue m_GraphicsQueue;
 	uint32_t m_GraphicsQueueFamily;
 	VkInstance m_Instance;
 	VkDebugUtilsMessengerEXT m_DebugMessenger;
 	VkPhysicalDevice m_PhysicalDevice;
+	DeviceCapabilities m_DeviceCaps;
 	VkDevice m_Device;
 	VkSurfaceKHR m_Surface;
 	VkSwapchainKHR m_Swapchain;
@@ -55,10 +97,99 @@ public:
 	std::vector<VkImage> m_SwapchainImages;
 	std::vector<VkImageView> m_SwapchainImageViews;
 	VkExtent2D m_SwapchainExtent;
+	// swapchain images can be written by the compute resolve, otherwise the draw image is blitted
+	bool m_SwapchainStorage{ false };
+	// the surface allows copying out of the swapchain images, for captures
+	bool m_SwapchainReadable{ false };
 	VkDescriptorSet m_DrawImageDescriptors;
 	VkDescriptorSetLayout m_DrawImageDescriptorLayout;
 	VkPipeline m_GradientPipeline;
 	VkPipelineLayout m_GradientPipelineLayout;
+	// the draw image plus the streamed textures at set 1
+	VkPipelineLayout m_TextureWallPipelineLayout;
+	ShaderCache m_ShaderCache;
+	WorkgroupTuner m_WorkgroupTuner;
+	GpuProfiler m_Profiler;
+	PostProcessChain m_PostProcess;
+	DynamicResolution m_DynamicResolution;
+	TemporalUpscaler m_Upscaler;
+	FrameActivity m_Activity;
+	JobSystem m_Jobs;
+	TextureLoader m_Textures;
+	TextureStreamer m_Streamer;
+	// procedural hierarchy standing in for a loaded scene, every node is an object and an instance
+	Scene m_Scene;
+	TransformHierarchy m_Hierarchy;
+	InstanceBuffer m_Instances;
+	std::vector<glm::mat4> m_SceneRestPose;
+	bool m_AnimateScene{ false };
+	// every animatedStride-th node of this level spins, taking its subtree along
+	int m_AnimatedLevel{ 3 };
+	int m_AnimatedStride{ 4 };
+	uint32_t m_SceneUpdatedNodes{ 0 };
+	double m_SceneUpdateMilliseconds{ 0 };
+	std::vector<uint32_t> m_SceneMovedObjects;
+	// refit after objects moved, rebuilt once that made it this much costlier than when it was built
+	Bvh m_Bvh;
+	float m_BvhBuiltCost{ 0 };
+	float m_BvhRebuildRatio{ 1.5f };
+	double m_BvhMilliseconds{ 0 };
+	uint32_t m_BvhRebuilds{ 0 };
+	// picking ray tested against the BVH from the scene window
+	glm::vec3 m_PickOrigin{ 0.0f, 20.0f, -20.0f };
+	glm::vec3 m_PickDirection{ 0.0f, -1.0f, 1.0f };
+	// bumped whenever objects moved, so the scene gets rendered again
+	uint64_t m_SceneVersion{ 0 };
+	// per frame data the gpu reads once, like the instance indices of the mesh draws
+	FrameRingBuffer m_FrameRing;
+	MeshPass m_MeshPass;
+	ClusteredLights m_Lights;
+	LightBenchmark m_LightBenchmark;
+	CascadedShadows m_Shadows;
+	FrameCapture m_Capture;
+	// binds of the background and mesh passes, which drops the redundant ones
+	CommandRecorder m_Recorder;
+	std::vector<uint32_t> m_VisibleObjects;
+	// orbit camera around the target, angles in degrees
+	glm::vec3 m_CameraTarget{ 0.0f, 1.0f, 0.0f };
+	float m_CameraYaw{ 30.0f };
+	float m_CameraPitch{ 35.0f };
+	float m_CameraDistance{ 16.0f };
+	float m_CameraFov{ 60.0f };
+	// camera and scene the upscaler history was accumulated under, it's reset when either moves
+	glm::mat4 m_HistoryView{ 0.0f };
+	float m_HistoryFov{ 0.0f };
+	uint64_t m_HistorySceneVersion{ 0 };
+	// output of the last scene render, re-presented while the scene state is unchanged
+	AllocatedImage* m_SceneResult{ nullptr };
+	VkExtent2D m_SceneResultExtent;
+	VkImageLayout m_SceneResultLayout;
+	// the frame ring overflowed while rendering it, so it can't be reused even if the scene is unchanged
+	bool m_SceneResultIncomplete{ false };
+
+	bool m_UseComputeResolve{ true };
+	uint32_t m_ResolveFlags{ RESOLVE_DITHER };
+	VkPipeline m_ResolvePipeline;
+	VkPipelineLayout m_ResolvePipelineLayout;
+	VkDescriptorSetLayout m_ResolveSourceLayout;
+	VkDescriptorSetLayout m_ResolveTargetLayout;
+	VkSampler m_LinearSampler;
+	DescriptorAllocator m_ResolveDescriptorAllocator;
+	// sampled sets of the images the resolve has read from, by view
+	std::unordered_map<VkImageView, VkDescriptorSet> m_ResolveSourceSets;
+	// storage sets of the swapchain images, reallocated with the swapchain
+	DescriptorAllocator m_SwapchainDescriptorAllocator;
+	std::vector<VkDescriptorSet> m_SwapchainDescriptors;
+
+	// ImGui is rendered into this swapchain sized image and composited by the compute resolve,
+	// only redrawn when its draw data changes or input arrives
+	bool m_CacheOverlay{ true };
+	AllocatedImage m_Overlay;
+	bool m_OverlayValid{ false };
+	uint64_t m_OverlayHash{ 0 };
+	uint64_t m_PlatformWindowsHash{ 0 };
+	// the UI saw input in the current ImGui frame
+	bool m_UIInput{ false };
 
 	VkFence m_ImmediateFence;
 	VkCommandBuffer m_ImmediateCommandBuffer;
@@ -74,20 +205,57 @@ public:
 	void ImmediateSubmit(std::function<void(VkCommandBuffer currentCMD)>&& function);
 	FrameData& GetCurrentFrame() { return m_Frames[m_FrameNumber % 2]; };
 
+	// Device local image with a view of its first mip. Destroy it with DestroyImage
+	AllocatedImage CreateImage(VkExtent3D extent, VkFormat format, VkImageUsageFlags usage, uint32_t mipLevels = 1,
+		MemoryCategory category = MEMORY_RENDER_TARGETS);
+	void DestroyImage(const AllocatedImage& image);
+	// Persistently mapped when memoryUsage is host visible. Destroy it with DestroyBuffer
+	AllocatedBuffer CreateBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, MemoryCategory category);
+	void DestroyBuffer(const AllocatedBuffer& buffer);
+
+	// Switches the draw image to another of m_DrawFormats, waits for the gpu to go idle
+	void SetDrawFormat(int index);
+
+	// The procedural tree InitScene loads, a node and an object per box. meshCount is the number of
+	// meshes the render items cycle through
+	static void BuildSceneTree(Scene& scene, std::vector<HierarchyNode>& nodes, uint32_t meshCount);
+
 private:
 
 	void InitVulkan();
+	void QueryDeviceCapabilities(VkPhysicalDevice physicalDevice);
+	void QueryDrawFormats();
 	void InitSwapchain();
 	void InitCommands();
 	void InitSyncStructures();
 	void InitDescriptors();
 	void InitPipelines();
 	void InitBackgroundPipelines();
+	void CreateBackgroundPipelines();
+	void InitResolvePipeline();
+	void InitScene();
+	void CreateOverlay();
+	void WriteSwapchainDescriptors();
+	WorkgroupSize TuneWorkgroupSize(const ComputeEffect& effect, VkShaderModule shaderModule);
+	void BindEffectSets(VkCommandBuffer currentCMD, const ComputeEffect& effect);
 
-	void CreateSwapchain(uint32_t width, uint32_t height);
+	void CreateSwapchain(uint32_t width, uint32_t height, VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
 	void DestroySwapchain();
+	void ResizeSwapchain();
+	void GrowDrawImage(VkExtent2D minimumExtent);
+	// With the device idle the old image goes right away and the draw image set is rewritten in place
+	void ReallocateDrawImage(VkExtent3D extent, VkFormat format, bool deviceIdle = false);
+	void WriteDrawImageDescriptors();
+	// Hash of everything the scene result depends on, for change tracking
+	uint64_t HashSceneState(VkExtent2D outputExtent) const;
+	// Moves the animated nodes, propagates the changes and uploads the instances that moved
+	void UpdateScene(VkCommandBuffer currentCMD);
 	void DrawBackground(VkCommandBuffer& currentCMD);
-	void DrawImgui(VkCommandBuffer currentCMD, VkImageView targetImageView);
+	// Culls the scene against the camera with the BVH and draws what is left in batches
+	void DrawMeshes(VkCommandBuffer currentCMD);
+	void DrawResolve(VkCommandBuffer currentCMD, const AllocatedImage& source, VkExtent2D sourceExtent, uint32_t swapchainImageIndex, bool overlay);
+	void DrawOverlay(VkCommandBuffer currentCMD);
+	void DrawImgui(VkCommandBuffer currentCMD, VkImageView targetImageView, VkClearValue* clear = nullptr);
 
 	void AddFPSToTitle();
 	void InitImGui();
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <vector>
+
 #include "vk_images.h"
 #include "vk_initializers.h"
 
@@ -63,3 +66,82 @@ void VkUtils::copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage dest
 
 	vkCmdBlitImage2(cmd, &blitInfo);
 }
+
+void VkUtils::computeBarrier(VkCommandBuffer cmd)
+{
+    VkMemoryBarrier2 memoryBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+    memoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    memoryBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    memoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+    VkDependencyInfo depInfo{};
+    depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    depInfo.pNext = nullptr;
+
+    depInfo.memoryBarrierCount = 1;
+    depInfo.pMemoryBarriers = &memoryBarrier;
+
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
+VkImage VkUtils::relocateImage(VkCommandBuffer cmd, VkDevice device, VmaAllocator allocator, VmaAllocation destination,
+    VkImage source, const VkImageCreateInfo& imageInfo, VkImageLayout layout)
+{
+    VkImage image;
+    VK_CHECK(vkCreateImage(device, &imageInfo, nullptr, &image));
+    VK_CHECK(vmaBindImageMemory(allocator, destination, image));
+
+    std::vector<VkImageCopy> copyRegions(imageInfo.mipLevels);
+    for (uint32_t level = 0; level < imageInfo.mipLevels; level++)
+    {
+        VkImageCopy& copyRegion = copyRegions[level];
+        copyRegion = {};
+        copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, imageInfo.arrayLayers };
+        copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, imageInfo.arrayLayers };
+        copyRegion.extent = { std::max(imageInfo.extent.width >> level, 1u), std::max(imageInfo.extent.height >> level, 1u),
+            std::max(imageInfo.extent.depth >> level, 1u) };
+    }
+
+    transitionImage(cmd, source, layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    transitionImage(cmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    vkCmdCopyImage(cmd, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        uint32_t(copyRegions.size()), copyRegions.data());
+
+    // the old image may still be sampled by what was recorded before its views were swapped
+    transitionImage(cmd, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, layout);
+    transitionImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, layout);
+    return image;
+}
+
+VkFormatFeatureFlags2 VkUtils::formatFeatures(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+    VkFormatProperties3 properties3{ .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3 };
+    VkFormatProperties2 properties{ .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2 };
+    properties.pNext = &properties3;
+    vkGetPhysicalDeviceFormatProperties2(physicalDevice, format, &properties);
+    return properties3.optimalTilingFeatures;
+}
+
+uint32_t VkUtils::bytesPerPixel(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return 16;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        return 8;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+    case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R32_SFLOAT:
+        return 4;
+    default:
+        return 4;
+    }
+}
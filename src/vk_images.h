@@ -1,9 +1,25 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
 
 namespace VkUtils
 {
 	void transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout);
 	void copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize, VkExtent2D dstSize);
+	// Makes compute shader writes visible to the compute dispatches recorded after it
+	void computeBarrier(VkCommandBuffer cmd);
+
+	// Recreates image at the place defragmentation moved its allocation to and copies every level and
+	// layer over, both images are left in layout. Destroying the old image is up to the caller, its
+	// memory belongs to VMA until the pass ends
+	VkImage relocateImage(VkCommandBuffer cmd, VkDevice device, VmaAllocator allocator, VmaAllocation destination,
+		VkImage source, const VkImageCreateInfo& imageInfo, VkImageLayout layout);
+
+	// Optimal tiling features of a format, queried through VkFormatProperties3 so the per-format
+	// storage read and write without format bits are there
+	VkFormatFeatureFlags2 formatFeatures(VkPhysicalDevice physicalDevice, VkFormat format);
+
+	// Size of one texel, for bandwidth estimates
+	uint32_t bytesPerPixel(VkFormat format);
 }
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstring>
+
+#include "vk_instances.h"
+#include "vk_engine.h"
+
+void InstanceBuffer::init(VulkanEngine* engine)
+{
+	m_Engine = engine;
+
+	engine->m_MainDeletionQueue.pushFunction([this]()
+		{
+			destroy();
+		});
+}
+
+void InstanceBuffer::destroy()
+{
+	if (m_Buffer.buffer != VK_NULL_HANDLE)
+	{
+		m_Engine->DestroyBuffer(m_Buffer);
+		m_Buffer = {};
+	}
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (m_Staging[i].buffer != VK_NULL_HANDLE)
+		{
+			m_Engine->DestroyBuffer(m_Staging[i]);
+			m_Staging[i] = {};
+			m_StagingBytes[i] = 0;
+		}
+	}
+	m_Capacity = 0;
+}
+
+void InstanceBuffer::resize(uint32_t count)
+{
+	m_Instances.resize(count, GpuInstance{});
+	m_Dirty.resize(count, 0);
+	std::erase_if(m_DirtyIndices, [count](uint32_t index) { return index >= count; });
+
+	if (count <= m_Capacity)
+	{
+		return;
+	}
+
+	// the frame in flight may still read the old one
+	if (m_Buffer.buffer != VK_NULL_HANDLE)
+	{
+		m_Engine->GetCurrentFrame().deletionQueue.pushFunction([old = m_Buffer, engine = m_Engine]()
+			{
+				engine->DestroyBuffer(old);
+			});
+	}
+
+	m_Capacity = std::max(count, m_Capacity * 2);
+	m_Buffer = m_Engine->CreateBuffer(VkDeviceSize(m_Capacity) * sizeof(GpuInstance),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_GEOMETRY);
+	m_FullUpload = true;
+
+	VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = m_Buffer.buffer;
+	m_Address = vkGetBufferDeviceAddress(m_Engine->m_Device, &addressInfo);
+}
+
+void InstanceBuffer::set(uint32_t index, const GpuInstance& instance)
+{
+	m_Instances[index] = instance;
+	if (!m_Dirty[index])
+	{
+		m_Dirty[index] = 1;
+		m_DirtyIndices.push_back(index);
+	}
+}
+
+void InstanceBuffer::upload(VkCommandBuffer cmd, uint32_t frameNumber)
+{
+	m_UploadedInstances = 0;
+	m_UploadedRegions = 0;
+	m_UploadedBytes = 0;
+
+	uint32_t count = size();
+	if (count == 0 || (m_DirtyIndices.empty() && !m_FullUpload))
+	{
+		return;
+	}
+
+	bool full = m_FullUpload || m_DirtyIndices.size() > size_t(count * fullUploadFraction);
+	uint32_t uploadCount = full ? count : uint32_t(m_DirtyIndices.size());
+	VkDeviceSize uploadBytes = VkDeviceSize(uploadCount) * sizeof(GpuInstance);
+
+	// this frame's staging was last read by the submit whose fence was just waited on
+	uint32_t frameIndex = frameNumber % MAX_FRAMES_IN_FLIGHT;
+	AllocatedBuffer& staging = m_Staging[frameIndex];
+	if (m_StagingBytes[frameIndex] < uploadBytes)
+	{
+		if (staging.buffer != VK_NULL_HANDLE)
+		{
+			m_Engine->DestroyBuffer(staging);
+		}
+		m_StagingBytes[frameIndex] = std::max(uploadBytes, m_StagingBytes[frameIndex] * 2);
+		staging = m_Engine->CreateBuffer(m_StagingBytes[frameIndex], VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_STAGING);
+	}
+
+	std::vector<VkBufferCopy> copyRegions;
+	uint8_t* mapped = static_cast<uint8_t*>(staging.info.pMappedData);
+	if (full)
+	{
+		memcpy(mapped, m_Instances.data(), uploadBytes);
+		copyRegions.push_back({ 0, 0, uploadBytes });
+	}
+	else
+	{
+		// sorted so neighbours end up next to each other in staging and share a region
+		std::sort(m_DirtyIndices.begin(), m_DirtyIndices.end());
+		for (uint32_t i = 0; i < uploadCount; i++)
+		{
+			uint32_t index = m_DirtyIndices[i];
+			memcpy(mapped + VkDeviceSize(i) * sizeof(GpuInstance), &m_Instances[index], sizeof(GpuInstance));
+
+			VkDeviceSize dstOffset = VkDeviceSize(index) * sizeof(GpuInstance);
+			if (!copyRegions.empty() && copyRegions.back().dstOffset + copyRegions.back().size == dstOffset)
+			{
+				copyRegions.back().size += sizeof(GpuInstance);
+			}
+			else
+			{
+				copyRegions.push_back({ VkDeviceSize(i) * sizeof(GpuInstance), dstOffset, sizeof(GpuInstance) });
+			}
+		}
+	}
+
+	for (uint32_t index : m_DirtyIndices)
+	{
+		m_Dirty[index] = 0;
+	}
+	m_DirtyIndices.clear();
+	m_FullUpload = false;
+
+	// the previous frame may still be reading the entries about to be overwritten
+	VkMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+
+	VkDependencyInfo dependencyInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dependencyInfo.memoryBarrierCount = 1;
+	dependencyInfo.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+
+	vkCmdCopyBuffer(cmd, staging.buffer, m_Buffer.buffer, uint32_t(copyRegions.size()), copyRegions.data());
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+	vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+
+	m_UploadedInstances = uploadCount;
+	m_UploadedRegions = uint32_t(copyRegions.size());
+	m_UploadedBytes = uploadBytes;
+}
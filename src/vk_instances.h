@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_types.h"
+
+class VulkanEngine;
+
+// One entry of the instance buffer, std430 layout
+struct GpuInstance
+{
+	glm::mat4 world;
+	uint32_t renderHandle;
+	uint32_t padding[3];
+};
+
+// Device local array of GpuInstance with a copy on the cpu. Changed entries are packed into this
+// frame's staging buffer and copied over with one vkCmdCopyBuffer, consecutive indices merged into
+// one region, so a frame where a few objects moved uploads those instead of the whole array.
+class InstanceBuffer
+{
+public:
+
+	// copy everything in one region once more than this share of the entries changed
+	float fullUploadFraction{ 0.5f };
+
+	void init(VulkanEngine* engine);
+
+	// Grows or shrinks the array, new entries are zeroed. Growing reallocates and uploads everything
+	void resize(uint32_t count);
+	void set(uint32_t index, const GpuInstance& instance);
+	uint32_t size() const { return uint32_t(m_Instances.size()); }
+	const GpuInstance& get(uint32_t index) const { return m_Instances[index]; }
+
+	VkBuffer buffer() const { return m_Buffer.buffer; }
+	// changes when growing reallocates the buffer
+	VkDeviceAddress deviceAddress() const { return m_Address; }
+	VkDeviceSize bufferBytes() const { return VkDeviceSize(m_Instances.size()) * sizeof(GpuInstance); }
+
+	// Records the copies of everything set since the last call, visible to shaders afterwards. Once
+	// per frame after the frame fence was waited on
+	void upload(VkCommandBuffer cmd, uint32_t frameNumber);
+
+	// last upload
+	uint32_t uploadedInstances() const { return m_UploadedInstances; }
+	uint32_t uploadedRegions() const { return m_UploadedRegions; }
+	VkDeviceSize uploadedBytes() const { return m_UploadedBytes; }
+
+private:
+
+	void destroy();
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	std::vector<GpuInstance> m_Instances;
+	// a byte per entry so set can be called many times per frame without duplicates
+	std::vector<uint8_t> m_Dirty;
+	std::vector<uint32_t> m_DirtyIndices;
+	bool m_FullUpload{ false };
+
+	AllocatedBuffer m_Buffer{};
+	VkDeviceAddress m_Address{ 0 };
+	uint32_t m_Capacity{ 0 };
+	// per frame in flight, only touched after that frame's fence
+	AllocatedBuffer m_Staging[MAX_FRAMES_IN_FLIGHT]{};
+	VkDeviceSize m_StagingBytes[MAX_FRAMES_IN_FLIGHT]{};
+
+	uint32_t m_UploadedInstances{ 0 };
+	uint32_t m_UploadedRegions{ 0 };
+	VkDeviceSize m_UploadedBytes{ 0 };
+};
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "vk_jobs.h"
+
+void JobSystem::init(uint32_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+
+	m_Stopping = false;
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		m_Workers.emplace_back([this]() { workerLoop(); });
+	}
+}
+
+void JobSystem::shutdown()
+{
+	{
+		std::lock_guard lock(m_Mutex);
+		m_Stopping = true;
+	}
+	m_JobAdded.notify_all();
+
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+	m_Workers.clear();
+}
+
+void JobSystem::submit(std::function<void()>&& job)
+{
+	{
+		std::lock_guard lock(m_Mutex);
+		m_Jobs.push_back(std::move(job));
+	}
+	m_JobAdded.notify_one();
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t begin, uint32_t end)>& body)
+{
+	grain = std::max(grain, 1u);
+	uint32_t ranges = (count + grain - 1) / grain;
+	if (ranges <= 1 || m_Workers.empty())
+	{
+		if (count > 0)
+		{
+			body(0, count);
+		}
+		return;
+	}
+
+	// helpers that only get to run after everything is done find no range left, so the state
+	// outlives this call but body is never touched after it returned
+	struct Ranges
+	{
+		std::atomic<uint32_t> next{ 0 };
+		std::atomic<uint32_t> done{ 0 };
+		const std::function<void(uint32_t, uint32_t)>* body;
+		uint32_t count;
+		uint32_t grain;
+		uint32_t ranges;
+	};
+	auto state = std::make_shared<Ranges>();
+	state->body = &body;
+	state->count = count;
+	state->grain = grain;
+	state->ranges = ranges;
+
+	auto takeRanges = [](Ranges& state)
+		{
+			for (uint32_t range = state.next++; range < state.ranges; range = state.next++)
+			{
+				uint32_t begin = range * state.grain;
+				(*state.body)(begin, std::min(begin + state.grain, state.count));
+				if (state.done.fetch_add(1) + 1 == state.ranges)
+				{
+					state.done.notify_all();
+				}
+			}
+		};
+
+	uint32_t helpers = std::min(threadCount(), ranges - 1);
+	for (uint32_t i = 0; i < helpers; i++)
+	{
+		submit([state, takeRanges]() { takeRanges(*state); });
+	}
+
+	takeRanges(*state);
+	for (uint32_t done = state->done.load(); done < ranges; done = state->done.load())
+	{
+		state->done.wait(done);
+	}
+}
+
+uint32_t JobSystem::pending() const
+{
+	std::lock_guard lock(m_Mutex);
+	return uint32_t(m_Jobs.size()) + m_Running;
+}
+
+void JobSystem::waitIdle()
+{
+	std::unique_lock lock(m_Mutex);
+	m_JobDone.wait(lock, [this]() { return m_Jobs.empty() && m_Running == 0; });
+}
+
+void JobSystem::workerLoop()
+{
+	std::unique_lock lock(m_Mutex);
+	while (true)
+	{
+		// queued jobs still run when stopping, nobody waits on half finished work
+		m_JobAdded.wait(lock, [this]() { return m_Stopping || !m_Jobs.empty(); });
+		if (m_Jobs.empty())
+		{
+			return;
+		}
+
+		std::function<void()> job = std::move(m_Jobs.front());
+		m_Jobs.pop_front();
+		m_Running++;
+
+		lock.unlock();
+		job();
+		lock.lock();
+
+		m_Running--;
+		m_JobDone.notify_all();
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed pool of worker threads for cpu work that should not stall the frame, such as
+// decoding images. Jobs run in submission order on whichever worker is free; they must not
+// touch the Vulkan device, results are handed back to the main thread by the job itself.
+class JobSystem
+{
+public:
+
+	// 0 uses one worker per hardware thread, minus the main thread
+	void init(uint32_t threadCount = 0);
+	// Finishes the queued jobs and joins the workers
+	void shutdown();
+
+	void submit(std::function<void()>&& job);
+
+	// Runs body over [0, count) in ranges of grain items spread over the workers, the calling
+	// thread takes ranges too. Returns once every range is done, also fine to call from a job
+	void parallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t begin, uint32_t end)>& body);
+
+	// jobs queued or running
+	uint32_t pending() const;
+	void waitIdle();
+
+	uint32_t threadCount() const { return uint32_t(m_Workers.size()); }
+
+private:
+
+	void workerLoop();
+
+	std::vector<std::thread> m_Workers;
+	std::deque<std::function<void()>> m_Jobs;
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_JobAdded;
+	std::condition_variable m_JobDone;
+	uint32_t m_Running{ 0 };
+	bool m_Stopping{ false };
+};
@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include <fmt/core.h>
+#include <fmt/color.h>
+#include <imgui.h>
+
+#include "vk_lights.h"
+#include "vk_engine.h"
+#include "vk_profiler.h"
+#include "vk_recorder.h"
+#include "vk_ringbuffer.h"
+
+void ClusteredLights::init(VulkanEngine* engine)
+{
+	m_Engine = engine;
+	VkDevice device = engine->m_Device;
+
+	// the binning shader finds everything through the cluster frame address
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(VkDeviceAddress);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo layoutInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_PipelineLayout));
+
+	VkShaderModule shader = engine->m_ShaderCache.get(device, "light_binning.comp.spv");
+	m_Pipeline = VkUtils::createComputePipeline(device, m_PipelineLayout, shader, { BINNING_WORKGROUP_SIZE, 1 });
+
+	createBuffers();
+	for (AllocatedBuffer& readback : m_Readback)
+	{
+		readback = engine->CreateBuffer(sizeof(GpuLightListHeader), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU,
+			MEMORY_RENDER_TARGETS);
+	}
+
+	engine->m_MainDeletionQueue.pushFunction([=, this]()
+		{
+			vkDestroyPipeline(device, m_Pipeline, nullptr);
+			vkDestroyPipelineLayout(device, m_PipelineLayout, nullptr);
+			m_Engine->DestroyBuffer(m_Clusters);
+			m_Engine->DestroyBuffer(m_LightIndices);
+			for (const AllocatedBuffer& readback : m_Readback)
+			{
+				m_Engine->DestroyBuffer(readback);
+			}
+		});
+}
+
+void ClusteredLights::resize()
+{
+	// the frame in flight may still shade with the old ones
+	m_Engine->GetCurrentFrame().deletionQueue.pushFunction([clusters = m_Clusters, lightIndices = m_LightIndices, engine = m_Engine]()
+		{
+			engine->DestroyBuffer(clusters);
+			engine->DestroyBuffer(lightIndices);
+		});
+	createBuffers();
+}
+
+uint32_t ClusteredLights::clusterCapacity() const
+{
+	VkExtent3D extent = m_Engine->m_DrawImage.imageExtent;
+	return VkUtils::divideRoundUp(extent.width, CLUSTER_TILE_SIZE) * VkUtils::divideRoundUp(extent.height, CLUSTER_TILE_SIZE) * CLUSTER_SLICES;
+}
+
+void ClusteredLights::createBuffers()
+{
+	// sized for the whole draw image, dynamic resolution only ever uses less of it
+	uint32_t clusters = clusterCapacity();
+	if (m_MaxLightIndices == 0)
+	{
+		m_MaxLightIndices = clusters * AVERAGE_CLUSTER_LIGHTS;
+	}
+
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	m_Clusters = m_Engine->CreateBuffer(clusters * sizeof(glm::uvec2), usage, VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_RENDER_TARGETS);
+
+	VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = m_Clusters.buffer;
+	m_ClustersAddress = vkGetBufferDeviceAddress(m_Engine->m_Device, &addressInfo);
+
+	createLightIndices();
+}
+
+void ClusteredLights::createLightIndices()
+{
+	// the header is cleared and copied back every frame
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	m_LightIndices = m_Engine->CreateBuffer(sizeof(GpuLightListHeader) + m_MaxLightIndices * sizeof(uint32_t), usage,
+		VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_RENDER_TARGETS);
+
+	VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = m_LightIndices.buffer;
+	m_LightIndicesAddress = vkGetBufferDeviceAddress(m_Engine->m_Device, &addressInfo);
+}
+
+void ClusteredLights::readStats(uint32_t frameNumber)
+{
+	// frames that didn't bin leave the last stats standing
+	uint32_t index = frameNumber % MAX_FRAMES_IN_FLIGHT;
+	if (m_ReadbackCapacity[index] == 0)
+	{
+		return;
+	}
+	m_StatsCapacity = m_ReadbackCapacity[index];
+	m_ReadbackCapacity[index] = 0;
+
+	vmaInvalidateAllocation(m_Engine->m_Memory.allocator(), m_Readback[index].allocation, 0, VK_WHOLE_SIZE);
+	memcpy(&m_BinningStats, m_Readback[index].info.pMappedData, sizeof(GpuLightListHeader));
+
+	// room for what the clusters asked for and a quarter more, given back once they ask for far less
+	uint32_t demand = m_BinningStats.count;
+	uint32_t minimum = clusterCapacity();
+	if (demand <= m_MaxLightIndices && (demand >= m_MaxLightIndices / 4 || m_MaxLightIndices <= minimum))
+	{
+		return;
+	}
+
+	// the frame in flight may still shade with the old list
+	m_Engine->GetCurrentFrame().deletionQueue.pushFunction([lightIndices = m_LightIndices, engine = m_Engine]()
+		{
+			engine->DestroyBuffer(lightIndices);
+		});
+	m_MaxLightIndices = std::max(demand + demand / 4, minimum);
+	createLightIndices();
+	// a cached frame missing lights gets rendered again
+	m_Version++;
+}
+
+uint32_t ClusteredLights::droppedLights() const
+{
+	uint32_t droppedFromList = m_BinningStats.count > m_StatsCapacity ? m_BinningStats.count - m_StatsCapacity : 0;
+	return m_BinningStats.droppedTileLights + m_BinningStats.droppedClusterLights + droppedFromList;
+}
+
+void ClusteredLights::generate(uint32_t count)
+{
+	// same seed every time, so a light count always looks the same
+	std::mt19937 random(1337);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	m_Sources.resize(count);
+	m_Lights.resize(count);
+	glm::vec3 size = m_Area.max - m_Area.min;
+	for (LightSource& source : m_Sources)
+	{
+		source.center = m_Area.min + size * glm::vec3(unit(random), unit(random), unit(random));
+		source.orbitRadius = 0.25f + unit(random) * 1.5f;
+		source.speed = (0.2f + unit(random)) * (unit(random) < 0.5f ? -1.0f : 1.0f);
+		source.phase = unit(random) * 6.2831853f;
+		// saturated colors, the brightest channel at one
+		glm::vec3 color(unit(random), unit(random), unit(random));
+		source.color = color / std::max({ color.r, color.g, color.b, 0.01f });
+		source.rangeScale = 0.5f + unit(random);
+		source.spotChoice = unit(random);
+		source.spotCos = std::cos(glm::radians(20.0f + unit(random) * 30.0f));
+	}
+	m_Generated = count;
+}
+
+void ClusteredLights::update(float time)
+{
+	uint32_t count = uint32_t(std::clamp(lightCount, 0, int(MAX_LIGHTS)));
+	if (count != m_Generated)
+	{
+		generate(count);
+		m_Applied = glm::vec3(-1.0f);
+	}
+
+	glm::vec3 settings(range, intensity, spotShare);
+	if (!animate && settings == m_Applied)
+	{
+		return;
+	}
+	if (animate)
+	{
+		m_Time = time;
+	}
+	m_Applied = settings;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const LightSource& source = m_Sources[i];
+		float angle = source.phase + m_Time * source.speed;
+		GpuLight& light = m_Lights[i];
+		light.position = source.center + source.orbitRadius * glm::vec3(std::cos(angle), 0.0f, std::sin(angle));
+		light.range = range * source.rangeScale;
+		light.color = source.color * intensity;
+		if (source.spotChoice < spotShare)
+		{
+			// pointing down, leaning towards where it is headed
+			light.direction = glm::normalize(glm::vec3(-std::sin(angle) * source.speed, -1.0f, std::cos(angle) * source.speed));
+			light.spotOuterCos = source.spotCos;
+			light.spotInnerCos = source.spotCos + (1.0f - source.spotCos) * 0.3f;
+		}
+		else
+		{
+			light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+			light.spotOuterCos = -2.0f;
+			light.spotInnerCos = -1.0f;
+		}
+	}
+	m_Version++;
+}
+
+VkDeviceAddress ClusteredLights::build(CommandRecorder& recorder, const glm::mat4& view, const glm::mat4& viewProjection, float fovY, float aspect,
+	float nearPlane, float farPlane, VkExtent2D extent, FrameRingBuffer& ring)
+{
+	uint32_t frameIndex = uint32_t(m_Engine->m_FrameNumber) % MAX_FRAMES_IN_FLIGHT;
+	readStats(uint32_t(m_Engine->m_FrameNumber));
+
+	m_VisibleLights = 0;
+	m_Grid = glm::uvec3(VkUtils::divideRoundUp(extent.width, CLUSTER_TILE_SIZE), VkUtils::divideRoundUp(extent.height, CLUSTER_TILE_SIZE), CLUSTER_SLICES);
+	if (!enabled || m_Lights.empty() || m_Grid.x * m_Grid.y * m_Grid.z > clusterCapacity())
+	{
+		m_BinningStats = {};
+		return 0;
+	}
+
+	RingAllocation lights = ring.allocate(m_Lights.size() * sizeof(GpuLight));
+	RingAllocation frameData = ring.allocate(sizeof(GpuClusterFrame));
+	if (lights.data == nullptr || frameData.data == nullptr)
+	{
+		// the ring grows the next time this frame comes around
+		return 0;
+	}
+
+	// lights off screen would only make every tile test them
+	Frustum frustum = Frustum::fromViewProjection(viewProjection);
+	GpuLight* visible = static_cast<GpuLight*>(lights.data);
+	for (const GpuLight& light : m_Lights)
+	{
+		bool inside = true;
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			inside = inside && glm::dot(glm::vec3(plane), light.position) + plane.w > -light.range;
+		}
+		if (inside)
+		{
+			visible[m_VisibleLights++] = light;
+		}
+	}
+
+	float tanHalfFovY = std::tan(fovY * 0.5f);
+	float sliceScale = float(CLUSTER_SLICES) / std::log(farPlane / nearPlane);
+	GpuClusterFrame* frame = static_cast<GpuClusterFrame*>(frameData.data);
+	frame->view = view;
+	frame->projection = glm::vec4(tanHalfFovY * aspect, tanHalfFovY, nearPlane, farPlane);
+	frame->slicing = glm::vec4(sliceScale, -std::log(nearPlane) * sliceScale, float(extent.width), float(extent.height));
+	frame->grid = glm::uvec4(m_Grid, CLUSTER_TILE_SIZE);
+	frame->lights = lights.address;
+	frame->clusters = m_ClustersAddress;
+	frame->lightIndices = m_LightIndicesAddress;
+	frame->lightCount = m_VisibleLights;
+	frame->maxLightIndices = m_MaxLightIndices;
+	if (m_VisibleLights == 0)
+	{
+		// the shading skips the clusters altogether
+		m_BinningStats = {};
+		return frameData.address;
+	}
+
+	VkCommandBuffer cmd = recorder.commandBuffer();
+
+	// the previous frame's fragments and header copy may still read the lists about to be rewritten
+	VkMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	VkDependencyInfo dependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dependency.memoryBarrierCount = 1;
+	dependency.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(cmd, &dependency);
+
+	// the length of the index list, which the clusters reserve their ranges from, and the overflow counters
+	vkCmdFillBuffer(cmd, m_LightIndices.buffer, 0, sizeof(GpuLightListHeader), 0);
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	vkCmdPipelineBarrier2(cmd, &dependency);
+
+	recorder.bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+	recorder.pushConstants(m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(VkDeviceAddress), &frameData.address);
+	vkCmdDispatch(cmd, m_Grid.x, m_Grid.y, 1);
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier2(cmd, &dependency);
+
+	// what didn't fit comes back once this frame's fence was waited on
+	VkBufferCopy copy{ 0, 0, sizeof(GpuLightListHeader) };
+	vkCmdCopyBuffer(cmd, m_LightIndices.buffer, m_Readback[frameIndex].buffer, 1, &copy);
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+	vkCmdPipelineBarrier2(cmd, &dependency);
+	m_ReadbackCapacity[frameIndex] = m_MaxLightIndices;
+
+	return frameData.address;
+}
+
+void ClusteredLights::drawUI()
+{
+	ImGui::Checkbox("Clustered lights", &enabled);
+	ImGui::SameLine();
+	ImGui::Checkbox("Animate lights", &animate);
+	ImGui::SliderInt("Lights", &lightCount, 0, int(MAX_LIGHTS), "%d", ImGuiSliderFlags_Logarithmic);
+	ImGui::SliderFloat("Light range", &range, 0.25f, 8.0f, "%.2f", ImGuiSliderFlags_Logarithmic);
+	ImGui::SliderFloat("Light intensity", &intensity, 0.0f, 4.0f);
+	ImGui::SliderFloat("Spot lights", &spotShare, 0.0f, 1.0f);
+	ImGui::Text("%u lights in view, %u x %u x %u clusters", m_VisibleLights, m_Grid.x, m_Grid.y, m_Grid.z);
+	ImGui::Text("Light index list: %u of %u entries used, %u lights in the fullest cluster", std::min(m_BinningStats.count, m_StatsCapacity),
+		m_MaxLightIndices, m_BinningStats.maxClusterLights);
+	uint32_t dropped = droppedLights();
+	if (dropped > 0)
+	{
+		uint32_t droppedFromList = dropped - m_BinningStats.droppedTileLights - m_BinningStats.droppedClusterLights;
+		ImGui::Text("Dropped lights: %u past %u per tile, %u past %u per cluster, %u from the full list", m_BinningStats.droppedTileLights,
+			MAX_TILE_LIGHTS, m_BinningStats.droppedClusterLights, MAX_CLUSTER_LIGHTS, droppedFromList);
+	}
+}
+
+void LightBenchmark::start(ClusteredLights& lights)
+{
+	m_Steps.clear();
+	m_Steps.push_back({ 0 });
+	for (uint32_t count = 64; count <= ClusteredLights::MAX_LIGHTS; count *= 2)
+	{
+		m_Steps.push_back({ count });
+	}
+
+	m_Running = true;
+	m_RestoreCount = lights.lightCount;
+	m_Step = 0;
+	m_Frame = 0;
+	lights.enabled = true;
+	lights.lightCount = int(m_Steps[0].lights);
+	fmt::print("{} {} light counts, {} frames each\n", fmt::styled("Light benchmark:", fmt::fg(fmt::color::white) | fmt::emphasis::bold),
+		m_Steps.size(), MEASURED_FRAMES);
+}
+
+void LightBenchmark::update(const GpuProfiler& profiler, ClusteredLights& lights)
+{
+	if (!m_Running)
+	{
+		return;
+	}
+	if (!profiler.isEnabled())
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Light benchmark needs gpu timestamps, which this device doesn't have\n");
+		m_Running = false;
+		lights.lightCount = m_RestoreCount;
+		return;
+	}
+
+	// the profiler lags a couple of frames behind, the first frames of a step still show the last one
+	m_Frame++;
+	if (m_Frame > SETTLE_FRAMES)
+	{
+		Step& step = m_Steps[m_Step];
+		step.binning += std::max(profiler.find("lights"), 0.0);
+		step.meshes += std::max(profiler.find("meshes"), 0.0);
+		step.frame += std::max(profiler.find("frame"), 0.0);
+		step.dropped = std::max(step.dropped, lights.droppedLights());
+	}
+	if (m_Frame < SETTLE_FRAMES + MEASURED_FRAMES)
+	{
+		return;
+	}
+
+	m_Frame = 0;
+	m_Step++;
+	if (m_Step < m_Steps.size())
+	{
+		lights.lightCount = int(m_Steps[m_Step].lights);
+		return;
+	}
+
+	m_Running = false;
+	lights.lightCount = m_RestoreCount;
+	// the mesh pass includes the binning
+	// dropped is the most light references a frame of the step left out, the timings of such a step are too good
+	fmt::print("{:>8} {:>12} {:>12} {:>12} {:>10}\n", "lights", "binning ms", "meshes ms", "frame ms", "dropped");
+	for (const Step& step : m_Steps)
+	{
+		fmt::print("{:>8} {:>12.3f} {:>12.3f} {:>12.3f} {:>10}\n", step.lights, step.binning / MEASURED_FRAMES, step.meshes / MEASURED_FRAMES,
+			step.frame / MEASURED_FRAMES, step.dropped);
+	}
+}
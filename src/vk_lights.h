@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_types.h"
+#include "vk_scene.h"
+
+class VulkanEngine;
+class FrameRingBuffer;
+class CommandRecorder;
+class GpuProfiler;
+
+// std430 layout, match lights.glsl
+struct GpuLight
+{
+	glm::vec3 position;
+	float range;
+	// premultiplied by the intensity
+	glm::vec3 color;
+	// cosines of the cone angles, full strength inside the inner one. An outer of -2 is a point light
+	float spotInnerCos;
+	glm::vec3 direction;
+	float spotOuterCos;
+};
+
+// Read by the binning shader and the mesh shading through one address, match lights.glsl
+struct GpuClusterFrame
+{
+	glm::mat4 view;
+	// tan of the half fov in x and y, near, far
+	glm::vec4 projection;
+	// log(depth) * x + y is the slice, zw is the extent in pixels
+	glm::vec4 slicing;
+	// clusters in x, y and z, tile size in pixels
+	glm::uvec4 grid;
+	VkDeviceAddress lights;
+	VkDeviceAddress clusters;
+	VkDeviceAddress lightIndices;
+	uint32_t lightCount;
+	uint32_t maxLightIndices;
+};
+static_assert(sizeof(GpuClusterFrame) == 144);
+
+// Start of the light index list, what the binning couldn't fit is counted here and read back. Match lights.glsl
+struct GpuLightListHeader
+{
+	// entries the clusters asked for, past the list's capacity when it ran out
+	uint32_t count;
+	uint32_t droppedTileLights;
+	uint32_t droppedClusterLights;
+	uint32_t maxClusterLights;
+};
+
+// Clustered forward lighting. Dynamic point and spot lights are culled against the view frustum
+// and written to the frame ring, then a compute pass bins them into a froxel grid: screen tiles of
+// CLUSTER_TILE_SIZE pixels times CLUSTER_SLICES depth slices spaced logarithmically between the
+// near and far plane. A workgroup per tile first gathers the lights touching the tile's column,
+// then splits those over the slices, writing every cluster's lights as a range of one compact index
+// list. Shading only loops over the lights of the cluster a fragment is in.
+class ClusteredLights
+{
+public:
+
+	static constexpr uint32_t MAX_LIGHTS = 16384;
+	static constexpr uint32_t CLUSTER_TILE_SIZE = 64;
+	static constexpr uint32_t CLUSTER_SLICES = 24;
+	// room for this many lights per cluster on average in the index list to start with, after that the
+	// list is sized after what the clusters asked for a couple of frames earlier
+	static constexpr uint32_t AVERAGE_CLUSTER_LIGHTS = 32;
+	// match light_binning.comp
+	static constexpr uint32_t BINNING_WORKGROUP_SIZE = 64;
+	static constexpr uint32_t MAX_TILE_LIGHTS = 512;
+	static constexpr uint32_t MAX_CLUSTER_LIGHTS = 256;
+
+	bool enabled{ true };
+	bool animate{ false };
+	int lightCount{ 1024 };
+	float range{ 1.5f };
+	float intensity{ 1.0f };
+	// share of the lights that are spot lights
+	float spotShare{ 0.5f };
+
+	void init(VulkanEngine* engine);
+	// Recreates the cluster buffers sized after the draw image, call after it was reallocated
+	void resize();
+
+	// Lights are placed randomly inside, call before the first update
+	void setArea(const Aabb& area) { m_Area = area; m_Generated = 0; }
+	// Regenerates the lights when the count changed and moves them along when animated
+	void update(float time);
+	// changes whenever the lights moved or were regenerated, or the index list was resized
+	uint64_t version() const { return m_Version; }
+	// the last binning read back, MAX_FRAMES_IN_FLIGHT frames old
+	const GpuLightListHeader& binningStats() const { return m_BinningStats; }
+	// light references the last binning read back left out, from full tiles, full clusters and a full index list
+	uint32_t droppedLights() const;
+
+	// Culls and bins the lights for the view, returns the address of the GpuClusterFrame the mesh
+	// shading reads, 0 when there is none this frame. Leaves the clusters readable by fragment shaders
+	VkDeviceAddress build(CommandRecorder& recorder, const glm::mat4& view, const glm::mat4& viewProjection, float fovY, float aspect,
+		float nearPlane, float farPlane, VkExtent2D extent, FrameRingBuffer& ring);
+	void drawUI();
+
+private:
+
+	// What a light was generated with, its GpuLight follows from this and the settings
+	struct LightSource
+	{
+		glm::vec3 center;
+		float orbitRadius;
+		float speed;
+		float phase;
+		glm::vec3 color;
+		float rangeScale;
+		// a spot light when below spotShare
+		float spotChoice;
+		float spotCos;
+	};
+
+	void generate(uint32_t count);
+	void createBuffers();
+	void createLightIndices();
+	uint32_t clusterCapacity() const;
+	// Takes in what the binning of the last time this frame ran reported and resizes the index list to it
+	void readStats(uint32_t frameNumber);
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	Aabb m_Area{ glm::vec3(-1.0f), glm::vec3(1.0f) };
+	std::vector<LightSource> m_Sources;
+	std::vector<GpuLight> m_Lights;
+	uint32_t m_Generated{ 0 };
+	// settings and time the lights were last placed with
+	glm::vec3 m_Applied{ -1.0f };
+	float m_Time{ 0.0f };
+	uint64_t m_Version{ 0 };
+
+	// a (first index, count) pair per cluster, and the list they index preceded by its length
+	AllocatedBuffer m_Clusters{};
+	AllocatedBuffer m_LightIndices{};
+	VkDeviceAddress m_ClustersAddress{ 0 };
+	VkDeviceAddress m_LightIndicesAddress{ 0 };
+	uint32_t m_MaxLightIndices{ 0 };
+	// the list header copied back per frame in flight, and the capacity the frame binned with. 0 when it didn't bin
+	AllocatedBuffer m_Readback[MAX_FRAMES_IN_FLIGHT]{};
+	uint32_t m_ReadbackCapacity[MAX_FRAMES_IN_FLIGHT]{};
+	GpuLightListHeader m_BinningStats{};
+	uint32_t m_StatsCapacity{ 0 };
+
+	VkPipelineLayout m_PipelineLayout;
+	VkPipeline m_Pipeline;
+
+	// last build
+	uint32_t m_VisibleLights{ 0 };
+	glm::uvec3 m_Grid{ 0 };
+};
+
+// Steps the light count through powers of two, rendering every frame, and prints the average gpu
+// time of the light binning, the mesh pass and the whole frame at each count
+class LightBenchmark
+{
+public:
+
+	// frames to wait for the profiler to catch up on a new count, and frames averaged after
+	static constexpr uint32_t SETTLE_FRAMES = 8;
+	static constexpr uint32_t MEASURED_FRAMES = 32;
+
+	void start(ClusteredLights& lights);
+	bool running() const { return m_Running; }
+	// step being measured and steps in total
+	uint32_t step() const { return m_Step; }
+	uint32_t stepCount() const { return uint32_t(m_Steps.size()); }
+	// After a frame was submitted, picks the light count of the next one
+	void update(const GpuProfiler& profiler, ClusteredLights& lights);
+
+private:
+
+	struct Step
+	{
+		uint32_t lights;
+		double binning;
+		double meshes;
+		double frame;
+		// most light references any measured frame left out
+		uint32_t dropped;
+	};
+
+	bool m_Running{ false };
+	int m_RestoreCount{ 0 };
+	uint32_t m_Step{ 0 };
+	uint32_t m_Frame{ 0 };
+	std::vector<Step> m_Steps;
+};
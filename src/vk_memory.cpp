@@ -0,0 +1,369 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include <imgui.h>
+
+#include "vk_memory.h"
+
+// vmaCalculateStatistics walks every block, so the fragmentation is refreshed this many frames apart
+static const uint32_t FRAGMENTATION_INTERVAL = 64;
+
+const char* memoryCategoryName(MemoryCategory category)
+{
+	switch (category)
+	{
+	case MEMORY_RENDER_TARGETS: return "render targets";
+	case MEMORY_POST_PROCESS: return "post processing";
+	case MEMORY_UPSCALER: return "upscaler";
+	case MEMORY_UI: return "ui";
+	case MEMORY_TEXTURES: return "textures";
+	case MEMORY_GEOMETRY: return "geometry";
+	case MEMORY_STAGING: return "staging";
+	default: return "unknown";
+	}
+}
+
+void MemorySystem::init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudget)
+{
+	m_MemoryBudget = memoryBudget;
+
+	VmaAllocatorCreateInfo allocatorInfo = {};
+	allocatorInfo.physicalDevice = physicalDevice;
+	allocatorInfo.device = device;
+	allocatorInfo.instance = instance;
+	// lets VMA use dedicated allocations for the large render targets, keeping them out of the shared blocks
+	allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_3;
+	// To use GPU pointers
+	allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+	if (memoryBudget)
+	{
+		allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+	}
+	VK_CHECK(vmaCreateAllocator(&allocatorInfo, &m_Allocator));
+
+	const VkPhysicalDeviceMemoryProperties* memoryProperties;
+	vmaGetMemoryProperties(m_Allocator, &memoryProperties);
+	m_Heaps.assign(memoryProperties->memoryHeapCount, HeapStats{});
+}
+
+void MemorySystem::destroy()
+{
+	if (m_Defragmentation != VK_NULL_HANDLE)
+	{
+		vmaEndDefragmentation(m_Allocator, m_Defragmentation, nullptr);
+		m_Defragmentation = VK_NULL_HANDLE;
+	}
+
+	for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+	{
+		if (m_Categories[i].allocations > 0)
+		{
+			fmt::print(fmt::fg(fmt::color::yellow), "{} allocations ({} bytes) of {} still alive at shutdown\n",
+				m_Categories[i].allocations, m_Categories[i].bytes, memoryCategoryName(MemoryCategory(i)));
+		}
+	}
+
+	vmaDestroyAllocator(m_Allocator);
+	m_Allocator = VK_NULL_HANDLE;
+}
+
+VkResult MemorySystem::createImage(const VkImageCreateInfo& imageInfo, const VmaAllocationCreateInfo& allocationInfo, MemoryCategory category,
+	VkImage* outImage, VmaAllocation* outAllocation)
+{
+	VmaAllocationCreateInfo info = allocationInfo;
+	info.pUserData = reinterpret_cast<void*>(uintptr_t(category));
+
+	VkResult result = vmaCreateImage(m_Allocator, &imageInfo, &info, outImage, outAllocation, nullptr);
+	if (result != VK_SUCCESS)
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Failed to allocate a {}x{} image for {}: {}\n",
+			imageInfo.extent.width, imageInfo.extent.height, memoryCategoryName(category), string_VkResult(result));
+		for (size_t i = 0; i < m_Heaps.size(); i++)
+		{
+			fmt::print("    heap {}: {} of {} MB used\n", i, m_Heaps[i].budget.usage >> 20, m_Heaps[i].budget.budget >> 20);
+		}
+		return result;
+	}
+
+	track(*outAllocation, category);
+	return result;
+}
+
+void MemorySystem::destroyImage(VkImage image, VmaAllocation allocation)
+{
+	untrack(allocation);
+	vmaDestroyImage(m_Allocator, image, allocation);
+}
+
+VkResult MemorySystem::createBuffer(const VkBufferCreateInfo& bufferInfo, const VmaAllocationCreateInfo& allocationInfo, MemoryCategory category,
+	VkBuffer* outBuffer, VmaAllocation* outAllocation, VmaAllocationInfo* outInfo)
+{
+	VmaAllocationCreateInfo info = allocationInfo;
+	info.pUserData = reinterpret_cast<void*>(uintptr_t(category));
+
+	VkResult result = vmaCreateBuffer(m_Allocator, &bufferInfo, &info, outBuffer, outAllocation, outInfo);
+	if (result != VK_SUCCESS)
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Failed to allocate a {} KB buffer for {}: {}\n",
+			bufferInfo.size >> 10, memoryCategoryName(category), string_VkResult(result));
+		for (size_t i = 0; i < m_Heaps.size(); i++)
+		{
+			fmt::print("    heap {}: {} of {} MB used\n", i, m_Heaps[i].budget.usage >> 20, m_Heaps[i].budget.budget >> 20);
+		}
+		return result;
+	}
+
+	track(*outAllocation, category);
+	return result;
+}
+
+void MemorySystem::destroyBuffer(VkBuffer buffer, VmaAllocation allocation)
+{
+	untrack(allocation);
+	vmaDestroyBuffer(m_Allocator, buffer, allocation);
+}
+
+void MemorySystem::setRelocator(VmaAllocation allocation, MemoryRelocator relocator)
+{
+	m_Relocators[allocation] = std::move(relocator);
+}
+
+void MemorySystem::track(VmaAllocation allocation, MemoryCategory category)
+{
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(m_Allocator, allocation, &info);
+
+	// the category also names the allocation, so it shows up in the JSON dump
+	vmaSetAllocationName(m_Allocator, allocation, memoryCategoryName(category));
+
+	CategoryStats& stats = m_Categories[category];
+	stats.bytes += info.size;
+	stats.allocations++;
+	stats.peakBytes = std::max(stats.peakBytes, stats.bytes);
+}
+
+void MemorySystem::untrack(VmaAllocation allocation)
+{
+	if (allocation == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(m_Allocator, allocation, &info);
+	m_Relocators.erase(allocation);
+
+	CategoryStats& stats = m_Categories[uintptr_t(info.pUserData)];
+	stats.bytes -= info.size;
+	stats.allocations--;
+}
+
+void MemorySystem::update(VkCommandBuffer cmd, uint32_t frameNumber)
+{
+	// the budget is cached by VMA and refreshed from the driver once per frame index
+	vmaSetCurrentFrameIndex(m_Allocator, frameNumber);
+
+	std::vector<VmaBudget> budgets(m_Heaps.size());
+	vmaGetHeapBudgets(m_Allocator, budgets.data());
+
+	for (size_t i = 0; i < m_Heaps.size(); i++)
+	{
+		HeapStats& heap = m_Heaps[i];
+		heap.budget = budgets[i];
+		heap.peakUsage = std::max(heap.peakUsage, heap.budget.usage);
+
+		if (heap.budget.budget == 0)
+		{
+			continue;
+		}
+
+		// past the budget the driver starts paging to system memory, so it is worth a line in the log
+		float used = float(heap.budget.usage) / float(heap.budget.budget);
+		if (used > budgetWarning && !heap.warned)
+		{
+			heap.warned = true;
+			fmt::print(fmt::fg(fmt::color::yellow), "Memory heap {} at {:.0f}% of its budget ({} of {} MB){}\n", i, used * 100.0f,
+				heap.budget.usage >> 20, heap.budget.budget >> 20, m_MemoryBudget ? "" : ", estimated without VK_EXT_memory_budget");
+		}
+		else if (used < budgetWarning - 0.1f)
+		{
+			heap.warned = false;
+		}
+	}
+
+	if (frameNumber % FRAGMENTATION_INTERVAL == 0)
+	{
+		updateFragmentation();
+	}
+
+	if (m_Defragmentation != VK_NULL_HANDLE)
+	{
+		stepDefragmentation(cmd, frameNumber);
+	}
+}
+
+void MemorySystem::updateFragmentation()
+{
+	VmaTotalStatistics statistics;
+	vmaCalculateStatistics(m_Allocator, &statistics);
+
+	for (size_t i = 0; i < m_Heaps.size(); i++)
+	{
+		const VmaDetailedStatistics& heap = statistics.memoryHeap[i];
+		uint64_t unused = heap.statistics.blockBytes - heap.statistics.allocationBytes;
+		m_Heaps[i].fragmentation = unused > 0 ? 1.0f - float(heap.unusedRangeSizeMax) / float(unused) : 0.0f;
+	}
+}
+
+void MemorySystem::beginDefragmentation()
+{
+	if (m_Defragmentation != VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	VmaDefragmentationInfo info = {};
+	info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+	info.maxBytesPerPass = maxBytesPerPass;
+	info.maxAllocationsPerPass = maxAllocationsPerPass;
+	VK_CHECK(vmaBeginDefragmentation(m_Allocator, &info, &m_Defragmentation));
+
+	m_PassActive = false;
+	m_Passes = 0;
+}
+
+void MemorySystem::stepDefragmentation(VkCommandBuffer cmd, uint32_t frameNumber)
+{
+	if (m_PassActive)
+	{
+		// the frame that recorded the copies and every frame still using the old places have finished
+		if (frameNumber < m_PassFrame + MAX_FRAMES_IN_FLIGHT)
+		{
+			return;
+		}
+
+		m_PassActive = false;
+		if (vmaEndDefragmentationPass(m_Allocator, m_Defragmentation, &m_Pass) == VK_SUCCESS)
+		{
+			endDefragmentation();
+			return;
+		}
+	}
+
+	if (vmaBeginDefragmentationPass(m_Allocator, m_Defragmentation, &m_Pass) == VK_SUCCESS)
+	{
+		endDefragmentation();
+		return;
+	}
+
+	for (uint32_t i = 0; i < m_Pass.moveCount; i++)
+	{
+		VmaDefragmentationMove& move = m_Pass.pMoves[i];
+		auto it = m_Relocators.find(move.srcAllocation);
+		if (it == m_Relocators.end() || !it->second(cmd, move))
+		{
+			move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+		}
+	}
+
+	m_PassActive = true;
+	m_PassFrame = frameNumber;
+	m_Passes++;
+}
+
+void MemorySystem::endDefragmentation()
+{
+	vmaEndDefragmentation(m_Allocator, m_Defragmentation, &m_LastDefragmentation);
+	m_Defragmentation = VK_NULL_HANDLE;
+	updateFragmentation();
+
+	fmt::print("{} {} allocations, {} KB moved and {} KB freed in {} passes\n",
+		fmt::styled("Defragmented", fmt::fg(fmt::color::white) | fmt::emphasis::bold),
+		m_LastDefragmentation.allocationsMoved, m_LastDefragmentation.bytesMoved >> 10, m_LastDefragmentation.bytesFreed >> 10, m_Passes);
+}
+
+std::string MemorySystem::buildStatsString(bool detailed) const
+{
+	char* json = nullptr;
+	vmaBuildStatsString(m_Allocator, &json, detailed ? VK_TRUE : VK_FALSE);
+	std::string result = json ? json : "";
+	vmaFreeStatsString(m_Allocator, json);
+	return result;
+}
+
+bool MemorySystem::writeStats(const char* path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open())
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Could not write memory stats to {}\n", path);
+		return false;
+	}
+
+	file << buildStatsString(true);
+	fmt::print("{} {}\n", fmt::styled("Memory stats written to", fmt::fg(fmt::color::white) | fmt::emphasis::bold), path);
+	return true;
+}
+
+void MemorySystem::drawUI()
+{
+	if (ImGui::Begin("memory"))
+	{
+		ImGui::Text("Budget: %s", m_MemoryBudget ? "VK_EXT_memory_budget" : "estimated by VMA");
+
+		for (size_t i = 0; i < m_Heaps.size(); i++)
+		{
+			const HeapStats& heap = m_Heaps[i];
+			float used = heap.budget.budget > 0 ? float(heap.budget.usage) / float(heap.budget.budget) : 0.0f;
+
+			char overlay[96];
+			snprintf(overlay, sizeof(overlay), "%llu / %llu MB", (unsigned long long)(heap.budget.usage >> 20), (unsigned long long)(heap.budget.budget >> 20));
+			ImGui::Text("Heap %zu", i);
+			ImGui::SameLine();
+			ImGui::ProgressBar(used, ImVec2(-1.0f, 0.0f), overlay);
+			ImGui::Text("    ours %llu MB in %u blocks, peak %llu MB, fragmentation %.0f%%",
+				(unsigned long long)(heap.budget.statistics.blockBytes >> 20), heap.budget.statistics.blockCount,
+				(unsigned long long)(heap.peakUsage >> 20), heap.fragmentation * 100.0f);
+		}
+
+		ImGui::Separator();
+		if (ImGui::BeginTable("categories", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+		{
+			ImGui::TableSetupColumn("Category");
+			ImGui::TableSetupColumn("Allocations");
+			ImGui::TableSetupColumn("MB");
+			ImGui::TableSetupColumn("Peak MB");
+			ImGui::TableHeadersRow();
+
+			for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+			{
+				const CategoryStats& stats = m_Categories[i];
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::TextUnformatted(memoryCategoryName(MemoryCategory(i)));
+				ImGui::TableNextColumn(); ImGui::Text("%u", stats.allocations);
+				ImGui::TableNextColumn(); ImGui::Text("%.1f", stats.bytes / (1024.0 * 1024.0));
+				ImGui::TableNextColumn(); ImGui::Text("%.1f", stats.peakBytes / (1024.0 * 1024.0));
+			}
+			ImGui::EndTable();
+		}
+
+		ImGui::Separator();
+		if (isDefragmenting())
+		{
+			ImGui::Text("Defragmenting, pass %u", m_Passes);
+		}
+		else if (ImGui::Button("Defragment"))
+		{
+			beginDefragmentation();
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Write stats JSON"))
+		{
+			writeStats("vma_stats.json");
+		}
+		ImGui::Text("Last defragmentation: %u moved, %llu KB freed", m_LastDefragmentation.allocationsMoved,
+			(unsigned long long)(m_LastDefragmentation.bytesFreed >> 10));
+	}
+	ImGui::End();
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vk_types.h"
+
+// What an allocation is for, every allocation made through the MemorySystem is counted in one
+enum MemoryCategory : uint32_t
+{
+	MEMORY_RENDER_TARGETS,
+	MEMORY_POST_PROCESS,
+	MEMORY_UPSCALER,
+	MEMORY_UI,
+	MEMORY_TEXTURES,
+	MEMORY_GEOMETRY,
+	MEMORY_STAGING,
+	MEMORY_CATEGORY_COUNT
+};
+
+const char* memoryCategoryName(MemoryCategory category);
+
+// Moves an allocation during an incremental defragmentation pass. Create the replacement resource,
+// bind it to move.dstTmpAllocation, record any copy into cmd and retire the old resource through
+// the frame deletion queue. Return false to leave the allocation where it is.
+using MemoryRelocator = std::function<bool(VkCommandBuffer cmd, const VmaDefragmentationMove& move)>;
+
+// VMA allocator with the bookkeeping to keep an eye on long sessions: per heap budgets from
+// VK_EXT_memory_budget polled every frame, bytes per MemoryCategory, fragmentation of the
+// memory blocks, incremental defragmentation spread over frames and the JSON stats dump.
+class MemorySystem
+{
+public:
+
+	struct CategoryStats
+	{
+		uint64_t bytes;
+		uint32_t allocations;
+		uint64_t peakBytes;
+	};
+
+	struct HeapStats
+	{
+		VmaBudget budget;
+		uint64_t peakUsage;
+		// 0 when the free space of the heap's blocks is one range, towards 1 the more it is scattered
+		float fragmentation;
+		// reported once until the usage drops again
+		bool warned;
+	};
+
+	// heap usage above this fraction of its budget gets reported
+	float budgetWarning{ 0.9f };
+	// limits of one incremental defragmentation pass, passes run a frame apart
+	uint64_t maxBytesPerPass{ 64ull << 20 };
+	uint32_t maxAllocationsPerPass{ 16 };
+
+	void init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudget);
+	void destroy();
+
+	VmaAllocator allocator() const { return m_Allocator; }
+
+	VkResult createImage(const VkImageCreateInfo& imageInfo, const VmaAllocationCreateInfo& allocationInfo, MemoryCategory category,
+		VkImage* outImage, VmaAllocation* outAllocation);
+	void destroyImage(VkImage image, VmaAllocation allocation);
+	VkResult createBuffer(const VkBufferCreateInfo& bufferInfo, const VmaAllocationCreateInfo& allocationInfo, MemoryCategory category,
+		VkBuffer* outBuffer, VmaAllocation* outAllocation, VmaAllocationInfo* outInfo);
+	void destroyBuffer(VkBuffer buffer, VmaAllocation allocation);
+	// Lets defragmentation move the allocation, only allocations with a relocator are moved
+	void setRelocator(VmaAllocation allocation, MemoryRelocator relocator);
+
+	// Once per frame after the frame fence was waited on, polls the budgets and steps the defragmentation
+	void update(VkCommandBuffer cmd, uint32_t frameNumber);
+
+	// Starts an incremental defragmentation, the passes run from update
+	void beginDefragmentation();
+	bool isDefragmenting() const { return m_Defragmentation != VK_NULL_HANDLE; }
+
+	// vmaBuildStatsString, a JSON description of every block and allocation
+	std::string buildStatsString(bool detailed) const;
+	bool writeStats(const char* path) const;
+
+	const std::vector<HeapStats>& heaps() const { return m_Heaps; }
+	const CategoryStats& category(MemoryCategory category) const { return m_Categories[category]; }
+
+	void drawUI();
+
+private:
+
+	void track(VmaAllocation allocation, MemoryCategory category);
+	void untrack(VmaAllocation allocation);
+	void updateFragmentation();
+	void stepDefragmentation(VkCommandBuffer cmd, uint32_t frameNumber);
+	void endDefragmentation();
+
+	VmaAllocator m_Allocator{ VK_NULL_HANDLE };
+	bool m_MemoryBudget{ false };
+
+	std::vector<HeapStats> m_Heaps;
+	std::array<CategoryStats, MEMORY_CATEGORY_COUNT> m_Categories{};
+	std::unordered_map<VmaAllocation, MemoryRelocator> m_Relocators;
+
+	VmaDefragmentationContext m_Defragmentation{ VK_NULL_HANDLE };
+	VmaDefragmentationPassMoveInfo m_Pass{};
+	bool m_PassActive{ false };
+	uint32_t m_PassFrame{ 0 };
+	uint32_t m_Passes{ 0 };
+	VmaDefragmentationStats m_LastDefragmentation{};
+};
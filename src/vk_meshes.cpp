@@ -0,0 +1,189 @@
+#include <cmath>
+#include <cstring>
+
+#include "vk_meshes.h"
+#include "vk_engine.h"
+#include "vk_simplify.h"
+
+void MeshLibrary::init(VulkanEngine* engine)
+{
+	m_Engine = engine;
+
+	engine->m_MainDeletionQueue.pushFunction([this]()
+		{
+			destroy();
+		});
+}
+
+void MeshLibrary::destroy()
+{
+	if (m_VertexBuffer.buffer != VK_NULL_HANDLE)
+	{
+		m_Engine->DestroyBuffer(m_VertexBuffer);
+		m_Engine->DestroyBuffer(m_IndexBuffer);
+		m_VertexBuffer = {};
+		m_IndexBuffer = {};
+	}
+}
+
+uint32_t MeshLibrary::add(const std::string& name, std::span<const Vertex> vertices, std::span<const uint32_t> indices, bool generateLods)
+{
+	MeshInfo& mesh = m_Meshes.emplace_back();
+	mesh.name = name;
+	mesh.lods[0] = { uint32_t(m_Indices.size()), uint32_t(indices.size()), 0.0f };
+	mesh.lodCount = 1;
+	mesh.vertexOffset = int32_t(m_Vertices.size());
+
+	mesh.bounds = { vertices[0].position, vertices[0].position };
+	for (const Vertex& vertex : vertices)
+	{
+		mesh.bounds.min = glm::min(mesh.bounds.min, vertex.position);
+		mesh.bounds.max = glm::max(mesh.bounds.max, vertex.position);
+	}
+
+	m_Vertices.insert(m_Vertices.end(), vertices.begin(), vertices.end());
+	m_Indices.insert(m_Indices.end(), indices.begin(), indices.end());
+
+	if (generateLods)
+	{
+		std::vector<SimplifiedLevel> levels;
+		MeshSimplify::buildLevels(vertices, indices, MAX_MESH_LODS - 1, 0.5f, levels);
+		for (const SimplifiedLevel& level : levels)
+		{
+			mesh.lods[mesh.lodCount++] = { uint32_t(m_Indices.size()), uint32_t(level.indices.size()), level.error };
+			m_Indices.insert(m_Indices.end(), level.indices.begin(), level.indices.end());
+		}
+	}
+	return uint32_t(m_Meshes.size()) - 1;
+}
+
+void MeshLibrary::upload()
+{
+	// meshes added later replace the buffers, the frame in flight may still draw from the old ones
+	if (m_VertexBuffer.buffer != VK_NULL_HANDLE)
+	{
+		m_Engine->GetCurrentFrame().deletionQueue.pushFunction([vertexBuffer = m_VertexBuffer, indexBuffer = m_IndexBuffer, engine = m_Engine]()
+			{
+				engine->DestroyBuffer(vertexBuffer);
+				engine->DestroyBuffer(indexBuffer);
+			});
+	}
+
+	size_t vertexBytes = m_Vertices.size() * sizeof(Vertex);
+	size_t indexBytes = m_Indices.size() * sizeof(uint32_t);
+	m_VertexBuffer = m_Engine->CreateBuffer(vertexBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_GEOMETRY);
+	m_IndexBuffer = m_Engine->CreateBuffer(indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_GEOMETRY);
+
+	VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = m_VertexBuffer.buffer;
+	m_VertexAddress = vkGetBufferDeviceAddress(m_Engine->m_Device, &addressInfo);
+
+	AllocatedBuffer staging = m_Engine->CreateBuffer(vertexBytes + indexBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_STAGING);
+	uint8_t* mapped = static_cast<uint8_t*>(staging.info.pMappedData);
+	memcpy(mapped, m_Vertices.data(), vertexBytes);
+	memcpy(mapped + vertexBytes, m_Indices.data(), indexBytes);
+
+	m_Engine->ImmediateSubmit([&](VkCommandBuffer cmd)
+		{
+			VkBufferCopy vertexCopy{ 0, 0, vertexBytes };
+			vkCmdCopyBuffer(cmd, staging.buffer, m_VertexBuffer.buffer, 1, &vertexCopy);
+			VkBufferCopy indexCopy{ vertexBytes, 0, indexBytes };
+			vkCmdCopyBuffer(cmd, staging.buffer, m_IndexBuffer.buffer, 1, &indexCopy);
+		});
+
+	m_Engine->DestroyBuffer(staging);
+}
+
+void MeshLibrary::makeCube(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	vertices.clear();
+	indices.clear();
+
+	// four vertices per face for flat normals
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (float side : { -1.0f, 1.0f })
+		{
+			glm::vec3 normal(0.0f);
+			normal[axis] = side;
+			glm::vec3 u(0.0f);
+			glm::vec3 v(0.0f);
+			u[(axis + 1) % 3] = 1.0f;
+			v[(axis + 2) % 3] = side;
+
+			uint32_t first = uint32_t(vertices.size());
+			for (int corner = 0; corner < 4; corner++)
+			{
+				float s = corner & 1 ? 1.0f : -1.0f;
+				float t = corner & 2 ? 1.0f : -1.0f;
+				vertices.push_back({ normal + u * s + v * t, s * 0.5f + 0.5f, normal, t * 0.5f + 0.5f });
+			}
+			// counter clockwise seen from outside
+			uint32_t quad[] = { 0, 1, 3, 0, 3, 2 };
+			for (uint32_t index : quad)
+			{
+				indices.push_back(first + index);
+			}
+		}
+	}
+}
+
+void MeshLibrary::makeSphere(uint32_t rings, uint32_t segments, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	vertices.clear();
+	indices.clear();
+
+	const float pi = 3.14159265f;
+	for (uint32_t ring = 0; ring <= rings; ring++)
+	{
+		float polar = pi * ring / rings;
+		for (uint32_t segment = 0; segment <= segments; segment++)
+		{
+			float azimuth = 2.0f * pi * segment / segments;
+			glm::vec3 normal(std::sin(polar) * std::cos(azimuth), std::cos(polar), std::sin(polar) * std::sin(azimuth));
+			vertices.push_back({ normal, float(segment) / segments, normal, float(ring) / rings });
+		}
+	}
+
+	for (uint32_t ring = 0; ring < rings; ring++)
+	{
+		for (uint32_t segment = 0; segment < segments; segment++)
+		{
+			uint32_t a = ring * (segments + 1) + segment;
+			uint32_t b = a + segments + 1;
+			uint32_t quad[] = { a, a + 1, b, a + 1, b + 1, b };
+			indices.insert(indices.end(), std::begin(quad), std::end(quad));
+		}
+	}
+}
+
+void MeshLibrary::makePyramid(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	vertices.clear();
+	indices.clear();
+
+	glm::vec3 apex(0.0f, 1.0f, 0.0f);
+	glm::vec3 base[4] = { { -1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, 1.0f }, { -1.0f, -1.0f, 1.0f } };
+
+	// sides, one flat triangle each
+	for (int side = 0; side < 4; side++)
+	{
+		glm::vec3 a = base[side];
+		glm::vec3 b = base[(side + 1) % 4];
+		glm::vec3 normal = glm::normalize(glm::cross(apex - a, b - a));
+		uint32_t first = uint32_t(vertices.size());
+		vertices.push_back({ a, 0.0f, normal, 0.0f });
+		vertices.push_back({ apex, 0.5f, normal, 1.0f });
+		vertices.push_back({ b, 1.0f, normal, 0.0f });
+		indices.insert(indices.end(), { first, first + 1, first + 2 });
+	}
+
+	uint32_t first = uint32_t(vertices.size());
+	for (int corner = 0; corner < 4; corner++)
+	{
+		vertices.push_back({ base[corner], float(corner & 1), glm::vec3(0.0f, -1.0f, 0.0f), float(corner >> 1) });
+	}
+	indices.insert(indices.end(), { first, first + 1, first + 2, first, first + 2, first + 3 });
+}
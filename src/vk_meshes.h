@@ -0,0 +1,82 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_types.h"
+#include "vk_scene.h"
+
+class VulkanEngine;
+
+// std430 layout, pulled by the vertex shader through a buffer device address
+struct Vertex
+{
+	glm::vec3 position;
+	float uvX;
+	glm::vec3 normal;
+	float uvY;
+};
+
+// full detail and up to five simplified levels
+static constexpr uint32_t MAX_MESH_LODS = 6;
+
+// An index range of the mesh, all of them use the vertices of the full detail one
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// how far the surface may be from the full detail one, in mesh units
+	float error;
+};
+
+struct MeshInfo
+{
+	std::string name;
+	// lods[0] is the mesh as added, each after that has about half the triangles
+	MeshLod lods[MAX_MESH_LODS];
+	uint32_t lodCount;
+	int32_t vertexOffset;
+	Aabb bounds;
+};
+
+// Every mesh in one vertex and one index buffer, so switching meshes between draws is only a
+// different firstIndex and vertexOffset. The simplified levels of a mesh go into the same index
+// buffer right after it.
+class MeshLibrary
+{
+public:
+
+	void init(VulkanEngine* engine);
+
+	// Kept on the cpu until upload. Simplifies it into its lods unless told not to
+	uint32_t add(const std::string& name, std::span<const Vertex> vertices, std::span<const uint32_t> indices, bool generateLods = true);
+	// Copies everything added so far into device local buffers, waits for the copy
+	void upload();
+
+	uint32_t count() const { return uint32_t(m_Meshes.size()); }
+	const MeshInfo& get(uint32_t mesh) const { return m_Meshes[mesh]; }
+	VkDeviceAddress vertexAddress() const { return m_VertexAddress; }
+	VkBuffer indexBuffer() const { return m_IndexBuffer.buffer; }
+
+	// Unit sized shapes centered on the origin
+	static void makeCube(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+	static void makeSphere(uint32_t rings, uint32_t segments, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+	static void makePyramid(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+private:
+
+	void destroy();
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	std::vector<MeshInfo> m_Meshes;
+	std::vector<Vertex> m_Vertices;
+	std::vector<uint32_t> m_Indices;
+
+	AllocatedBuffer m_VertexBuffer{};
+	AllocatedBuffer m_IndexBuffer{};
+	VkDeviceAddress m_VertexAddress{ 0 };
+};
@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include <fmt/core.h>
+#include <fmt/color.h>
+#include <imgui.h>
+
+#include "vk_meshpass.h"
+#include "vk_engine.h"
+#include "vk_images.h"
+#include "vk_initializers.h"
+#include "vk_instances.h"
+#include "vk_jobs.h"
+#include "vk_recorder.h"
+#include "vk_ringbuffer.h"
+
+static const VkFormat MESH_DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+static const uint32_t LOD_GRAIN = 1024;
+
+void MeshPass::init(VulkanEngine* engine)
+{
+	m_Engine = engine;
+	VkDevice device = engine->m_Device;
+
+	m_Meshes.init(engine);
+
+	m_Materials = engine->CreateBuffer(MAX_MATERIALS * sizeof(GpuMaterial), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_GEOMETRY);
+	VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = m_Materials.buffer;
+	m_MaterialsAddress = vkGetBufferDeviceAddress(device, &addressInfo);
+
+	// everything comes through the addresses in the push constants, only the shadow maps need a descriptor
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(MeshPushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayout shadowLayout = engine->m_Shadows.setLayout();
+	VkPipelineLayoutCreateInfo layoutInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &shadowLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_PipelineLayout));
+
+	createDepthImage();
+	createPipelines();
+
+	engine->m_MainDeletionQueue.pushFunction([=, this]()
+		{
+			for (VkPipeline pipeline : m_Pipelines)
+			{
+				vkDestroyPipeline(device, pipeline, nullptr);
+			}
+			vkDestroyPipelineLayout(device, m_PipelineLayout, nullptr);
+			m_Engine->DestroyImage(m_DepthImage);
+			m_Engine->DestroyBuffer(m_Materials);
+		});
+}
+
+void MeshPass::resize()
+{
+	// the frame in flight may still render into the old one
+	m_Engine->GetCurrentFrame().deletionQueue.pushFunction([depthImage = m_DepthImage, engine = m_Engine]()
+		{
+			engine->DestroyImage(depthImage);
+		});
+	createDepthImage();
+}
+
+void MeshPass::createDepthImage()
+{
+	m_DepthImage = m_Engine->CreateImage(m_Engine->m_DrawImage.imageExtent, MESH_DEPTH_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+}
+
+void MeshPass::createPipelines()
+{
+	VkDevice device = m_Engine->m_Device;
+	for (VkPipeline& pipeline : m_Pipelines)
+	{
+		vkDestroyPipeline(device, pipeline, nullptr);
+		pipeline = VK_NULL_HANDLE;
+	}
+
+	VkFormat colorFormat = m_Engine->m_DrawImage.imageFormat;
+	if (!(VkUtils::formatFeatures(m_Engine->m_PhysicalDevice, colorFormat) & VK_FORMAT_FEATURE_2_COLOR_ATTACHMENT_BIT))
+	{
+		fmt::print(fmt::fg(fmt::color::yellow), "Draw format can't be rendered to, meshes are skipped\n");
+		return;
+	}
+
+	VkShaderModule vertexShader = m_Engine->m_ShaderCache.get(device, "mesh.vert.spv");
+	VkShaderModule fragmentShader = m_Engine->m_ShaderCache.get(device, "mesh.frag.spv");
+
+	VkSpecializationMapEntry unlitEntry{ 0, 0, sizeof(VkBool32) };
+	VkBool32 unlit = VK_FALSE;
+	VkSpecializationInfo specialization{ 1, &unlitEntry, sizeof(VkBool32), &unlit };
+
+	VkPipelineShaderStageCreateInfo stages[2]{};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vertexShader;
+	stages[0].pName = "main";
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = fragmentShader;
+	stages[1].pName = "main";
+	stages[1].pSpecializationInfo = &specialization;
+
+	// vertices are pulled from the vertex buffer address
+	VkPipelineVertexInputStateCreateInfo vertexInput{ .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{ .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewportState{ .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	// the projection flips y, so the counter clockwise meshes stay counter clockwise on screen
+	VkPipelineRasterizationStateCreateInfo rasterizer{ .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{ .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampling.minSampleShading = 1.0f;
+
+	VkPipelineColorBlendAttachmentState blendAttachment{};
+	blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	VkPipelineColorBlendStateCreateInfo colorBlending{ .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &blendAttachment;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{ .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.maxDepthBounds = 1.0f;
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{ .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkPipelineRenderingCreateInfo renderingInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &colorFormat;
+	renderingInfo.depthAttachmentFormat = MESH_DEPTH_FORMAT;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{ .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	pipelineInfo.pNext = &renderingInfo;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = stages;
+	pipelineInfo.pVertexInputState = &vertexInput;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = m_PipelineLayout;
+
+	for (uint32_t pipeline = 0; pipeline < MESH_PIPELINE_COUNT; pipeline++)
+	{
+		unlit = pipeline == MESH_PIPELINE_UNLIT;
+		VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_Pipelines[pipeline]));
+	}
+}
+
+uint32_t MeshPass::addMaterial(const glm::vec4& color)
+{
+	if (m_MaterialCount == MAX_MATERIALS)
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Out of mesh materials, using the last one\n");
+		return MAX_MATERIALS - 1;
+	}
+
+	static_cast<GpuMaterial*>(m_Materials.info.pMappedData)[m_MaterialCount] = { color };
+	return m_MaterialCount++;
+}
+
+uint32_t MeshPass::addRenderItem(const RenderItem& item)
+{
+	if (!DrawBatcher::fitsKey(item) || item.pipeline >= MESH_PIPELINE_COUNT)
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Render item {} {} {} does not fit the batch key\n", item.pipeline, item.material, item.mesh);
+		return INVALID_RENDER_ITEM;
+	}
+	m_RenderItems.push_back(item);
+	return uint32_t(m_RenderItems.size()) - 1;
+}
+
+void MeshPass::selectLods(std::span<const uint32_t> visible, const Scene& scene, const MeshView& view, JobSystem* jobs)
+{
+	m_ObjectLods.resize(scene.size(), 0);
+
+	float refineAbove = lodThreshold * (1.0f + lodHysteresis);
+	float coarsenBelow = lodThreshold * (1.0f - lodHysteresis);
+	auto select = [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				uint32_t object = visible[i];
+				uint32_t handle = scene.renderHandle(object);
+				if (handle >= m_RenderItems.size())
+				{
+					continue;
+				}
+
+				const MeshInfo& mesh = m_Meshes.get(m_RenderItems[handle].mesh);
+				if (forcedLod >= 0)
+				{
+					m_ObjectLods[object] = uint8_t(std::min(uint32_t(forcedLod), mesh.lodCount - 1));
+					continue;
+				}
+
+				// the largest axis scale, the error can't grow by more than that
+				glm::mat4 transform = scene.transform(object);
+				float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+				// to the nearest point of the bounds, from inside them that's full detail
+				Aabb bounds = scene.worldBounds(object);
+				float distance = glm::length(glm::clamp(view.eye, bounds.min, bounds.max) - view.eye);
+				float pixelsPerError = scale * view.pixelsPerUnit / std::max(distance, 1e-4f);
+
+				// finer while this one is clearly too coarse, coarser while the next one is clearly fine
+				uint32_t lod = std::min(uint32_t(m_ObjectLods[object]), mesh.lodCount - 1);
+				while (lod > 0 && mesh.lods[lod].error * pixelsPerError > refineAbove)
+				{
+					lod--;
+				}
+				while (lod + 1 < mesh.lodCount && mesh.lods[lod + 1].error * pixelsPerError < coarsenBelow)
+				{
+					lod++;
+				}
+				m_ObjectLods[object] = uint8_t(lod);
+			}
+		};
+
+	uint32_t count = uint32_t(visible.size());
+	if (jobs)
+	{
+		jobs->parallelFor(count, LOD_GRAIN, select);
+	}
+	else
+	{
+		select(0, count);
+	}
+}
+
+void MeshPass::draw(CommandRecorder& recorder, std::span<const uint32_t> visible, const Scene& scene, const InstanceBuffer& instances,
+	const MeshView& view, FrameRingBuffer& ring, VkExtent2D extent, JobSystem* jobs)
+{
+	VkCommandBuffer cmd = recorder.commandBuffer();
+	m_VisibleObjects = uint32_t(visible.size());
+	m_DrawCalls = 0;
+	std::fill(std::begin(m_LodInstances), std::end(m_LodInstances), 0);
+	m_Triangles = 0;
+	m_FullDetailTriangles = 0;
+	if (!enabled || !available() || m_Meshes.count() == 0)
+	{
+		return;
+	}
+
+	selectLods(visible, scene, view, jobs);
+	batcher.build(visible, scene, m_RenderItems, m_ObjectLods, view.eye, jobs);
+	const std::vector<uint32_t>& batchInstances = batcher.instances();
+	if (batchInstances.empty())
+	{
+		return;
+	}
+
+	// one allocation for the whole frame, every draw starts at its batch through firstInstance
+	RingAllocation indices = ring.allocate(batchInstances.size() * sizeof(uint32_t));
+	if (indices.data == nullptr)
+	{
+		// the ring grows the next time this frame comes around
+		return;
+	}
+	memcpy(indices.data, batchInstances.data(), batchInstances.size() * sizeof(uint32_t));
+
+	// the background compute shader wrote the draw image. The light clusters and shadow maps come with their own barriers
+	VkMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	VkDependencyInfo dependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dependency.memoryBarrierCount = 1;
+	dependency.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(cmd, &dependency);
+
+	VkUtils::transitionImage(cmd, m_DepthImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+
+	VkRenderingAttachmentInfo colorAttachment = VkInit::attachmentInfo(m_Engine->m_DrawImage.imageView, nullptr, VK_IMAGE_LAYOUT_GENERAL);
+	VkClearValue depthClear{};
+	depthClear.depthStencil.depth = 1.0f;
+	VkRenderingAttachmentInfo depthAttachment = VkInit::attachmentInfo(m_DepthImage.imageView, &depthClear, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	VkRenderingInfo renderInfo = VkInit::renderingInfo(extent, &colorAttachment, &depthAttachment);
+	vkCmdBeginRendering(cmd, &renderInfo);
+
+	VkViewport viewport{ 0.0f, 0.0f, float(extent.width), float(extent.height), 0.0f, 1.0f };
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+	VkRect2D scissor{ { 0, 0 }, extent };
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	const VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	MeshPushConstants constants{};
+	constants.viewProjection = view.viewProjection;
+	constants.vertices = m_Meshes.vertexAddress();
+	constants.instances = instances.deviceAddress();
+	constants.instanceIndices = indices.address;
+	constants.materials = m_MaterialsAddress;
+	constants.clusterFrame = view.clusterFrame;
+	constants.shadowFrame = view.shadowFrame;
+	VkDescriptorSet shadowSet = m_Engine->m_Shadows.descriptorSet();
+	recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &shadowSet);
+	recorder.pushConstants(m_PipelineLayout, stages, 0, offsetof(MeshPushConstants, material), &constants);
+	vkCmdBindIndexBuffer(cmd, m_Meshes.indexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+	// batches come sorted by pipeline then material, the recorder drops the binds of the runs
+	for (const DrawBatch& batch : batcher.batches())
+	{
+		if (batch.item.pipeline >= MESH_PIPELINE_COUNT)
+		{
+			continue;
+		}
+		recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipelines[batch.item.pipeline]);
+		recorder.pushConstants(m_PipelineLayout, stages, offsetof(MeshPushConstants, material), sizeof(uint32_t), &batch.item.material);
+
+		const MeshInfo& mesh = m_Meshes.get(batch.item.mesh);
+		const MeshLod& lod = mesh.lods[batch.lod];
+		vkCmdDrawIndexed(cmd, lod.indexCount, batch.instanceCount, lod.firstIndex, mesh.vertexOffset, batch.firstInstance);
+		m_DrawCalls++;
+
+		m_LodInstances[batch.lod] += batch.instanceCount;
+		m_Triangles += uint64_t(lod.indexCount / 3) * batch.instanceCount;
+		m_FullDetailTriangles += uint64_t(mesh.lods[0].indexCount / 3) * batch.instanceCount;
+	}
+
+	vkCmdEndRendering(cmd);
+
+	// post processing reads and writes the draw image from compute shaders
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+	vkCmdPipelineBarrier2(cmd, &dependency);
+}
+
+void MeshPass::drawUI()
+{
+	ImGui::Checkbox("Draw meshes", &enabled);
+	if (!available())
+	{
+		ImGui::Text("Draw format can't be rendered to");
+		return;
+	}
+	ImGui::Checkbox("Merge draws", &batcher.merge);
+	ImGui::SliderInt("Depth buckets", &batcher.depthBuckets, 1, 64);
+	// without merging every visible object would be its own draw
+	ImGui::Text("Draw calls: %u before merging, %u after", m_VisibleObjects, m_DrawCalls);
+	ImGui::Text("%u meshes, %u materials", m_Meshes.count(), m_MaterialCount);
+	const RenderQueue& queue = batcher.queue();
+	ImGui::Text("Queue sort: %u keys, %u radix passes, %.3f ms", queue.size(), queue.sortPasses(), queue.sortMilliseconds());
+
+	ImGui::SliderFloat("LOD error (px)", &lodThreshold, 0.1f, 16.0f, "%.2f", ImGuiSliderFlags_Logarithmic);
+	ImGui::SliderFloat("LOD hysteresis", &lodHysteresis, 0.0f, 0.9f);
+	ImGui::SliderInt("Force LOD", &forcedLod, -1, int(MAX_MESH_LODS) - 1, forcedLod < 0 ? "off" : "%d");
+	double saved = m_FullDetailTriangles > 0 ? 100.0 * (1.0 - double(m_Triangles) / double(m_FullDetailTriangles)) : 0.0;
+	ImGui::Text("Triangles: %llu of %llu at full detail, %.1f%% saved", (unsigned long long)m_Triangles, (unsigned long long)m_FullDetailTriangles, saved);
+	ImGui::Text("Instances per LOD:");
+	for (uint32_t instances : m_LodInstances)
+	{
+		ImGui::SameLine();
+		ImGui::Text("%u", instances);
+	}
+	for (uint32_t i = 0; i < m_Meshes.count(); i++)
+	{
+		const MeshInfo& mesh = m_Meshes.get(i);
+		ImGui::Text("%s: %u LODs, %u to %u triangles", mesh.name.c_str(), mesh.lodCount, mesh.lods[0].indexCount / 3,
+			mesh.lods[mesh.lodCount - 1].indexCount / 3);
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_types.h"
+#include "vk_batching.h"
+#include "vk_meshes.h"
+
+class VulkanEngine;
+class Scene;
+class InstanceBuffer;
+class FrameRingBuffer;
+class CommandRecorder;
+class JobSystem;
+
+// Pipelines of the mesh pass, the pipeline of a RenderItem
+enum MeshPipeline : uint32_t
+{
+	MESH_PIPELINE_LIT,
+	MESH_PIPELINE_UNLIT,
+	MESH_PIPELINE_COUNT
+};
+
+// std430 layout, match mesh.glsl
+struct GpuMaterial
+{
+	glm::vec4 color;
+};
+
+// match mesh.glsl
+struct MeshPushConstants
+{
+	glm::mat4 viewProjection;
+	VkDeviceAddress vertices;
+	VkDeviceAddress instances;
+	VkDeviceAddress instanceIndices;
+	VkDeviceAddress materials;
+	VkDeviceAddress clusterFrame;
+	VkDeviceAddress shadowFrame;
+	uint32_t material;
+	uint32_t padding;
+};
+static_assert(sizeof(MeshPushConstants) <= 128);
+
+// Camera of a mesh pass draw
+struct MeshView
+{
+	glm::mat4 viewProjection;
+	glm::vec3 eye;
+	// pixels a unit long facing the camera at distance one covers on the draw image
+	float pixelsPerUnit;
+	// GpuClusterFrame of the lights shading this view, 0 for none
+	VkDeviceAddress clusterFrame;
+	// GpuShadowFrame of the sun, 0 for none
+	VkDeviceAddress shadowFrame;
+};
+
+// Rasterizes the visible scene objects into the draw image on top of the background. Objects are
+// grouped by their RenderItem into one instanced draw each: the instance buffer indices of every
+// batch go into the frame ring buffer, and the shaders fetch vertices, transforms and materials
+// through buffer device addresses, so a draw only changes the pipeline, the material push constant
+// and the index range. Those go through a CommandRecorder, which drops the ones already set.
+// Every object is drawn with the coarsest lod of its mesh whose error projects to less than
+// lodThreshold pixels, and only switches once the error is past the threshold by the hysteresis.
+class MeshPass
+{
+public:
+
+	static constexpr uint32_t MAX_MATERIALS = 256;
+
+	bool enabled{ true };
+	DrawBatcher batcher;
+	// screen space error in pixels an object's lod may have
+	float lodThreshold{ 1.0f };
+	// share of the threshold the error has to move past it by before the lod changes
+	float lodHysteresis{ 0.25f };
+	// draws everything with this lod, or the coarsest one a mesh has. -1 picks by screen space error
+	int forcedLod{ -1 };
+
+	void init(VulkanEngine* engine);
+	// Recreates the depth image sized after the draw image, call after it was reallocated
+	void resize();
+	// For the current draw image format, call after it changed with the gpu idle
+	void createPipelines();
+
+	// the draw image format can be rendered to
+	bool available() const { return m_Pipelines[0] != VK_NULL_HANDLE; }
+
+	MeshLibrary& meshes() { return m_Meshes; }
+	const std::vector<RenderItem>& renderItems() const { return m_RenderItems; }
+	uint32_t addMaterial(const glm::vec4& color);
+	// INVALID_RENDER_ITEM when the item doesn't fit the batch key or names no pipeline
+	uint32_t addRenderItem(const RenderItem& item);
+
+	// Draws the visible objects into the draw image, which stays in VK_IMAGE_LAYOUT_GENERAL
+	void draw(CommandRecorder& recorder, std::span<const uint32_t> visible, const Scene& scene, const InstanceBuffer& instances,
+		const MeshView& view, FrameRingBuffer& ring, VkExtent2D extent, JobSystem* jobs = nullptr);
+	void drawUI();
+
+private:
+
+	void createDepthImage();
+	void selectLods(std::span<const uint32_t> visible, const Scene& scene, const MeshView& view, JobSystem* jobs);
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	MeshLibrary m_Meshes;
+	std::vector<RenderItem> m_RenderItems;
+	uint32_t m_MaterialCount{ 0 };
+	// host visible, only written while setting up the scene
+	AllocatedBuffer m_Materials{};
+	VkDeviceAddress m_MaterialsAddress{ 0 };
+
+	AllocatedImage m_DepthImage{};
+	VkPipelineLayout m_PipelineLayout;
+	VkPipeline m_Pipelines[MESH_PIPELINE_COUNT]{};
+
+	// lod of every scene object, kept while it is out of view
+	std::vector<uint8_t> m_ObjectLods;
+
+	// last draw
+	uint32_t m_VisibleObjects{ 0 };
+	uint32_t m_DrawCalls{ 0 };
+	uint32_t m_LodInstances[MAX_MESH_LODS]{};
+	uint64_t m_Triangles{ 0 };
+	uint64_t m_FullDetailTriangles{ 0 };
+};
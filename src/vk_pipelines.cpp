@@ -1,9 +1,27 @@
 #include <fstream>
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <string>
 
 #include "vk_pipelines.h"
 #include "vk_initializers.h"
+#include "vk_embedded_shaders.h"
 
-bool VkUtils::loadShaderModule(const char* filePath, VkDevice device, VkShaderModule* outShaderModule)
+std::span<const uint32_t> VkUtils::findEmbeddedShader(std::string_view name)
+{
+    for (const EmbeddedShaders::ShaderBinary& binary : EmbeddedShaders::binaries)
+    {
+        if (binary.name == name)
+        {
+            return binary.code;
+        }
+    }
+
+    return {};
+}
+
+bool VkUtils::loadShaderFile(const char* filePath, std::vector<uint32_t>& outCode)
 {
     // open the file. With cursor at the end
     std::ifstream file(filePath, std::ios::ate | std::ios::binary);
@@ -19,26 +37,35 @@ bool VkUtils::loadShaderModule(const char* filePath, VkDevice device, VkShaderMo
 
     // spirv expects the buffer to be on uint32, so make sure to reserve a int
     // vector big enough for the entire file
-    std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
+    outCode.resize(fileSize / sizeof(uint32_t));
 
     // put file cursor at beginning
     file.seekg(0);
 
     // load the entire file into the buffer
-    file.read((char*)buffer.data(), fileSize);
+    file.read((char*)outCode.data(), fileSize);
 
     // now that the file is loaded into the buffer, we can close it
     file.close();
 
-    // create a new shader module, using the buffer we loaded
+    return true;
+}
+
+bool VkUtils::loadShaderModule(std::span<const uint32_t> code, VkDevice device, VkShaderModule* outShaderModule)
+{
+    if (code.empty())
+    {
+        return false;
+    }
+
+    // create a new shader module straight from the given words, no copy is made
     VkShaderModuleCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     createInfo.pNext = nullptr;
 
-    // codeSize has to be in bytes, so multply the ints in the buffer by size of
-    // int to know the real size of the buffer
-    createInfo.codeSize = buffer.size() * sizeof(uint32_t);
-    createInfo.pCode = buffer.data();
+    // codeSize has to be in bytes
+    createInfo.codeSize = code.size_bytes();
+    createInfo.pCode = code.data();
 
     // check that the creation goes well.
     VkShaderModule shaderModule;
@@ -48,4 +75,235 @@ bool VkUtils::loadShaderModule(const char* filePath, VkDevice device, VkShaderMo
     }
     *outShaderModule = shaderModule;
     return true;
-}
\ No newline at end of file
+}
+
+static const struct
+{
+    ShaderPermutationBits bit;
+    const char* name;
+} shaderPermutationNames[] =
+{
+    { SHADER_PERMUTATION_FP16, "fp16" },
+    { SHADER_PERMUTATION_SUBGROUP, "subgroup" },
+    { SHADER_PERMUTATION_DRAW_R11G11B10, "draw_format_r11f_g11f_b10f" },
+    { SHADER_PERMUTATION_DRAW_RGBA8, "draw_format_rgba8" },
+    { SHADER_PERMUTATION_DRAW_UNTYPED, "draw_format_untyped" },
+};
+
+static std::vector<std::string> shaderPermutationTokens(uint32_t permutation)
+{
+    std::vector<std::string> tokens;
+    for (const auto& entry : shaderPermutationNames)
+    {
+        if (permutation & entry.bit)
+        {
+            tokens.push_back(entry.name);
+        }
+    }
+
+    // CMake sorts the defines of a variant
+    std::sort(tokens.begin(), tokens.end());
+    return tokens;
+}
+
+std::string VkUtils::shaderPermutationFile(const char* shaderName, uint32_t permutation)
+{
+    std::string file = shaderName;
+
+    std::vector<std::string> tokens = shaderPermutationTokens(permutation);
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        file += (i == 0 ? "." : "_") + tokens[i];
+    }
+
+    return file + ".spv";
+}
+
+std::string VkUtils::shaderPermutationLabel(uint32_t permutation)
+{
+    std::string label;
+    for (const std::string& token : shaderPermutationTokens(permutation))
+    {
+        label += (label.empty() ? "" : " + ") + token;
+    }
+
+    return label.empty() ? "fp32" : label;
+}
+
+uint32_t VkUtils::selectShaderPermutation(const char* shaderName, uint32_t supported, uint32_t required)
+{
+    supported &= ~required;
+
+    // shaders without variants for the required defines don't depend on them, so retry without
+    for (uint32_t fixed : { required, 0u })
+    {
+        uint32_t best = 0;
+        int bestFeatures = -1;
+
+        // walk every subset of the supported features, preferring the ones enabling the most of them
+        for (uint32_t permutation = supported;; permutation = (permutation - 1) & supported)
+        {
+            int features = std::popcount(permutation);
+            if (features > bestFeatures && !findEmbeddedShader(shaderPermutationFile(shaderName, permutation | fixed)).empty())
+            {
+                best = permutation | fixed;
+                bestFeatures = features;
+            }
+
+            if (permutation == 0)
+            {
+                break;
+            }
+        }
+
+        if (bestFeatures >= 0)
+        {
+            return best;
+        }
+    }
+
+    return 0;
+}
+
+VkPipeline VkUtils::createComputePipeline(VkDevice device, VkPipelineLayout layout, VkShaderModule shaderModule, WorkgroupSize workgroupSize,
+    uint32_t requiredSubgroupSize, std::span<const uint32_t> specConstants)
+{
+    // local_size_x_id = 0, local_size_y_id = 1 in the shaders, followed by the shader specific constants
+    std::vector<uint32_t> specData = { workgroupSize.x, workgroupSize.y };
+    specData.insert(specData.end(), specConstants.begin(), specConstants.end());
+
+    std::vector<VkSpecializationMapEntry> specEntries(specData.size());
+    for (uint32_t i = 0; i < specEntries.size(); i++)
+    {
+        specEntries[i].constantID = i;
+        specEntries[i].offset = i * sizeof(uint32_t);
+        specEntries[i].size = sizeof(uint32_t);
+    }
+
+    VkSpecializationInfo specInfo{};
+    specInfo.mapEntryCount = (uint32_t)specEntries.size();
+    specInfo.pMapEntries = specEntries.data();
+    specInfo.dataSize = specData.size() * sizeof(uint32_t);
+    specInfo.pData = specData.data();
+
+    VkPipelineShaderStageCreateInfo stageinfo{};
+    stageinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageinfo.pNext = nullptr;
+    stageinfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    stageinfo.module = shaderModule;
+    stageinfo.pName = "main";
+    stageinfo.pSpecializationInfo = &specInfo;
+
+    // wave size for the subgroup variants. Their shuffles read the neighbouring lanes, so every
+    // subgroup has to be full, which needs the workgroup width to be a multiple of the size
+    VkPipelineShaderStageRequiredSubgroupSizeCreateInfo subgroupSizeInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO };
+    subgroupSizeInfo.requiredSubgroupSize = requiredSubgroupSize;
+    if (requiredSubgroupSize != 0)
+    {
+        stageinfo.pNext = &subgroupSizeInfo;
+        stageinfo.flags |= VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT;
+    }
+
+    VkComputePipelineCreateInfo computePipelineCreateInfo{};
+    computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    computePipelineCreateInfo.pNext = nullptr;
+    computePipelineCreateInfo.layout = layout;
+    computePipelineCreateInfo.stage = stageinfo;
+
+    VkPipeline pipeline;
+    VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &pipeline));
+
+    return pipeline;
+}
+
+static uint64_t hashSpirv(std::span<const uint32_t> code)
+{
+    // FNV-1a over the words, seeded with the size so truncated binaries never collide with the full one
+    uint64_t hash = 14695981039346656037ull ^ code.size();
+    for (uint32_t word : code)
+    {
+        hash ^= word;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+VkShaderModule ShaderCache::get(VkDevice device, const char* name)
+{
+    auto named = names.find(name);
+    if (named != names.end())
+    {
+        return named->second;
+    }
+
+    std::vector<uint32_t> diskCode;
+    std::span<const uint32_t> code;
+
+    if (const char* overrideDir = std::getenv("VULKAN_RENDERER_SHADER_DIR"))
+    {
+        std::string path = std::string(overrideDir) + "/" + name;
+        if (VkUtils::loadShaderFile(path.c_str(), diskCode))
+        {
+            code = diskCode;
+        }
+        else
+        {
+            fmt::print(fmt::fg(fmt::color::yellow), "Shader override {} not found, using embedded copy\n", path);
+        }
+    }
+
+    if (code.empty())
+    {
+        code = VkUtils::findEmbeddedShader(name);
+    }
+
+    if (code.empty())
+    {
+        fmt::print(fmt::fg(fmt::color::red), "Unknown shader {}\n", name);
+        return VK_NULL_HANDLE;
+    }
+
+    uint64_t hash = hashSpirv(code);
+    auto [first, last] = modules.equal_range(hash);
+    for (auto it = first; it != last; ++it)
+    {
+        if (std::equal(code.begin(), code.end(), it->second.code.begin(), it->second.code.end()))
+        {
+            names[name] = it->second.module;
+            return it->second.module;
+        }
+    }
+
+    VkShaderModule shaderModule;
+    if (!VkUtils::loadShaderModule(code, device, &shaderModule))
+    {
+        fmt::print(fmt::fg(fmt::color::red), "Error when building {} shader module\n", name);
+        return VK_NULL_HANDLE;
+    }
+
+    // embedded code is kept by the executable, only files read from disk need a home
+    bool fromDisk = !diskCode.empty() && code.data() == diskCode.data();
+    auto stored = modules.emplace(hash, Module{ {}, fromDisk ? std::move(diskCode) : std::vector<uint32_t>(), shaderModule });
+    Module& entry = stored->second;
+    entry.code = fromDisk ? std::span<const uint32_t>(entry.ownedCode) : code;
+    names[name] = shaderModule;
+    return shaderModule;
+}
+
+void ShaderCache::destroy(VkDevice device)
+{
+    for (auto& [hash, entry] : modules)
+    {
+        vkDestroyShaderModule(device, entry.module, nullptr);
+    }
+
+    modules.clear();
+    names.clear();
+}
+
+void VkUtils::pushComputeConstants(VkCommandBuffer cmd, VkPipelineLayout layout, const ComputePushConstants& data, VkExtent2D extent, glm::vec2 jitter)
+{
+    ComputeFrameConstants frame{ glm::ivec2(extent.width, extent.height), jitter };
+    vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &data);
+    vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, COMPUTE_FRAME_OFFSET, sizeof(ComputeFrameConstants), &frame);
+}
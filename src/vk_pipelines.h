@@ -1,8 +1,116 @@
 #pragma once
 
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
 #include "vk_types.h"
 
+// Local size of a 2D compute shader, fed through specialization constants 0 and 1
+struct WorkgroupSize
+{
+	uint32_t x;
+	uint32_t y;
+};
+
+struct ComputePushConstants
+{
+	glm::vec4 data1;
+	glm::vec4 data2;
+	glm::vec4 data3;
+	glm::vec4 data4;
+};
+
+// Pushed right after the effect data. With dynamic resolution only a corner of the draw image is
+// rendered to, and temporal upscaling shades every frame at a different sub-pixel offset
+struct ComputeFrameConstants
+{
+	glm::ivec2 extent;
+	// in texels, added to the texel coordinate an effect is evaluated at
+	glm::vec2 jitter;
+};
+
+constexpr uint32_t COMPUTE_FRAME_OFFSET = sizeof(ComputePushConstants);
+constexpr uint32_t COMPUTE_PUSH_CONSTANTS_SIZE = COMPUTE_FRAME_OFFSET + sizeof(ComputeFrameConstants);
+
+struct ComputeEffect
+{
+	const char* name;
+	const char* shaderName;
+
+	VkPipeline pipeline{ VK_NULL_HANDLE };
+	VkPipelineLayout layout;
+	WorkgroupSize workgroupSize;
+	// ShaderPermutationBits of the variant in use and the subgroup size it requires, 0 if none
+	uint32_t permutation;
+	uint32_t subgroupSize;
+	// samples the streamed textures, bound at set 1 of its layout
+	bool streamedTextures{ false };
+
+	ComputePushConstants data;
+};
+
+// Defines a shader variant was built with, matching the "// permute:" lines of the shaders
+enum ShaderPermutationBits : uint32_t
+{
+	SHADER_PERMUTATION_FP16 = 1 << 0,
+	SHADER_PERMUTATION_SUBGROUP = 1 << 1,
+	// format qualifier of the draw image, at most one is set and none means rgba16f
+	SHADER_PERMUTATION_DRAW_R11G11B10 = 1 << 2,
+	SHADER_PERMUTATION_DRAW_RGBA8 = 1 << 3,
+	SHADER_PERMUTATION_DRAW_UNTYPED = 1 << 4,
+};
+
 namespace VkUtils
 {
-	bool loadShaderModule(const char* filePath, VkDevice device, VkShaderModule* outShaderModule);
-}
\ No newline at end of file
+	// Returns the SPIR-V embedded at build time for the given file name (e.g. "sky.comp.spv"), empty if unknown
+	std::span<const uint32_t> findEmbeddedShader(std::string_view name);
+	bool loadShaderFile(const char* filePath, std::vector<uint32_t>& outCode);
+	bool loadShaderModule(std::span<const uint32_t> code, VkDevice device, VkShaderModule* outShaderModule);
+
+	// "sky.comp" with FP16 | SUBGROUP -> "sky.comp.fp16_subgroup.spv", the same naming CMake uses
+	std::string shaderPermutationFile(const char* shaderName, uint32_t permutation);
+	// Human readable list of the enabled permutation defines, for the overlay
+	std::string shaderPermutationLabel(uint32_t permutation);
+	// Richest variant of the shader that was built and only needs features from the supported mask.
+	// The required bits are part of every candidate, unless the shader has no variants for them at all.
+	uint32_t selectShaderPermutation(const char* shaderName, uint32_t supported, uint32_t required = 0);
+
+	// requiredSubgroupSize of 0 leaves the subgroup size to the driver. Otherwise the subgroups are full,
+	// and workgroupSize.x has to be a multiple of it.
+	// specConstants feed the shader's own uint specialization constants, starting at constant_id 2.
+	VkPipeline createComputePipeline(VkDevice device, VkPipelineLayout layout, VkShaderModule shaderModule, WorkgroupSize workgroupSize,
+		uint32_t requiredSubgroupSize = 0, std::span<const uint32_t> specConstants = {});
+
+	// Pushes the effect data followed by the frame constants, for layouts with a COMPUTE_PUSH_CONSTANTS_SIZE range
+	void pushComputeConstants(VkCommandBuffer cmd, VkPipelineLayout layout, const ComputePushConstants& data, VkExtent2D extent, glm::vec2 jitter = glm::vec2(0.0f));
+
+	// Number of workgroups of the given size needed to cover every texel
+	inline uint32_t divideRoundUp(uint32_t value, uint32_t divisor) { return (value + divisor - 1) / divisor; }
+}
+
+// Creates shader modules by name and keeps them alive until destroy().
+// A name is only read and hashed the first time it is asked for. Identical binaries under different
+// names share one VkShaderModule, found by a hash of their SPIR-V and confirmed by comparing the code.
+// Setting the VULKAN_RENDERER_SHADER_DIR environment variable loads shaders from that directory
+// instead of the embedded copies, which is handy while iterating on shaders.
+struct ShaderCache
+{
+	struct Module
+	{
+		// the embedded array itself, or ownedCode for files from VULKAN_RENDERER_SHADER_DIR
+		std::span<const uint32_t> code;
+		std::vector<uint32_t> ownedCode;
+		VkShaderModule module;
+	};
+
+	std::unordered_map<std::string, VkShaderModule> names;
+	// binaries with the same hash but different code get a module each
+	std::unordered_multimap<uint64_t, Module> modules;
+
+	VkShaderModule get(VkDevice device, const char* name);
+	void destroy(VkDevice device);
+};
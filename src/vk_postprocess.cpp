@@ -0,0 +1,502 @@
+#include <algorithm>
+#include <cmath>
+
+#include <imgui.h>
+
+#include "vk_postprocess.h"
+#include "vk_engine.h"
+#include "vk_images.h"
+#include "vk_initializers.h"
+#include "vk_profiler.h"
+
+static const WorkgroupSize FUSED_WORKGROUP = { 16, 16 };
+static const WorkgroupSize BLOOM_WORKGROUP = { 8, 8 };
+
+void PostProcessChain::init(VulkanEngine* engine)
+{
+	m_Engine = engine;
+	VkDevice device = engine->m_Device;
+
+	// fixed order, passes are toggled rather than reordered
+	passes =
+	{
+		{ "Exposure", POST_STAGE_EXPOSURE, false },
+		{ "Bloom", POST_STAGE_BLOOM, false },
+		{ "Tonemap", POST_STAGE_TONEMAP, false },
+		{ "Color grading", POST_STAGE_GRADING, false },
+		{ "Sharpen", POST_STAGE_SHARPEN, false },
+	};
+
+	effect = {};
+	effect.name = "post process";
+	effect.shaderName = "postprocess.comp";
+	effect.workgroupSize = FUSED_WORKGROUP;
+	effect.data.data1 = glm::vec4(0.0f, 0.05f, 1.0f, 0.3f);
+	effect.data.data2 = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+	effect.data.data3 = glm::vec4(0.0f);
+	effect.data.data4 = glm::vec4(1.0f);
+
+	VkSamplerCreateInfo samplerInfo{ .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &m_LinearSampler));
+
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		m_FusedSetLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		m_BloomSetLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = COMPUTE_PUSH_CONSTANTS_SIZE;
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo layoutInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &m_FusedSetLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_FusedPipelineLayout));
+
+	pushConstant.size = sizeof(BloomPushConstants);
+	layoutInfo.pSetLayouts = &m_BloomSetLayout;
+	VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_BloomPipelineLayout));
+
+	effect.layout = m_FusedPipelineLayout;
+
+	reloadShaders();
+	m_DownsampleShader = engine->m_ShaderCache.get(device, "bloom_downsample.comp.spv");
+	VkShaderModule upsampleShader = engine->m_ShaderCache.get(device, "bloom_upsample.comp.spv");
+
+	const uint32_t prefilterOn = 1;
+	const uint32_t prefilterOff = 0;
+	m_PrefilterPipeline = VkUtils::createComputePipeline(device, m_BloomPipelineLayout, m_DownsampleShader, BLOOM_WORKGROUP, 0, { &prefilterOn, 1 });
+	m_DownsamplePipeline = VkUtils::createComputePipeline(device, m_BloomPipelineLayout, m_DownsampleShader, BLOOM_WORKGROUP, 0, { &prefilterOff, 1 });
+	m_UpsamplePipeline = VkUtils::createComputePipeline(device, m_BloomPipelineLayout, upsampleShader, BLOOM_WORKGROUP);
+
+	createTargets();
+
+	engine->m_MainDeletionQueue.pushFunction([=, this]()
+		{
+			retireTargets()();
+
+			for (auto& [stages, pipeline] : m_FusedPipelines)
+			{
+				vkDestroyPipeline(device, pipeline, nullptr);
+			}
+			m_FusedPipelines.clear();
+
+			vkDestroyPipeline(device, m_PrefilterPipeline, nullptr);
+			vkDestroyPipeline(device, m_DownsamplePipeline, nullptr);
+			vkDestroyPipeline(device, m_UpsamplePipeline, nullptr);
+			vkDestroyPipelineLayout(device, m_FusedPipelineLayout, nullptr);
+			vkDestroyPipelineLayout(device, m_BloomPipelineLayout, nullptr);
+
+			vkDestroyDescriptorSetLayout(device, m_FusedSetLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, m_BloomSetLayout, nullptr);
+			vkDestroySampler(device, m_LinearSampler, nullptr);
+		});
+}
+
+void PostProcessChain::resize()
+{
+	// the frame in flight may still read the old targets, they go once it has finished
+	m_Engine->GetCurrentFrame().deletionQueue.pushFunction(retireTargets());
+	createTargets();
+}
+
+void PostProcessChain::reloadShaders()
+{
+	VkDevice device = m_Engine->m_Device;
+
+	// the fused pipelines are rebuilt on demand from the new module
+	if (!m_FusedPipelines.empty())
+	{
+		std::vector<VkPipeline> oldPipelines;
+		for (auto& [stages, pipeline] : m_FusedPipelines)
+		{
+			oldPipelines.push_back(pipeline);
+		}
+		m_FusedPipelines.clear();
+
+		m_Engine->GetCurrentFrame().deletionQueue.pushFunction([=]()
+			{
+				for (VkPipeline pipeline : oldPipelines)
+				{
+					vkDestroyPipeline(device, pipeline, nullptr);
+				}
+			});
+	}
+
+	effect.permutation = VkUtils::selectShaderPermutation(effect.shaderName, 0, m_Engine->m_DrawFormatPermutation);
+	m_FusedShader = m_Engine->m_ShaderCache.get(device, VkUtils::shaderPermutationFile(effect.shaderName, effect.permutation).c_str());
+}
+
+void PostProcessChain::createTargets()
+{
+	VkDevice device = m_Engine->m_Device;
+	const AllocatedImage& drawImage = m_Engine->m_DrawImage;
+
+	// bloom chain starts at half resolution and stops before the levels get too small to matter
+	VkExtent3D bloomExtent = { std::max(drawImage.imageExtent.width / 2, 1u), std::max(drawImage.imageExtent.height / 2, 1u), 1 };
+	VkExtent2D mipExtent = { bloomExtent.width, bloomExtent.height };
+	m_BloomMips = 0;
+	while (m_BloomMips < MAX_BLOOM_MIPS && mipExtent.width >= 2 && mipExtent.height >= 2)
+	{
+		m_BloomMipExtents[m_BloomMips++] = mipExtent;
+		mipExtent = { std::max(mipExtent.width / 2, 1u), std::max(mipExtent.height / 2, 1u) };
+	}
+	m_BloomMips = std::max(m_BloomMips, 1u);
+
+	m_BloomImage = m_Engine->CreateImage(bloomExtent, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, m_BloomMips,
+		MEMORY_POST_PROCESS);
+	for (uint32_t mip = 0; mip < m_BloomMips; mip++)
+	{
+		VkImageViewCreateInfo viewInfo = VkInit::imageviewCreateInfo(m_BloomImage.imageFormat, m_BloomImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+		viewInfo.subresourceRange.baseMipLevel = mip;
+		VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &m_BloomMipViews[mip]));
+	}
+
+	// sharpening reads neighbours, so it cannot write in place
+	m_ScratchImage = m_Engine->CreateImage(drawImage.imageExtent, drawImage.imageFormat,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 1, MEMORY_POST_PROCESS);
+
+	// one fused set plus a downsample and an upsample set per bloom level
+	std::vector<DescriptorAllocator::PoolSizeRatio> sizes =
+	{
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }
+	};
+	m_DescriptorAllocator.initPool(device, 1 + 2 * MAX_BLOOM_MIPS, sizes);
+
+	DescriptorWriter writer;
+	m_FusedSet = m_DescriptorAllocator.allocate(device, m_FusedSetLayout);
+	writer.writeImage(0, drawImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	writer.writeImage(1, m_BloomMipViews[0], m_LinearSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	writer.writeImage(2, m_ScratchImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	writer.updateSet(device, m_FusedSet);
+
+	for (uint32_t mip = 0; mip < m_BloomMips; mip++)
+	{
+		// level 0 downsamples the draw image itself
+		VkImageView source = mip == 0 ? drawImage.imageView : m_BloomMipViews[mip - 1];
+
+		writer.clear();
+		m_DownsampleSets[mip] = m_DescriptorAllocator.allocate(device, m_BloomSetLayout);
+		writer.writeImage(0, source, m_LinearSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(1, m_BloomMipViews[mip], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		writer.updateSet(device, m_DownsampleSets[mip]);
+
+		// level N accumulates the upsampled level N + 1
+		if (mip + 1 < m_BloomMips)
+		{
+			writer.clear();
+			m_UpsampleSets[mip] = m_DescriptorAllocator.allocate(device, m_BloomSetLayout);
+			writer.writeImage(0, m_BloomMipViews[mip + 1], m_LinearSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			writer.writeImage(1, m_BloomMipViews[mip], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+			writer.updateSet(device, m_UpsampleSets[mip]);
+		}
+	}
+}
+
+std::function<void()> PostProcessChain::retireTargets()
+{
+	VulkanEngine* engine = m_Engine;
+	AllocatedImage bloomImage = m_BloomImage;
+	AllocatedImage scratchImage = m_ScratchImage;
+	std::vector<VkImageView> mipViews(m_BloomMipViews, m_BloomMipViews + m_BloomMips);
+	VkDescriptorPool pool = m_DescriptorAllocator.pool;
+
+	return [=]()
+		{
+			vkDestroyDescriptorPool(engine->m_Device, pool, nullptr);
+			for (VkImageView view : mipViews)
+			{
+				vkDestroyImageView(engine->m_Device, view, nullptr);
+			}
+			engine->DestroyImage(bloomImage);
+			engine->DestroyImage(scratchImage);
+		};
+}
+
+std::vector<PostDispatch> PostProcessChain::buildPlan(bool fuse) const
+{
+	const uint32_t drawBytes = VkUtils::bytesPerPixel(m_Engine->m_DrawImage.imageFormat);
+	const uint32_t bloomBytes = VkUtils::bytesPerPixel(m_BloomImage.imageFormat);
+	auto texels = [](VkExtent2D extent) { return uint64_t(extent.width) * extent.height; };
+
+	std::vector<PostDispatch> plan;
+	// per-pixel stages waiting to be evaluated by the next fused dispatch
+	uint32_t pending = 0;
+
+	auto flush = [&]()
+		{
+			if (pending == 0)
+			{
+				return;
+			}
+
+			PostDispatch dispatch{ PostDispatch::FUSED, pending, 0 };
+			for (const PostPass& pass : passes)
+			{
+				if (pending & pass.stage)
+				{
+					dispatch.label += (dispatch.label.empty() ? "" : " + ") + std::string(pass.name);
+				}
+			}
+			dispatch.bytes = fusedBytes(pending);
+			plan.push_back(dispatch);
+			pending = 0;
+		};
+
+	for (const PostPass& pass : passes)
+	{
+		if (!pass.enabled)
+		{
+			continue;
+		}
+
+		if (pass.stage == POST_STAGE_BLOOM)
+		{
+			// The bloom chain only reads the draw image, so it does not break fusion.
+			// Pending stages stay pending, the exposure among them is applied by the prefilter on the fly.
+			for (uint32_t mip = 0; mip < m_BloomMips; mip++)
+			{
+				uint64_t sourceBytes = mip == 0 ? texels(m_Engine->m_DrawExtent) * drawBytes : texels(m_BloomMipExtents[mip - 1]) * bloomBytes;
+				PostDispatch dispatch{ PostDispatch::BLOOM_DOWNSAMPLE, pending & POST_STAGE_EXPOSURE, mip };
+				dispatch.label = fmt::format("Bloom down {}", mip);
+				dispatch.bytes = sourceBytes + texels(m_BloomMipExtents[mip]) * bloomBytes;
+				plan.push_back(dispatch);
+			}
+			for (uint32_t mip = m_BloomMips - 1; mip-- > 0;)
+			{
+				PostDispatch dispatch{ PostDispatch::BLOOM_UPSAMPLE, 0, mip };
+				dispatch.label = fmt::format("Bloom up {}", mip);
+				dispatch.bytes = texels(m_BloomMipExtents[mip + 1]) * bloomBytes + 2 * texels(m_BloomMipExtents[mip]) * bloomBytes;
+				plan.push_back(dispatch);
+			}
+		}
+
+		pending |= pass.stage;
+		if (!fuse)
+		{
+			flush();
+		}
+	}
+	flush();
+
+	return plan;
+}
+
+uint64_t PostProcessChain::fusedBytes(uint32_t stages) const
+{
+	const VkExtent2D extent = m_Engine->m_DrawExtent;
+	uint64_t imageBytes = uint64_t(extent.width) * extent.height * VkUtils::bytesPerPixel(m_Engine->m_DrawImage.imageFormat);
+
+	// one read and one write of the draw image, the sharpen tiles re-read their one texel apron
+	uint64_t bytes = imageBytes * 2;
+	if (stages & POST_STAGE_SHARPEN)
+	{
+		bytes += imageBytes * (18 * 18 - 16 * 16) / (16 * 16);
+	}
+	if (stages & POST_STAGE_BLOOM)
+	{
+		bytes += uint64_t(m_BloomMipExtents[0].width) * m_BloomMipExtents[0].height * VkUtils::bytesPerPixel(m_BloomImage.imageFormat);
+	}
+
+	return bytes;
+}
+
+VkPipeline PostProcessChain::getFusedPipeline(uint32_t stages)
+{
+	auto it = m_FusedPipelines.find(stages);
+	if (it != m_FusedPipelines.end())
+	{
+		return it->second;
+	}
+
+	VkPipeline pipeline = VkUtils::createComputePipeline(m_Engine->m_Device, m_FusedPipelineLayout, m_FusedShader, FUSED_WORKGROUP, 0, { &stages, 1 });
+	m_FusedPipelines[stages] = pipeline;
+	return pipeline;
+}
+
+AllocatedImage& PostProcessChain::draw(VkCommandBuffer cmd, GpuProfiler& profiler)
+{
+	m_LastPlan = buildPlan(fusePasses);
+	m_ResultInScratch = false;
+
+	if (m_LastPlan.empty())
+	{
+		return m_Engine->m_DrawImage;
+	}
+
+	m_ResultInScratch = (m_LastPlan.back().stages & POST_STAGE_SHARPEN) != 0;
+
+	// the fused set always references both images, keep them in the layout it was written with
+	VkUtils::transitionImage(cmd, m_BloomImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	VkUtils::transitionImage(cmd, m_ScratchImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+	for (const PostDispatch& dispatch : m_LastPlan)
+	{
+		// every dispatch consumes what the previous one wrote
+		VkUtils::computeBarrier(cmd);
+
+		uint32_t scope = profiler.beginScope(cmd, dispatch.label.c_str());
+		if (dispatch.kind == PostDispatch::FUSED)
+		{
+			dispatchFused(cmd, dispatch);
+		}
+		else
+		{
+			dispatchBloom(cmd, dispatch);
+		}
+		profiler.endScope(cmd, scope);
+	}
+
+	return m_ResultInScratch ? m_ScratchImage : m_Engine->m_DrawImage;
+}
+
+void PostProcessChain::dispatchBloom(VkCommandBuffer cmd, const PostDispatch& dispatch)
+{
+	float threshold = effect.data.data1.z;
+
+	BloomPushConstants push{};
+	push.params = glm::vec4((dispatch.stages & POST_STAGE_EXPOSURE) ? std::exp2(effect.data.data1.x) : 1.0f, threshold, threshold * 0.5f, 1.0f);
+
+	VkExtent2D destination = m_BloomMipExtents[dispatch.level];
+	VkExtent2D source;
+	VkPipeline pipeline;
+	VkDescriptorSet set;
+
+	if (dispatch.kind == PostDispatch::BLOOM_DOWNSAMPLE)
+	{
+		source = dispatch.level == 0 ? VkExtent2D{ m_Engine->m_DrawImage.imageExtent.width, m_Engine->m_DrawImage.imageExtent.height } : m_BloomMipExtents[dispatch.level - 1];
+		pipeline = dispatch.level == 0 ? m_PrefilterPipeline : m_DownsamplePipeline;
+		set = m_DownsampleSets[dispatch.level];
+	}
+	else
+	{
+		source = m_BloomMipExtents[dispatch.level + 1];
+		pipeline = m_UpsamplePipeline;
+		set = m_UpsampleSets[dispatch.level];
+	}
+
+	push.sourceTexelSize = glm::vec2(1.0f / source.width, 1.0f / source.height);
+	push.destinationSize = glm::ivec2(destination.width, destination.height);
+	push.sourceUVScale = glm::vec2(1.0f);
+	if (dispatch.kind == PostDispatch::BLOOM_DOWNSAMPLE && dispatch.level == 0)
+	{
+		const VkExtent3D& drawImageExtent = m_Engine->m_DrawImage.imageExtent;
+		push.sourceUVScale = glm::vec2(float(m_Engine->m_DrawExtent.width) / drawImageExtent.width, float(m_Engine->m_DrawExtent.height) / drawImageExtent.height);
+	}
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_BloomPipelineLayout, 0, 1, &set, 0, nullptr);
+	vkCmdPushConstants(cmd, m_BloomPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomPushConstants), &push);
+	vkCmdDispatch(cmd, VkUtils::divideRoundUp(destination.width, BLOOM_WORKGROUP.x), VkUtils::divideRoundUp(destination.height, BLOOM_WORKGROUP.y), 1);
+}
+
+void PostProcessChain::dispatchFused(VkCommandBuffer cmd, const PostDispatch& dispatch)
+{
+	VkPipeline pipeline = getFusedPipeline(dispatch.stages);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_FusedPipelineLayout, 0, 1, &m_FusedSet, 0, nullptr);
+	VkUtils::pushComputeConstants(cmd, m_FusedPipelineLayout, effect.data, m_Engine->m_DrawExtent);
+	vkCmdDispatch(cmd, VkUtils::divideRoundUp(m_Engine->m_DrawExtent.width, FUSED_WORKGROUP.x), VkUtils::divideRoundUp(m_Engine->m_DrawExtent.height, FUSED_WORKGROUP.y), 1);
+}
+
+bool PostProcessChain::tonemaps() const
+{
+	return std::any_of(passes.begin(), passes.end(), [](const PostPass& pass) { return pass.stage == POST_STAGE_TONEMAP && pass.enabled; });
+}
+
+void PostProcessChain::drawUI(const GpuProfiler& profiler)
+{
+	if (ImGui::Begin("post processing"))
+	{
+		ImGui::Checkbox("Fuse passes", &fusePasses);
+		ImGui::Separator();
+
+		for (PostPass& pass : passes)
+		{
+			ImGui::Checkbox(pass.name, &pass.enabled);
+		}
+
+		ImGui::Separator();
+		ImGui::SliderFloat("Exposure (EV)", &effect.data.data1.x, -4.0f, 4.0f);
+		ImGui::SliderFloat("Bloom strength", &effect.data.data1.y, 0.0f, 1.0f);
+		ImGui::SliderFloat("Bloom threshold", &effect.data.data1.z, 0.0f, 4.0f);
+		ImGui::SliderFloat("Sharpen", &effect.data.data1.w, 0.0f, 1.0f);
+		ImGui::SliderFloat("Contrast", &effect.data.data2.x, 0.5f, 2.0f);
+		ImGui::SliderFloat("Saturation", &effect.data.data2.y, 0.0f, 2.0f);
+		ImGui::SliderFloat("Temperature", &effect.data.data2.z, -0.5f, 0.5f);
+		ImGui::SliderFloat("Tint", &effect.data.data2.w, -0.5f, 0.5f);
+		ImGui::ColorEdit3("Lift", (float*)&effect.data.data3);
+		ImGui::ColorEdit3("Gain", (float*)&effect.data.data4);
+		ImGui::SliderFloat("Gamma", &effect.data.data4.w, 0.2f, 3.0f);
+
+		ImGui::Separator();
+		if (ImGui::BeginTable("dispatches", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+		{
+			ImGui::TableSetupColumn("Dispatch");
+			ImGui::TableSetupColumn("GPU ms");
+			ImGui::TableSetupColumn("MB");
+			ImGui::TableSetupColumn("GB/s");
+			ImGui::TableHeadersRow();
+
+			double totalMilliseconds = 0.0;
+			uint64_t totalBytes = 0;
+			for (const PostDispatch& dispatch : m_LastPlan)
+			{
+				double milliseconds = profiler.find(dispatch.label.c_str());
+				totalMilliseconds += std::max(milliseconds, 0.0);
+				totalBytes += dispatch.bytes;
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(dispatch.label.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", milliseconds);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", dispatch.bytes / 1e6);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", milliseconds > 0.0 ? dispatch.bytes / (milliseconds * 1e6) : 0.0);
+			}
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("Total (%zu dispatches)", m_LastPlan.size());
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", totalMilliseconds);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", totalBytes / 1e6);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", totalMilliseconds > 0.0 ? totalBytes / (totalMilliseconds * 1e6) : 0.0);
+
+			ImGui::EndTable();
+		}
+
+		// what the same passes would move if every one of them ran on its own
+		uint64_t unfusedBytes = 0;
+		for (const PostDispatch& dispatch : buildPlan(false))
+		{
+			unfusedBytes += dispatch.bytes;
+		}
+		ImGui::Text("Unfused traffic: %.1f MB", unfusedBytes / 1e6);
+	}
+	ImGui::End();
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_descriptors.h"
+#include "vk_pipelines.h"
+
+class GpuProfiler;
+class VulkanEngine;
+
+// Stages of the post processing stack, in the order they are applied. Matches postprocess.glsl
+enum PostStageBits : uint32_t
+{
+	POST_STAGE_EXPOSURE = 1 << 0,
+	POST_STAGE_BLOOM = 1 << 1,
+	POST_STAGE_TONEMAP = 1 << 2,
+	POST_STAGE_GRADING = 1 << 3,
+	POST_STAGE_SHARPEN = 1 << 4,
+};
+
+struct PostPass
+{
+	const char* name;
+	PostStageBits stage;
+	bool enabled;
+};
+
+// A dispatch of the chain after fusing the enabled passes
+struct PostDispatch
+{
+	enum Kind
+	{
+		BLOOM_DOWNSAMPLE,
+		BLOOM_UPSAMPLE,
+		FUSED
+	};
+
+	Kind kind;
+	// FUSED: every PostStageBits evaluated by the dispatch
+	uint32_t stages;
+	// bloom mip written by the bloom dispatches
+	uint32_t level;
+	std::string label;
+	// estimated bytes read and written
+	uint64_t bytes;
+};
+
+struct BloomPushConstants
+{
+	glm::vec4 params; // x exposure scale, y threshold, z soft knee, w upsample radius
+	glm::vec2 sourceTexelSize;
+	glm::ivec2 destinationSize;
+	// part of the source read by the first downsample, the rendered corner of the draw image
+	glm::vec2 sourceUVScale;
+};
+
+// Compute post processing stack run on the draw image after the background effect.
+// Consecutive per-pixel passes are fused into a single dispatch with their intermediates kept
+// in registers, sharpening reuses the shaded tile from shared memory, and the exposure in front
+// of bloom is folded into the bloom prefilter, so the draw image is read and written only once.
+class PostProcessChain
+{
+public:
+
+	std::vector<PostPass> passes;
+	// tunables of every pass share the push constants of the effects, see postprocess.comp for the layout
+	ComputeEffect effect;
+	// runs every pass as its own dispatch when off, to compare against the fused chain
+	bool fusePasses{ true };
+
+	void init(VulkanEngine* engine);
+	// Recreates the images sized after the draw image, call after it was reallocated
+	void resize();
+	// Picks the fused shader variant storing to the current draw format, call after it changed
+	void reloadShaders();
+
+	// Records the chain. Returns the image holding the result, left in VK_IMAGE_LAYOUT_GENERAL
+	AllocatedImage& draw(VkCommandBuffer cmd, GpuProfiler& profiler);
+	void drawUI(const GpuProfiler& profiler);
+	// the tonemap pass is enabled, later passes get display referred colors
+	bool tonemaps() const;
+
+private:
+
+	void createTargets();
+	// Returns a function destroying the current targets, to run once no frame uses them anymore
+	std::function<void()> retireTargets();
+
+	std::vector<PostDispatch> buildPlan(bool fuse) const;
+	VkPipeline getFusedPipeline(uint32_t stages);
+	void dispatchBloom(VkCommandBuffer cmd, const PostDispatch& dispatch);
+	void dispatchFused(VkCommandBuffer cmd, const PostDispatch& dispatch);
+	uint64_t fusedBytes(uint32_t stages) const;
+
+	static constexpr uint32_t MAX_BLOOM_MIPS = 6;
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	AllocatedImage m_BloomImage;
+	VkImageView m_BloomMipViews[MAX_BLOOM_MIPS];
+	VkExtent2D m_BloomMipExtents[MAX_BLOOM_MIPS];
+	uint32_t m_BloomMips{ 0 };
+	AllocatedImage m_ScratchImage;
+	VkSampler m_LinearSampler;
+
+	DescriptorAllocator m_DescriptorAllocator;
+	VkDescriptorSetLayout m_FusedSetLayout;
+	VkDescriptorSetLayout m_BloomSetLayout;
+	VkDescriptorSet m_FusedSet;
+	VkDescriptorSet m_DownsampleSets[MAX_BLOOM_MIPS];
+	VkDescriptorSet m_UpsampleSets[MAX_BLOOM_MIPS];
+
+	VkPipelineLayout m_FusedPipelineLayout;
+	VkPipelineLayout m_BloomPipelineLayout;
+	VkPipeline m_PrefilterPipeline;
+	VkPipeline m_DownsamplePipeline;
+	VkPipeline m_UpsamplePipeline;
+	VkShaderModule m_FusedShader;
+	VkShaderModule m_DownsampleShader;
+	// fused pipelines by PostStageBits, created the first time a combination is used
+	std::unordered_map<uint32_t, VkPipeline> m_FusedPipelines;
+
+	std::vector<PostDispatch> m_LastPlan;
+	bool m_ResultInScratch{ false };
+};
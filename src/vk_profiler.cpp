@@ -0,0 +1,118 @@
+#include "vk_profiler.h"
+
+void GpuProfiler::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily)
+{
+	m_Device = device;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_TimestampPeriod = properties.limits.timestampPeriod;
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	// scopes silently become no-ops when the queue cannot write timestamps
+	m_Enabled = queueFamilies[queueFamily].timestampValidBits != 0;
+	if (!m_Enabled)
+	{
+		return;
+	}
+
+	VkQueryPoolCreateInfo queryPoolInfo{ .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = MAX_SCOPES * 2;
+
+	for (FrameQueries& frame : m_Frames)
+	{
+		VK_CHECK(vkCreateQueryPool(m_Device, &queryPoolInfo, nullptr, &frame.pool));
+	}
+}
+
+void GpuProfiler::destroy()
+{
+	for (FrameQueries& frame : m_Frames)
+	{
+		if (frame.pool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(m_Device, frame.pool, nullptr);
+			frame.pool = VK_NULL_HANDLE;
+		}
+	}
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer cmd, uint32_t frameNumber)
+{
+	if (!m_Enabled)
+	{
+		return;
+	}
+
+	m_Current = &m_Frames[frameNumber % MAX_FRAMES_IN_FLIGHT];
+
+	// the fence of this slot was waited on, so its queries are available without stalling
+	if (m_Current->queryCount > 0)
+	{
+		uint64_t timestamps[MAX_SCOPES * 2];
+		VkResult result = vkGetQueryPoolResults(m_Device, m_Current->pool, 0, m_Current->queryCount,
+			sizeof(uint64_t) * m_Current->queryCount, timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+		if (result == VK_SUCCESS)
+		{
+			m_Results.clear();
+			for (const Scope& scope : m_Current->scopes)
+			{
+				double ticks = double(timestamps[scope.endQuery] - timestamps[scope.beginQuery]);
+				m_Results.push_back({ scope.name, ticks * m_TimestampPeriod / 1e6 });
+			}
+			m_ResultsFrameNumber = m_Current->frameNumber;
+		}
+	}
+
+	m_Current->scopes.clear();
+	m_Current->queryCount = 0;
+	m_Current->frameNumber = frameNumber;
+	vkCmdResetQueryPool(cmd, m_Current->pool, 0, MAX_SCOPES * 2);
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer cmd, const char* name)
+{
+	if (!m_Enabled || m_Current == nullptr || m_Current->queryCount + 2 > MAX_SCOPES * 2)
+	{
+		return UINT32_MAX;
+	}
+
+	Scope scope;
+	scope.name = name;
+	scope.beginQuery = m_Current->queryCount++;
+	scope.endQuery = m_Current->queryCount++;
+
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_Current->pool, scope.beginQuery);
+
+	m_Current->scopes.push_back(scope);
+	return uint32_t(m_Current->scopes.size() - 1);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer cmd, uint32_t scope)
+{
+	if (scope == UINT32_MAX)
+	{
+		return;
+	}
+
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_Current->pool, m_Current->scopes[scope].endQuery);
+}
+
+double GpuProfiler::find(const char* name) const
+{
+	for (const Result& result : m_Results)
+	{
+		if (result.name == name)
+		{
+			return result.milliseconds;
+		}
+	}
+
+	return -1.0;
+}
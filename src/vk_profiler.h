@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vk_types.h"
+
+// GPU timestamp scopes recorded into the frame command buffers.
+// Every frame in flight owns a query pool; its results are read back once the frame fence
+// has been waited on, so timings always lag MAX_FRAMES_IN_FLIGHT frames behind.
+class GpuProfiler
+{
+public:
+
+	struct Result
+	{
+		std::string name;
+		double milliseconds;
+	};
+
+	// maximum number of scopes per frame
+	static constexpr uint32_t MAX_SCOPES = 64;
+
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily);
+	void destroy();
+
+	// Collects the results of the frame that last used this slot and resets its queries.
+	// Call right after waiting on the frame fence, before recording any scope.
+	void beginFrame(VkCommandBuffer cmd, uint32_t frameNumber);
+
+	// Returns a handle for endScope, scopes can nest
+	uint32_t beginScope(VkCommandBuffer cmd, const char* name);
+	void endScope(VkCommandBuffer cmd, uint32_t scope);
+
+	bool isEnabled() const { return m_Enabled; }
+	// Timings of the most recently completed frame, in the order the scopes were opened
+	const std::vector<Result>& results() const { return m_Results; }
+	uint32_t resultsFrameNumber() const { return m_ResultsFrameNumber; }
+	// Milliseconds of the first scope with that name in the last results, negative if absent
+	double find(const char* name) const;
+
+private:
+
+	struct Scope
+	{
+		std::string name;
+		uint32_t beginQuery;
+		uint32_t endQuery;
+	};
+
+	struct FrameQueries
+	{
+		VkQueryPool pool{ VK_NULL_HANDLE };
+		std::vector<Scope> scopes;
+		uint32_t queryCount{ 0 };
+		uint32_t frameNumber{ 0 };
+	};
+
+	VkDevice m_Device{ VK_NULL_HANDLE };
+	bool m_Enabled{ false };
+	double m_TimestampPeriod{ 1.0 };
+	FrameQueries m_Frames[MAX_FRAMES_IN_FLIGHT];
+	FrameQueries* m_Current{ nullptr };
+
+	std::vector<Result> m_Results;
+	uint32_t m_ResultsFrameNumber{ 0 };
+};
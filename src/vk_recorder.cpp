@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cstring>
+
+#include "vk_recorder.h"
+
+void CommandRecorder::begin(VkCommandBuffer cmd)
+{
+	m_Cmd = cmd;
+	m_Stats = {};
+	invalidate();
+}
+
+void CommandRecorder::invalidate()
+{
+	m_Graphics = {};
+	m_Compute = {};
+	m_PushLayout = VK_NULL_HANDLE;
+	m_PushStages = 0;
+	m_PushWritten.fill(false);
+}
+
+void CommandRecorder::bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline)
+{
+	BindPointState& bound = state(bindPoint);
+	if (bound.pipeline == pipeline)
+	{
+		m_Stats.pipelineBindsSkipped++;
+		return;
+	}
+
+	vkCmdBindPipeline(m_Cmd, bindPoint, pipeline);
+	bound.pipeline = pipeline;
+	m_Stats.pipelineBinds++;
+}
+
+void CommandRecorder::bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount,
+	const VkDescriptorSet* sets)
+{
+	BindPointState& bound = state(bindPoint);
+	bool tracked = firstSet + setCount <= MAX_TRACKED_SETS;
+	if (tracked && bound.layout == layout)
+	{
+		bool same = true;
+		for (uint32_t i = 0; i < setCount; i++)
+		{
+			same &= bound.sets[firstSet + i] == sets[i];
+		}
+		if (same)
+		{
+			m_Stats.descriptorBindsSkipped++;
+			return;
+		}
+	}
+
+	vkCmdBindDescriptorSets(m_Cmd, bindPoint, layout, firstSet, setCount, sets, 0, nullptr);
+	m_Stats.descriptorBinds++;
+
+	// sets bound with another layout may have been disturbed, only keep what is known for this one
+	if (bound.layout != layout)
+	{
+		bound.sets = {};
+		bound.layout = layout;
+	}
+	for (uint32_t i = 0; i < setCount && firstSet + i < MAX_TRACKED_SETS; i++)
+	{
+		bound.sets[firstSet + i] = sets[i];
+	}
+}
+
+void CommandRecorder::pushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data)
+{
+	bool tracked = offset + size <= MAX_PUSH_CONSTANT_BYTES;
+	if (tracked && layout == m_PushLayout && stages == m_PushStages)
+	{
+		bool same = memcmp(&m_PushData[offset], data, size) == 0;
+		for (uint32_t i = offset; i < offset + size && same; i++)
+		{
+			same = m_PushWritten[i];
+		}
+		if (same)
+		{
+			m_Stats.pushConstantsSkipped++;
+			return;
+		}
+	}
+
+	vkCmdPushConstants(m_Cmd, layout, stages, offset, size, data);
+	m_Stats.pushConstants++;
+
+	if (layout != m_PushLayout || stages != m_PushStages)
+	{
+		m_PushLayout = layout;
+		m_PushStages = stages;
+		m_PushWritten.fill(false);
+	}
+	if (tracked)
+	{
+		memcpy(&m_PushData[offset], data, size);
+		std::fill(m_PushWritten.begin() + offset, m_PushWritten.begin() + offset + size, true);
+	}
+}
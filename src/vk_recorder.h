@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+
+#include "vk_types.h"
+
+// Records binds and push constants into a command buffer, dropping the ones that would set what is
+// already set. Only knows what went through it: code recording directly in between has to call
+// invalidate, which the engine does at the end of the passes using it.
+class CommandRecorder
+{
+public:
+
+	struct Stats
+	{
+		uint32_t pipelineBinds;
+		uint32_t pipelineBindsSkipped;
+		uint32_t descriptorBinds;
+		uint32_t descriptorBindsSkipped;
+		uint32_t pushConstants;
+		uint32_t pushConstantsSkipped;
+	};
+
+	static constexpr uint32_t MAX_TRACKED_SETS = 4;
+	// the smallest maxPushConstantsSize the spec allows
+	static constexpr uint32_t MAX_PUSH_CONSTANT_BYTES = 128;
+
+	// Starts tracking a new command buffer and the stats of a new frame
+	void begin(VkCommandBuffer cmd);
+	// Forgets the bound state, the next calls record unconditionally
+	void invalidate();
+
+	VkCommandBuffer commandBuffer() const { return m_Cmd; }
+
+	void bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline);
+	void bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount,
+		const VkDescriptorSet* sets);
+	void pushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data);
+
+	const Stats& stats() const { return m_Stats; }
+
+private:
+
+	struct BindPointState
+	{
+		VkPipeline pipeline;
+		VkPipelineLayout layout;
+		std::array<VkDescriptorSet, MAX_TRACKED_SETS> sets;
+	};
+
+	BindPointState& state(VkPipelineBindPoint bindPoint) { return bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE ? m_Compute : m_Graphics; }
+
+	VkCommandBuffer m_Cmd{ VK_NULL_HANDLE };
+	BindPointState m_Graphics{};
+	BindPointState m_Compute{};
+
+	// what was pushed with m_PushLayout, a byte is only compared once it was written
+	VkPipelineLayout m_PushLayout{ VK_NULL_HANDLE };
+	VkShaderStageFlags m_PushStages{ 0 };
+	std::array<uint8_t, MAX_PUSH_CONSTANT_BYTES> m_PushData{};
+	std::array<bool, MAX_PUSH_CONSTANT_BYTES> m_PushWritten{};
+
+	Stats m_Stats{};
+};
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include "vk_renderqueue.h"
+#include "vk_jobs.h"
+
+void RenderQueue::clear()
+{
+	m_Keys.clear();
+	m_Payloads.clear();
+}
+
+void RenderQueue::reserve(uint32_t count)
+{
+	m_Keys.reserve(count);
+	m_Payloads.reserve(count);
+}
+
+void RenderQueue::push(uint64_t key, uint32_t payload)
+{
+	m_Keys.push_back(key);
+	m_Payloads.push_back(payload);
+}
+
+void RenderQueue::sort(JobSystem* jobs)
+{
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point start = Clock::now();
+
+	m_SortPasses = 0;
+	uint32_t count = size();
+	if (count < 2)
+	{
+		m_SortMilliseconds = 0.0;
+		return;
+	}
+
+	uint32_t chunkCount = 1;
+	if (jobs != nullptr && jobs->threadCount() > 0 && count >= PARALLEL_THRESHOLD)
+	{
+		chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	}
+	uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+	auto forEachChunk = [&](const std::function<void(uint32_t chunk, uint32_t begin, uint32_t end)>& body)
+		{
+			auto range = [&](uint32_t chunkBegin, uint32_t chunkEnd)
+				{
+					for (uint32_t chunk = chunkBegin; chunk < chunkEnd; chunk++)
+					{
+						body(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+					}
+				};
+			if (chunkCount > 1)
+			{
+				jobs->parallelFor(chunkCount, 1, range);
+			}
+			else
+			{
+				range(0, 1);
+			}
+		};
+
+	// bits that differ between any two keys, bytes without any are already in order
+	std::vector<uint64_t> chunkDiffering(chunkCount, 0);
+	uint64_t firstKey = m_Keys[0];
+	forEachChunk([&](uint32_t chunk, uint32_t begin, uint32_t end)
+		{
+			uint64_t differing = 0;
+			for (uint32_t i = begin; i < end; i++)
+			{
+				differing |= m_Keys[i] ^ firstKey;
+			}
+			chunkDiffering[chunk] = differing;
+		});
+	uint64_t differing = 0;
+	for (uint64_t chunk : chunkDiffering)
+	{
+		differing |= chunk;
+	}
+
+	m_ScratchKeys.resize(count);
+	m_ScratchPayloads.resize(count);
+	m_ChunkOffsets.resize(size_t(chunkCount) * RADIX_BUCKETS);
+
+	for (uint32_t shift = 0; shift < 64; shift += RADIX_BITS)
+	{
+		if (((differing >> shift) & (RADIX_BUCKETS - 1)) == 0)
+		{
+			continue;
+		}
+		m_SortPasses++;
+
+		forEachChunk([&](uint32_t chunk, uint32_t begin, uint32_t end)
+			{
+				uint32_t* counts = &m_ChunkOffsets[size_t(chunk) * RADIX_BUCKETS];
+				std::fill(counts, counts + RADIX_BUCKETS, 0u);
+				for (uint32_t i = begin; i < end; i++)
+				{
+					counts[(m_Keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+				}
+			});
+
+		// digit major, then chunk order, which keeps every pass stable
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < RADIX_BUCKETS; digit++)
+		{
+			for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				uint32_t& chunkOffset = m_ChunkOffsets[size_t(chunk) * RADIX_BUCKETS + digit];
+				uint32_t digitCount = chunkOffset;
+				chunkOffset = offset;
+				offset += digitCount;
+			}
+		}
+
+		forEachChunk([&](uint32_t chunk, uint32_t begin, uint32_t end)
+			{
+				uint32_t* offsets = &m_ChunkOffsets[size_t(chunk) * RADIX_BUCKETS];
+				for (uint32_t i = begin; i < end; i++)
+				{
+					uint32_t destination = offsets[(m_Keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+					m_ScratchKeys[destination] = m_Keys[i];
+					m_ScratchPayloads[destination] = m_Payloads[i];
+				}
+			});
+
+		m_Keys.swap(m_ScratchKeys);
+		m_Payloads.swap(m_ScratchPayloads);
+	}
+
+	m_SortMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class JobSystem;
+
+// Passes of the render queue, the most significant field of the sort key
+enum RenderQueuePass : uint32_t
+{
+	RENDER_PASS_OPAQUE,
+	RENDER_PASS_SHADOW,
+	RENDER_PASS_COUNT
+};
+
+// Fields of a 64-bit draw sort key, from the most significant down: pass, pipeline, material, depth
+// bucket, mesh, lod. Sorting the keys puts draws that share a pipeline next to each other, then the
+// ones sharing a material, then roughly front to back within those.
+struct RenderKey
+{
+	static constexpr uint32_t PASS_BITS = 4;
+	static constexpr uint32_t PIPELINE_BITS = 8;
+	static constexpr uint32_t MATERIAL_BITS = 16;
+	static constexpr uint32_t DEPTH_BITS = 16;
+	static constexpr uint32_t MESH_BITS = 17;
+	static constexpr uint32_t LOD_BITS = 3;
+
+	static constexpr uint32_t LOD_SHIFT = 0;
+	static constexpr uint32_t MESH_SHIFT = LOD_SHIFT + LOD_BITS;
+	static constexpr uint32_t DEPTH_SHIFT = MESH_SHIFT + MESH_BITS;
+	static constexpr uint32_t MATERIAL_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+	static constexpr uint32_t PIPELINE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+	static constexpr uint32_t PASS_SHIFT = PIPELINE_SHIFT + PIPELINE_BITS;
+
+	// Fields are masked to their bits, a value too large would otherwise spill into the field above it.
+	// Callers check their values fit, e.g. with DrawBatcher::fitsKey
+	static uint64_t make(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t depthBucket, uint32_t mesh, uint32_t lod = 0)
+	{
+		return put(pass, PASS_SHIFT, PASS_BITS) | put(pipeline, PIPELINE_SHIFT, PIPELINE_BITS) | put(material, MATERIAL_SHIFT, MATERIAL_BITS) |
+			put(depthBucket, DEPTH_SHIFT, DEPTH_BITS) | put(mesh, MESH_SHIFT, MESH_BITS) | put(lod, LOD_SHIFT, LOD_BITS);
+	}
+	static uint64_t put(uint32_t value, uint32_t shift, uint32_t bits) { return uint64_t(value & ((1u << bits) - 1)) << shift; }
+	static uint32_t field(uint64_t key, uint32_t shift, uint32_t bits) { return uint32_t(key >> shift) & ((1u << bits) - 1); }
+	static uint32_t pass(uint64_t key) { return field(key, PASS_SHIFT, PASS_BITS); }
+	static uint32_t pipeline(uint64_t key) { return field(key, PIPELINE_SHIFT, PIPELINE_BITS); }
+	static uint32_t material(uint64_t key) { return field(key, MATERIAL_SHIFT, MATERIAL_BITS); }
+	static uint32_t depthBucket(uint64_t key) { return field(key, DEPTH_SHIFT, DEPTH_BITS); }
+	static uint32_t mesh(uint64_t key) { return field(key, MESH_SHIFT, MESH_BITS); }
+	static uint32_t lod(uint64_t key) { return field(key, LOD_SHIFT, LOD_BITS); }
+};
+
+// Draws as (sort key, payload) pairs, sorted with a stable LSD radix sort over the key bytes. Bytes
+// every key agrees on are skipped, which with few pipelines and materials is most of them. Large
+// queues count and scatter in chunks spread over the job pool.
+class RenderQueue
+{
+public:
+
+	static constexpr uint32_t RADIX_BITS = 8;
+	static constexpr uint32_t RADIX_BUCKETS = 1u << RADIX_BITS;
+	// smaller queues sort on the calling thread
+	static constexpr uint32_t PARALLEL_THRESHOLD = 65536;
+	static constexpr uint32_t CHUNK_SIZE = 16384;
+
+	void clear();
+	void reserve(uint32_t count);
+	void push(uint64_t key, uint32_t payload);
+	void sort(JobSystem* jobs = nullptr);
+
+	uint32_t size() const { return uint32_t(m_Keys.size()); }
+	std::span<const uint64_t> keys() const { return m_Keys; }
+	std::span<const uint32_t> payloads() const { return m_Payloads; }
+
+	// last sort
+	double sortMilliseconds() const { return m_SortMilliseconds; }
+	uint32_t sortPasses() const { return m_SortPasses; }
+
+private:
+
+	std::vector<uint64_t> m_Keys;
+	std::vector<uint32_t> m_Payloads;
+	std::vector<uint64_t> m_ScratchKeys;
+	std::vector<uint32_t> m_ScratchPayloads;
+	// RADIX_BUCKETS counts per chunk, turned into scatter offsets in place
+	std::vector<uint32_t> m_ChunkOffsets;
+
+	double m_SortMilliseconds{ 0 };
+	uint32_t m_SortPasses{ 0 };
+};
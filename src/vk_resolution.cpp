@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <cmath>
+
+#include "vk_resolution.h"
+
+void DynamicResolution::update(double gpuMilliseconds, uint32_t sampleFrame)
+{
+	if (!enabled)
+	{
+		scale = maxScale;
+		smoothedMilliseconds = 0.0f;
+		return;
+	}
+
+	if (gpuMilliseconds <= 0.0 || sampleFrame == m_LastSampleFrame)
+	{
+		return;
+	}
+	m_LastSampleFrame = sampleFrame;
+
+	float milliseconds = float(gpuMilliseconds);
+	smoothedMilliseconds = smoothedMilliseconds > 0.0f ? smoothedMilliseconds + (milliseconds - smoothedMilliseconds) * 0.25f : milliseconds;
+
+	if (m_Cooldown > 0)
+	{
+		m_Cooldown--;
+		return;
+	}
+
+	// react to spikes right away, but only grow on the smoothed time
+	float newScale = scale;
+	float overBudget = std::max(milliseconds, smoothedMilliseconds);
+	if (overBudget > targetMilliseconds)
+	{
+		// GPU time roughly follows the pixel count, which goes with the square of the scale
+		newScale = scale * std::sqrt(targetMilliseconds * 0.95f / overBudget);
+	}
+	else if (smoothedMilliseconds < targetMilliseconds * (1.0f - hysteresis))
+	{
+		newScale = scale * std::min(std::sqrt(targetMilliseconds * (1.0f - hysteresis * 0.5f) / smoothedMilliseconds), 1.05f);
+	}
+	newScale = std::clamp(newScale, minScale, maxScale);
+
+	if (std::abs(newScale - scale) > 0.01f)
+	{
+		scale = newScale;
+		smoothedMilliseconds = 0.0f;
+		m_Cooldown = MAX_FRAMES_IN_FLIGHT + 1;
+	}
+}
+
+VkExtent2D DynamicResolution::apply(VkExtent2D extent) const
+{
+	return
+	{
+		std::max(uint32_t(extent.width * scale), 1u),
+		std::max(uint32_t(extent.height * scale), 1u)
+	};
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "vk_types.h"
+
+// Render scale governor. Shrinks the rendered extent when the measured GPU frame time goes over
+// budget and grows it back once there is enough headroom, so load spikes cost resolution rather
+// than dropped frames. The hysteresis band keeps it from oscillating around the budget.
+struct DynamicResolution
+{
+	bool enabled{ false };
+	float targetMilliseconds{ 16.0f };
+	float minScale{ 0.5f };
+	float maxScale{ 1.0f };
+	// the scale only grows when the frame is this fraction below the budget
+	float hysteresis{ 0.15f };
+
+	// current fraction of the output extent rendered, per axis
+	float scale{ 1.0f };
+	float smoothedMilliseconds{ 0.0f };
+
+	// Feeds a GPU frame time, frames that were already seen are ignored
+	void update(double gpuMilliseconds, uint32_t sampleFrame);
+	VkExtent2D apply(VkExtent2D extent) const;
+
+private:
+
+	uint32_t m_LastSampleFrame{ UINT32_MAX };
+	// frames left before the timings reflect the last change, the profiler lags behind
+	uint32_t m_Cooldown{ 0 };
+};
@@ -0,0 +1,65 @@
+#include <algorithm>
+
+#include <fmt/core.h>
+#include <fmt/color.h>
+
+#include "vk_ringbuffer.h"
+#include "vk_engine.h"
+
+void FrameRingBuffer::init(VulkanEngine* engine, VkDeviceSize bytesPerFrame)
+{
+	m_Engine = engine;
+	for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+	{
+		create(frame, bytesPerFrame);
+	}
+
+	engine->m_MainDeletionQueue.pushFunction([this]()
+		{
+			for (const AllocatedBuffer& buffer : m_Buffers)
+			{
+				m_Engine->DestroyBuffer(buffer);
+			}
+		});
+}
+
+void FrameRingBuffer::create(uint32_t frame, VkDeviceSize size)
+{
+	m_Buffers[frame] = m_Engine->CreateBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_STAGING);
+	m_Capacity[frame] = size;
+
+	VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = m_Buffers[frame].buffer;
+	m_Addresses[frame] = vkGetBufferDeviceAddress(m_Engine->m_Device, &addressInfo);
+}
+
+void FrameRingBuffer::beginFrame(uint32_t frameNumber)
+{
+	m_Frame = frameNumber % MAX_FRAMES_IN_FLIGHT;
+	m_Used = 0;
+
+	// the gpu is done with this frame's buffer, so it can be replaced right away
+	if (m_Requested[m_Frame] > m_Capacity[m_Frame])
+	{
+		VkDeviceSize size = std::max(m_Capacity[m_Frame] * 2, m_Requested[m_Frame]);
+		fmt::print(fmt::fg(fmt::color::yellow), "Frame ring buffer grows to {} KB\n", size >> 10);
+		m_Engine->DestroyBuffer(m_Buffers[m_Frame]);
+		create(m_Frame, size);
+	}
+	m_Requested[m_Frame] = 0;
+}
+
+RingAllocation FrameRingBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	VkDeviceSize offset = (m_Used + alignment - 1) / alignment * alignment;
+	m_Requested[m_Frame] = std::max(m_Requested[m_Frame], offset + size);
+	if (offset + size > m_Capacity[m_Frame])
+	{
+		return { nullptr, 0, VK_NULL_HANDLE, 0 };
+	}
+
+	m_Used = offset + size;
+	uint8_t* mapped = static_cast<uint8_t*>(m_Buffers[m_Frame].info.pMappedData);
+	return { mapped + offset, m_Addresses[m_Frame] + offset, m_Buffers[m_Frame].buffer, offset };
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "vk_types.h"
+
+class VulkanEngine;
+
+struct RingAllocation
+{
+	// nullptr when the frame's buffer is full
+	void* data;
+	VkDeviceAddress address;
+	VkBuffer buffer;
+	VkDeviceSize offset;
+};
+
+// Host visible scratch memory for data written once per frame and read by the gpu through buffer
+// device addresses. Every frame in flight has its own buffer, rewound once its fence was waited on;
+// a frame that ran out of room gets a larger buffer the next time it comes around.
+class FrameRingBuffer
+{
+public:
+
+	void init(VulkanEngine* engine, VkDeviceSize bytesPerFrame);
+
+	// After the frame fence was waited on
+	void beginFrame(uint32_t frameNumber);
+	RingAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+	VkDeviceSize used() const { return m_Used; }
+	// an allocation of this frame didn't fit, whatever was drawn with the ring is missing parts
+	bool overflowed() const { return m_Requested[m_Frame] > m_Capacity[m_Frame]; }
+	VkDeviceSize capacity() const { return m_Capacity[m_Frame]; }
+
+private:
+
+	void create(uint32_t frame, VkDeviceSize size);
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	AllocatedBuffer m_Buffers[MAX_FRAMES_IN_FLIGHT]{};
+	VkDeviceAddress m_Addresses[MAX_FRAMES_IN_FLIGHT]{};
+	VkDeviceSize m_Capacity[MAX_FRAMES_IN_FLIGHT]{};
+	// what each frame asked for last time, including what didn't fit
+	VkDeviceSize m_Requested[MAX_FRAMES_IN_FLIGHT]{};
+	uint32_t m_Frame{ 0 };
+	VkDeviceSize m_Used{ 0 };
+};
@@ -0,0 +1,682 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <string>
+
+#include <fmt/core.h>
+#include <fmt/color.h>
+
+#include "vk_scene.h"
+#include "vk_jobs.h"
+
+#if defined(__AVX2__)
+#define SCENE_AVX2 1
+#define SCENE_SIMD 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_SSE2 1
+#define SCENE_SIMD 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#define SCENE_NEON 1
+#define SCENE_SIMD 1
+#include <arm_neon.h>
+#else
+#define SCENE_SIMD 0
+#endif
+
+// The few lane operations the bounds update and the plane test need, over 8 floats with AVX2 and 4 otherwise
+#if defined(SCENE_AVX2)
+using Lanes = __m256;
+static constexpr uint32_t LANE_COUNT = 8;
+static inline Lanes lanesLoad(const float* p) { return _mm256_loadu_ps(p); }
+static inline void lanesStore(float* p, Lanes a) { _mm256_storeu_ps(p, a); }
+static inline Lanes lanesSplat(float a) { return _mm256_set1_ps(a); }
+static inline Lanes lanesAdd(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+static inline Lanes lanesMul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+static inline Lanes lanesAbs(Lanes a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline Lanes lanesGreaterEqual(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline Lanes lanesAnd(Lanes a, Lanes b) { return _mm256_and_ps(a, b); }
+static inline uint32_t lanesMask(Lanes a) { return uint32_t(_mm256_movemask_ps(a)); }
+#elif defined(SCENE_SSE2)
+using Lanes = __m128;
+static constexpr uint32_t LANE_COUNT = 4;
+static inline Lanes lanesLoad(const float* p) { return _mm_loadu_ps(p); }
+static inline void lanesStore(float* p, Lanes a) { _mm_storeu_ps(p, a); }
+static inline Lanes lanesSplat(float a) { return _mm_set1_ps(a); }
+static inline Lanes lanesAdd(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes lanesMul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes lanesAbs(Lanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline Lanes lanesGreaterEqual(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+static inline Lanes lanesAnd(Lanes a, Lanes b) { return _mm_and_ps(a, b); }
+static inline uint32_t lanesMask(Lanes a) { return uint32_t(_mm_movemask_ps(a)); }
+#elif defined(SCENE_NEON)
+using Lanes = float32x4_t;
+static constexpr uint32_t LANE_COUNT = 4;
+static inline Lanes lanesLoad(const float* p) { return vld1q_f32(p); }
+static inline void lanesStore(float* p, Lanes a) { vst1q_f32(p, a); }
+static inline Lanes lanesSplat(float a) { return vdupq_n_f32(a); }
+static inline Lanes lanesAdd(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+static inline Lanes lanesMul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+static inline Lanes lanesAbs(Lanes a) { return vabsq_f32(a); }
+static inline Lanes lanesGreaterEqual(Lanes a, Lanes b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+static inline Lanes lanesAnd(Lanes a, Lanes b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+static inline uint32_t lanesMask(Lanes a)
+{
+	const uint32x4_t bits = { 1, 2, 4, 8 };
+	return vaddvq_u32(vandq_u32(vreinterpretq_u32_f32(a), bits));
+}
+#else
+static constexpr uint32_t LANE_COUNT = 1;
+#endif
+
+static_assert(Scene::PARALLEL_GRAIN % LANE_COUNT == 0, "jobs must cover whole lanes");
+
+const char* Scene::simdName()
+{
+#if defined(SCENE_AVX2)
+	return "AVX2";
+#elif defined(SCENE_SSE2)
+	return "SSE2";
+#elif defined(SCENE_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+Frustum Frustum::fromViewProjection(const glm::mat4& viewProjection)
+{
+	// rows of the matrix, glm stores columns
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	// depth goes from 0 rather than -w
+	frustum.planes[4] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+
+	for (glm::vec4& plane : frustum.planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+uint32_t Scene::add(const glm::mat4& transform, const Aabb& localBounds, uint32_t renderHandle)
+{
+	uint32_t object = size();
+
+	for (std::vector<float>& component : m_Transform)
+	{
+		component.push_back(0.0f);
+	}
+	glm::vec3 center = (localBounds.min + localBounds.max) * 0.5f;
+	glm::vec3 extent = (localBounds.max - localBounds.min) * 0.5f;
+	for (int i = 0; i < 3; i++)
+	{
+		m_LocalCenter[i].push_back(center[i]);
+		m_LocalExtent[i].push_back(extent[i]);
+		m_WorldCenter[i].push_back(0.0f);
+		m_WorldExtent[i].push_back(0.0f);
+	}
+	m_RenderHandles.push_back(renderHandle);
+
+	setTransform(object, transform);
+	return object;
+}
+
+void Scene::setTransform(uint32_t object, const glm::mat4& transform)
+{
+	for (int column = 0; column < 4; column++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			m_Transform[column * 3 + row][object] = transform[column][row];
+		}
+	}
+}
+
+void Scene::reserve(uint32_t count)
+{
+	for (std::vector<float>& component : m_Transform)
+	{
+		component.reserve(count);
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		m_LocalCenter[i].reserve(count);
+		m_LocalExtent[i].reserve(count);
+		m_WorldCenter[i].reserve(count);
+		m_WorldExtent[i].reserve(count);
+	}
+	m_RenderHandles.reserve(count);
+}
+
+void Scene::clear()
+{
+	for (std::vector<float>& component : m_Transform)
+	{
+		component.clear();
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		m_LocalCenter[i].clear();
+		m_LocalExtent[i].clear();
+		m_WorldCenter[i].clear();
+		m_WorldExtent[i].clear();
+	}
+	m_RenderHandles.clear();
+}
+
+glm::mat4 Scene::transform(uint32_t object) const
+{
+	glm::mat4 transform(1.0f);
+	for (int column = 0; column < 4; column++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			transform[column][row] = m_Transform[column * 3 + row][object];
+		}
+	}
+	return transform;
+}
+
+Aabb Scene::worldBounds(uint32_t object) const
+{
+	glm::vec3 center(m_WorldCenter[0][object], m_WorldCenter[1][object], m_WorldCenter[2][object]);
+	glm::vec3 extent(m_WorldExtent[0][object], m_WorldExtent[1][object], m_WorldExtent[2][object]);
+	return { center - extent, center + extent };
+}
+
+void Scene::updateWorldBounds(JobSystem* jobs)
+{
+	if (jobs)
+	{
+		jobs->parallelFor(size(), PARALLEL_GRAIN, [this](uint32_t begin, uint32_t end) { updateRange(begin, end); });
+	}
+	else
+	{
+		updateRange(0, size());
+	}
+}
+
+void Scene::updateWorldBounds(std::span<const uint32_t> objects, JobSystem* jobs)
+{
+	// scattered objects go one at a time, past a quarter of the scene the packed pass over all of them is cheaper
+	if (objects.size() * 4 > size())
+	{
+		updateWorldBounds(jobs);
+		return;
+	}
+
+	auto update = [this, objects](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				updateObject(objects[i]);
+			}
+		};
+	if (jobs)
+	{
+		jobs->parallelFor(uint32_t(objects.size()), PARALLEL_GRAIN, update);
+	}
+	else
+	{
+		update(0, uint32_t(objects.size()));
+	}
+}
+
+void Scene::cull(const Frustum& frustum, std::vector<uint32_t>& visible, JobSystem* jobs) const
+{
+	visible.clear();
+	if (!jobs)
+	{
+		cullRange(frustum, 0, size(), visible);
+		return;
+	}
+
+	// every range collects on its own, joined in order afterwards
+	std::vector<std::vector<uint32_t>> ranges((size() + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN);
+	jobs->parallelFor(size(), PARALLEL_GRAIN, [&](uint32_t begin, uint32_t end)
+		{
+			cullRange(frustum, begin, end, ranges[begin / PARALLEL_GRAIN]);
+		});
+
+	size_t total = 0;
+	for (const std::vector<uint32_t>& range : ranges)
+	{
+		total += range.size();
+	}
+	visible.reserve(total);
+	for (const std::vector<uint32_t>& range : ranges)
+	{
+		visible.insert(visible.end(), range.begin(), range.end());
+	}
+}
+
+void Scene::updateRange(uint32_t begin, uint32_t end)
+{
+	uint32_t i = begin;
+
+#if SCENE_SIMD
+	// center' = M * center, extent' = |M| * extent, a lane per object
+	const std::vector<float>* m = m_Transform;
+	for (; useSimd && i + LANE_COUNT <= end; i += LANE_COUNT)
+	{
+		Lanes center[3] = { lanesLoad(&m_LocalCenter[0][i]), lanesLoad(&m_LocalCenter[1][i]), lanesLoad(&m_LocalCenter[2][i]) };
+		Lanes extent[3] = { lanesLoad(&m_LocalExtent[0][i]), lanesLoad(&m_LocalExtent[1][i]), lanesLoad(&m_LocalExtent[2][i]) };
+
+		for (int row = 0; row < 3; row++)
+		{
+			Lanes m0 = lanesLoad(&m[0 * 3 + row][i]);
+			Lanes m1 = lanesLoad(&m[1 * 3 + row][i]);
+			Lanes m2 = lanesLoad(&m[2 * 3 + row][i]);
+			Lanes translation = lanesLoad(&m[3 * 3 + row][i]);
+
+			Lanes worldCenter = lanesAdd(lanesAdd(lanesMul(m0, center[0]), lanesMul(m1, center[1])), lanesAdd(lanesMul(m2, center[2]), translation));
+			Lanes worldExtent = lanesAdd(lanesAdd(lanesMul(lanesAbs(m0), extent[0]), lanesMul(lanesAbs(m1), extent[1])), lanesMul(lanesAbs(m2), extent[2]));
+			lanesStore(&m_WorldCenter[row][i], worldCenter);
+			lanesStore(&m_WorldExtent[row][i], worldExtent);
+		}
+	}
+#endif
+
+	for (; i < end; i++)
+	{
+		updateObject(i);
+	}
+}
+
+void Scene::updateObject(uint32_t object)
+{
+	const std::vector<float>* m = m_Transform;
+	uint32_t i = object;
+	for (int row = 0; row < 3; row++)
+	{
+		float m0 = m[0 * 3 + row][i];
+		float m1 = m[1 * 3 + row][i];
+		float m2 = m[2 * 3 + row][i];
+		m_WorldCenter[row][i] = m0 * m_LocalCenter[0][i] + m1 * m_LocalCenter[1][i] + m2 * m_LocalCenter[2][i] + m[3 * 3 + row][i];
+		m_WorldExtent[row][i] = std::abs(m0) * m_LocalExtent[0][i] + std::abs(m1) * m_LocalExtent[1][i] + std::abs(m2) * m_LocalExtent[2][i];
+	}
+}
+
+void Scene::cullRange(const Frustum& frustum, uint32_t begin, uint32_t end, std::vector<uint32_t>& visible) const
+{
+	uint32_t i = begin;
+
+#if SCENE_SIMD
+	Lanes normals[6][3];
+	Lanes absNormals[6][3];
+	Lanes distances[6];
+	for (int p = 0; p < 6; p++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			normals[p][axis] = lanesSplat(frustum.planes[p][axis]);
+			absNormals[p][axis] = lanesSplat(std::abs(frustum.planes[p][axis]));
+		}
+		distances[p] = lanesSplat(frustum.planes[p].w);
+	}
+	const Lanes zero = lanesSplat(0.0f);
+
+	// outside when the center is further behind some plane than the box reaches towards it
+	for (; useSimd && i + LANE_COUNT <= end; i += LANE_COUNT)
+	{
+		Lanes center[3] = { lanesLoad(&m_WorldCenter[0][i]), lanesLoad(&m_WorldCenter[1][i]), lanesLoad(&m_WorldCenter[2][i]) };
+		Lanes extent[3] = { lanesLoad(&m_WorldExtent[0][i]), lanesLoad(&m_WorldExtent[1][i]), lanesLoad(&m_WorldExtent[2][i]) };
+
+		Lanes inside = lanesGreaterEqual(zero, zero);
+		for (int p = 0; p < 6; p++)
+		{
+			Lanes distance = lanesAdd(lanesAdd(lanesMul(normals[p][0], center[0]), lanesMul(normals[p][1], center[1])),
+				lanesAdd(lanesMul(normals[p][2], center[2]), distances[p]));
+			Lanes radius = lanesAdd(lanesAdd(lanesMul(absNormals[p][0], extent[0]), lanesMul(absNormals[p][1], extent[1])),
+				lanesMul(absNormals[p][2], extent[2]));
+			inside = lanesAnd(inside, lanesGreaterEqual(lanesAdd(distance, radius), zero));
+		}
+
+		for (uint32_t mask = lanesMask(inside); mask != 0; mask &= mask - 1)
+		{
+			visible.push_back(i + uint32_t(std::countr_zero(mask)));
+		}
+	}
+#endif
+
+	for (; i < end; i++)
+	{
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			float distance = plane.x * m_WorldCenter[0][i] + plane.y * m_WorldCenter[1][i] + plane.z * m_WorldCenter[2][i] + plane.w;
+			float radius = std::abs(plane.x) * m_WorldExtent[0][i] + std::abs(plane.y) * m_WorldExtent[1][i] + std::abs(plane.z) * m_WorldExtent[2][i];
+			inside = distance + radius >= 0.0f;
+		}
+		if (inside)
+		{
+			visible.push_back(i);
+		}
+	}
+}
+
+void TransformHierarchy::build(std::span<const HierarchyNode> nodes, std::vector<uint32_t>* remap)
+{
+	uint32_t count = uint32_t(nodes.size());
+
+	// depth of every node, parents may come after their children in the input
+	std::vector<uint32_t> depths(count, NO_PARENT);
+	std::vector<uint32_t> chain;
+	uint32_t levels = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t node = i;
+		while (node != NO_PARENT && depths[node] == NO_PARENT)
+		{
+			chain.push_back(node);
+			node = nodes[node].parent;
+		}
+		uint32_t depth = node == NO_PARENT ? 0 : depths[node] + 1;
+		for (auto it = chain.rbegin(); it != chain.rend(); it++)
+		{
+			depths[*it] = depth++;
+		}
+		levels = std::max(levels, depth);
+		chain.clear();
+	}
+
+	// counting sort by depth, stable so siblings keep their order
+	m_LevelStarts.assign(levels + 1, 0);
+	for (uint32_t depth : depths)
+	{
+		m_LevelStarts[depth + 1]++;
+	}
+	for (uint32_t level = 0; level < levels; level++)
+	{
+		m_LevelStarts[level + 1] += m_LevelStarts[level];
+	}
+
+	std::vector<uint32_t> newIndex(count);
+	std::vector<uint32_t> next(m_LevelStarts.begin(), m_LevelStarts.end() - 1);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		newIndex[i] = next[depths[i]]++;
+	}
+
+	m_Parents.resize(count);
+	m_Objects.resize(count);
+	m_Locals.resize(count);
+	m_Worlds.resize(count);
+	m_Levels.resize(count);
+	m_Dirty.assign(count, 1);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t node = newIndex[i];
+		m_Parents[node] = nodes[i].parent == NO_PARENT ? NO_PARENT : newIndex[nodes[i].parent];
+		m_Objects[node] = nodes[i].object;
+		m_Locals[node] = nodes[i].local;
+		m_Levels[node] = depths[i];
+	}
+	m_FirstDirtyLevel = 0;
+
+	if (remap)
+	{
+		*remap = std::move(newIndex);
+	}
+}
+
+void TransformHierarchy::setLocal(uint32_t node, const glm::mat4& local)
+{
+	m_Locals[node] = local;
+	m_Dirty[node] = 1;
+	m_FirstDirtyLevel = std::min(m_FirstDirtyLevel, m_Levels[node]);
+}
+
+const std::vector<uint32_t>& TransformHierarchy::update(JobSystem* jobs)
+{
+	m_Changed.clear();
+	if (m_FirstDirtyLevel >= levelCount())
+	{
+		return m_Changed;
+	}
+
+	// a level only reads the one above it, which is final once its batch is done
+	for (uint32_t level = m_FirstDirtyLevel; level < levelCount(); level++)
+	{
+		uint32_t begin = m_LevelStarts[level];
+		uint32_t end = m_LevelStarts[level + 1];
+		if (jobs)
+		{
+			jobs->parallelFor(end - begin, PARALLEL_GRAIN, [&](uint32_t first, uint32_t last) { updateRange(begin + first, begin + last); });
+		}
+		else
+		{
+			updateRange(begin, end);
+		}
+	}
+
+	for (uint32_t node = m_LevelStarts[m_FirstDirtyLevel]; node < size(); node++)
+	{
+		if (m_Dirty[node])
+		{
+			m_Changed.push_back(node);
+			m_Dirty[node] = 0;
+		}
+	}
+	m_FirstDirtyLevel = levelCount();
+
+	return m_Changed;
+}
+
+void TransformHierarchy::updateRange(uint32_t begin, uint32_t end)
+{
+	for (uint32_t node = begin; node < end; node++)
+	{
+		uint32_t parent = m_Parents[node];
+		if (parent == NO_PARENT)
+		{
+			if (m_Dirty[node])
+			{
+				m_Worlds[node] = m_Locals[node];
+			}
+			continue;
+		}
+
+		if (m_Dirty[parent])
+		{
+			m_Dirty[node] = 1;
+		}
+		if (m_Dirty[node])
+		{
+			m_Worlds[node] = m_Worlds[parent] * m_Locals[node];
+		}
+	}
+}
+
+// Every box rotated and scaled randomly, the camera has a 60 degree field of view looking down +z
+void SceneBenchmark::buildScene(Scene& scene, uint32_t objectCount, Frustum& frustum)
+{
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	scene.clear();
+	scene.reserve(objectCount);
+	for (uint32_t i = 0; i < objectCount; i++)
+	{
+		glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + 0.01f);
+		float angle = unit(random) * 6.2831853f;
+		float scale = 0.5f + unit(random) * 4.0f;
+
+		// Rodrigues, glm's gtc headers aren't needed for one rotation
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		glm::mat3 cross(0.0f, axis.z, -axis.y, -axis.z, 0.0f, axis.x, axis.y, -axis.x, 0.0f);
+		glm::mat3 rotation = glm::mat3(c) + s * cross + (1.0f - c) * glm::outerProduct(axis, axis);
+
+		glm::mat4 transform = glm::mat4(rotation * scale);
+		transform[3] = glm::vec4(position(random), position(random), position(random), 1.0f);
+
+		Aabb bounds = { glm::vec3(-1.0f), glm::vec3(1.0f) };
+		scene.add(transform, bounds, i);
+	}
+
+	// a perspective projection looking down +z, Vulkan depth range
+	float nearPlane = 0.1f;
+	float farPlane = 600.0f;
+	float focal = 1.0f / std::tan(0.5f * 1.0471976f);
+	glm::mat4 projection(0.0f);
+	projection[0][0] = focal / (16.0f / 9.0f);
+	projection[1][1] = -focal;
+	projection[2][2] = farPlane / (farPlane - nearPlane);
+	projection[2][3] = 1.0f;
+	projection[3][2] = -nearPlane * farPlane / (farPlane - nearPlane);
+	frustum = Frustum::fromViewProjection(projection);
+}
+
+double SceneBenchmark::bestOf(int runs, const std::function<void()>& work, const std::function<void()>& setup)
+{
+	using Clock = std::chrono::steady_clock;
+
+	double best = 1e9;
+	for (int run = 0; run < runs; run++)
+	{
+		if (setup)
+		{
+			setup();
+		}
+		Clock::time_point start = Clock::now();
+		work();
+		best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+	}
+	return best;
+}
+
+bool SceneBenchmark::sameVisible(std::vector<uint32_t>& visible, std::vector<uint32_t>& reference)
+{
+	std::sort(visible.begin(), visible.end());
+	std::sort(reference.begin(), reference.end());
+	std::vector<uint32_t> difference;
+	std::set_symmetric_difference(visible.begin(), visible.end(), reference.begin(), reference.end(), std::back_inserter(difference));
+	return difference.size() <= reference.size() / 10000;
+}
+
+bool SceneBenchmark::runCommandLine(int argc, char* argv[], int& exitCode, const char* flag, bool (*benchmark)(JobSystem&, uint32_t))
+{
+	if (argc < 2 || strcmp(argv[1], flag) != 0)
+	{
+		return false;
+	}
+
+	uint32_t objectCount = 1000000;
+	if (argc > 2)
+	{
+		char* end = nullptr;
+		unsigned long count = std::strtoul(argv[2], &end, 10);
+		if (end == argv[2] || *end != '\0' || count == 0 || count > UINT32_MAX)
+		{
+			fmt::print(fmt::fg(fmt::color::red), "{} expects a positive object count, got {}\n", flag, argv[2]);
+			exitCode = 2;
+			return true;
+		}
+		objectCount = uint32_t(count);
+	}
+
+	JobSystem jobs;
+	jobs.init();
+	exitCode = benchmark(jobs, objectCount) ? 0 : 1;
+	jobs.shutdown();
+	return true;
+}
+
+bool SceneBenchmark::run(JobSystem& jobs, uint32_t objectCount)
+{
+	Scene scene;
+	Frustum frustum;
+	buildScene(scene, objectCount, frustum);
+
+	fmt::print("{} {} objects, {} lanes, {} workers\n", fmt::styled("Cull benchmark:", fmt::fg(fmt::color::white) | fmt::emphasis::bold),
+		objectCount, Scene::simdName(), jobs.threadCount());
+
+	struct Variant
+	{
+		const char* name;
+		bool simd;
+		bool parallel;
+	};
+	const Variant variants[] =
+	{
+		{ "scalar", false, false },
+		{ "simd", true, false },
+		{ "scalar parallel", false, true },
+		{ "simd parallel", true, true },
+	};
+
+	std::vector<uint32_t> reference;
+	std::vector<Aabb> referenceBounds;
+	bool passed = true;
+	for (const Variant& variant : variants)
+	{
+		scene.useSimd = variant.simd;
+		JobSystem* pool = variant.parallel ? &jobs : nullptr;
+		std::vector<uint32_t> visible;
+
+		constexpr int runs = 5;
+		double updateMilliseconds = bestOf(runs, [&]() { scene.updateWorldBounds(pool); });
+		double cullMilliseconds = bestOf(runs, [&]() { scene.cull(frustum, visible, pool); });
+
+		// every path has to find the same objects as the plain loop, up to rounding of boxes touching a plane
+		bool matches = true;
+		if (referenceBounds.empty())
+		{
+			reference = visible;
+			for (uint32_t i = 0; i < scene.size(); i++)
+			{
+				referenceBounds.push_back(scene.worldBounds(i));
+			}
+		}
+		else
+		{
+			matches = sameVisible(visible, reference);
+			for (uint32_t i = 0; i < scene.size() && matches; i++)
+			{
+				Aabb bounds = scene.worldBounds(i);
+				matches = glm::all(glm::lessThanEqual(glm::abs(bounds.min - referenceBounds[i].min), glm::vec3(1e-3f))) &&
+					glm::all(glm::lessThanEqual(glm::abs(bounds.max - referenceBounds[i].max), glm::vec3(1e-3f)));
+			}
+		}
+		passed = passed && matches;
+
+		fmt::print("  {:<16} bounds {:7.2f} ms ({:6.1f} M/s)  cull {:7.2f} ms ({:6.1f} M/s)  {} visible{}\n", variant.name,
+			updateMilliseconds, objectCount / updateMilliseconds / 1e3, cullMilliseconds, objectCount / cullMilliseconds / 1e3,
+			visible.size(), matches ? "" : "  MISMATCH");
+	}
+
+	if (passed)
+	{
+		fmt::print(fmt::fg(fmt::color::green), "Cull benchmark passed\n");
+	}
+	else
+	{
+		fmt::print(fmt::fg(fmt::color::red), "Cull benchmark failed, the paths disagree\n");
+	}
+	return passed;
+}
+
+bool SceneBenchmark::runCommandLine(int argc, char* argv[], int& exitCode)
+{
+	return runCommandLine(argc, argv, exitCode, "--bench-cull", &run);
+}
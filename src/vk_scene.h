@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class JobSystem;
+
+struct Aabb
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// Planes point inwards, xyz is the normal and w the distance
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	// Vulkan clip space, depth from 0 to 1
+	static Frustum fromViewProjection(const glm::mat4& viewProjection);
+};
+
+// Objects as structure of arrays: every component of the transforms and bounds sits in its own
+// packed array, so the bounds update and the frustum test load 8 objects per instruction with
+// AVX2 and 4 with SSE2 or NEON. Bounds are kept as center and half extent, which transforms
+// without touching the corners and needs one dot product per plane.
+class Scene
+{
+public:
+
+	// objects per job when the work is spread over the pool, a multiple of every lane count
+	static constexpr uint32_t PARALLEL_GRAIN = 16384;
+
+	// SIMD paths are used when the build has one, turned off to compare against the scalar code
+	bool useSimd{ true };
+
+	// "AVX2", "SSE2", "NEON" or "scalar"
+	static const char* simdName();
+
+	uint32_t add(const glm::mat4& transform, const Aabb& localBounds, uint32_t renderHandle);
+	void setTransform(uint32_t object, const glm::mat4& transform);
+	void reserve(uint32_t count);
+	void clear();
+
+	uint32_t size() const { return uint32_t(m_RenderHandles.size()); }
+	uint32_t renderHandle(uint32_t object) const { return m_RenderHandles[object]; }
+	glm::mat4 transform(uint32_t object) const;
+	// valid after updateWorldBounds
+	Aabb worldBounds(uint32_t object) const;
+
+	// World bounds of every object from its transform and local bounds, spread over jobs when given
+	void updateWorldBounds(JobSystem* jobs = nullptr);
+	// Only the given objects, e.g. the ones whose transform changed
+	void updateWorldBounds(std::span<const uint32_t> objects, JobSystem* jobs = nullptr);
+	// Objects whose world bounds touch the frustum, in object order
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible, JobSystem* jobs = nullptr) const;
+
+private:
+
+	void updateRange(uint32_t begin, uint32_t end);
+	void updateObject(uint32_t object);
+	void cullRange(const Frustum& frustum, uint32_t begin, uint32_t end, std::vector<uint32_t>& visible) const;
+
+	// column c, row r of the affine transform at c * 3 + r
+	std::vector<float> m_Transform[12];
+	std::vector<float> m_LocalCenter[3];
+	std::vector<float> m_LocalExtent[3];
+	std::vector<float> m_WorldCenter[3];
+	std::vector<float> m_WorldExtent[3];
+	std::vector<uint32_t> m_RenderHandles;
+};
+
+struct HierarchyNode
+{
+	// index into the nodes handed to build, NO_PARENT for roots
+	uint32_t parent;
+	glm::mat4 local;
+	// Scene object placed by this node, NO_OBJECT for pure transform nodes
+	uint32_t object;
+};
+
+// Node transforms flattened into arrays sorted parents first, so every depth is one contiguous range
+// and a parent always comes before its children. Changing a local matrix marks the node dirty; update
+// walks the levels from the shallowest dirty one, each level split over the job pool, and only
+// multiplies the matrices of nodes whose parent or own flag is set, so still subtrees cost a flag test.
+class TransformHierarchy
+{
+public:
+
+	static constexpr uint32_t NO_PARENT = ~0u;
+	static constexpr uint32_t NO_OBJECT = ~0u;
+	// nodes per job within one level
+	static constexpr uint32_t PARALLEL_GRAIN = 1024;
+
+	// Sorts the nodes by depth, remap gets the new index of every input node. Everything starts dirty
+	void build(std::span<const HierarchyNode> nodes, std::vector<uint32_t>* remap = nullptr);
+
+	uint32_t size() const { return uint32_t(m_Parents.size()); }
+	uint32_t levelCount() const { return uint32_t(m_LevelStarts.size()) - 1; }
+	// nodes of a level are levelBegin to levelEnd - 1
+	uint32_t levelBegin(uint32_t level) const { return m_LevelStarts[level]; }
+	uint32_t levelEnd(uint32_t level) const { return m_LevelStarts[level + 1]; }
+	uint32_t parent(uint32_t node) const { return m_Parents[node]; }
+	uint32_t object(uint32_t node) const { return m_Objects[node]; }
+	const glm::mat4& local(uint32_t node) const { return m_Locals[node]; }
+	// valid after update
+	const glm::mat4& world(uint32_t node) const { return m_Worlds[node]; }
+
+	void setLocal(uint32_t node, const glm::mat4& local);
+
+	// Recomputes the world matrices below every node changed since the last call, spread over jobs
+	// when given. Returns the nodes whose world matrix was recomputed, in index order
+	const std::vector<uint32_t>& update(JobSystem* jobs = nullptr);
+
+private:
+
+	void updateRange(uint32_t begin, uint32_t end);
+
+	std::vector<uint32_t> m_Parents;
+	std::vector<uint32_t> m_Objects;
+	std::vector<glm::mat4> m_Locals;
+	std::vector<glm::mat4> m_Worlds;
+	// a byte per node, set by setLocal and spread to the children during update
+	std::vector<uint8_t> m_Dirty;
+	// first node of every level, plus the node count at the end
+	std::vector<uint32_t> m_LevelStarts;
+	std::vector<uint32_t> m_Levels;
+	// shallowest level with a dirty node, levelCount when nothing changed
+	uint32_t m_FirstDirtyLevel{ 0 };
+	std::vector<uint32_t> m_Changed;
+};
+
+// "--bench-cull [objects]": updates and culls random objects, default one million, with the
+// scalar and the SIMD path on one thread and on the job pool. Fails when the paths disagree.
+// Returns true when it ran, exitCode is set to its result
+namespace SceneBenchmark
+{
+	// Random boxes in a cube of 1000 units and a camera in its middle, shared with the BVH benchmark
+	void buildScene(Scene& scene, uint32_t objectCount, Frustum& frustum);
+	bool run(JobSystem& jobs, uint32_t objectCount);
+	bool runCommandLine(int argc, char* argv[], int& exitCode);
+
+	// Helpers shared with the BVH benchmark
+
+	// Best time of work in milliseconds over a few runs, the first one also warms the caches.
+	// setup runs untimed before every run
+	double bestOf(int runs, const std::function<void()>& work, const std::function<void()>& setup = {});
+	// Whether two culls found the same objects, up to one in ten thousand boxes touching a plane
+	// that round either way. Sorts both
+	bool sameVisible(std::vector<uint32_t>& visible, std::vector<uint32_t>& reference);
+	// Runs benchmark on a fresh job pool when argv[1] is flag, with the object count from argv[2],
+	// default one million. Returns false when the flag isn't there
+	bool runCommandLine(int argc, char* argv[], int& exitCode, const char* flag, bool (*benchmark)(JobSystem&, uint32_t));
+}
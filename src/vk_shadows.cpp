@@ -0,0 +1,507 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#include <fmt/core.h>
+#include <fmt/color.h>
+#include <imgui.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "vk_shadows.h"
+#include "vk_bvh.h"
+#include "vk_engine.h"
+#include "vk_initializers.h"
+#include "vk_instances.h"
+#include "vk_recorder.h"
+#include "vk_ringbuffer.h"
+
+static const VkFormat SHADOW_FORMAT = VK_FORMAT_D32_SFLOAT;
+// clip space xy to uv, depth stays
+static const glm::mat4 SHADOW_UV = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f, 0.5f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f, 0.5f, 1.0f));
+
+// Like VkUtils::transitionImage, for one layer of a depth image
+static void transitionLayer(VkCommandBuffer cmd, VkImage image, uint32_t layer, uint32_t layerCount, VkImageLayout currentLayout, VkImageLayout newLayout)
+{
+	VkImageMemoryBarrier2 imageBarrier{ .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+	imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	imageBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+	imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	imageBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;
+	imageBarrier.oldLayout = currentLayout;
+	imageBarrier.newLayout = newLayout;
+	imageBarrier.subresourceRange = VkInit::imageSubresourceRange(VK_IMAGE_ASPECT_DEPTH_BIT);
+	imageBarrier.subresourceRange.baseArrayLayer = layer;
+	imageBarrier.subresourceRange.layerCount = layerCount;
+	imageBarrier.image = image;
+
+	VkDependencyInfo depInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	depInfo.imageMemoryBarrierCount = 1;
+	depInfo.pImageMemoryBarriers = &imageBarrier;
+	vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
+void CascadedShadows::init(VulkanEngine* engine)
+{
+	m_Engine = engine;
+	VkDevice device = engine->m_Device;
+
+	// every cascade is a layer of both, the cache is only ever copied from
+	VkImageCreateInfo imageInfo = VkInit::imageCreateInfo(SHADOW_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		{ MAP_SIZE, MAP_SIZE, 1 });
+	imageInfo.arrayLayers = CASCADE_COUNT;
+	VmaAllocationCreateInfo allocationInfo{};
+	allocationInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	allocationInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VK_CHECK(engine->m_Memory.createImage(imageInfo, allocationInfo, MEMORY_RENDER_TARGETS, &m_CacheImage, &m_CacheAllocation));
+	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	VK_CHECK(engine->m_Memory.createImage(imageInfo, allocationInfo, MEMORY_RENDER_TARGETS, &m_ShadowImage, &m_ShadowAllocation));
+
+	for (uint32_t layer = 0; layer < CASCADE_COUNT; layer++)
+	{
+		VkImageViewCreateInfo viewInfo = VkInit::imageviewCreateInfo(SHADOW_FORMAT, m_CacheImage, VK_IMAGE_ASPECT_DEPTH_BIT);
+		viewInfo.subresourceRange.baseArrayLayer = layer;
+		VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &m_CacheLayerViews[layer]));
+		viewInfo.image = m_ShadowImage;
+		VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &m_ShadowLayerViews[layer]));
+	}
+	VkImageViewCreateInfo arrayViewInfo = VkInit::imageviewCreateInfo(SHADOW_FORMAT, m_ShadowImage, VK_IMAGE_ASPECT_DEPTH_BIT);
+	arrayViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	arrayViewInfo.subresourceRange.layerCount = CASCADE_COUNT;
+	VK_CHECK(vkCreateImageView(device, &arrayViewInfo, nullptr, &m_ShadowArrayView));
+
+	// hardware compare, filtered where the format allows it. Outside the map is lit
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(engine->m_PhysicalDevice, SHADOW_FORMAT, &properties);
+	VkFilter filter = (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+	VkSamplerCreateInfo samplerInfo{ .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.magFilter = filter;
+	samplerInfo.minFilter = filter;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	samplerInfo.compareEnable = VK_TRUE;
+	samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &m_Sampler));
+
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		m_SetLayout = builder.build(device, VK_SHADER_STAGE_FRAGMENT_BIT);
+	}
+	std::vector<DescriptorAllocator::PoolSizeRatio> sizes = { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 } };
+	m_DescriptorAllocator.initPool(device, 1, sizes);
+	m_DescriptorSet = m_DescriptorAllocator.allocate(device, m_SetLayout);
+	DescriptorWriter writer;
+	writer.writeImage(0, m_ShadowArrayView, m_Sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	writer.updateSet(device, m_DescriptorSet);
+
+	// the sampled maps rest in the read only layout between frames, fully lit until drawn
+	engine->ImmediateSubmit([&](VkCommandBuffer cmd)
+		{
+			transitionLayer(cmd, m_ShadowImage, 0, CASCADE_COUNT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+			VkClearDepthStencilValue clear{ 1.0f, 0 };
+			VkImageSubresourceRange range = VkInit::imageSubresourceRange(VK_IMAGE_ASPECT_DEPTH_BIT);
+			vkCmdClearDepthStencilImage(cmd, m_ShadowImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear, 1, &range);
+			transitionLayer(cmd, m_ShadowImage, 0, CASCADE_COUNT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		});
+
+	createPipeline();
+
+	engine->m_MainDeletionQueue.pushFunction([=, this]()
+		{
+			vkDestroyPipeline(device, m_Pipeline, nullptr);
+			vkDestroyPipelineLayout(device, m_PipelineLayout, nullptr);
+			m_DescriptorAllocator.destroyPool(device);
+			vkDestroyDescriptorSetLayout(device, m_SetLayout, nullptr);
+			vkDestroySampler(device, m_Sampler, nullptr);
+			vkDestroyImageView(device, m_ShadowArrayView, nullptr);
+			for (uint32_t layer = 0; layer < CASCADE_COUNT; layer++)
+			{
+				vkDestroyImageView(device, m_CacheLayerViews[layer], nullptr);
+				vkDestroyImageView(device, m_ShadowLayerViews[layer], nullptr);
+			}
+			m_Engine->m_Memory.destroyImage(m_CacheImage, m_CacheAllocation);
+			m_Engine->m_Memory.destroyImage(m_ShadowImage, m_ShadowAllocation);
+		});
+}
+
+void CascadedShadows::createPipeline()
+{
+	VkDevice device = m_Engine->m_Device;
+
+	// the mesh pass push constants, only the vertex shader reads them here
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(MeshPushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkPipelineLayoutCreateInfo layoutInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_PipelineLayout));
+
+	// depth only, no fragment shader at all
+	VkPipelineShaderStageCreateInfo stage{ .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+	stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stage.module = m_Engine->m_ShaderCache.get(device, "mesh.vert.spv");
+	stage.pName = "main";
+
+	VkPipelineVertexInputStateCreateInfo vertexInput{ .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{ .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewportState{ .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	// both faces, thin casters still throw shadows. The bias keeps lit surfaces from shadowing themselves
+	VkPipelineRasterizationStateCreateInfo rasterizer{ .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_TRUE;
+	rasterizer.depthBiasConstantFactor = 1.25f;
+	rasterizer.depthBiasSlopeFactor = 1.75f;
+	rasterizer.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{ .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampling.minSampleShading = 1.0f;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{ .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{ .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.maxDepthBounds = 1.0f;
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{ .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkPipelineRenderingCreateInfo renderingInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+	renderingInfo.depthAttachmentFormat = SHADOW_FORMAT;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{ .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	pipelineInfo.pNext = &renderingInfo;
+	pipelineInfo.stageCount = 1;
+	pipelineInfo.pStages = &stage;
+	pipelineInfo.pVertexInputState = &vertexInput;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = m_PipelineLayout;
+	VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_Pipeline));
+}
+
+void CascadedShadows::update(std::span<const uint32_t> movedObjects, uint32_t objectCount, uint32_t frameNumber)
+{
+	if (m_Dynamic.size() != objectCount)
+	{
+		m_LastMoved.assign(objectCount, 0);
+		m_Dynamic.assign(objectCount, 0);
+		m_DynamicObjects.clear();
+		m_Version++;
+	}
+
+	bool changed = false;
+	for (uint32_t object : movedObjects)
+	{
+		m_LastMoved[object] = frameNumber;
+		if (!m_Dynamic[object])
+		{
+			m_Dynamic[object] = 1;
+			m_DynamicObjects.push_back(object);
+			changed = true;
+		}
+	}
+
+	// the ones that came to rest go back into the caches
+	for (size_t i = 0; i < m_DynamicObjects.size();)
+	{
+		uint32_t object = m_DynamicObjects[i];
+		if (frameNumber - m_LastMoved[object] >= STATIC_AFTER_FRAMES)
+		{
+			m_Dynamic[object] = 0;
+			m_DynamicObjects[i] = m_DynamicObjects.back();
+			m_DynamicObjects.pop_back();
+			changed = true;
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	if (changed)
+	{
+		m_Version++;
+	}
+}
+
+void CascadedShadows::invalidate()
+{
+	std::fill(std::begin(m_CacheValid), std::end(m_CacheValid), false);
+}
+
+CascadedShadows::Cascade CascadedShadows::fitCascade(const ShadowView& view, const glm::vec3& sun, float nearDepth, float farDepth) const
+{
+	// the sphere around the slice only depends on its shape, not on where the camera looks. Its
+	// farthest points are the corners of the far end
+	float tanY = std::tan(view.fovY * 0.5f);
+	float tanX = tanY * view.aspect;
+	float centerDepth = (nearDepth + farDepth) * 0.5f;
+	float radius = glm::length(glm::vec3(tanX * farDepth, tanY * farDepth, farDepth - centerDepth));
+	glm::vec3 center = glm::vec3(glm::inverse(view.view) * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+
+	glm::vec3 up = std::abs(sun.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), -sun, up);
+
+	// snapping moves the center by up to half a step, the map is grown by that much to still hold the
+	// whole sphere
+	float halfSize = radius / (1.0f - float(CACHE_SNAP_TEXELS) / float(MAP_SIZE));
+	float step = 2.0f * halfSize / float(MAP_SIZE) * float(CACHE_SNAP_TEXELS);
+	glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+	lightCenter = glm::floor(lightCenter / step + 0.5f) * step;
+
+	// the light looks down -z, casters up to casterReach towards the sun are still in the depth range
+	glm::mat4 projection = glm::orthoRH_ZO(lightCenter.x - halfSize, lightCenter.x + halfSize, lightCenter.y - halfSize, lightCenter.y + halfSize,
+		-lightCenter.z - halfSize - casterReach, -lightCenter.z + halfSize);
+
+	return { projection * lightView, glm::vec4(lightCenter, halfSize) };
+}
+
+VkDeviceAddress CascadedShadows::draw(CommandRecorder& recorder, const ShadowView& view, const Bvh& bvh, const Scene& scene,
+	const InstanceBuffer& instances, FrameRingBuffer& ring)
+{
+	VkCommandBuffer cmd = recorder.commandBuffer();
+	m_CacheRenders = 0;
+	m_Composites = 0;
+	m_StaticDrawn = 0;
+	m_DynamicDrawn = 0;
+	m_DrawCalls = 0;
+
+	RingAllocation allocation = ring.allocate(sizeof(GpuShadowFrame));
+	if (allocation.data == nullptr)
+	{
+		return 0;
+	}
+	GpuShadowFrame* frame = static_cast<GpuShadowFrame*>(allocation.data);
+	*frame = {};
+	glm::vec3 sun = glm::length(sunDirection) > 1e-4f ? glm::normalize(sunDirection) : glm::vec3(0.0f, 1.0f, 0.0f);
+	frame->sunDirection = glm::vec4(sun, 0.0f);
+	// the camera looks down -z
+	frame->viewDepth = -glm::vec4(view.view[0][2], view.view[1][2], view.view[2][2], view.view[3][2]);
+	if (!enabled || !m_Engine->m_MeshPass.available())
+	{
+		// splits of zero leave everything lit
+		return allocation.address;
+	}
+
+	if (!caching || sun != m_CachedSun || m_Version != m_CachedVersion)
+	{
+		invalidate();
+	}
+	m_CachedSun = sun;
+	m_CachedVersion = m_Version;
+
+	float nearPlane = view.nearPlane;
+	float farPlane = std::max(distance, nearPlane * 2.0f);
+	float splitNear = nearPlane;
+	for (uint32_t c = 0; c < CASCADE_COUNT; c++)
+	{
+		// practical split scheme, between uniform and logarithmic
+		float t = float(c + 1) / float(CASCADE_COUNT);
+		float logarithmic = nearPlane * std::pow(farPlane / nearPlane, t);
+		float uniform = nearPlane + (farPlane - nearPlane) * t;
+		float splitFar = uniform + (logarithmic - uniform) * splitLambda;
+
+		Cascade cascade = fitCascade(view, sun, splitNear, splitFar);
+		frame->cascades[c] = SHADOW_UV * cascade.viewProjection;
+		frame->splits[c] = splitFar;
+		frame->texelSizes[c] = 2.0f * cascade.placement.w / float(MAP_SIZE);
+		splitNear = splitFar;
+
+		m_Casters.clear();
+		bvh.cull(Frustum::fromViewProjection(cascade.viewProjection), m_Casters);
+		m_StaticCasters.clear();
+		m_DynamicCasters.clear();
+		for (uint32_t object : m_Casters)
+		{
+			(object < m_Dynamic.size() && m_Dynamic[object] ? m_DynamicCasters : m_StaticCasters).push_back(object);
+		}
+		m_DynamicDrawn += uint32_t(m_DynamicCasters.size());
+
+		if (!caching)
+		{
+			transitionLayer(cmd, m_ShadowImage, c, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+			renderCasters(recorder, m_ShadowLayerViews[c], true, cascade.viewProjection, m_StaticCasters, c, scene, instances, ring);
+			renderCasters(recorder, m_ShadowLayerViews[c], false, cascade.viewProjection, m_DynamicCasters, c, scene, instances, ring);
+			transitionLayer(cmd, m_ShadowImage, c, 1, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			m_StaticDrawn += uint32_t(m_StaticCasters.size());
+			m_CacheRenders++;
+			continue;
+		}
+
+		bool refresh = !m_CacheValid[c] || cascade.placement != m_Cached[c].placement;
+		if (refresh)
+		{
+			transitionLayer(cmd, m_CacheImage, c, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+			bool drawn = renderCasters(recorder, m_CacheLayerViews[c], true, cascade.viewProjection, m_StaticCasters, c, scene, instances, ring);
+			transitionLayer(cmd, m_CacheImage, c, 1, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+			m_Cached[c] = cascade;
+			// a layer that was only cleared gets rendered again once the ring has grown
+			m_CacheValid[c] = drawn;
+			m_StaticDrawn += uint32_t(m_StaticCasters.size());
+			m_CacheRenders++;
+			m_TotalCacheRenders++;
+		}
+
+		// a sampled layer that still equals its cache is left alone
+		if (!refresh && m_DynamicCasters.empty() && !m_HasDynamic[c])
+		{
+			continue;
+		}
+
+		transitionLayer(cmd, m_ShadowImage, c, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		VkImageCopy copy{};
+		copy.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, c, 1 };
+		copy.dstSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, c, 1 };
+		copy.extent = { MAP_SIZE, MAP_SIZE, 1 };
+		vkCmdCopyImage(cmd, m_CacheImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_ShadowImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+		if (!m_DynamicCasters.empty())
+		{
+			transitionLayer(cmd, m_ShadowImage, c, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+			renderCasters(recorder, m_ShadowLayerViews[c], false, cascade.viewProjection, m_DynamicCasters, c, scene, instances, ring);
+			transitionLayer(cmd, m_ShadowImage, c, 1, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		}
+		else
+		{
+			transitionLayer(cmd, m_ShadowImage, c, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		}
+		m_HasDynamic[c] = !m_DynamicCasters.empty();
+		m_Composites++;
+	}
+
+	return allocation.address;
+}
+
+bool CascadedShadows::renderCasters(CommandRecorder& recorder, VkImageView target, bool clear, const glm::mat4& viewProjection,
+	std::span<const uint32_t> casters, uint32_t cascade, const Scene& scene, const InstanceBuffer& instances, FrameRingBuffer& ring)
+{
+	VkCommandBuffer cmd = recorder.commandBuffer();
+	const MeshLibrary& meshes = m_Engine->m_MeshPass.meshes();
+	const std::vector<RenderItem>& items = m_Engine->m_MeshPass.renderItems();
+
+	// one draw per mesh and lod. Distant cascades spread a texel over more of the world, coarser
+	// lods don't show there
+	m_Queue.clear();
+	m_Queue.reserve(uint32_t(casters.size()));
+	for (uint32_t object : casters)
+	{
+		uint32_t handle = scene.renderHandle(object);
+		if (handle >= items.size())
+		{
+			continue;
+		}
+		uint32_t mesh = items[handle].mesh;
+		uint32_t lod = std::min(cascade, meshes.get(mesh).lodCount - 1);
+		m_Queue.push(RenderKey::make(RENDER_PASS_SHADOW, 0, 0, 0, mesh, lod), object);
+	}
+	if (m_Queue.size() == 0 && !clear)
+	{
+		return true;
+	}
+	m_Queue.sort();
+
+	// the instance indices of every draw in a row, each starts at its own through firstInstance
+	std::span<const uint32_t> objects = m_Queue.payloads();
+	RingAllocation indices{};
+	if (!objects.empty())
+	{
+		indices = ring.allocate(objects.size() * sizeof(uint32_t));
+		if (indices.data != nullptr)
+		{
+			memcpy(indices.data, objects.data(), objects.size() * sizeof(uint32_t));
+		}
+	}
+
+	VkClearValue depthClear{};
+	depthClear.depthStencil.depth = 1.0f;
+	VkRenderingAttachmentInfo depthAttachment = VkInit::attachmentInfo(target, clear ? &depthClear : nullptr, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+	VkRenderingInfo renderInfo = VkInit::renderingInfo({ MAP_SIZE, MAP_SIZE }, nullptr, &depthAttachment);
+	renderInfo.colorAttachmentCount = 0;
+	vkCmdBeginRendering(cmd, &renderInfo);
+
+	// the ring grows the next time this frame comes around, until then the layer only gets cleared
+	if (indices.data != nullptr)
+	{
+		VkViewport viewport{ 0.0f, 0.0f, float(MAP_SIZE), float(MAP_SIZE), 0.0f, 1.0f };
+		vkCmdSetViewport(cmd, 0, 1, &viewport);
+		VkRect2D scissor{ { 0, 0 }, { MAP_SIZE, MAP_SIZE } };
+		vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+		MeshPushConstants constants{};
+		constants.viewProjection = viewProjection;
+		constants.vertices = meshes.vertexAddress();
+		constants.instances = instances.deviceAddress();
+		constants.instanceIndices = indices.address;
+		recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipeline);
+		recorder.pushConstants(m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
+		vkCmdBindIndexBuffer(cmd, meshes.indexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+
+		std::span<const uint64_t> keys = m_Queue.keys();
+		uint32_t count = uint32_t(keys.size());
+		for (uint32_t first = 0; first < count;)
+		{
+			uint32_t last = first + 1;
+			while (last < count && keys[last] == keys[first])
+			{
+				last++;
+			}
+
+			const MeshInfo& mesh = meshes.get(RenderKey::mesh(keys[first]));
+			const MeshLod& lod = mesh.lods[RenderKey::lod(keys[first])];
+			vkCmdDrawIndexed(cmd, lod.indexCount, last - first, lod.firstIndex, mesh.vertexOffset, first);
+			m_DrawCalls++;
+			first = last;
+		}
+	}
+
+	vkCmdEndRendering(cmd);
+	return objects.empty() || indices.data != nullptr;
+}
+
+void CascadedShadows::drawUI(double milliseconds)
+{
+	ImGui::Checkbox("Shadows", &enabled);
+	if (!enabled)
+	{
+		return;
+	}
+	ImGui::Checkbox("Cache static casters", &caching);
+	ImGui::DragFloat3("Sun direction", &sunDirection.x, 0.01f, -1.0f, 1.0f);
+	ImGui::SliderFloat("Shadow distance", &distance, 5.0f, 200.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+	ImGui::SliderFloat("Cascade split lambda", &splitLambda, 0.0f, 1.0f);
+
+	// smoothed per mode, so both stay around to compare after switching
+	double& average = m_Milliseconds[caching ? 1 : 0];
+	if (milliseconds >= 0.0)
+	{
+		average = average == 0.0 ? milliseconds : average + (milliseconds - average) * 0.05;
+	}
+	ImGui::Text("Shadow pass: %.3f ms, averaging %.3f ms cached and %.3f ms uncached", milliseconds, m_Milliseconds[1], m_Milliseconds[0]);
+	ImGui::Text("Cascades rendered: %u of %u, %u composited, %llu cache renders in total", m_CacheRenders, CASCADE_COUNT, m_Composites,
+		(unsigned long long)m_TotalCacheRenders);
+	ImGui::Text("Casters drawn: %u static, %u dynamic in %u draws", m_StaticDrawn, m_DynamicDrawn, m_DrawCalls);
+	ImGui::Text("Dynamic objects: %zu", m_DynamicObjects.size());
+}
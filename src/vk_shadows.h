@@ -0,0 +1,155 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_types.h"
+#include "vk_descriptors.h"
+#include "vk_renderqueue.h"
+
+class VulkanEngine;
+class Scene;
+class Bvh;
+class InstanceBuffer;
+class FrameRingBuffer;
+class CommandRecorder;
+
+static constexpr uint32_t SHADOW_CASCADE_COUNT = 4;
+
+// Read by the mesh shading through one address, match mesh.glsl
+struct GpuShadowFrame
+{
+	// world to shadow map uv in xy and depth in z, per cascade
+	glm::mat4 cascades[SHADOW_CASCADE_COUNT];
+	// view depth every cascade ends at, 0 for all of them leaves everything lit
+	glm::vec4 splits;
+	// world size of a shadow map texel per cascade
+	glm::vec4 texelSizes;
+	// towards the sun
+	glm::vec4 sunDirection;
+	// dot with the world position is the view depth
+	glm::vec4 viewDepth;
+};
+static_assert(sizeof(GpuShadowFrame) == 320);
+
+// Camera the cascades are fitted to
+struct ShadowView
+{
+	glm::mat4 view;
+	float fovY;
+	float aspect;
+	float nearPlane;
+};
+
+// Cascaded shadow maps of the sun. Every cascade is a bounding sphere of its slice of the view
+// frustum, so it keeps its size while the camera turns, and its center is snapped to steps of
+// CACHE_SNAP_TEXELS texels in light space, so it keeps its texels while the camera moves and only
+// jumps once the camera crossed a step. That is what lets the static casters be cached: they are
+// rendered into a cache layer per cascade only when that cascade jumped, the sun turned or the set of
+// static objects changed. Every frame a cascade that has dynamic casters gets its cache layer copied
+// into the sampled map and the dynamic ones drawn on top. Objects turn dynamic when they move and
+// go back to static once they rested for STATIC_AFTER_FRAMES, both of which invalidate the caches.
+class CascadedShadows
+{
+public:
+
+	static constexpr uint32_t CASCADE_COUNT = SHADOW_CASCADE_COUNT;
+	static constexpr uint32_t MAP_SIZE = 2048;
+	// cascades move in steps of this many texels
+	static constexpr uint32_t CACHE_SNAP_TEXELS = 64;
+	// frames an object has to stand still to count as static again
+	static constexpr uint32_t STATIC_AFTER_FRAMES = 60;
+
+	bool enabled{ true };
+	// off renders every caster into every cascade each frame
+	bool caching{ true };
+	glm::vec3 sunDirection{ 0.4f, 0.8f, 0.45f };
+	float distance{ 60.0f };
+	// between uniform (0) and logarithmic (1) splits
+	float splitLambda{ 0.75f };
+	// how far towards the sun casters outside a cascade still throw shadows into it
+	float casterReach{ 50.0f };
+
+	void init(VulkanEngine* engine);
+
+	// the mesh pass samples the maps through this set
+	VkDescriptorSetLayout setLayout() const { return m_SetLayout; }
+	VkDescriptorSet descriptorSet() const { return m_DescriptorSet; }
+
+	// After the scene update, sorts the objects into static and dynamic casters
+	void update(std::span<const uint32_t> movedObjects, uint32_t objectCount, uint32_t frameNumber);
+	// changes whenever the static casters changed, the settings are hashed on their own
+	uint64_t version() const { return m_Version; }
+
+	// Renders whatever changed of the cascades, returns the address of the GpuShadowFrame the mesh
+	// shading reads, 0 when there is none this frame. Leaves the maps readable by fragment shaders
+	VkDeviceAddress draw(CommandRecorder& recorder, const ShadowView& view, const Bvh& bvh, const Scene& scene, const InstanceBuffer& instances,
+		FrameRingBuffer& ring);
+	// milliseconds is the profiled time of the last shadow pass
+	void drawUI(double milliseconds);
+
+private:
+
+	struct Cascade
+	{
+		glm::mat4 viewProjection;
+		// light space center and half size the matrix was made from, what the cache is checked against
+		glm::vec4 placement;
+	};
+
+	void createPipeline();
+	void invalidate();
+	Cascade fitCascade(const ShadowView& view, const glm::vec3& sun, float nearDepth, float farDepth) const;
+	// Draws the casters into an image layer in the depth attachment layout. False when the ring was
+	// full and the layer only got cleared
+	bool renderCasters(CommandRecorder& recorder, VkImageView target, bool clear, const glm::mat4& viewProjection, std::span<const uint32_t> casters,
+		uint32_t cascade, const Scene& scene, const InstanceBuffer& instances, FrameRingBuffer& ring);
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	// static casters of every cascade, and the maps that get sampled
+	VkImage m_CacheImage{ VK_NULL_HANDLE };
+	VmaAllocation m_CacheAllocation{};
+	VkImage m_ShadowImage{ VK_NULL_HANDLE };
+	VmaAllocation m_ShadowAllocation{};
+	VkImageView m_CacheLayerViews[CASCADE_COUNT]{};
+	VkImageView m_ShadowLayerViews[CASCADE_COUNT]{};
+	VkImageView m_ShadowArrayView{ VK_NULL_HANDLE };
+	VkSampler m_Sampler{ VK_NULL_HANDLE };
+
+	VkDescriptorSetLayout m_SetLayout{ VK_NULL_HANDLE };
+	DescriptorAllocator m_DescriptorAllocator;
+	VkDescriptorSet m_DescriptorSet{ VK_NULL_HANDLE };
+	VkPipelineLayout m_PipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline m_Pipeline{ VK_NULL_HANDLE };
+
+	// frame every object last moved in, and whether it counts as dynamic
+	std::vector<uint32_t> m_LastMoved;
+	std::vector<uint8_t> m_Dynamic;
+	std::vector<uint32_t> m_DynamicObjects;
+	uint64_t m_Version{ 0 };
+
+	// what the cache layers hold, and whether the sampled layers have dynamic casters on top of it
+	Cascade m_Cached[CASCADE_COUNT]{};
+	bool m_CacheValid[CASCADE_COUNT]{};
+	bool m_HasDynamic[CASCADE_COUNT]{};
+	glm::vec3 m_CachedSun{ 0.0f };
+	uint64_t m_CachedVersion{ ~0ull };
+
+	std::vector<uint32_t> m_Casters;
+	std::vector<uint32_t> m_StaticCasters;
+	std::vector<uint32_t> m_DynamicCasters;
+	RenderQueue m_Queue;
+
+	// last draw
+	uint32_t m_CacheRenders{ 0 };
+	uint32_t m_Composites{ 0 };
+	uint32_t m_StaticDrawn{ 0 };
+	uint32_t m_DynamicDrawn{ 0 };
+	uint32_t m_DrawCalls{ 0 };
+	uint64_t m_TotalCacheRenders{ 0 };
+	// smoothed shadow pass time with caching on and off
+	double m_Milliseconds[2]{};
+};
@@ -0,0 +1,450 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+#include "vk_simplify.h"
+
+namespace
+{
+	// stops when the next level would keep more than this share of the triangles the last one had
+	constexpr float MIN_PROGRESS = 0.9f;
+	// planes along open edges, weighted so borders only move along themselves
+	constexpr double BOUNDARY_WEIGHT = 10.0;
+	// a collapse may not turn a triangle further than about 80 degrees
+	constexpr float MIN_NORMAL_COSINE = 0.2f;
+	// no levels below this, closed shells fold flat before they get there
+	constexpr uint32_t MIN_TRIANGLES = 8;
+
+	// Sum of squared distances to a set of planes, the symmetric 4x4 matrix as its upper triangle
+	struct Quadric
+	{
+		double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+
+		void addPlane(const glm::vec3& normal, double distance, double weight)
+		{
+			double a = normal.x, b = normal.y, c = normal.z, d = distance;
+			a00 += weight * a * a; a01 += weight * a * b; a02 += weight * a * c; a03 += weight * a * d;
+			a11 += weight * b * b; a12 += weight * b * c; a13 += weight * b * d;
+			a22 += weight * c * c; a23 += weight * c * d;
+			a33 += weight * d * d;
+		}
+
+		double evaluate(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			return a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+				+ a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+				+ a22 * z * z + 2.0 * a23 * z
+				+ a33;
+		}
+
+		Quadric& operator+=(const Quadric& other)
+		{
+			a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+			a11 += other.a11; a12 += other.a12; a13 += other.a13;
+			a22 += other.a22; a23 += other.a23;
+			a33 += other.a33;
+			return *this;
+		}
+	};
+
+	struct Triangle
+	{
+		// welded positions, and the vertex each corner uses
+		uint32_t positions[3];
+		uint32_t vertices[3];
+		bool alive;
+	};
+
+	struct Collapse
+	{
+		float cost;
+		uint32_t from;
+		uint32_t to;
+		// of both positions when this was queued, stale entries are skipped
+		uint32_t fromVersion;
+		uint32_t toVersion;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	struct PositionKey
+	{
+		uint32_t bits[3];
+		bool operator==(const PositionKey& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const PositionKey& key) const
+		{
+			return (size_t(key.bits[0]) * 73856093u) ^ (size_t(key.bits[1]) * 19349663u) ^ (size_t(key.bits[2]) * 83492791u);
+		}
+	};
+
+	class Simplifier
+	{
+	public:
+
+		Simplifier(std::span<const Vertex> vertices, std::span<const uint32_t> indices);
+		void run(uint32_t maxLevels, float reduction, std::vector<SimplifiedLevel>& levels);
+
+	private:
+
+		void queueEdges(uint32_t position);
+		void queue(uint32_t from, uint32_t to);
+		bool flips(uint32_t from, uint32_t to) const;
+		bool pinches(uint32_t from, uint32_t to);
+		void collapse(uint32_t from, uint32_t to);
+		void emit(std::vector<SimplifiedLevel>& levels, float error) const;
+
+		std::span<const Vertex> m_Vertices;
+		std::vector<uint32_t> m_VertexPositions;
+		std::vector<glm::vec3> m_Positions;
+		// vertices welded into every position
+		std::vector<std::vector<uint32_t>> m_PositionVertices;
+		std::vector<std::vector<uint32_t>> m_PositionTriangles;
+		std::vector<Quadric> m_Quadrics;
+		std::vector<uint32_t> m_Versions;
+		std::vector<uint8_t> m_Removed;
+
+		// scratch of pinches, a mark per position
+		std::vector<uint32_t> m_Marks;
+		uint32_t m_Mark{ 0 };
+
+		std::vector<Triangle> m_Triangles;
+		uint32_t m_LiveTriangles{ 0 };
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_Queue;
+	};
+
+	Simplifier::Simplifier(std::span<const Vertex> vertices, std::span<const uint32_t> indices)
+		: m_Vertices(vertices)
+	{
+		std::unordered_map<PositionKey, uint32_t, PositionKeyHash> welded;
+		m_VertexPositions.resize(vertices.size());
+		for (uint32_t vertex = 0; vertex < vertices.size(); vertex++)
+		{
+			PositionKey key;
+			memcpy(key.bits, &vertices[vertex].position, sizeof(key.bits));
+			auto [it, inserted] = welded.try_emplace(key, uint32_t(m_Positions.size()));
+			if (inserted)
+			{
+				m_Positions.push_back(vertices[vertex].position);
+				m_PositionVertices.emplace_back();
+			}
+			m_VertexPositions[vertex] = it->second;
+			m_PositionVertices[it->second].push_back(vertex);
+		}
+
+		uint32_t positionCount = uint32_t(m_Positions.size());
+		m_PositionTriangles.resize(positionCount);
+		m_Quadrics.resize(positionCount, Quadric{});
+		m_Versions.resize(positionCount, 0);
+		m_Removed.resize(positionCount, 0);
+		m_Marks.resize(positionCount, 0);
+
+		// open edges are seen once, from the triangle along them
+		std::unordered_map<uint64_t, uint32_t> edgeUses;
+		auto edgeKey = [](uint32_t a, uint32_t b) { return uint64_t(std::min(a, b)) << 32 | std::max(a, b); };
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			Triangle triangle{};
+			for (int corner = 0; corner < 3; corner++)
+			{
+				triangle.vertices[corner] = indices[i + corner];
+				triangle.positions[corner] = m_VertexPositions[indices[i + corner]];
+			}
+			// welding made it degenerate, like the pole triangles of a sphere
+			if (triangle.positions[0] == triangle.positions[1] || triangle.positions[1] == triangle.positions[2] ||
+				triangle.positions[0] == triangle.positions[2])
+			{
+				continue;
+			}
+
+			glm::vec3 a = m_Positions[triangle.positions[0]];
+			glm::vec3 normal = glm::cross(m_Positions[triangle.positions[1]] - a, m_Positions[triangle.positions[2]] - a);
+			float area = glm::length(normal);
+			if (area > 0.0f)
+			{
+				normal = normal * (1.0f / area);
+				Quadric plane{};
+				plane.addPlane(normal, -glm::dot(normal, a), 1.0);
+				for (uint32_t position : triangle.positions)
+				{
+					m_Quadrics[position] += plane;
+				}
+			}
+
+			triangle.alive = true;
+			uint32_t index = uint32_t(m_Triangles.size());
+			m_Triangles.push_back(triangle);
+			for (int corner = 0; corner < 3; corner++)
+			{
+				m_PositionTriangles[triangle.positions[corner]].push_back(index);
+				edgeUses[edgeKey(triangle.positions[corner], triangle.positions[(corner + 1) % 3])]++;
+			}
+		}
+		m_LiveTriangles = uint32_t(m_Triangles.size());
+
+		for (const Triangle& triangle : m_Triangles)
+		{
+			glm::vec3 a = m_Positions[triangle.positions[0]];
+			glm::vec3 faceNormal = glm::cross(m_Positions[triangle.positions[1]] - a, m_Positions[triangle.positions[2]] - a);
+			for (int corner = 0; corner < 3; corner++)
+			{
+				uint32_t from = triangle.positions[corner];
+				uint32_t to = triangle.positions[(corner + 1) % 3];
+				if (edgeUses[edgeKey(from, to)] != 1)
+				{
+					continue;
+				}
+
+				// plane through the edge, perpendicular to the triangle
+				glm::vec3 edge = m_Positions[to] - m_Positions[from];
+				glm::vec3 normal = glm::cross(edge, faceNormal);
+				float length = glm::length(normal);
+				if (length == 0.0f)
+				{
+					continue;
+				}
+				normal = normal * (1.0f / length);
+				Quadric plane{};
+				plane.addPlane(normal, -glm::dot(normal, m_Positions[from]), BOUNDARY_WEIGHT);
+				m_Quadrics[from] += plane;
+				m_Quadrics[to] += plane;
+			}
+		}
+
+		for (uint32_t position = 0; position < positionCount; position++)
+		{
+			queueEdges(position);
+		}
+	}
+
+	void Simplifier::queue(uint32_t from, uint32_t to)
+	{
+		Quadric sum = m_Quadrics[from];
+		sum += m_Quadrics[to];
+		float cost = float(std::max(sum.evaluate(m_Positions[to]), 0.0));
+		m_Queue.push({ cost, from, to, m_Versions[from], m_Versions[to] });
+	}
+
+	void Simplifier::queueEdges(uint32_t position)
+	{
+		std::vector<uint32_t>& triangles = m_PositionTriangles[position];
+		std::erase_if(triangles, [this](uint32_t triangle) { return !m_Triangles[triangle].alive; });
+		for (uint32_t triangle : triangles)
+		{
+			for (uint32_t other : m_Triangles[triangle].positions)
+			{
+				if (other != position)
+				{
+					// edges are seen from both triangles along them, the second entry just goes stale
+					queue(position, other);
+					queue(other, position);
+				}
+			}
+		}
+	}
+
+	bool Simplifier::flips(uint32_t from, uint32_t to) const
+	{
+		for (uint32_t index : m_PositionTriangles[from])
+		{
+			const Triangle& triangle = m_Triangles[index];
+			if (!triangle.alive)
+			{
+				continue;
+			}
+
+			glm::vec3 before[3];
+			glm::vec3 after[3];
+			bool collapses = false;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				before[corner] = m_Positions[triangle.positions[corner]];
+				after[corner] = triangle.positions[corner] == from ? m_Positions[to] : before[corner];
+				collapses |= triangle.positions[corner] == to;
+			}
+			// the triangles along the edge go away
+			if (collapses)
+			{
+				continue;
+			}
+
+			glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+			float lengths = glm::length(normalBefore) * glm::length(normalAfter);
+			if (lengths == 0.0f || glm::dot(normalBefore, normalAfter) < MIN_NORMAL_COSINE * lengths)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Link condition: the only positions next to both ends may be the ones across the edge, otherwise
+	// the collapse glues two parts of the surface together
+	bool Simplifier::pinches(uint32_t from, uint32_t to)
+	{
+		m_Mark++;
+		uint32_t across = 0;
+		for (uint32_t index : m_PositionTriangles[from])
+		{
+			const Triangle& triangle = m_Triangles[index];
+			if (!triangle.alive)
+			{
+				continue;
+			}
+			bool onEdge = triangle.positions[0] == to || triangle.positions[1] == to || triangle.positions[2] == to;
+			across += onEdge;
+			for (uint32_t position : triangle.positions)
+			{
+				m_Marks[position] = m_Mark;
+			}
+		}
+
+		uint32_t shared = 0;
+		uint32_t sharedMark = m_Mark + 1;
+		for (uint32_t index : m_PositionTriangles[to])
+		{
+			const Triangle& triangle = m_Triangles[index];
+			if (!triangle.alive)
+			{
+				continue;
+			}
+			for (uint32_t position : triangle.positions)
+			{
+				if (position != from && position != to && m_Marks[position] == m_Mark)
+				{
+					m_Marks[position] = sharedMark;
+					shared++;
+				}
+			}
+		}
+		m_Mark = sharedMark;
+		return shared != across;
+	}
+
+	void Simplifier::collapse(uint32_t from, uint32_t to)
+	{
+		m_Quadrics[to] += m_Quadrics[from];
+
+		for (uint32_t index : m_PositionTriangles[from])
+		{
+			Triangle& triangle = m_Triangles[index];
+			if (!triangle.alive)
+			{
+				continue;
+			}
+			if (triangle.positions[0] == to || triangle.positions[1] == to || triangle.positions[2] == to)
+			{
+				triangle.alive = false;
+				m_LiveTriangles--;
+				continue;
+			}
+
+			for (int corner = 0; corner < 3; corner++)
+			{
+				if (triangle.positions[corner] != from)
+				{
+					continue;
+				}
+
+				// the vertex at the new position that looks most like the old one
+				glm::vec3 normal = m_Vertices[triangle.vertices[corner]].normal;
+				uint32_t best = m_PositionVertices[to][0];
+				float bestCosine = -2.0f;
+				for (uint32_t vertex : m_PositionVertices[to])
+				{
+					float cosine = glm::dot(normal, m_Vertices[vertex].normal);
+					if (cosine > bestCosine)
+					{
+						bestCosine = cosine;
+						best = vertex;
+					}
+				}
+				triangle.positions[corner] = to;
+				triangle.vertices[corner] = best;
+			}
+			m_PositionTriangles[to].push_back(index);
+		}
+
+		m_PositionTriangles[from].clear();
+		m_Removed[from] = 1;
+		m_Versions[from]++;
+		m_Versions[to]++;
+		queueEdges(to);
+	}
+
+	void Simplifier::emit(std::vector<SimplifiedLevel>& levels, float error) const
+	{
+		SimplifiedLevel& level = levels.emplace_back();
+		level.error = error;
+		level.indices.reserve(size_t(m_LiveTriangles) * 3);
+		for (const Triangle& triangle : m_Triangles)
+		{
+			if (triangle.alive)
+			{
+				level.indices.insert(level.indices.end(), std::begin(triangle.vertices), std::end(triangle.vertices));
+			}
+		}
+	}
+
+	void Simplifier::run(uint32_t maxLevels, float reduction, std::vector<SimplifiedLevel>& levels)
+	{
+		uint32_t lastCount = m_LiveTriangles;
+		uint32_t target = uint32_t(lastCount * reduction);
+		float maxError = 0.0f;
+
+		while (levels.size() < maxLevels && target >= MIN_TRIANGLES)
+		{
+			bool exhausted = m_Queue.empty();
+			if (!exhausted && m_LiveTriangles > target)
+			{
+				Collapse candidate = m_Queue.top();
+				m_Queue.pop();
+				if (m_Removed[candidate.from] || m_Removed[candidate.to] ||
+					candidate.fromVersion != m_Versions[candidate.from] || candidate.toVersion != m_Versions[candidate.to] ||
+					flips(candidate.from, candidate.to) || pinches(candidate.from, candidate.to))
+				{
+					continue;
+				}
+
+				collapse(candidate.from, candidate.to);
+				// the quadrics sum squared plane distances, so the root bounds the distance to each plane
+				maxError = std::max(maxError, std::sqrt(candidate.cost));
+				continue;
+			}
+
+			// reached the target, or nothing left that can collapse
+			if (m_LiveTriangles > lastCount * MIN_PROGRESS)
+			{
+				break;
+			}
+			emit(levels, maxError);
+			lastCount = m_LiveTriangles;
+			target = uint32_t(lastCount * reduction);
+			if (exhausted)
+			{
+				break;
+			}
+		}
+	}
+}
+
+void MeshSimplify::buildLevels(std::span<const Vertex> vertices, std::span<const uint32_t> indices, uint32_t maxLevels, float reduction,
+	std::vector<SimplifiedLevel>& levels)
+{
+	levels.clear();
+	if (vertices.empty() || indices.size() < 3)
+	{
+		return;
+	}
+
+	Simplifier simplifier(vertices, indices);
+	simplifier.run(maxLevels, reduction, levels);
+}
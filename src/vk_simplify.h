@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "vk_meshes.h"
+
+struct SimplifiedLevel
+{
+	// into the same vertices as the full detail indices
+	std::vector<uint32_t> indices;
+	// bound on how far the surface moved from the original, in mesh units
+	float error;
+};
+
+// Mesh simplification with quadric error metrics (Garland and Heckbert). Edges collapse into one
+// of their endpoints, cheapest first, so every level keeps indexing the original vertices and
+// all levels of a mesh share its vertex range. Vertices at the same position are welded for the
+// collapses; a corner that moved picks the vertex at its new position whose normal is closest to
+// the one it had, which keeps flat shaded edges flat.
+namespace MeshSimplify
+{
+	// Successively coarser levels, each with at most reduction times the triangles of the one
+	// before. Stops early once collapses no longer get anywhere or only a handful of triangles are
+	// left, so a cube gets none
+	void buildLevels(std::span<const Vertex> vertices, std::span<const uint32_t> indices, uint32_t maxLevels, float reduction,
+		std::vector<SimplifiedLevel>& levels);
+}
@@ -0,0 +1,729 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#include <imgui.h>
+
+#include "vk_streaming.h"
+#include "vk_engine.h"
+#include "vk_images.h"
+#include "vk_initializers.h"
+
+// levels up to this size make up the tail, loaded first and never evicted
+static const uint32_t TAIL_SIZE = 64;
+// the info buffer starts with the texture count, padded like the GLSL block
+static const VkDeviceSize INFO_HEADER_BYTES = 16;
+static const VkDeviceSize INFO_BYTES = INFO_HEADER_BYTES + sizeof(StreamedTextureInfo) * MAX_STREAMED_TEXTURES;
+static const VkDeviceSize FEEDBACK_BYTES = sizeof(uint32_t) * MAX_STREAMED_TEXTURES;
+static const uint32_t NO_REQUEST = ~0u;
+
+static uint32_t tailMip(const CookedTextureHeader& header)
+{
+	uint32_t level = 0;
+	while (level + 1 < header.mipLevels && std::max(header.width >> level, header.height >> level) > TAIL_SIZE)
+	{
+		level++;
+	}
+	return level;
+}
+
+// The blocks as they are, or rgba8 for devices without textureCompressionBC
+static void takeLevels(CookedTexture& file, uint32_t firstMip, bool compressed, std::vector<uint8_t>& data, std::vector<size_t>& mipOffsets)
+{
+	if (compressed)
+	{
+		data = std::move(file.data);
+		mipOffsets = std::move(file.mipOffsets);
+		return;
+	}
+
+	for (size_t i = 0; i < file.mipOffsets.size(); i++)
+	{
+		uint32_t level = firstMip + uint32_t(i);
+		std::vector<uint8_t> texels = BCn::decodeImage(file.header.format, &file.data[file.mipOffsets[i]],
+			std::max(file.header.width >> level, 1u), std::max(file.header.height >> level, 1u));
+		mipOffsets.push_back(data.size());
+		data.insert(data.end(), texels.begin(), texels.end());
+	}
+}
+
+void TextureStreamer::init(VulkanEngine* engine)
+{
+	m_Engine = engine;
+	VkDevice device = engine->m_Device;
+
+	VkSamplerCreateInfo samplerInfo{ .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &m_Sampler));
+
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_STREAMED_TEXTURES);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		builder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+		// slots without a texture are never written, the shaders check the infos before sampling
+		VkDescriptorBindingFlags bindingFlags[] = { VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT, 0, 0 };
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+		flagsInfo.bindingCount = 3;
+		flagsInfo.pBindingFlags = bindingFlags;
+		m_SetLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT, &flagsInfo);
+	}
+
+	std::vector<DescriptorAllocator::PoolSizeRatio> sizes =
+	{
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, float(MAX_STREAMED_TEXTURES) },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+	};
+	m_DescriptorAllocator.initPool(device, MAX_FRAMES_IN_FLIGHT, sizes);
+
+	VmaAllocator allocator = engine->m_Memory.allocator();
+	for (FrameResources& frame : m_Frames)
+	{
+		frame.set = m_DescriptorAllocator.allocate(device, m_SetLayout);
+		frame.infos = engine->CreateBuffer(INFO_BYTES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_TEXTURES);
+		// read back on the cpu, cached memory where there is some
+		frame.feedback = engine->CreateBuffer(FEEDBACK_BYTES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU, MEMORY_TEXTURES);
+		frame.feedbackWritten = false;
+
+		memset(frame.infos.info.pMappedData, 0, INFO_BYTES);
+		memset(frame.feedback.info.pMappedData, 0xFF, FEEDBACK_BYTES);
+		vmaFlushAllocation(allocator, frame.infos.allocation, 0, VK_WHOLE_SIZE);
+		vmaFlushAllocation(allocator, frame.feedback.allocation, 0, VK_WHOLE_SIZE);
+
+		DescriptorWriter writer;
+		writer.writeBuffer(1, frame.infos.buffer, INFO_BYTES, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		writer.writeBuffer(2, frame.feedback.buffer, FEEDBACK_BYTES, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		writer.updateSet(device, frame.set);
+	}
+
+	engine->m_MainDeletionQueue.pushFunction([=, this]()
+		{
+			for (StreamedTexture& texture : m_Textures)
+			{
+				if (texture.image.image != VK_NULL_HANDLE)
+				{
+					m_Engine->DestroyImage(texture.image);
+				}
+			}
+			m_Textures.clear();
+
+			for (FrameResources& frame : m_Frames)
+			{
+				m_Engine->DestroyBuffer(frame.infos);
+				m_Engine->DestroyBuffer(frame.feedback);
+			}
+			m_DescriptorAllocator.destroyPool(device);
+			vkDestroyDescriptorSetLayout(device, m_SetLayout, nullptr);
+			vkDestroySampler(device, m_Sampler, nullptr);
+		});
+}
+
+uint32_t TextureStreamer::load(const std::string& path)
+{
+	if (m_Textures.size() >= MAX_STREAMED_TEXTURES)
+	{
+		fmt::print(fmt::fg(fmt::color::red), "No streaming slot left for {}\n", path);
+		return MAX_STREAMED_TEXTURES;
+	}
+
+	uint32_t slot = uint32_t(m_Textures.size());
+
+	StreamedTexture& texture = m_Textures.emplace_back();
+	texture.path = path;
+	texture.name = std::filesystem::path(path).filename().string();
+	texture.state = StreamedTexture::LOADING;
+	texture.format = VK_FORMAT_UNDEFINED;
+	texture.fileFormat = BCFormat::BC7;
+	texture.width = 0;
+	texture.height = 0;
+	texture.mipLevels = 0;
+	texture.tailMip = 0;
+	texture.image = {};
+	texture.residentMip = 0;
+	texture.residentBytes = 0;
+	texture.streaming = true;
+	texture.incomingBytes = 0;
+	texture.relocatedFrame = ~0u;
+	texture.requestedMip = 0;
+	texture.requestFrame = 0;
+	m_ReadsInFlight++;
+
+	bool compressed = m_Engine->m_DeviceCaps.textureCompressionBC;
+	m_Engine->m_Jobs.submit([this, slot, path, compressed]()
+		{
+			ReadMips read{};
+			read.slot = slot;
+
+			// the header says where the tail starts, only the tail is read
+			CookedTextureHeader header;
+			CookedTexture file;
+			if (TextureCooker::readHeader(path.c_str(), header) && TextureCooker::load(path.c_str(), file, tailMip(header)))
+			{
+				read.header = file.header;
+				read.firstMip = tailMip(header);
+				takeLevels(file, read.firstMip, compressed, read.data, read.mipOffsets);
+			}
+
+			std::lock_guard lock(m_ReadMutex);
+			m_Reads.push_back(std::move(read));
+		});
+
+	return slot;
+}
+
+bool TextureStreamer::busy() const
+{
+	return m_ReadsInFlight > 0;
+}
+
+void TextureStreamer::update(VkCommandBuffer cmd, uint32_t frameNumber)
+{
+	FrameResources& frame = m_Frames[frameNumber % MAX_FRAMES_IN_FLIGHT];
+	readFeedback(frame, frameNumber);
+
+	std::vector<ReadMips> reads;
+	{
+		std::lock_guard lock(m_ReadMutex);
+		reads.swap(m_Reads);
+	}
+
+	bool compressed = m_Engine->m_DeviceCaps.textureCompressionBC;
+	for (ReadMips& read : reads)
+	{
+		m_ReadsInFlight--;
+		StreamedTexture& texture = m_Textures[read.slot];
+		texture.streaming = false;
+		texture.incomingBytes = 0;
+
+		if (read.data.empty())
+		{
+			if (texture.state == StreamedTexture::LOADING)
+			{
+				texture.state = StreamedTexture::FAILED;
+			}
+			continue;
+		}
+
+		if (texture.state == StreamedTexture::LOADING)
+		{
+			bool srgb = read.header.flags & COOKED_TEXTURE_SRGB;
+			texture.fileFormat = read.header.format;
+			texture.format = compressed ? blockCompressedFormat(read.header.format, srgb) : (srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM);
+			texture.width = read.header.width;
+			texture.height = read.header.height;
+			texture.mipLevels = read.header.mipLevels;
+			texture.tailMip = read.firstMip;
+			texture.residentMip = texture.mipLevels;
+			texture.requestedMip = texture.tailMip;
+			texture.requestFrame = frameNumber;
+		}
+
+		resize(cmd, read.slot, read.firstMip, &read);
+		m_StreamedBytes += read.data.size();
+	}
+
+	schedule(cmd, frameNumber);
+
+	m_ResidentBytes = 0;
+	for (const StreamedTexture& texture : m_Textures)
+	{
+		m_ResidentBytes += texture.residentBytes;
+	}
+
+	// the last frame that used this set has finished, swapped slots can be written without waiting on anything
+	if (!frame.dirtySlots.empty())
+	{
+		DescriptorWriter writer;
+		for (uint32_t slot : frame.dirtySlots)
+		{
+			writer.writeImage(0, m_Textures[slot].image.imageView, m_Sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, slot);
+		}
+		writer.updateSet(m_Engine->m_Device, frame.set);
+		frame.dirtySlots.clear();
+	}
+	writeInfos(frame);
+}
+
+void TextureStreamer::readFeedback(FrameResources& frame, uint32_t frameNumber)
+{
+	// cached frames don't run the passes that sample, the last requests stand
+	if (!frame.feedbackWritten)
+	{
+		return;
+	}
+	frame.feedbackWritten = false;
+
+	VmaAllocator allocator = m_Engine->m_Memory.allocator();
+	vmaInvalidateAllocation(allocator, frame.feedback.allocation, 0, VK_WHOLE_SIZE);
+	uint32_t* requested = static_cast<uint32_t*>(frame.feedback.info.pMappedData);
+
+	for (uint32_t slot = 0; slot < uint32_t(m_Textures.size()); slot++)
+	{
+		StreamedTexture& texture = m_Textures[slot];
+		if (texture.state != StreamedTexture::RESIDENT)
+		{
+			continue;
+		}
+
+		// unseen textures only need their tail
+		uint32_t wanted = requested[slot] == NO_REQUEST ? texture.tailMip : std::min(requested[slot], texture.tailMip);
+		// finer requests count right away, coarser ones once the finer level went unused for a while
+		if (wanted <= texture.requestedMip || frameNumber - texture.requestFrame > uint32_t(evictDelayFrames))
+		{
+			texture.requestedMip = wanted;
+			texture.requestFrame = frameNumber;
+		}
+	}
+
+	memset(requested, 0xFF, FEEDBACK_BYTES);
+	vmaFlushAllocation(allocator, frame.feedback.allocation, 0, VK_WHOLE_SIZE);
+}
+
+void TextureStreamer::writeInfos(FrameResources& frame)
+{
+	uint8_t* mapped = static_cast<uint8_t*>(frame.infos.info.pMappedData);
+	uint32_t count = uint32_t(m_Textures.size());
+	memcpy(mapped, &count, sizeof(count));
+
+	StreamedTextureInfo* infos = reinterpret_cast<StreamedTextureInfo*>(mapped + INFO_HEADER_BYTES);
+	for (uint32_t slot = 0; slot < count; slot++)
+	{
+		const StreamedTexture& texture = m_Textures[slot];
+		infos[slot] = {};
+		if (texture.image.image != VK_NULL_HANDLE)
+		{
+			infos[slot].size = glm::uvec2(texture.width, texture.height);
+			infos[slot].residentMip = texture.residentMip;
+			infos[slot].mipLevels = texture.mipLevels;
+		}
+	}
+
+	vmaFlushAllocation(m_Engine->m_Memory.allocator(), frame.infos.allocation, 0, INFO_HEADER_BYTES + sizeof(StreamedTextureInfo) * count);
+}
+
+void TextureStreamer::schedule(VkCommandBuffer cmd, uint32_t frameNumber)
+{
+	m_BudgetBytes = budget();
+
+	uint64_t committed = 0;
+	for (const StreamedTexture& texture : m_Textures)
+	{
+		committed += texture.residentBytes + texture.incomingBytes;
+	}
+
+	auto evict = [&](uint32_t slot, uint32_t mip)
+		{
+			StreamedTexture& texture = m_Textures[slot];
+			uint64_t before = texture.residentBytes;
+			m_EvictedLevels += mip - texture.residentMip;
+			m_Evictions++;
+			resize(cmd, slot, mip, nullptr);
+			committed -= before - texture.residentBytes;
+		};
+
+	auto idle = [frameNumber](const StreamedTexture& texture)
+		{
+			return texture.state == StreamedTexture::RESIDENT && !texture.streaming && texture.relocatedFrame != frameNumber;
+		};
+
+	// levels the feedback stopped asking for stay cached until the space is needed, least recently asked first
+	std::vector<uint32_t> unused;
+	for (uint32_t slot = 0; slot < uint32_t(m_Textures.size()); slot++)
+	{
+		if (idle(m_Textures[slot]) && m_Textures[slot].residentMip < m_Textures[slot].requestedMip)
+		{
+			unused.push_back(slot);
+		}
+	}
+	std::sort(unused.begin(), unused.end(), [&](uint32_t a, uint32_t b) { return m_Textures[a].requestFrame < m_Textures[b].requestFrame; });
+
+	size_t nextUnused = 0;
+	auto makeRoom = [&](uint64_t bytes)
+		{
+			while (committed + bytes > m_BudgetBytes && nextUnused < unused.size())
+			{
+				uint32_t slot = unused[nextUnused++];
+				evict(slot, m_Textures[slot].requestedMip);
+			}
+			return committed + bytes <= m_BudgetBytes;
+		};
+
+	// still over, e.g. the budget was lowered: the textures asked for longest ago lose levels they use
+	if (!makeRoom(0))
+	{
+		std::vector<uint32_t> used;
+		for (uint32_t slot = 0; slot < uint32_t(m_Textures.size()); slot++)
+		{
+			if (idle(m_Textures[slot]) && m_Textures[slot].residentMip < m_Textures[slot].tailMip)
+			{
+				used.push_back(slot);
+			}
+		}
+		std::sort(used.begin(), used.end(), [&](uint32_t a, uint32_t b) { return m_Textures[a].requestFrame < m_Textures[b].requestFrame; });
+
+		for (uint32_t slot : used)
+		{
+			if (committed <= m_BudgetBytes)
+			{
+				break;
+			}
+
+			const StreamedTexture& texture = m_Textures[slot];
+			uint32_t mip = texture.residentMip;
+			while (mip < texture.tailMip && committed - (texture.residentBytes - bytesFrom(texture, mip)) > m_BudgetBytes)
+			{
+				mip++;
+			}
+			evict(slot, mip);
+		}
+	}
+
+	// textures missing levels the feedback asked for, the ones missing the most first
+	m_PendingRequests = 0;
+	std::vector<uint32_t> wanted;
+	for (uint32_t slot = 0; slot < uint32_t(m_Textures.size()); slot++)
+	{
+		const StreamedTexture& texture = m_Textures[slot];
+		if (texture.state == StreamedTexture::LOADING || (texture.state == StreamedTexture::RESIDENT && texture.requestedMip < texture.residentMip))
+		{
+			m_PendingRequests++;
+		}
+		if (idle(texture) && texture.requestedMip < texture.residentMip)
+		{
+			wanted.push_back(slot);
+		}
+	}
+	std::sort(wanted.begin(), wanted.end(), [&](uint32_t a, uint32_t b)
+		{
+			const StreamedTexture& first = m_Textures[a];
+			const StreamedTexture& second = m_Textures[b];
+			uint32_t firstMissing = first.residentMip - first.requestedMip;
+			uint32_t secondMissing = second.residentMip - second.requestedMip;
+			return firstMissing != secondMissing ? firstMissing > secondMissing : first.requestFrame > second.requestFrame;
+		});
+
+	for (uint32_t slot : wanted)
+	{
+		if (m_ReadsInFlight >= uint32_t(maxReadsInFlight))
+		{
+			break;
+		}
+
+		// as many of the wanted levels as fit
+		StreamedTexture& texture = m_Textures[slot];
+		uint32_t mip = texture.requestedMip;
+		makeRoom(bytesFrom(texture, mip) - texture.residentBytes);
+		while (mip < texture.residentMip && committed + bytesFrom(texture, mip) - texture.residentBytes > m_BudgetBytes)
+		{
+			mip++;
+		}
+		if (mip == texture.residentMip)
+		{
+			continue;
+		}
+
+		texture.incomingBytes = bytesFrom(texture, mip) - texture.residentBytes;
+		committed += texture.incomingBytes;
+		startRead(slot, mip);
+	}
+}
+
+void TextureStreamer::startRead(uint32_t slot, uint32_t firstMip)
+{
+	StreamedTexture& texture = m_Textures[slot];
+	texture.streaming = true;
+	m_ReadsInFlight++;
+
+	// the resident levels are copied over on the gpu, only the ones above them come from disk
+	uint32_t levelCount = texture.residentMip - firstMip;
+	bool compressed = m_Engine->m_DeviceCaps.textureCompressionBC;
+	m_Engine->m_Jobs.submit([this, slot, path = texture.path, firstMip, levelCount, compressed]()
+		{
+			ReadMips read{};
+			read.slot = slot;
+			read.firstMip = firstMip;
+
+			CookedTexture file;
+			if (TextureCooker::load(path.c_str(), file, firstMip, levelCount))
+			{
+				read.header = file.header;
+				takeLevels(file, firstMip, compressed, read.data, read.mipOffsets);
+			}
+
+			std::lock_guard lock(m_ReadMutex);
+			m_Reads.push_back(std::move(read));
+		});
+}
+
+void TextureStreamer::resize(VkCommandBuffer cmd, uint32_t slot, uint32_t firstMip, ReadMips* read)
+{
+	VkDevice device = m_Engine->m_Device;
+	StreamedTexture& texture = m_Textures[slot];
+
+	VkExtent3D extent = { std::max(texture.width >> firstMip, 1u), std::max(texture.height >> firstMip, 1u), 1 };
+	VkImageCreateInfo imageInfo = VkInit::imageCreateInfo(texture.format,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, extent);
+	imageInfo.mipLevels = texture.mipLevels - firstMip;
+
+	VmaAllocationCreateInfo allocationInfo{};
+	allocationInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	allocationInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	AllocatedImage image{};
+	image.imageExtent = extent;
+	image.imageFormat = texture.format;
+	VK_CHECK(m_Engine->m_Memory.createImage(imageInfo, allocationInfo, MEMORY_TEXTURES, &image.image, &image.allocation));
+	m_Engine->m_Memory.setRelocator(image.allocation, [this, slot](VkCommandBuffer cmd, const VmaDefragmentationMove& move)
+		{
+			return relocate(cmd, slot, move);
+		});
+
+	VkImageViewCreateInfo viewInfo = VkInit::imageviewCreateInfo(texture.format, image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+	viewInfo.subresourceRange.levelCount = imageInfo.mipLevels;
+	VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &image.imageView));
+
+	VkUtils::transitionImage(cmd, image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	// the levels that were read come from staging
+	uint32_t readLevels = read ? uint32_t(read->mipOffsets.size()) : 0;
+	if (readLevels > 0)
+	{
+		AllocatedBuffer staging = m_Engine->CreateBuffer(read->data.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_STAGING);
+		memcpy(staging.info.pMappedData, read->data.data(), read->data.size());
+
+		std::vector<VkBufferImageCopy> copyRegions(readLevels);
+		for (uint32_t i = 0; i < readLevels; i++)
+		{
+			uint32_t level = firstMip + i;
+			VkBufferImageCopy& copyRegion = copyRegions[i];
+			copyRegion = {};
+			copyRegion.bufferOffset = read->mipOffsets[i];
+			copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copyRegion.imageSubresource.mipLevel = i;
+			copyRegion.imageSubresource.layerCount = 1;
+			copyRegion.imageExtent = { std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u), 1 };
+		}
+		vkCmdCopyBufferToImage(cmd, staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, readLevels, copyRegions.data());
+
+		m_Engine->GetCurrentFrame().deletionQueue.pushFunction([=, engine = m_Engine]()
+			{
+				engine->DestroyBuffer(staging);
+			});
+	}
+
+	// the rest is resident already
+	if (texture.image.image != VK_NULL_HANDLE)
+	{
+		std::vector<VkImageCopy> copyRegions;
+		for (uint32_t level = firstMip + readLevels; level < texture.mipLevels; level++)
+		{
+			VkImageCopy& copyRegion = copyRegions.emplace_back();
+			copyRegion = {};
+			copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - texture.residentMip, 0, 1 };
+			copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - firstMip, 0, 1 };
+			copyRegion.extent = { std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u), 1 };
+		}
+
+		// nothing samples the old image after this frame, so it isn't transitioned back
+		VkUtils::transitionImage(cmd, texture.image.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		vkCmdCopyImage(cmd, texture.image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			uint32_t(copyRegions.size()), copyRegions.data());
+
+		// the frame in flight may still sample it, and the other set points at it until that frame is recorded again
+		m_Engine->GetCurrentFrame().deletionQueue.pushFunction([old = texture.image, engine = m_Engine]()
+			{
+				engine->DestroyImage(old);
+			});
+	}
+
+	VkUtils::transitionImage(cmd, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	texture.image = image;
+	texture.residentMip = firstMip;
+	texture.residentBytes = bytesFrom(texture, firstMip);
+	texture.state = StreamedTexture::RESIDENT;
+	m_Version++;
+
+	for (FrameResources& frame : m_Frames)
+	{
+		frame.dirtySlots.push_back(slot);
+	}
+}
+
+bool TextureStreamer::relocate(VkCommandBuffer cmd, uint32_t slot, const VmaDefragmentationMove& move)
+{
+	VkDevice device = m_Engine->m_Device;
+	StreamedTexture& texture = m_Textures[slot];
+
+	// an image resize already replaced goes away soon anyway, a landing read would replace this one
+	if (texture.image.allocation != move.srcAllocation || texture.streaming)
+	{
+		return false;
+	}
+
+	VkImageCreateInfo imageInfo = VkInit::imageCreateInfo(texture.format,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, texture.image.imageExtent);
+	imageInfo.mipLevels = texture.mipLevels - texture.residentMip;
+
+	VkImage image = VkUtils::relocateImage(cmd, device, m_Engine->m_Memory.allocator(), move.dstTmpAllocation,
+		texture.image.image, imageInfo, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	VkImageViewCreateInfo viewInfo = VkInit::imageviewCreateInfo(texture.format, image, VK_IMAGE_ASPECT_COLOR_BIT);
+	viewInfo.subresourceRange.levelCount = imageInfo.mipLevels;
+	VkImageView imageView;
+	VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &imageView));
+
+	// the memory is VMA's until the pass ends, only the image and view go
+	m_Engine->GetCurrentFrame().deletionQueue.pushFunction([device, oldImage = texture.image.image, oldView = texture.image.imageView]()
+		{
+			vkDestroyImageView(device, oldView, nullptr);
+			vkDestroyImage(device, oldImage, nullptr);
+		});
+
+	texture.image.image = image;
+	texture.image.imageView = imageView;
+	texture.relocatedFrame = uint32_t(m_Engine->m_FrameNumber);
+
+	for (FrameResources& frame : m_Frames)
+	{
+		frame.dirtySlots.push_back(slot);
+	}
+	return true;
+}
+
+void TextureStreamer::bind(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t setIndex, uint32_t frameNumber)
+{
+	FrameResources& frame = m_Frames[frameNumber % MAX_FRAMES_IN_FLIGHT];
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, setIndex, 1, &frame.set, 0, nullptr);
+	frame.feedbackWritten = true;
+}
+
+void TextureStreamer::endFeedback(VkCommandBuffer cmd)
+{
+	VkMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+	VkDependencyInfo dependencyInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dependencyInfo.memoryBarrierCount = 1;
+	dependencyInfo.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+}
+
+uint64_t TextureStreamer::levelBytes(const StreamedTexture& texture, uint32_t level) const
+{
+	uint32_t width = std::max(texture.width >> level, 1u);
+	uint32_t height = std::max(texture.height >> level, 1u);
+	return m_Engine->m_DeviceCaps.textureCompressionBC ? BCn::imageBytes(texture.fileFormat, width, height) : uint64_t(width) * height * 4;
+}
+
+uint64_t TextureStreamer::bytesFrom(const StreamedTexture& texture, uint32_t firstMip) const
+{
+	uint64_t bytes = 0;
+	for (uint32_t level = firstMip; level < texture.mipLevels; level++)
+	{
+		bytes += levelBytes(texture, level);
+	}
+	return bytes;
+}
+
+uint64_t TextureStreamer::budget() const
+{
+	const VkPhysicalDeviceMemoryProperties* properties;
+	vmaGetMemoryProperties(m_Engine->m_Memory.allocator(), &properties);
+
+	uint64_t heapBudget = 0;
+	uint64_t heapUsage = 0;
+	const std::vector<MemorySystem::HeapStats>& heaps = m_Engine->m_Memory.heaps();
+	for (uint32_t i = 0; i < uint32_t(heaps.size()); i++)
+	{
+		if (properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+		{
+			heapBudget += heaps[i].budget.budget;
+			heapUsage += heaps[i].budget.usage;
+		}
+	}
+
+	// whatever else lives in the heaps stays out of reach
+	uint64_t others = heapUsage > m_ResidentBytes ? heapUsage - m_ResidentBytes : 0;
+	uint64_t available = heapBudget > others ? heapBudget - others : 0;
+	return std::min(uint64_t(double(available) * budgetFraction), uint64_t(budgetMegabytes) << 20);
+}
+
+void TextureStreamer::drawUI()
+{
+	if (ImGui::Begin("streaming"))
+	{
+		// a folder loads every cooked texture in it
+		ImGui::InputText("Path", m_PathInput, sizeof(m_PathInput));
+		ImGui::SameLine();
+		if (ImGui::Button("Load") && m_PathInput[0] != '\0')
+		{
+			std::error_code error;
+			if (std::filesystem::is_directory(m_PathInput, error))
+			{
+				for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(m_PathInput, error))
+				{
+					if (entry.path().extension() == ".vktex")
+					{
+						load(entry.path().string());
+					}
+				}
+			}
+			else
+			{
+				load(m_PathInput);
+			}
+		}
+
+		ImGui::SliderInt("Budget (MB)", &budgetMegabytes, 8, 4096, "%d", ImGuiSliderFlags_Logarithmic);
+		ImGui::SliderFloat("Share of free VRAM", &budgetFraction, 0.05f, 1.0f);
+		ImGui::SliderInt("Evict delay (frames)", &evictDelayFrames, 0, 600);
+		ImGui::SliderInt("Reads in flight", &maxReadsInFlight, 1, 16);
+
+		ImGui::Text("Resident: %.1f of %.1f MB", double(m_ResidentBytes) / (1 << 20), double(m_BudgetBytes) / (1 << 20));
+		ImGui::Text("Pending requests: %u, %u reads in flight", m_PendingRequests, m_ReadsInFlight);
+		ImGui::Text("Evictions: %u (%u levels)", m_Evictions, m_EvictedLevels);
+		ImGui::Text("Streamed in: %.1f MB", double(m_StreamedBytes) / (1 << 20));
+
+		if (ImGui::BeginTable("streamed", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+		{
+			ImGui::TableSetupColumn("Name");
+			ImGui::TableSetupColumn("Size");
+			ImGui::TableSetupColumn("Resident mip");
+			ImGui::TableSetupColumn("Requested mip");
+			ImGui::TableSetupColumn("MB");
+			ImGui::TableHeadersRow();
+
+			for (const StreamedTexture& texture : m_Textures)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(texture.name.c_str());
+
+				ImGui::TableNextColumn();
+				if (texture.state != StreamedTexture::RESIDENT)
+				{
+					ImGui::TextUnformatted(texture.state == StreamedTexture::LOADING ? "loading" : "failed");
+					continue;
+				}
+				ImGui::Text("%ux%u", texture.width, texture.height);
+				ImGui::TableNextColumn(); ImGui::Text("%u of %u%s", texture.residentMip, texture.mipLevels, texture.streaming ? " (reading)" : "");
+				ImGui::TableNextColumn(); ImGui::Text("%u", texture.requestedMip);
+				ImGui::TableNextColumn(); ImGui::Text("%.2f", double(texture.residentBytes) / (1 << 20));
+			}
+			ImGui::EndTable();
+		}
+	}
+	ImGui::End();
+}
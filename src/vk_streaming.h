@@ -0,0 +1,161 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vk_types.h"
+#include "vk_cooker.h"
+#include "vk_descriptors.h"
+
+class VulkanEngine;
+
+// slots of the bindless array, match texture_streaming.glsl
+constexpr uint32_t MAX_STREAMED_TEXTURES = 256;
+
+// What shaders know about a slot, mipLevels is 0 until the first mips arrived
+struct StreamedTextureInfo
+{
+	glm::uvec2 size;
+	uint32_t residentMip;
+	uint32_t mipLevels;
+};
+
+struct StreamedTexture
+{
+	enum State
+	{
+		LOADING,
+		RESIDENT,
+		FAILED,
+	};
+
+	std::string path;
+	std::string name;
+	State state;
+	VkFormat format;
+	BCFormat fileFormat;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipLevels;
+	// coarsest levels that never get evicted, the first load brings these
+	uint32_t tailMip;
+
+	// levels residentMip to mipLevels - 1 are in image, its level 0 is residentMip
+	AllocatedImage image;
+	uint32_t residentMip;
+	uint64_t residentBytes;
+	// a read is on its way, nothing else starts until it lands
+	bool streaming;
+	// what the read adds to residentBytes
+	uint64_t incomingBytes;
+	// defragmentation moved the image this frame, its old allocation has to outlive the pass so it isn't resized
+	uint32_t relocatedFrame;
+
+	// finest level the feedback asked for lately, and when it last asked for it
+	uint32_t requestedMip;
+	uint32_t requestFrame;
+};
+
+// Streams the mips of cooked .vktex textures in and out of a memory budget. Textures start with
+// their small tail levels only; shaders sampling them through texture_streaming.glsl atomicMin the
+// level they wanted into a feedback buffer that is read back once the frame's fence was waited on.
+// Finer levels are read from disk on the job pool and the image is replaced by a larger one, the
+// resident levels copied over on the gpu. When the budget taken from the VMA heap budgets runs out
+// levels nothing asked for lately are dropped the same way. Every frame in flight has its own
+// bindless set, a swapped slot is written into each set the next time that frame is recorded so
+// nothing waits on the gpu.
+class TextureStreamer
+{
+public:
+
+	// never use more than this, the device local heaps' budget may cap it lower
+	int budgetMegabytes{ 256 };
+	// share of the device local budget left over by everything else the streamer may take
+	float budgetFraction{ 0.5f };
+	// frames a finer level stays resident after the feedback stopped asking for it
+	int evictDelayFrames{ 60 };
+	int maxReadsInFlight{ 4 };
+
+	void init(VulkanEngine* engine);
+
+	// Reads the tail mips on the job pool, the slot is sampled as soon as they are uploaded
+	uint32_t load(const std::string& path);
+	uint32_t count() const { return uint32_t(m_Textures.size()); }
+	// reads or shrinks still on their way
+	bool busy() const;
+	// bumped whenever a slot gets another image, for change tracking
+	uint64_t version() const { return m_Version; }
+
+	VkDescriptorSetLayout setLayout() const { return m_SetLayout; }
+
+	// Once per frame after the frame fence was waited on: reads the feedback of the last time this
+	// frame ran, writes swapped slots into this frame's set and records finished reads and shrinks
+	void update(VkCommandBuffer cmd, uint32_t frameNumber);
+	// Binds this frame's set for a dispatch that samples the textures and writes feedback
+	void bind(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t setIndex, uint32_t frameNumber);
+	// After the last dispatch writing feedback, makes it visible to the host
+	void endFeedback(VkCommandBuffer cmd);
+
+	void drawUI();
+
+private:
+
+	struct ReadMips
+	{
+		uint32_t slot;
+		CookedTextureHeader header;
+		uint32_t firstMip;
+		// every level from firstMip to the resident ones, empty when the read failed
+		std::vector<uint8_t> data;
+		std::vector<size_t> mipOffsets;
+	};
+
+	struct FrameResources
+	{
+		VkDescriptorSet set;
+		AllocatedBuffer infos;
+		AllocatedBuffer feedback;
+		// slots whose image changed since this set was last written
+		std::vector<uint32_t> dirtySlots;
+		bool feedbackWritten;
+	};
+
+	void readFeedback(FrameResources& frame, uint32_t frameNumber);
+	void writeInfos(FrameResources& frame);
+	void schedule(VkCommandBuffer cmd, uint32_t frameNumber);
+	void startRead(uint32_t slot, uint32_t firstMip);
+	// Replaces the slot's image with one holding firstMip and down, levels in read come from its staging copy
+	void resize(VkCommandBuffer cmd, uint32_t slot, uint32_t firstMip, ReadMips* read);
+	// Defragmentation relocator, copies the image to the allocation's new place and swaps the slot over
+	bool relocate(VkCommandBuffer cmd, uint32_t slot, const VmaDefragmentationMove& move);
+
+	uint64_t levelBytes(const StreamedTexture& texture, uint32_t level) const;
+	uint64_t bytesFrom(const StreamedTexture& texture, uint32_t firstMip) const;
+	uint64_t budget() const;
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	std::vector<StreamedTexture> m_Textures;
+	std::mutex m_ReadMutex;
+	std::vector<ReadMips> m_Reads;
+
+	VkSampler m_Sampler;
+	VkDescriptorSetLayout m_SetLayout;
+	DescriptorAllocator m_DescriptorAllocator;
+	FrameResources m_Frames[MAX_FRAMES_IN_FLIGHT];
+	uint64_t m_Version{ 0 };
+
+	// overlay stats
+	uint64_t m_ResidentBytes{ 0 };
+	uint64_t m_BudgetBytes{ 0 };
+	uint32_t m_PendingRequests{ 0 };
+	uint32_t m_ReadsInFlight{ 0 };
+	uint64_t m_StreamedBytes{ 0 };
+	uint32_t m_Evictions{ 0 };
+	uint32_t m_EvictedLevels{ 0 };
+
+	char m_PathInput[256]{};
+};
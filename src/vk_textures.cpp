@@ -0,0 +1,576 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <glm/gtc/packing.hpp>
+#include <imgui.h>
+#include <imgui_impl_vulkan.h>
+
+#include "vk_textures.h"
+#include "vk_cooker.h"
+#include "vk_engine.h"
+#include "vk_images.h"
+#include "vk_initializers.h"
+#include "vk_profiler.h"
+
+static const WorkgroupSize MIPGEN_WORKGROUP = { 256, 1 };
+// levels one dispatch writes, and the widest source whose sixth level still fits one workgroup
+static const uint32_t MIPGEN_MAX_LEVELS = 12;
+static const uint32_t MIPGEN_MAX_SINGLE_PASS_SIZE = 4096;
+static const uint32_t MIPGEN_TILE_SIZE = 64;
+// the atomic counters of the mip dispatches sit in front of the pixels in the staging buffer,
+// a dispatch each at the largest storage buffer offset alignment
+static const uint32_t COUNTER_STRIDE = 256;
+static const uint32_t MAX_MIP_DISPATCHES = 4;
+static const VkDeviceSize COUNTER_BYTES = COUNTER_STRIDE * MAX_MIP_DISPATCHES;
+
+using Clock = std::chrono::steady_clock;
+
+VkFormat blockCompressedFormat(BCFormat format, bool srgb)
+{
+	switch (format)
+	{
+	case BCFormat::BC1: return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case BCFormat::BC3: return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+	case BCFormat::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+	default: return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+	}
+}
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void TextureLoader::init(VulkanEngine* engine)
+{
+	m_Engine = engine;
+	VkDevice device = engine->m_Device;
+
+	VkSamplerCreateInfo samplerInfo{ .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &m_Sampler));
+
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MIPGEN_MAX_LEVELS + 1);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		m_MipGenSetLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+
+	std::vector<DescriptorAllocator::PoolSizeRatio> sizes =
+	{
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, float(MIPGEN_MAX_LEVELS + 1) },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+	};
+	for (DescriptorAllocator& allocator : m_DescriptorAllocators)
+	{
+		allocator.initPool(device, MAX_UPLOADS_PER_FRAME * MAX_MIP_DISPATCHES, sizes);
+	}
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(MipGenPushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo layoutInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &m_MipGenSetLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_MipGenPipelineLayout));
+
+	VkShaderModule mipGenShader = engine->m_ShaderCache.get(device, "mipgen.comp.spv");
+	VkShaderModule mipGenHdrShader = engine->m_ShaderCache.get(device, "mipgen.comp.hdr.spv");
+	const uint32_t srgbOn = 1;
+	const uint32_t srgbOff = 0;
+	m_MipGenPipeline = VkUtils::createComputePipeline(device, m_MipGenPipelineLayout, mipGenShader, MIPGEN_WORKGROUP, 0, { &srgbOff, 1 });
+	m_MipGenSrgbPipeline = VkUtils::createComputePipeline(device, m_MipGenPipelineLayout, mipGenShader, MIPGEN_WORKGROUP, 0, { &srgbOn, 1 });
+	m_MipGenHdrPipeline = VkUtils::createComputePipeline(device, m_MipGenPipelineLayout, mipGenHdrShader, MIPGEN_WORKGROUP, 0, { &srgbOff, 1 });
+
+	engine->m_MainDeletionQueue.pushFunction([=, this]()
+		{
+			for (Texture& texture : m_Textures)
+			{
+				if (texture.state == Texture::READY)
+				{
+					m_Engine->DestroyImage(texture.image);
+				}
+			}
+			m_Textures.clear();
+
+			for (DescriptorAllocator& allocator : m_DescriptorAllocators)
+			{
+				allocator.destroyPool(device);
+			}
+
+			vkDestroyPipeline(device, m_MipGenPipeline, nullptr);
+			vkDestroyPipeline(device, m_MipGenSrgbPipeline, nullptr);
+			vkDestroyPipeline(device, m_MipGenHdrPipeline, nullptr);
+			vkDestroyPipelineLayout(device, m_MipGenPipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, m_MipGenSetLayout, nullptr);
+
+			vkDestroySampler(device, m_Sampler, nullptr);
+		});
+}
+
+TextureHandle TextureLoader::load(const std::string& path, bool srgb)
+{
+	TextureHandle handle = TextureHandle(m_Textures.size());
+
+	Texture& texture = m_Textures.emplace_back();
+	texture.path = path;
+	texture.name = std::filesystem::path(path).filename().string();
+	texture.state = Texture::DECODING;
+	texture.srgb = srgb;
+	texture.hdr = false;
+	texture.cooked = std::filesystem::path(path).extension() == ".vktex";
+	texture.image = {};
+	texture.mipLevels = 0;
+	texture.imageInfo = {};
+	texture.storageFormat = VK_FORMAT_UNDEFINED;
+	texture.decodeMilliseconds = 0.0;
+	texture.uploadMilliseconds = 0.0;
+	texture.gpuMilliseconds = -1.0;
+	texture.gpuTimed = false;
+	texture.uploadFrame = 0;
+	texture.uploadScope = fmt::format("upload {}", texture.name);
+	texture.preview = VK_NULL_HANDLE;
+
+	bool cooked = texture.cooked;
+	bool compressionSupported = m_Engine->m_DeviceCaps.textureCompressionBC;
+	m_Engine->m_Jobs.submit([this, handle, path, srgb, cooked, compressionSupported]()
+		{
+			Clock::time_point start = Clock::now();
+
+			DecodedImage decoded{};
+			decoded.handle = handle;
+			decoded.srgb = srgb;
+
+			int width, height, channels;
+			if (cooked)
+			{
+				CookedTexture file;
+				if (TextureCooker::load(path.c_str(), file))
+				{
+					decoded.width = file.header.width;
+					decoded.height = file.header.height;
+					decoded.srgb = file.header.flags & COOKED_TEXTURE_SRGB;
+					if (compressionSupported)
+					{
+						decoded.format = blockCompressedFormat(file.header.format, decoded.srgb);
+						decoded.pixels = std::move(file.data);
+						decoded.mipOffsets = std::move(file.mipOffsets);
+					}
+					else
+					{
+						decoded.format = decoded.srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+						for (uint32_t level = 0; level < file.header.mipLevels; level++)
+						{
+							std::vector<uint8_t> texels = BCn::decodeImage(file.header.format, &file.data[file.mipOffsets[level]],
+								std::max(decoded.width >> level, 1u), std::max(decoded.height >> level, 1u));
+							decoded.mipOffsets.push_back(decoded.pixels.size());
+							decoded.pixels.insert(decoded.pixels.end(), texels.begin(), texels.end());
+						}
+					}
+				}
+				decoded.decodeMilliseconds = millisecondsSince(start);
+
+				std::lock_guard lock(m_DecodedMutex);
+				m_Decoded.push_back(std::move(decoded));
+				return;
+			}
+
+			if (stbi_is_hdr(path.c_str()))
+			{
+				decoded.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+				decoded.srgb = false;
+				float* data = stbi_loadf(path.c_str(), &width, &height, &channels, 4);
+				if (data)
+				{
+					// rgba16f holds the range of any HDR file at half the size
+					size_t count = size_t(width) * height * 4;
+					decoded.pixels.resize(count * sizeof(uint16_t));
+					uint16_t* halves = reinterpret_cast<uint16_t*>(decoded.pixels.data());
+					for (size_t i = 0; i < count; i++)
+					{
+						halves[i] = glm::packHalf1x16(data[i]);
+					}
+					stbi_image_free(data);
+				}
+			}
+			else
+			{
+				decoded.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+				stbi_uc* data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+				if (data)
+				{
+					decoded.pixels.assign(data, data + size_t(width) * height * 4);
+					stbi_image_free(data);
+				}
+			}
+
+			if (decoded.pixels.empty())
+			{
+				fmt::print(fmt::fg(fmt::color::red), "Failed to load texture {}: {}\n", path, stbi_failure_reason());
+			}
+			else
+			{
+				decoded.width = uint32_t(width);
+				decoded.height = uint32_t(height);
+			}
+			decoded.decodeMilliseconds = millisecondsSince(start);
+
+			std::lock_guard lock(m_DecodedMutex);
+			m_Decoded.push_back(std::move(decoded));
+		});
+
+	return handle;
+}
+
+bool TextureLoader::loading() const
+{
+	return std::any_of(m_Textures.begin(), m_Textures.end(), [](const Texture& texture) { return texture.state == Texture::DECODING; });
+}
+
+void TextureLoader::update(VkCommandBuffer cmd, GpuProfiler& profiler, uint32_t frameNumber)
+{
+	DescriptorAllocator& allocator = m_DescriptorAllocators[frameNumber % MAX_FRAMES_IN_FLIGHT];
+	allocator.clearDescriptors(m_Engine->m_Device);
+
+	// upload timings come back with the profiler results of their frame
+	for (Texture& texture : m_Textures)
+	{
+		if (texture.state == Texture::READY && !texture.gpuTimed && profiler.resultsFrameNumber() >= texture.uploadFrame)
+		{
+			texture.gpuMilliseconds = profiler.resultsFrameNumber() == texture.uploadFrame ? profiler.find(texture.uploadScope.c_str()) : -1.0;
+			texture.gpuTimed = true;
+		}
+	}
+
+	std::vector<DecodedImage> decoded;
+	{
+		std::lock_guard lock(m_DecodedMutex);
+		size_t count = std::min(m_Decoded.size(), size_t(std::clamp(maxUploadsPerFrame, 1, int(MAX_UPLOADS_PER_FRAME))));
+		decoded.assign(std::make_move_iterator(m_Decoded.begin()), std::make_move_iterator(m_Decoded.begin() + count));
+		m_Decoded.erase(m_Decoded.begin(), m_Decoded.begin() + count);
+	}
+
+	for (DecodedImage& image : decoded)
+	{
+		Texture& texture = m_Textures[image.handle];
+		texture.decodeMilliseconds = image.decodeMilliseconds;
+		if (image.pixels.empty())
+		{
+			texture.state = Texture::FAILED;
+			continue;
+		}
+
+		upload(cmd, profiler, image, frameNumber);
+	}
+}
+
+void TextureLoader::upload(VkCommandBuffer cmd, GpuProfiler& profiler, DecodedImage& decoded, uint32_t frameNumber)
+{
+	Clock::time_point start = Clock::now();
+	VkDevice device = m_Engine->m_Device;
+	Texture& texture = m_Textures[decoded.handle];
+
+	texture.uploadFrame = frameNumber;
+	texture.srgb = decoded.srgb;
+	texture.hdr = decoded.format == VK_FORMAT_R16G16B16A16_SFLOAT;
+
+	// cooked textures bring their mips, everything else gets them generated
+	bool generateMipChain = decoded.mipOffsets.empty();
+	texture.mipLevels = generateMipChain ? uint32_t(std::floor(std::log2(std::max(decoded.width, decoded.height)))) + 1 : uint32_t(decoded.mipOffsets.size());
+
+	// sRGB images can't be storage images, the mips are written through a UNORM alias of the same memory
+	VkFormat format = decoded.format;
+	VkFormat storageFormat = format == VK_FORMAT_R8G8B8A8_SRGB ? VK_FORMAT_R8G8B8A8_UNORM : format;
+	bool mutableFormat = generateMipChain && storageFormat != format;
+
+	VkExtent3D extent = { decoded.width, decoded.height, 1 };
+	// transfer source so defragmentation can copy it
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	if (generateMipChain)
+	{
+		usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+	VkImageCreateInfo imageInfo = VkInit::imageCreateInfo(format, usage, extent);
+	imageInfo.mipLevels = texture.mipLevels;
+
+	VkFormat viewFormats[] = { format, storageFormat };
+	VkImageFormatListCreateInfo formatList{ .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO };
+	formatList.viewFormatCount = 2;
+	formatList.pViewFormats = viewFormats;
+	if (mutableFormat)
+	{
+		// extended usage allows the storage usage the sRGB format itself doesn't support
+		imageInfo.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+		imageInfo.pNext = &formatList;
+	}
+
+	VmaAllocationCreateInfo allocationInfo{};
+	allocationInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	allocationInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	texture.image.imageExtent = extent;
+	texture.image.imageFormat = format;
+	VK_CHECK(m_Engine->m_Memory.createImage(imageInfo, allocationInfo, MEMORY_TEXTURES, &texture.image.image, &texture.image.allocation));
+	texture.imageInfo = imageInfo;
+	texture.imageInfo.pNext = nullptr;
+	texture.storageFormat = storageFormat;
+	m_Engine->m_Memory.setRelocator(texture.image.allocation, [this, handle = decoded.handle](VkCommandBuffer cmd, const VmaDefragmentationMove& move)
+		{
+			return relocate(cmd, handle, move);
+		});
+
+	VkImageViewUsageCreateInfo sampledUsage{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO };
+	sampledUsage.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+	VkImageViewCreateInfo viewInfo = VkInit::imageviewCreateInfo(format, texture.image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+	viewInfo.subresourceRange.levelCount = texture.mipLevels;
+	viewInfo.pNext = mutableFormat ? &sampledUsage : nullptr;
+	VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &texture.image.imageView));
+
+	std::vector<VkImageView> levelViews(generateMipChain ? texture.mipLevels : 0);
+	for (uint32_t level = 0; level < levelViews.size(); level++)
+	{
+		VkImageViewCreateInfo levelInfo = VkInit::imageviewCreateInfo(storageFormat, texture.image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+		levelInfo.subresourceRange.baseMipLevel = level;
+		VK_CHECK(vkCreateImageView(device, &levelInfo, nullptr, &levelViews[level]));
+	}
+
+	AllocatedBuffer staging = m_Engine->CreateBuffer(COUNTER_BYTES + decoded.pixels.size(),
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_STAGING);
+	uint8_t* mapped = static_cast<uint8_t*>(staging.info.pMappedData);
+	memset(mapped, 0, COUNTER_BYTES);
+	memcpy(mapped + COUNTER_BYTES, decoded.pixels.data(), decoded.pixels.size());
+
+	uint32_t scope = profiler.beginScope(cmd, texture.uploadScope.c_str());
+
+	VkUtils::transitionImage(cmd, texture.image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	// level 0 only, or every level the file brought
+	std::vector<VkBufferImageCopy> copyRegions(generateMipChain ? 1 : texture.mipLevels);
+	for (uint32_t level = 0; level < copyRegions.size(); level++)
+	{
+		VkBufferImageCopy& copyRegion = copyRegions[level];
+		copyRegion = {};
+		copyRegion.bufferOffset = COUNTER_BYTES + (generateMipChain ? 0 : decoded.mipOffsets[level]);
+		copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copyRegion.imageSubresource.mipLevel = level;
+		copyRegion.imageSubresource.baseArrayLayer = 0;
+		copyRegion.imageSubresource.layerCount = 1;
+		copyRegion.imageExtent = { std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u), 1 };
+	}
+	vkCmdCopyBufferToImage(cmd, staging.buffer, texture.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		uint32_t(copyRegions.size()), copyRegions.data());
+
+	if (generateMipChain && texture.mipLevels > 1)
+	{
+		VkUtils::transitionImage(cmd, texture.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+		generateMips(cmd, texture, decoded.width, decoded.height, staging.buffer, levelViews);
+		VkUtils::transitionImage(cmd, texture.image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+	else
+	{
+		VkUtils::transitionImage(cmd, texture.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+
+	profiler.endScope(cmd, scope);
+
+	// the staging memory and the per level views are only needed until this frame has run
+	m_Engine->GetCurrentFrame().deletionQueue.pushFunction([=, engine = m_Engine]()
+		{
+			for (VkImageView view : levelViews)
+			{
+				vkDestroyImageView(engine->m_Device, view, nullptr);
+			}
+			engine->DestroyBuffer(staging);
+		});
+
+	texture.state = Texture::READY;
+	texture.uploadMilliseconds = millisecondsSince(start);
+}
+
+bool TextureLoader::relocate(VkCommandBuffer cmd, TextureHandle handle, const VmaDefragmentationMove& move)
+{
+	VkDevice device = m_Engine->m_Device;
+	Texture& texture = m_Textures[handle];
+
+	VkImageCreateInfo imageInfo = texture.imageInfo;
+	VkFormat viewFormats[] = { imageInfo.format, texture.storageFormat };
+	VkImageFormatListCreateInfo formatList{ .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO };
+	formatList.viewFormatCount = 2;
+	formatList.pViewFormats = viewFormats;
+	bool mutableFormat = imageInfo.flags & VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+	if (mutableFormat)
+	{
+		imageInfo.pNext = &formatList;
+	}
+
+	VkImage image = VkUtils::relocateImage(cmd, device, m_Engine->m_Memory.allocator(), move.dstTmpAllocation,
+		texture.image.image, imageInfo, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	VkImageViewUsageCreateInfo sampledUsage{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO };
+	sampledUsage.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+	VkImageViewCreateInfo viewInfo = VkInit::imageviewCreateInfo(imageInfo.format, image, VK_IMAGE_ASPECT_COLOR_BIT);
+	viewInfo.subresourceRange.levelCount = texture.mipLevels;
+	viewInfo.pNext = mutableFormat ? &sampledUsage : nullptr;
+	VkImageView imageView;
+	VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &imageView));
+
+	// the preview still points at the old view, the frames in flight may draw it. The memory is VMA's
+	// until the pass ends, only the image and view go
+	m_Engine->GetCurrentFrame().deletionQueue.pushFunction([device, oldImage = texture.image.image, oldView = texture.image.imageView,
+		preview = texture.preview]()
+		{
+			if (preview != VK_NULL_HANDLE)
+			{
+				ImGui_ImplVulkan_RemoveTexture(preview);
+			}
+			vkDestroyImageView(device, oldView, nullptr);
+			vkDestroyImage(device, oldImage, nullptr);
+		});
+
+	texture.image.image = image;
+	texture.image.imageView = imageView;
+	texture.preview = VK_NULL_HANDLE;
+	return true;
+}
+
+void TextureLoader::generateMips(VkCommandBuffer cmd, Texture& texture, uint32_t width, uint32_t height, VkBuffer counters,
+	const std::vector<VkImageView>& levelViews)
+{
+	VkDevice device = m_Engine->m_Device;
+	DescriptorAllocator& allocator = m_DescriptorAllocators[texture.uploadFrame % MAX_FRAMES_IN_FLIGHT];
+
+	VkPipeline pipeline = texture.hdr ? m_MipGenHdrPipeline : (texture.srgb ? m_MipGenSrgbPipeline : m_MipGenPipeline);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	// usually a single dispatch, sources above 4096 first get six levels on their own
+	uint32_t source = 0;
+	for (uint32_t dispatch = 0; source + 1 < texture.mipLevels; dispatch++)
+	{
+		MipGenPushConstants pushConstants;
+		pushConstants.sourceSize = glm::ivec2(std::max(width >> source, 1u), std::max(height >> source, 1u));
+		uint32_t largest = uint32_t(std::max(pushConstants.sourceSize.x, pushConstants.sourceSize.y));
+		pushConstants.levels = std::min(texture.mipLevels - 1 - source, largest > MIPGEN_MAX_SINGLE_PASS_SIZE ? MIPGEN_MAX_LEVELS / 2 : MIPGEN_MAX_LEVELS);
+
+		uint32_t groupsX = VkUtils::divideRoundUp(pushConstants.sourceSize.x, MIPGEN_TILE_SIZE);
+		uint32_t groupsY = VkUtils::divideRoundUp(pushConstants.sourceSize.y, MIPGEN_TILE_SIZE);
+		pushConstants.groupCount = groupsX * groupsY;
+
+		// slots past the last written level repeat it, the shader never touches them
+		VkDescriptorSet set = allocator.allocate(device, m_MipGenSetLayout);
+		DescriptorWriter writer;
+		for (uint32_t i = 0; i <= MIPGEN_MAX_LEVELS; i++)
+		{
+			writer.writeImage(0, levelViews[source + std::min(i, pushConstants.levels)], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL,
+				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, i);
+		}
+		writer.writeBuffer(1, counters, sizeof(uint32_t), dispatch * COUNTER_STRIDE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		writer.updateSet(device, set);
+
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_MipGenPipelineLayout, 0, 1, &set, 0, nullptr);
+		vkCmdPushConstants(cmd, m_MipGenPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MipGenPushConstants), &pushConstants);
+		vkCmdDispatch(cmd, groupsX, groupsY, 1);
+
+		source += pushConstants.levels;
+		if (source + 1 < texture.mipLevels)
+		{
+			VkUtils::computeBarrier(cmd);
+		}
+	}
+}
+
+void TextureLoader::drawUI()
+{
+	if (ImGui::Begin("textures"))
+	{
+		ImGui::InputText("Path", m_PathInput, sizeof(m_PathInput));
+		ImGui::SameLine();
+		if (ImGui::Button("Load") && m_PathInput[0] != '\0')
+		{
+			load(m_PathInput, m_LoadSrgb);
+		}
+		ImGui::Checkbox("sRGB (color data)", &m_LoadSrgb);
+		ImGui::SliderInt("Uploads per frame", &maxUploadsPerFrame, 1, MAX_UPLOADS_PER_FRAME);
+		ImGui::Text("Decode jobs pending: %u on %u workers", m_Engine->m_Jobs.pending(), m_Engine->m_Jobs.threadCount());
+
+		if (ImGui::BeginTable("textures", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+		{
+			ImGui::TableSetupColumn("Name");
+			ImGui::TableSetupColumn("Size");
+			ImGui::TableSetupColumn("Mips");
+			ImGui::TableSetupColumn("Decode ms");
+			ImGui::TableSetupColumn("Upload cpu ms");
+			ImGui::TableSetupColumn("Upload gpu ms");
+			ImGui::TableHeadersRow();
+
+			for (size_t i = 0; i < m_Textures.size(); i++)
+			{
+				const Texture& texture = m_Textures[i];
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				if (ImGui::Selectable(texture.name.c_str(), m_Selected == int(i), ImGuiSelectableFlags_SpanAllColumns))
+				{
+					m_Selected = int(i);
+				}
+
+				ImGui::TableNextColumn();
+				if (texture.state == Texture::DECODING)
+				{
+					ImGui::TextUnformatted("decoding");
+					continue;
+				}
+				if (texture.state == Texture::FAILED)
+				{
+					ImGui::TextUnformatted("failed");
+					continue;
+				}
+				// VK_FORMAT_ is left off
+				ImGui::Text("%ux%u %s", texture.image.imageExtent.width, texture.image.imageExtent.height,
+					string_VkFormat(texture.image.imageFormat) + 10);
+				ImGui::TableNextColumn(); ImGui::Text("%u", texture.mipLevels);
+				ImGui::TableNextColumn(); ImGui::Text("%.2f", texture.decodeMilliseconds);
+				ImGui::TableNextColumn(); ImGui::Text("%.2f", texture.uploadMilliseconds);
+				ImGui::TableNextColumn();
+				if (texture.gpuMilliseconds >= 0.0)
+				{
+					ImGui::Text("%.3f", texture.gpuMilliseconds);
+				}
+				else
+				{
+					ImGui::TextUnformatted("-");
+				}
+			}
+			ImGui::EndTable();
+		}
+
+		if (m_Selected >= 0 && m_Textures[m_Selected].state == Texture::READY)
+		{
+			Texture& texture = m_Textures[m_Selected];
+			if (texture.preview == VK_NULL_HANDLE)
+			{
+				texture.preview = ImGui_ImplVulkan_AddTexture(m_Sampler, texture.image.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			}
+
+			// shrinking the preview walks down the mip chain
+			ImGui::SliderFloat("Preview size", &m_PreviewSize, 8.0f, 1024.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+			float aspect = float(texture.image.imageExtent.height) / float(texture.image.imageExtent.width);
+			ImGui::Image((ImTextureID)texture.preview, ImVec2(m_PreviewSize, m_PreviewSize * aspect));
+		}
+	}
+	ImGui::End();
+}
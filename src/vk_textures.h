@@ -0,0 +1,137 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_bcn.h"
+#include "vk_descriptors.h"
+#include "vk_pipelines.h"
+
+class GpuProfiler;
+class VulkanEngine;
+
+struct MipGenPushConstants
+{
+	glm::ivec2 sourceSize;
+	uint32_t levels;
+	uint32_t groupCount;
+};
+
+using TextureHandle = uint32_t;
+
+// Format the blocks of a cooked texture are sampled as
+VkFormat blockCompressedFormat(BCFormat format, bool srgb);
+
+struct Texture
+{
+	enum State
+	{
+		DECODING,
+		READY,
+		FAILED,
+	};
+
+	std::string path;
+	std::string name;
+	State state;
+	bool srgb;
+	bool hdr;
+	// cooked, the mips came with the file
+	bool cooked;
+	// imageView samples every mip, valid once READY. Left in SHADER_READ_ONLY_OPTIMAL
+	AllocatedImage image;
+	uint32_t mipLevels;
+	// how image was made, defragmentation makes it again the same way. The format list of a mutable
+	// format image isn't kept in pNext, it is built again from storageFormat
+	VkImageCreateInfo imageInfo;
+	VkFormat storageFormat;
+
+	double decodeMilliseconds;
+	// cpu time recording the upload and mip generation
+	double uploadMilliseconds;
+	// gpu time of the copy and mip generation, known a few frames after the upload
+	double gpuMilliseconds;
+	bool gpuTimed;
+	uint32_t uploadFrame;
+	std::string uploadScope;
+
+	// ImGui texture for the preview, made on first use
+	VkDescriptorSet preview;
+};
+
+// Loads PNG, JPG and HDR files. stb_image decodes them on the job pool, the main thread then
+// copies level 0 through a staging buffer and builds the rest of the mip chain with mipgen.comp,
+// one dispatch for up to twelve levels instead of a blit per level. 8 bit files are sRGB unless
+// loaded as data, their mips are filtered in linear space; HDR files become rgba16f.
+// Cooked .vktex files already carry their block compressed mips, they are copied as they are, or
+// decompressed to rgba8 on the worker when the device has no textureCompressionBC.
+class TextureLoader
+{
+public:
+
+	static constexpr uint32_t MAX_UPLOADS_PER_FRAME = 8;
+
+	// textures uploaded per frame, spreads a burst of loads over several frames
+	int maxUploadsPerFrame{ 4 };
+
+	void init(VulkanEngine* engine);
+
+	// Starts decoding on the job pool, the texture is usable once its state is READY
+	TextureHandle load(const std::string& path, bool srgb = true);
+	const Texture& get(TextureHandle handle) const { return m_Textures[handle]; }
+	// some texture is still decoding or waiting for its upload
+	bool loading() const;
+	// Trilinear, repeating
+	VkSampler sampler() const { return m_Sampler; }
+
+	// Records the uploads of finished decodes. Call once per frame after the frame fence was
+	// waited on, before anything samples the textures
+	void update(VkCommandBuffer cmd, GpuProfiler& profiler, uint32_t frameNumber);
+
+	void drawUI();
+
+private:
+
+	struct DecodedImage
+	{
+		TextureHandle handle;
+		uint32_t width;
+		uint32_t height;
+		VkFormat format;
+		bool srgb;
+		// rgba8, rgba16f halves for HDR files or the blocks of a cooked texture. Empty when decoding failed
+		std::vector<uint8_t> pixels;
+		// where each level starts in pixels for cooked textures, empty when the mips are generated on the gpu
+		std::vector<size_t> mipOffsets;
+		double decodeMilliseconds;
+	};
+
+	void upload(VkCommandBuffer cmd, GpuProfiler& profiler, DecodedImage& decoded, uint32_t frameNumber);
+	// Defragmentation relocator, copies the image to the allocation's new place and swaps the views over
+	bool relocate(VkCommandBuffer cmd, TextureHandle handle, const VmaDefragmentationMove& move);
+	void generateMips(VkCommandBuffer cmd, Texture& texture, uint32_t width, uint32_t height, VkBuffer counters,
+		const std::vector<VkImageView>& levelViews);
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	std::vector<Texture> m_Textures;
+	// filled by the decode jobs, drained by update
+	std::mutex m_DecodedMutex;
+	std::vector<DecodedImage> m_Decoded;
+
+	VkSampler m_Sampler;
+	VkDescriptorSetLayout m_MipGenSetLayout;
+	VkPipelineLayout m_MipGenPipelineLayout;
+	VkPipeline m_MipGenPipeline;
+	VkPipeline m_MipGenSrgbPipeline;
+	VkPipeline m_MipGenHdrPipeline;
+	// per frame in flight, cleared once the frame's fence was waited on
+	DescriptorAllocator m_DescriptorAllocators[MAX_FRAMES_IN_FLIGHT];
+
+	char m_PathInput[256]{};
+	bool m_LoadSrgb{ true };
+	int m_Selected{ -1 };
+	float m_PreviewSize{ 256.0f };
+};
@@ -9,6 +9,7 @@
 
 #include <deque>
 #include <functional>
+#include <iterator>
 
 constexpr unsigned int MAX_FRAMES_IN_FLIGHT = 2;
 
@@ -44,6 +45,36 @@ struct DeletionQueue
 
 		deletors.clear();
 	}
+
+	// Moves the other queue's functions to the end of this one, they run first on flush
+	void append(DeletionQueue& other)
+	{
+		deletors.insert(deletors.end(), std::make_move_iterator(other.deletors.begin()), std::make_move_iterator(other.deletors.end()));
+		other.deletors.clear();
+	}
+};
+
+// Optional device features and properties the renderer adapts to, queried in InitVulkan
+struct DeviceCapabilities
+{
+	bool shaderFloat16;
+	// shuffle-relative and ballot subgroup operations usable from compute shaders
+	bool subgroupShuffle;
+	// pipelines can request a subgroup size between min and max for compute
+	bool subgroupSizeControl;
+	// storage images can be written without a format qualifier, needed to write the swapchain from compute
+	bool storageImageWriteWithoutFormat;
+	// format-less storage images can be read too, needed for draw formats without a GLSL qualifier
+	bool storageImageReadWithoutFormat;
+	// storage images in the extended formats such as r11f_g11f_b10f
+	bool storageImageExtendedFormats;
+	// BC1-7 images can be sampled, cooked textures are decompressed on load otherwise
+	bool textureCompressionBC;
+	uint32_t subgroupSize;
+	uint32_t minSubgroupSize;
+	uint32_t maxSubgroupSize;
+	// ShaderPermutationBits the device can run
+	uint32_t shaderPermutations;
 };
 
 struct FrameData
@@ -64,4 +95,11 @@ struct AllocatedImage
 	VmaAllocation allocation;
 	VkExtent3D imageExtent;
 	VkFormat imageFormat;
+};
+
+struct AllocatedBuffer
+{
+	VkBuffer buffer;
+	VmaAllocation allocation;
+	VmaAllocationInfo info;
 };
\ No newline at end of file
@@ -0,0 +1,252 @@
+#include "vk_upscale.h"
+#include "vk_engine.h"
+#include "vk_images.h"
+#include "vk_initializers.h"
+#include "vk_profiler.h"
+
+static const WorkgroupSize UPSCALE_WORKGROUP = { 8, 8 };
+
+// radical inverse of index in the given base, low discrepancy in [0, 1)
+static float halton(uint32_t index, uint32_t base)
+{
+	float fraction = 1.0f;
+	float result = 0.0f;
+	while (index > 0)
+	{
+		fraction /= base;
+		result += fraction * (index % base);
+		index /= base;
+	}
+	return result;
+}
+
+void TemporalUpscaler::init(VulkanEngine* engine)
+{
+	m_Engine = engine;
+	VkDevice device = engine->m_Device;
+
+	VkSamplerCreateInfo samplerInfo{ .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &m_LinearSampler));
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &m_NearestSampler));
+
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		m_UpscaleSetLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		m_SharpenSetLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(UpscalePushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo layoutInfo{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &m_UpscaleSetLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_UpscalePipelineLayout));
+
+	pushConstant.size = sizeof(UpscaleSharpenPushConstants);
+	layoutInfo.pSetLayouts = &m_SharpenSetLayout;
+	VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_SharpenPipelineLayout));
+
+	VkShaderModule upscaleShader = engine->m_ShaderCache.get(device, "taau.comp.spv");
+	VkShaderModule sharpenShader = engine->m_ShaderCache.get(device, "taau_sharpen.comp.spv");
+	m_UpscalePipeline = VkUtils::createComputePipeline(device, m_UpscalePipelineLayout, upscaleShader, UPSCALE_WORKGROUP);
+	m_SharpenPipeline = VkUtils::createComputePipeline(device, m_SharpenPipelineLayout, sharpenShader, UPSCALE_WORKGROUP);
+
+	createTargets();
+
+	engine->m_MainDeletionQueue.pushFunction([=, this]()
+		{
+			retireTargets()();
+
+			vkDestroyPipeline(device, m_UpscalePipeline, nullptr);
+			vkDestroyPipeline(device, m_SharpenPipeline, nullptr);
+			vkDestroyPipelineLayout(device, m_UpscalePipelineLayout, nullptr);
+			vkDestroyPipelineLayout(device, m_SharpenPipelineLayout, nullptr);
+
+			vkDestroyDescriptorSetLayout(device, m_UpscaleSetLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, m_SharpenSetLayout, nullptr);
+
+			vkDestroySampler(device, m_LinearSampler, nullptr);
+			vkDestroySampler(device, m_NearestSampler, nullptr);
+		});
+}
+
+void TemporalUpscaler::resize()
+{
+	// the frame in flight may still read the old targets, they go once it has finished
+	m_Engine->GetCurrentFrame().deletionQueue.pushFunction(retireTargets());
+	createTargets();
+}
+
+void TemporalUpscaler::createTargets()
+{
+	VkDevice device = m_Engine->m_Device;
+	const AllocatedImage& drawImage = m_Engine->m_DrawImage;
+
+	// everything is sized for the largest output, like the draw image
+	const VkImageUsageFlags historyUsage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	m_History[0] = m_Engine->CreateImage(drawImage.imageExtent, VK_FORMAT_R16G16B16A16_SFLOAT, historyUsage, 1, MEMORY_UPSCALER);
+	m_History[1] = m_Engine->CreateImage(drawImage.imageExtent, VK_FORMAT_R16G16B16A16_SFLOAT, historyUsage, 1, MEMORY_UPSCALER);
+	m_OutputImage = m_Engine->CreateImage(drawImage.imageExtent, VK_FORMAT_R16G16B16A16_SFLOAT, historyUsage | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		1, MEMORY_UPSCALER);
+	motionVectors = m_Engine->CreateImage(drawImage.imageExtent, VK_FORMAT_R16G16_SFLOAT,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 1, MEMORY_UPSCALER);
+
+	// two sets for each of the couple of images the post chain can hand over, plus the sharpen sets
+	std::vector<DescriptorAllocator::PoolSizeRatio> sizes =
+	{
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 }
+	};
+	m_DescriptorAllocator.initPool(device, 8, sizes);
+
+	DescriptorWriter writer;
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		// sharpens the history written while reading history i
+		m_SharpenSets[i] = m_DescriptorAllocator.allocate(device, m_SharpenSetLayout);
+		writer.clear();
+		writer.writeImage(0, m_History[1 - i].imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		writer.writeImage(1, m_OutputImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		writer.updateSet(device, m_SharpenSets[i]);
+	}
+
+	m_UpscaleSets.clear();
+	m_HistoryValid = false;
+}
+
+std::function<void()> TemporalUpscaler::retireTargets()
+{
+	VulkanEngine* engine = m_Engine;
+	AllocatedImage images[] = { m_History[0], m_History[1], m_OutputImage, motionVectors };
+	VkDescriptorPool pool = m_DescriptorAllocator.pool;
+
+	return [=]()
+		{
+			vkDestroyDescriptorPool(engine->m_Device, pool, nullptr);
+			for (const AllocatedImage& image : images)
+			{
+				engine->DestroyImage(image);
+			}
+		};
+}
+
+glm::vec2 TemporalUpscaler::jitter(uint32_t frameNumber) const
+{
+	if (!enabled)
+	{
+		return glm::vec2(0.0f);
+	}
+
+	// Halton(2, 3) spreads the samples of consecutive frames evenly over the texel
+	uint32_t index = frameNumber % JITTER_PHASES + 1;
+	return glm::vec2(halton(index, 2) - 0.5f, halton(index, 3) - 0.5f);
+}
+
+void TemporalUpscaler::clearMotionVectors(VkCommandBuffer cmd)
+{
+	VkUtils::transitionImage(cmd, motionVectors.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+	VkClearColorValue zero = {};
+	VkImageSubresourceRange range = VkInit::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+	vkCmdClearColorImage(cmd, motionVectors.image, VK_IMAGE_LAYOUT_GENERAL, &zero, 1, &range);
+
+	// same layout, only makes the clear visible to the passes reading it
+	VkUtils::transitionImage(cmd, motionVectors.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+}
+
+AllocatedImage& TemporalUpscaler::draw(VkCommandBuffer cmd, const AllocatedImage& source, VkExtent2D inputExtent, VkExtent2D outputExtent, GpuProfiler& profiler)
+{
+	VkDevice device = m_Engine->m_Device;
+
+	// the history is in output pixels, it is meaningless once the output size changes
+	if (outputExtent.width != m_LastOutputExtent.width || outputExtent.height != m_LastOutputExtent.height)
+	{
+		m_HistoryValid = false;
+		m_LastOutputExtent = outputExtent;
+	}
+
+	if (!m_HistoryValid)
+	{
+		VkUtils::transitionImage(cmd, m_History[0].image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+		VkUtils::transitionImage(cmd, m_History[1].image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	}
+	VkUtils::transitionImage(cmd, m_OutputImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+	auto it = m_UpscaleSets.find(source.imageView);
+	if (it == m_UpscaleSets.end())
+	{
+		std::array<VkDescriptorSet, 2> sets;
+		DescriptorWriter writer;
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			sets[i] = m_DescriptorAllocator.allocate(device, m_UpscaleSetLayout);
+			writer.clear();
+			writer.writeImage(0, source.imageView, m_NearestSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			writer.writeImage(1, motionVectors.imageView, m_NearestSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			writer.writeImage(2, m_History[i].imageView, m_LinearSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+			writer.writeImage(3, m_History[1 - i].imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+			writer.updateSet(device, sets[i]);
+		}
+		it = m_UpscaleSets.emplace(source.imageView, sets).first;
+	}
+
+	const VkExtent3D& historyExtent = m_History[0].imageExtent;
+
+	UpscalePushConstants push{};
+	push.inputScale = glm::vec2(float(inputExtent.width) / outputExtent.width, float(inputExtent.height) / outputExtent.height);
+	push.jitter = jitter(m_Engine->m_FrameNumber);
+	push.inputExtent = glm::ivec2(inputExtent.width, inputExtent.height);
+	push.outputExtent = glm::ivec2(outputExtent.width, outputExtent.height);
+	push.historyUVScale = glm::vec2(float(outputExtent.width) / historyExtent.width, float(outputExtent.height) / historyExtent.height);
+	push.historyWeight = historyWeight;
+	push.resetHistory = m_HistoryValid ? 0 : 1;
+
+	uint32_t groupsX = VkUtils::divideRoundUp(outputExtent.width, UPSCALE_WORKGROUP.x);
+	uint32_t groupsY = VkUtils::divideRoundUp(outputExtent.height, UPSCALE_WORKGROUP.y);
+
+	uint32_t scope = profiler.beginScope(cmd, "upscale");
+
+	// the frame has just been written by compute passes
+	VkUtils::computeBarrier(cmd);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_UpscalePipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_UpscalePipelineLayout, 0, 1, &it->second[m_HistoryIndex], 0, nullptr);
+	vkCmdPushConstants(cmd, m_UpscalePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpscalePushConstants), &push);
+	vkCmdDispatch(cmd, groupsX, groupsY, 1);
+
+	VkUtils::computeBarrier(cmd);
+
+	UpscaleSharpenPushConstants sharpenPush{ glm::ivec2(outputExtent.width, outputExtent.height), sharpness };
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_SharpenPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_SharpenPipelineLayout, 0, 1, &m_SharpenSets[m_HistoryIndex], 0, nullptr);
+	vkCmdPushConstants(cmd, m_SharpenPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpscaleSharpenPushConstants), &sharpenPush);
+	vkCmdDispatch(cmd, groupsX, groupsY, 1);
+
+	profiler.endScope(cmd, scope);
+
+	m_HistoryIndex = 1 - m_HistoryIndex;
+	m_HistoryValid = true;
+
+	return m_OutputImage;
+}
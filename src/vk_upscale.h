@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <unordered_map>
+
+#include "vk_types.h"
+#include "vk_descriptors.h"
+#include "vk_pipelines.h"
+
+class GpuProfiler;
+class VulkanEngine;
+
+struct UpscalePushConstants
+{
+	glm::vec2 inputScale;
+	glm::vec2 jitter;
+	glm::ivec2 inputExtent;
+	glm::ivec2 outputExtent;
+	glm::vec2 historyUVScale;
+	float historyWeight;
+	uint32_t resetHistory;
+};
+
+struct UpscaleSharpenPushConstants
+{
+	glm::ivec2 extent;
+	float sharpness;
+};
+
+// Temporal upscaling of the draw image to the output resolution. The frame is shaded below the
+// output resolution at a different sub-pixel offset every frame, and the jittered samples are
+// accumulated into a persistent output-sized history, followed by a light sharpening pass.
+class TemporalUpscaler
+{
+public:
+
+	bool enabled{ false };
+	// fraction of the output extent shaded per axis, dynamic resolution scales it further
+	float renderScale{ 0.67f };
+	// share of the history kept every frame when it is fully trusted
+	float historyWeight{ 0.9f };
+	float sharpness{ 0.2f };
+
+	// Screen space motion of every texel of the draw image, in output uv units per frame
+	AllocatedImage motionVectors;
+
+	void init(VulkanEngine* engine);
+	// Recreates the images sized after the draw image, call after it was reallocated
+	void resize();
+
+	// Offset to shade the current frame at, in draw image texels. Zero when disabled
+	glm::vec2 jitter(uint32_t frameNumber) const;
+
+	// Nothing writes motion yet, so the vectors are simply cleared every frame. The engine resets the
+	// history instead whenever the camera or the scene moves
+	void clearMotionVectors(VkCommandBuffer cmd);
+
+	// Upscales source from inputExtent to outputExtent. Returns the output image, in VK_IMAGE_LAYOUT_GENERAL
+	AllocatedImage& draw(VkCommandBuffer cmd, const AllocatedImage& source, VkExtent2D inputExtent, VkExtent2D outputExtent, GpuProfiler& profiler);
+
+	// forgets the history, the next frame starts accumulating from scratch
+	void reset() { m_HistoryValid = false; }
+
+private:
+
+	void createTargets();
+	// Returns a function destroying the current targets, to run once no frame uses them anymore
+	std::function<void()> retireTargets();
+
+	static constexpr uint32_t JITTER_PHASES = 16;
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	AllocatedImage m_History[2];
+	AllocatedImage m_OutputImage;
+	// history read this frame, the other one is written
+	uint32_t m_HistoryIndex{ 0 };
+	bool m_HistoryValid{ false };
+	VkExtent2D m_LastOutputExtent{ 0, 0 };
+
+	VkSampler m_LinearSampler;
+	VkSampler m_NearestSampler;
+
+	DescriptorAllocator m_DescriptorAllocator;
+	VkDescriptorSetLayout m_UpscaleSetLayout;
+	VkDescriptorSetLayout m_SharpenSetLayout;
+	// per source image, one set for each history read
+	std::unordered_map<VkImageView, std::array<VkDescriptorSet, 2>> m_UpscaleSets;
+	VkDescriptorSet m_SharpenSets[2];
+
+	VkPipelineLayout m_UpscalePipelineLayout;
+	VkPipelineLayout m_SharpenPipelineLayout;
+	VkPipeline m_UpscalePipeline;
+	VkPipeline m_SharpenPipeline;
+};